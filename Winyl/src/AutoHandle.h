@@ -55,6 +55,9 @@ private:
 
 typedef AutoHandle<HANDLE, ::FindClose, INVALID_HANDLE_VALUE> FindHandle;
 typedef AutoHandle<HMODULE, ::FreeLibrary> LibraryHandle;
+typedef AutoHandle<HANDLE, ::CloseHandle, INVALID_HANDLE_VALUE> FileHandle;
+typedef AutoHandle<HANDLE, ::CloseHandle> MappingHandle;
+typedef AutoHandle<LPCVOID, ::UnmapViewOfFile> MapViewHandle;
 // etc.
 
 /////////////////////////////////////
@@ -256,6 +256,8 @@ void ContextMenu::FillLyricsMenu()
 	::AppendMenu(lyricsMenu, MF_STRING, ID_MENU_LYRICS_GOOGLE, lang->GetLine(Lang::LyricsMenu, 9));
 	::AppendMenu(lyricsMenuProv, MF_STRING, ID_MENU_LYRICS_PROV_OFF, lang->GetLine(Lang::LyricsMenu, 8));
 	::AppendMenu(lyricsMenuProv, MF_SEPARATOR, NULL, NULL);
+	::AppendMenu(lyricsMenuProv, MF_STRING, ID_MENU_LYRICS_PROV_AUTO, lang->GetLine(Lang::LyricsMenu, 21));
+	::AppendMenu(lyricsMenuProv, MF_SEPARATOR, NULL, NULL);
 	for (int i = 0; i < LyricsLoader::GetLyricsProviderCount(); i++)
 		::AppendMenu(lyricsMenuProv, MF_STRING, ID_MENU_LYRICS_PROV_1 + i, LyricsLoader::GetLyricsProvider(i));
 
@@ -551,11 +553,14 @@ void ContextMenu::CheckLyricsFontBold(bool bold)
 void ContextMenu::CheckLyricsProvider(int provider)
 {
 	::CheckMenuItem(lyricsMenuProv, ID_MENU_LYRICS_PROV_OFF, MF_BYCOMMAND|MF_UNCHECKED);
+	::CheckMenuItem(lyricsMenuProv, ID_MENU_LYRICS_PROV_AUTO, MF_BYCOMMAND|MF_UNCHECKED);
 	for (int i = 0; i < LyricsLoader::GetLyricsProviderCount(); i++)
 		::CheckMenuItem(lyricsMenuProv, ID_MENU_LYRICS_PROV_1 + i, MF_BYCOMMAND|MF_UNCHECKED);
 
 	if (provider == -1)
 		::CheckMenuItem(lyricsMenuProv, ID_MENU_LYRICS_PROV_OFF, MF_BYCOMMAND|MF_CHECKED);
+	else if (provider == -2)
+		::CheckMenuItem(lyricsMenuProv, ID_MENU_LYRICS_PROV_AUTO, MF_BYCOMMAND|MF_CHECKED);
 	else if (provider > -1)
 		::CheckMenuItem(lyricsMenuProv, ID_MENU_LYRICS_PROV_1 + provider, MF_BYCOMMAND|MF_CHECKED);
 }
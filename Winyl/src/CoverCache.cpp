@@ -0,0 +1,269 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "CoverCache.h"
+#include "FileSystem.h"
+#include "UTF.h"
+
+CoverCache::CoverCache()
+{
+	static_assert(sizeof(Record) == 40, "Wrong size of CoverCache::Record");
+}
+
+CoverCache::~CoverCache()
+{
+	Close();
+}
+
+bool CoverCache::Open(const std::wstring& file)
+{
+	Close();
+
+	fileHandle.reset(::CreateFileW(file.c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!fileHandle)
+		return false;
+
+	LARGE_INTEGER size = {};
+	::GetFileSizeEx(fileHandle.get(), &size);
+	fileSize = size.QuadPart;
+
+	unsigned int header[2] = {};
+	if (fileSize >= (long long)sizeof(header))
+	{
+		DWORD bytesRead = 0;
+		::ReadFile(fileHandle.get(), header, sizeof(header), &bytesRead, NULL);
+	}
+
+	// New file, old format or too many records, start from scratch
+	if (header[0] != fileMagic || fileSize > maxFileSize)
+	{
+		if (!Reset())
+		{
+			Close();
+			return false;
+		}
+	}
+
+	if (fileSize > (long long)sizeof(header))
+	{
+		mapHandle.reset(::CreateFileMappingW(fileHandle.get(), NULL, PAGE_READONLY, 0, 0, NULL));
+		if (mapHandle)
+		{
+			mapView.reset(::MapViewOfFile(mapHandle.get(), FILE_MAP_READ, 0, 0, 0));
+			if (mapView)
+				mapSize = fileSize;
+		}
+	}
+
+	ReadIndex();
+
+	return true;
+}
+
+void CoverCache::Close()
+{
+	mapView.reset();
+	mapHandle.reset();
+	fileHandle.reset();
+
+	mapSize = 0;
+	fileSize = 0;
+
+	index.clear();
+	bits.clear();
+	bits.shrink_to_fit();
+}
+
+bool CoverCache::Reset()
+{
+	// The file cannot be truncated while it is mapped
+	mapView.reset();
+	mapHandle.reset();
+	mapSize = 0;
+
+	index.clear();
+
+	LARGE_INTEGER zero = {};
+	::SetFilePointerEx(fileHandle.get(), zero, NULL, FILE_BEGIN);
+	::SetEndOfFile(fileHandle.get());
+
+	unsigned int header[2] = {fileMagic, 0};
+	fileSize = 0;
+	if (!WriteData(0, header, sizeof(header)))
+		return false;
+	fileSize = sizeof(header);
+
+	return true;
+}
+
+void CoverCache::ReadIndex()
+{
+	if (!mapView)
+		return;
+
+	const char* data = static_cast<const char*>(mapView.get());
+
+	long long offset = sizeof(unsigned int) * 2;
+	while (offset + (long long)sizeof(Record) <= mapSize)
+	{
+		Record record;
+		memcpy(&record, data + offset, sizeof(Record));
+
+		if (record.width < 0 || record.width > maxCoverSize ||
+			record.height < 0 || record.height > maxCoverSize)
+			break;
+
+		long long size = (long long)record.width * record.height * 4;
+		if (offset + (long long)sizeof(Record) + size > mapSize)
+			break; // The last record is not complete
+
+		Item& item = index[Key{record.hash, record.cx, record.cy}];
+		item.offset = offset + sizeof(Record);
+		item.fileTime = record.fileTime;
+		item.fileSize = record.fileSize;
+		item.width = record.width;
+		item.height = record.height;
+
+		offset += sizeof(Record) + size;
+	}
+
+	// Write new records after the last valid record
+	fileSize = offset;
+}
+
+CoverCache::Key CoverCache::MakeKey(const std::wstring& file, int cx, int cy)
+{
+	return Key{StringEx::HashFNV1a64(StringEx::ToLowerUS(file)), cx, cy};
+}
+
+bool CoverCache::Load(const std::wstring& file, int cx, int cy, ExImage& outImage)
+{
+	outImage.Clear();
+
+	if (!fileHandle)
+		return false;
+
+	auto find = index.find(MakeKey(file, cx, cy));
+	if (find == index.end())
+		return false;
+
+	const Item& item = find->second;
+
+	FileSystem::FindFile findFile(file);
+	if (!findFile.IsFound() || item.fileTime != findFile.GetModified() || item.fileSize != findFile.GetFileSize())
+		return false;
+
+	if (item.width == 0 || item.height == 0)
+		return true; // No cover
+
+	std::size_t size = (std::size_t)item.width * item.height * 4;
+
+	if (item.offset + (long long)size <= mapSize)
+		return outImage.LoadFromBits(static_cast<const char*>(mapView.get()) + item.offset, item.width, item.height);
+	else if (ReadBits(item.offset, size))
+		return outImage.LoadFromBits(bits.data(), item.width, item.height);
+
+	return false;
+}
+
+void CoverCache::Save(const std::wstring& file, int cx, int cy, ExImage* image)
+{
+	if (!fileHandle)
+		return;
+
+	Record record = {};
+	record.cx = cx;
+	record.cy = cy;
+
+	if (image && image->IsValid())
+	{
+		if (!image->GetBits(bits))
+			return;
+
+		record.width = image->Width();
+		record.height = image->Height();
+
+		if (record.width > maxCoverSize || record.height > maxCoverSize)
+			return;
+	}
+	else
+		bits.clear();
+
+	FileSystem::FindFile findFile(file);
+	if (!findFile.IsFound())
+		return;
+
+	Key key = MakeKey(file, cx, cy);
+	record.hash = key.hash;
+	record.fileTime = findFile.GetModified();
+	record.fileSize = findFile.GetFileSize();
+
+	// Keep the file in the limit during the session too, start from scratch
+	if (fileSize + (long long)(sizeof(Record) + bits.size()) > maxFileSize)
+	{
+		if (!Reset())
+		{
+			Close();
+			return;
+		}
+	}
+
+	long long offset = fileSize;
+
+	if (!WriteData(offset, &record, sizeof(Record)))
+		return;
+	if (!bits.empty() && !WriteData(offset + sizeof(Record), bits.data(), bits.size()))
+		return;
+
+	fileSize = offset + sizeof(Record) + bits.size();
+
+	Item& item = index[key];
+	item.offset = offset + sizeof(Record);
+	item.fileTime = record.fileTime;
+	item.fileSize = record.fileSize;
+	item.width = record.width;
+	item.height = record.height;
+}
+
+bool CoverCache::ReadBits(long long offset, std::size_t size)
+{
+	bits.resize(size);
+
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	DWORD bytesRead = 0;
+	if (::ReadFile(fileHandle.get(), bits.data(), (DWORD)size, &bytesRead, &overlapped) && bytesRead == size)
+		return true;
+
+	return false;
+}
+
+bool CoverCache::WriteData(long long offset, const void* data, std::size_t size)
+{
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	DWORD bytesWritten = 0;
+	if (::WriteFile(fileHandle.get(), data, (DWORD)size, &bytesWritten, &overlapped) && bytesWritten == size)
+		return true;
+
+	return false;
+}
@@ -0,0 +1,106 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "ExImage.h"
+#include <unordered_map>
+
+// Disk cache of cover thumbnails for the list (see SkinListThread).
+// All thumbnails are stored in one pack file in the profile folder as ready to use
+// premultiplied BGRA pixels, so when the list is filled again covers are not loaded
+// from tags or the track folder and are not decoded/scaled again.
+// A thumbnail is found by the file of the cover (an image in the track folder or the track itself
+// for the embedded cover) and the size of the cover in the skin, so all tracks of an album share
+// one record, and it is valid while the modified time and the size of the cover file are the same.
+// Tracks without the embedded cover are stored too (with empty image).
+// The pack file is only appended, the last record for the same key wins,
+// all records are dropped when the file becomes too big.
+// Not thread safe, used only from the thread of SkinListThread.
+
+class CoverCache
+{
+
+public:
+	CoverCache();
+	virtual ~CoverCache();
+	CoverCache(const CoverCache&) = delete;
+	CoverCache& operator=(const CoverCache&) = delete;
+
+	bool Open(const std::wstring& file);
+	void Close();
+	inline bool IsOpen() {return fileHandle ? true : false;}
+
+	// file is the cover file (the track file for the embedded cover)
+	// Return true if found, outImage is not valid if the file doesn't have a cover
+	bool Load(const std::wstring& file, int cx, int cy, ExImage& outImage);
+	// image == nullptr to save that the file doesn't have a cover
+	void Save(const std::wstring& file, int cx, int cy, ExImage* image);
+
+private:
+	static const unsigned int fileMagic = 0x32435657; // "WVC2"
+	static const long long maxFileSize = 256LL * 1024 * 1024;
+	static const int maxCoverSize = 2048;
+
+	struct Record
+	{
+		long long hash;
+		long long fileTime;
+		long long fileSize;
+		int cx;
+		int cy;
+		int width;
+		int height;
+	};
+
+	struct Key
+	{
+		long long hash;
+		int cx;
+		int cy;
+		bool operator==(const Key& other) const {return hash == other.hash && cx == other.cx && cy == other.cy;}
+	};
+	struct HashKey
+	{
+		std::size_t operator()(const Key& key) const {return (std::size_t)key.hash ^ ((std::size_t)key.cx << 16) ^ (std::size_t)key.cy;}
+	};
+
+	struct Item
+	{
+		long long offset; // Offset of pixels in the file
+		long long fileTime;
+		long long fileSize;
+		int width;
+		int height;
+	};
+
+	std::unordered_map<Key, Item, HashKey> index;
+
+	FileHandle fileHandle;
+	MappingHandle mapHandle;
+	MapViewHandle mapView;
+	long long mapSize = 0;
+	long long fileSize = 0;
+
+	std::vector<char> bits;
+
+	static Key MakeKey(const std::wstring& file, int cx, int cy);
+	bool Reset();
+	void ReadIndex();
+	bool ReadBits(long long offset, std::size_t size);
+	bool WriteData(long long offset, const void* data, std::size_t size);
+};
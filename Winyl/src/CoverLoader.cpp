@@ -34,12 +34,9 @@ bool CoverLoader::LoadCoverImage(const std::wstring& file)
 {
 	coverImage.Free();
 
-	std::wstring path = PathEx::PathFromFile(file);
-
 	std::wstring fileCover;
 
-	if (FindImageByName(path, L"*front*.*", fileCover) ||
-		FindImageByName(path, L"*cover*.*", fileCover))
+	if (FindFrontCover(file, fileCover))
 	{
 		coverImage.LoadFile(fileCover);
 
@@ -50,13 +47,7 @@ bool CoverLoader::LoadCoverImage(const std::wstring& file)
 		// Return false if embedded, because need to always reload such cover art
 		return false;
 	}
-	else if (FindImageByName(path, L"folder.*", fileCover))
-	{
-		coverImage.LoadFile(fileCover);
-
-		return true;
-	}
-	else if (FindImageByExt(path, fileCover))
+	else if (FindFolderCover(file, fileCover))
 	{
 		coverImage.LoadFile(fileCover);
 
@@ -66,6 +57,36 @@ bool CoverLoader::LoadCoverImage(const std::wstring& file)
 	return false;
 }
 
+bool CoverLoader::FindFrontCover(const std::wstring& file, std::wstring& fileCover)
+{
+	std::wstring path = PathEx::PathFromFile(file);
+
+	return FindImageByName(path, L"*front*.*", fileCover) ||
+		FindImageByName(path, L"*cover*.*", fileCover);
+}
+
+bool CoverLoader::FindFolderCover(const std::wstring& file, std::wstring& fileCover)
+{
+	std::wstring path = PathEx::PathFromFile(file);
+
+	return FindImageByName(path, L"folder.*", fileCover) ||
+		FindImageByExt(path, fileCover);
+}
+
+bool CoverLoader::LoadCoverFile(const std::wstring& fileCover)
+{
+	coverImage.Free();
+
+	return coverImage.LoadFile(fileCover);
+}
+
+bool CoverLoader::LoadCoverEmbedded(const std::wstring& file)
+{
+	coverImage.Free();
+
+	return LoadCoverFromTrack(file);
+}
+
 bool CoverLoader::LoadCoverImageTagEditor(const std::wstring& file)
 {
 	coverImage.Free();
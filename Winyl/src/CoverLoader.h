@@ -32,6 +32,13 @@ public:
 	bool LoadCoverImage(const std::wstring& file);
 	bool LoadCoverImageTagEditor(const std::wstring& file);
 
+	// Find a cover file in the track folder in the same order as LoadCoverImage,
+	// front and cover images go before the embedded cover, folder and other images after it
+	bool FindFrontCover(const std::wstring& file, std::wstring& fileCover);
+	bool FindFolderCover(const std::wstring& file, std::wstring& fileCover);
+	bool LoadCoverFile(const std::wstring& fileCover);
+	bool LoadCoverEmbedded(const std::wstring& file);
+
 	ExImage::Source& GetImage() {return coverImage;}
 
 private:
@@ -0,0 +1,168 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "ExImage.h"
+#include "Threading.h"
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// Decoded covers of the list in memory (see SkinListThread and SkinList::GetNodeCover).
+// Nodes hold handles, covers are owned by the cache and the least recently drawn covers
+// are deleted when the size of all covers becomes bigger than the budget.
+// When a node is drawn and its cover is deleted, the list loads the cover again.
+// Covers drawn in the current paint pass are not deleted even if the budget is smaller than one screen,
+// otherwise each loaded cover would delete another visible cover and the list would repaint endlessly.
+// Covers are returned as shared_ptr so a cover that is drawn right now is not deleted under the list.
+// The cache is used from the main thread and from the threads of SkinListThread.
+
+class CoverMemory final
+{
+public:
+	using Handle = unsigned int;
+
+	static CoverMemory& Instance()
+	{
+		static CoverMemory coverMemory;
+		return coverMemory;
+	}
+
+	// Take ownership of the image, return 0 if the image is not valid
+	Handle Add(ExImage* image)
+	{
+		if (image == nullptr || !image->IsValid())
+		{
+			delete image;
+			return 0;
+		}
+
+		std::size_t size = (std::size_t)image->Width() * image->Height() * 4;
+
+		LockGuard lock(mutex);
+
+		if (++handleCounter == 0) // Skip 0 after overflow
+			++handleCounter;
+		Handle handle = handleCounter;
+
+		covers.emplace_front(Cover{handle, size, std::shared_ptr<ExImage>(image)});
+		index.emplace(handle, covers.begin());
+		bytesUsed += size;
+
+		Evict();
+
+		return handle;
+	}
+
+	// Return nullptr if the cover is deleted
+	std::shared_ptr<ExImage> Get(Handle handle)
+	{
+		std::shared_ptr<ExImage> image;
+
+		if (handle == 0)
+			return image;
+
+		LockGuard lock(mutex);
+
+		auto find = index.find(handle);
+		if (find != index.end())
+		{
+			covers.splice(covers.begin(), covers, find->second);
+			find->second->paintPass = paintPass;
+			image = find->second->image;
+		}
+
+		return image;
+	}
+
+	void Remove(Handle handle)
+	{
+		if (handle == 0)
+			return;
+
+		LockGuard lock(mutex);
+
+		auto find = index.find(handle);
+		if (find != index.end())
+		{
+			bytesUsed -= find->second->size;
+			covers.erase(find->second);
+			index.erase(find);
+		}
+	}
+
+	void SetBudget(std::size_t bytes)
+	{
+		LockGuard lock(mutex);
+		bytesBudget = std::max(bytes, bytesBudgetMin);
+		Evict();
+	}
+
+	// Call before the list is painted, the covers that the paint gets (Get) are kept until the next paint
+	void NewPaintPass()
+	{
+		LockGuard lock(mutex);
+		++paintPass;
+	}
+
+	// For diagnostics
+	std::size_t GetBytesUsed() {LockGuard lock(mutex); return bytesUsed;}
+	std::size_t GetBytesBudget() {LockGuard lock(mutex); return bytesBudget;}
+	std::size_t GetCount() {LockGuard lock(mutex); return index.size();}
+	std::size_t GetCountEvicted() {LockGuard lock(mutex); return countEvicted;}
+
+private:
+	CoverMemory() {}
+	~CoverMemory() {}
+	CoverMemory(const CoverMemory&) = delete;
+	CoverMemory& operator=(const CoverMemory&) = delete;
+
+	void Evict()
+	{
+		// Keep at least one cover (the last added) and the covers of the current paint,
+		// they are at the front of the list so stop at the first one
+		while (bytesUsed > bytesBudget && covers.size() > 1 && covers.back().paintPass != paintPass)
+		{
+			bytesUsed -= covers.back().size;
+			index.erase(covers.back().handle);
+			covers.pop_back();
+			++countEvicted;
+		}
+	}
+
+	static const std::size_t bytesBudgetMin = 4 * 1024 * 1024;
+
+	struct Cover
+	{
+		Handle handle;
+		std::size_t size;
+		std::shared_ptr<ExImage> image;
+		unsigned paintPass = 0; // The last paint that got the cover
+	};
+
+	Threading::Mutex mutex;
+	std::list<Cover> covers; // The most recently used first
+	std::unordered_map<Handle, std::list<Cover>::iterator> index;
+
+	Handle handleCounter = 0;
+	unsigned paintPass = 1; // New covers (0) are not of the current paint
+	std::size_t bytesUsed = 0;
+	std::size_t bytesBudget = 64 * 1024 * 1024;
+	std::size_t countEvicted = 0;
+};
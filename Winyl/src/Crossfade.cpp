@@ -0,0 +1,248 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "Crossfade.h"
+#include "bass/bass.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+	const float silenceLevel = 0.0031623f; // -50 dB, peak of a block below it is silence
+	const int blocksPerSecond = 100; // Silence is detected by blocks of 10 ms
+	const double pi = 3.14159265358979323846;
+}
+
+Crossfade::Crossfade()
+{
+
+}
+
+Crossfade::~Crossfade()
+{
+
+}
+
+void Crossfade::SetEnable(bool isEnable, int seconds, int curve)
+{
+	this->isEnable = isEnable;
+	fadeTime = (double)std::max(1, std::min(seconds, 15));
+
+	if (curve == (int)Curve::SquareRoot)
+		fadeCurve = Curve::SquareRoot;
+	else if (curve == (int)Curve::Linear)
+		fadeCurve = Curve::Linear;
+	else
+		fadeCurve = Curve::EqualPower;
+}
+
+double Crossfade::FindSoundEnd(const std::wstring& file, double start)
+{
+	HSTREAM stream = BASS_StreamCreateFile(FALSE, file.c_str(), 0, 0, BASS_UNICODE|BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT);
+	if (stream == NULL)
+		return -1.0;
+
+	BASS_CHANNELINFO ci;
+	if (!BASS_ChannelGetInfo(stream, &ci) || ci.chans == 0 || ci.freq < blocksPerSecond)
+	{
+		BASS_StreamFree(stream);
+		return -1.0;
+	}
+
+	if (start > 0.0)
+		BASS_ChannelSetPosition(stream, BASS_ChannelSeconds2Bytes(stream, start), BASS_POS_BYTE);
+
+	std::size_t blockSamples = (ci.freq / blocksPerSecond) * ci.chans;
+	buffer.resize(blockSamples);
+
+	// If all blocks are silent then the sound ends at the start
+	long long block = 0;
+	long long soundBlocks = 0;
+	for (;;)
+	{
+		DWORD read = BASS_ChannelGetData(stream, buffer.data(), (DWORD)(blockSamples * sizeof(float)));
+		if (read == (DWORD)-1 || read == 0) // The end
+			break;
+
+		++block;
+		if (!IsSilent(buffer.data(), read / sizeof(float)))
+			soundBlocks = block;
+	}
+
+	BASS_StreamFree(stream);
+
+	return start + (double)soundBlocks / blocksPerSecond;
+}
+
+double Crossfade::FindSoundStart(const std::wstring& file)
+{
+	HSTREAM stream = BASS_StreamCreateFile(FALSE, file.c_str(), 0, 0, BASS_UNICODE|BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT);
+	if (stream == NULL)
+		return -1.0;
+
+	BASS_CHANNELINFO ci;
+	if (!BASS_ChannelGetInfo(stream, &ci) || ci.chans == 0 || ci.freq < blocksPerSecond)
+	{
+		BASS_StreamFree(stream);
+		return -1.0;
+	}
+
+	std::size_t blockSamples = (ci.freq / blocksPerSecond) * ci.chans;
+	buffer.resize(blockSamples);
+
+	long long block = 0;
+	while (block < MaxLeadSilence * blocksPerSecond)
+	{
+		DWORD read = BASS_ChannelGetData(stream, buffer.data(), (DWORD)(blockSamples * sizeof(float)));
+		if (read == (DWORD)-1 || read == 0) // The end
+			break;
+
+		if (!IsSilent(buffer.data(), read / sizeof(float)))
+			break;
+
+		++block;
+	}
+
+	BASS_StreamFree(stream);
+
+	return (double)block / blocksPerSecond;
+}
+
+bool Crossfade::IsSilent(const float* samples, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		if (std::abs(samples[i]) >= silenceLevel)
+			return false;
+	}
+
+	return true;
+}
+
+void Crossfade::Fader::Start(Ramp& ramp, Curve curve, bool isFadeIn, long long start, long long length)
+{
+	// The ramp can be started only once, the DSP can be reading it already
+	if (ramp.isActive)
+		return;
+
+	length = std::max(length, 1LL);
+
+	// Gain of the next track, the current track goes backwards
+	for (int i = 0; i <= tableSize; ++i)
+	{
+		double x = (double)i / tableSize;
+		if (!isFadeIn)
+			x = 1.0 - x;
+
+		double gain = x;
+		if (curve == Curve::EqualPower)
+			gain = std::sin(x * pi * 0.5);
+		else if (curve == Curve::SquareRoot)
+			gain = std::sqrt(x);
+
+		ramp.table[i] = (float)gain;
+	}
+
+	ramp.start = start;
+	ramp.length = length;
+	ramp.step = (float)tableSize / (float)length;
+
+	// The DSP sees the ramp only when everything is written
+	ramp.isActive.store(true, std::memory_order_release);
+}
+
+float Crossfade::Fader::Ramp::GetGain(long long frame) const
+{
+	long long offset = frame - start;
+	if (offset <= 0)
+		return table[0];
+	if (offset >= length)
+		return table[tableSize];
+
+	float x = (float)offset * step;
+	int index = std::min((int)x, tableSize - 1);
+	float frac = x - (float)index;
+
+	return table[index] + (table[index + 1] - table[index]) * frac;
+}
+
+bool Crossfade::Fader::Ramp::IsConstant(long long frame, std::size_t frames, float& outGain) const
+{
+	if (frame + (long long)frames <= start)
+	{
+		outGain = table[0];
+		return true;
+	}
+	if (frame >= start + length)
+	{
+		outGain = table[tableSize];
+		return true;
+	}
+
+	return false;
+}
+
+void Crossfade::Fader::Process(float* samples, std::size_t frames)
+{
+	long long frame = position;
+	position += frames;
+
+	bool isIn = rampIn.isActive.load(std::memory_order_acquire);
+	bool isOut = rampOut.isActive.load(std::memory_order_acquire);
+	if (!isIn && !isOut)
+		return;
+
+	// Most of the time the buffer is before or after the fades and the gain is the same for all samples
+	float gainIn = 1.0f;
+	float gainOut = 1.0f;
+	bool isConstIn = !isIn || rampIn.IsConstant(frame, frames, gainIn);
+	bool isConstOut = !isOut || rampOut.IsConstant(frame, frames, gainOut);
+
+	if (isConstIn && isConstOut)
+	{
+		float gain = gainIn * gainOut;
+
+		if (gain == 1.0f)
+			return;
+
+		std::size_t count = frames * channels;
+		if (gain == 0.0f)
+			memset(samples, 0, count * sizeof(float));
+		else
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				samples[i] *= gain;
+		}
+		return;
+	}
+
+	for (std::size_t i = 0; i < frames; ++i)
+	{
+		float gain = 1.0f;
+		if (isIn)
+			gain *= rampIn.GetGain(frame + (long long)i);
+		if (isOut)
+			gain *= rampOut.GetGain(frame + (long long)i);
+
+		for (int c = 0; c < channels; ++c)
+			samples[c] *= gain;
+		samples += channels;
+	}
+}
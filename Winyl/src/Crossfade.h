@@ -0,0 +1,112 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+// Crossfade between tracks for WASAPI/ASIO (see LibAudio::PrepareCrossfade).
+// The next track starts a few seconds before the end of the current track and both streams
+// are in the mixer for the time of the fade. Each stream has a Fader DSP that applies the gain
+// per sample from a table filled before the fade, so the mixer thread doesn't allocate and doesn't lock.
+// Fade points are found in the crossfade thread: the fade out ends where the trailing silence
+// of the track starts and the fade in starts where the leading silence of the next track ends.
+
+class Crossfade
+{
+
+public:
+	Crossfade();
+	virtual ~Crossfade();
+	Crossfade(const Crossfade&) = delete;
+	Crossfade& operator=(const Crossfade&) = delete;
+
+	enum class Curve
+	{
+		EqualPower = 0, // Sine/cosine, the power stays the same for different tracks
+		SquareRoot = 1, // Equal power too but the next track comes in faster
+		Linear     = 2  // Equal gain, for a track that continues in the next one
+	};
+
+	static const int MaxTrailSilence = 10; // In seconds, how far the end of the sound is searched
+	static const int MaxLeadSilence = 2; // In seconds, how much of the silence is skipped at the start
+
+	void SetEnable(bool isEnable, int seconds, int curve);
+	inline bool IsEnable() {return isEnable;}
+	inline double GetTime() {return fadeTime;}
+	inline Curve GetCurve() {return fadeCurve;}
+
+	// Crossfade thread, return time in seconds or -1.0 if the file cannot be opened
+	double FindSoundEnd(const std::wstring& file, double start); // From the start to the end of the file
+	double FindSoundStart(const std::wstring& file); // Up to MaxLeadSilence
+
+	// Gain of one stream, each fade can be started once while the stream plays
+	class Fader
+	{
+
+	public:
+		Fader() = default;
+		Fader(const Fader&) = delete;
+		Fader& operator=(const Fader&) = delete;
+
+		inline void SetChannels(int chans) {channels = chans;}
+		inline int GetChannels() {return channels;}
+
+		// Any thread before the stream reaches the start frame (frames are counted from the start of the stream)
+		void FadeIn(Curve curve, long long start, long long length) {Start(rampIn, curve, true, start, length);}
+		void FadeOut(Curve curve, long long start, long long length) {Start(rampOut, curve, false, start, length);}
+
+		// Mixer thread
+		void Process(float* samples, std::size_t frames);
+
+	private:
+		static const int tableSize = 256;
+
+		struct Ramp
+		{
+			float table[tableSize + 1];
+			long long start = 0;
+			long long length = 0;
+			float step = 0.0f; // Table entries per frame
+			std::atomic<bool> isActive = false;
+
+			float GetGain(long long frame) const;
+			bool IsConstant(long long frame, std::size_t frames, float& outGain) const;
+		};
+
+		Ramp rampIn;
+		Ramp rampOut;
+
+		long long position = 0; // Frames processed by the DSP
+		int channels = 2;
+
+		static void Start(Ramp& ramp, Curve curve, bool isFadeIn, long long start, long long length);
+	};
+
+private:
+	bool isEnable = false;
+	double fadeTime = 5.0;
+	Curve fadeCurve = Curve::EqualPower;
+
+	std::vector<float> buffer;
+
+	bool IsSilent(const float* samples, std::size_t count);
+};
@@ -29,8 +29,25 @@ DBase::DBase()
 
 DBase::~DBase()
 {
+	if (threadStats.IsJoinable())
+	{
+		isStopStats = true;
+		eventStats.Set();
+		threadStats.Join();
+	}
+	isStopStats = true; // The last flush writes all updates (see WriteStats)
+	FlushStats();
+
 	// Close databases
 
+	if (dbLibraryRead)
+	{
+		if (dbLibraryRead != dbLibrary)
+			dbLibraryRead.Close();
+
+		dbLibraryRead.Null();
+	}
+
 	if (dbLibrary)
 		dbLibrary.Close();
 
@@ -51,157 +68,6 @@ DBase::~DBase()
 	if (dbPlayTemp)
 		dbPlayTemp.Close();
 }
-/*
-int DBase::CompareStringToNum(const char* str, int len)
-{
-	int value = 0;
-	int sign = 1;
-	int cnt = 0;
-
-	while (cnt < len && *str == ' ')
-	{
-		cnt++;
-		str++;
-	}
-
-	if (cnt < len && *str == '-')
-		sign = -1;
-
-	while (cnt < len && *str != '\0')
-	{
-		if (*str >= '0' && *str <= '9')
-			value = (value * 10) + (*str - '0');
-		else
-			break;
-
-		cnt++;
-		str++;
-	}
-
-	return value * sign;
-}
-
-int DBase::CompareStringsNum(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	int i1 = CompareStringToNum((const char*)str1, len1);
-	int i2 = CompareStringToNum((const char*)str2, len2);
-
-	if (i1 > i2)
-		return 1;
-	else if (i1 < i2)
-		return -1;
-
-	return 0;
-}
-*/
-int DBase::CompareStringsXP(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	//return lstrcmpi((const wchar_t*)str1, (const wchar_t*)str2);
-	return CompareStringW(LOCALE_USER_DEFAULT, NORM_IGNORECASE, (LPCWSTR)str1, -1, (LPCWSTR)str2, -1) - CSTR_EQUAL;
-}
-
-int DBase::CompareStringsLikeXP(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	if (len1 < len2)
-		return -1;
-
-	// Find substring
-	int i = 0, size = len1/2 - len2/2; // see assert
-	for (wchar_t* first = (wchar_t*)str1;*first && i <= size; ++first, ++i)
-	{
-		//assert((size_t)len2/2 <= wcslen(first));
-		if (CompareStringW(LOCALE_USER_DEFAULT, NORM_IGNORECASE, (LPCWSTR)first, len2/2, (LPCWSTR)str2, len2/2) == CSTR_EQUAL)
-			return 0;
-	}
-
-	return -1;
-}
-
-int DBase::CompareStringsFolderSelectXP(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	if (len1 < len2)
-		return -1;
-
-	if (CompareStringW(LOCALE_INVARIANT, NORM_IGNORECASE, (LPCWSTR)str1, len2/2, (LPCWSTR)str2, len2/2) == CSTR_EQUAL)
-		return 0;
-
-	return -1;
-}
-
-int DBase::CompareStringsFolderGroupXP(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	const wchar_t* find1 = wcsrchr((const wchar_t*)str1, '\\');
-	const wchar_t* find2 = wcsrchr((const wchar_t*)str2, '\\');
-
-	return CompareStringW(LOCALE_INVARIANT, NORM_IGNORECASE,
-		(LPWSTR)str1, (DWORD)(find1 - (LPWSTR)str1) + 1, (LPWSTR)str2, (DWORD)(find2 - (LPWSTR)str2) + 1) - CSTR_EQUAL;
-
-
-	// Test
-	//const wchar_t* find1 = wcsrchr((const wchar_t*)str1, '\\');
-	//const wchar_t* find2 = wcsrchr((const wchar_t*)str2, '\\');
-
-	//unsigned int count1 = find1 ? find1 - (const wchar_t*)str1 + 1 : 0;
-	//unsigned int count2 = find2 ? find2 - (const wchar_t*)str2 + 1 : 0;
-
-	//int ret = 0;
-	//if (count1 <= count2)
-	//	ret = wcsncmp((const wchar_t*)str1, (const wchar_t*)str2, count1);
-	//else
-	//	ret = wcsncmp((const wchar_t*)str1, (const wchar_t*)str2, count2);
-
-	//if (ret == 0)
-	//	ret = count1 - count2;
-
-	//return ret;
-}
-
-int DBase::CompareStringsFileXP(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	return CompareStringW(LOCALE_INVARIANT, NORM_IGNORECASE, (LPCWSTR)str1, -1, (LPCWSTR)str2, -1) - CSTR_EQUAL;
-}
-
-int DBase::CompareStrings(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	return futureWin->CompareStringEx(LOCALE_NAME_USER_DEFAULT, LINGUISTIC_IGNORECASE, (LPCWSTR)str1, -1, (LPCWSTR)str2, -1, 0, 0, 0) - CSTR_EQUAL;
-}
-
-int DBase::CompareStringsLike(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	if (len1 < len2)
-		return -1;
-
-	if (futureWin->FindNLSStringEx(LOCALE_NAME_USER_DEFAULT, FIND_FROMSTART|LINGUISTIC_IGNORECASE, (LPCWSTR)str1, -1, (LPCWSTR)str2, -1,
-		NULL, 0, 0, 0) > -1)
-		return 0;
-
-	return -1;
-}
-
-int DBase::CompareStringsFolderSelect(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	if (len1 < len2)
-		return -1;
-
-	if (futureWin->CompareStringOrdinal((LPCWSTR)str1, len2/2, (LPCWSTR)str2, len2/2, TRUE) == CSTR_EQUAL)
-		return 0;
-
-	return -1;
-}
-
-int DBase::CompareStringsFolderGroup(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	const wchar_t* find1 = wcsrchr((const wchar_t*)str1, '\\');
-	const wchar_t* find2 = wcsrchr((const wchar_t*)str2, '\\');
-
-	return futureWin->CompareStringOrdinal(
-		(LPCWSTR)str1, (DWORD)(find1 - (LPCWSTR)str1) + 1, (LPCWSTR)str2, (DWORD)(find2 - (LPCWSTR)str2) + 1, TRUE) - CSTR_EQUAL;
-}
-
-int DBase::CompareStringsFile(void* context, int len1, const void* str1, int len2, const void* str2)
-{
-	return futureWin->CompareStringOrdinal((LPCWSTR)str1, len1/2, (LPCWSTR)str2, len2/2, TRUE) - CSTR_EQUAL;
-}
 
 bool DBase::IsEqualPaths(const std::wstring& str1, size_t len1, const std::wstring& str2, size_t len2)
 {
@@ -254,6 +120,16 @@ void DBase::OpenLibrary()
 	//// Maybe truncate? (if DELETE and EXCLUSIVE or WAL)
 	//SQLRequest::Exec(dbLibrary, "PRAGMA journal_size_limit=0;");
 
+	// Journal mode is persistent in the database file, so always set it to be able to switch back from WAL
+	if (isLibraryWAL)
+	{
+		SQLRequest::Exec(dbLibrary, "PRAGMA journal_mode=WAL;");
+		SQLRequest::Exec(dbLibrary, "PRAGMA synchronous=NORMAL;");
+		SQLRequest::Exec(dbLibrary, ("PRAGMA wal_autocheckpoint=" + std::to_string(libraryWALCheckpoint) + ";").c_str());
+	}
+	else
+		SQLRequest::Exec(dbLibrary, "PRAGMA journal_mode=DELETE;");
+
 	file = profilePath + L"Cue.db";
 
 	dbCue.OpenCreate(file);
@@ -270,28 +146,32 @@ void DBase::OpenLibrary()
 	sqlCheckForeignKeys.Finalize();
 #endif
 
-	//sqlite3_create_collation(dbLibrary.get(), "MYNUM", SQLITE_UTF8, nullptr, CompareStringsNum);
+	CreateFunctions(dbLibrary);
+
 	if (futureWin->IsVistaOrLater())
-	{
-		sqlite3_create_collation(dbLibrary.get(), "MYCASE", SQLITE_UTF16LE, nullptr, CompareStrings);
-		sqlite3_create_collation(dbLibrary.get(), "LIKECASE", SQLITE_UTF16LE, nullptr, CompareStringsLike);
-		sqlite3_create_collation(dbLibrary.get(), "FSELECT", SQLITE_UTF16LE, nullptr, CompareStringsFolderSelect);
-		sqlite3_create_collation(dbLibrary.get(), "FGROUP", SQLITE_UTF16LE, nullptr, CompareStringsFolderGroup);
-		sqlite3_create_collation(dbLibrary.get(), "FILECASE", SQLITE_UTF16LE, nullptr, CompareStringsFile);
 		sqlite3_create_collation(dbCue.get(), "FILECASE", SQLITE_UTF16LE, nullptr, CompareStringsFile);
-	}
 	else
-	{
-		sqlite3_create_collation(dbLibrary.get(), "MYCASE", SQLITE_UTF16LE, nullptr, CompareStringsXP);
-		sqlite3_create_collation(dbLibrary.get(), "LIKECASE", SQLITE_UTF16LE, nullptr, CompareStringsLikeXP);
-		sqlite3_create_collation(dbLibrary.get(), "FSELECT", SQLITE_UTF16LE, nullptr, CompareStringsFolderSelectXP);
-		sqlite3_create_collation(dbLibrary.get(), "FGROUP", SQLITE_UTF16LE, nullptr, CompareStringsFolderGroupXP);
-		sqlite3_create_collation(dbLibrary.get(), "FILECASE", SQLITE_UTF16LE, nullptr, CompareStringsFileXP);
 		sqlite3_create_collation(dbCue.get(), "FILECASE", SQLITE_UTF16LE, nullptr, CompareStringsFileXP);
-	}
 
 	CreateTableLibrary(dbLibrary);
 	CreateTableCue(dbCue);
+
+	isSearchIndex = CreateTableSearch(dbLibrary);
+
+	LoadReplayGains();
+
+	// In WAL mode readers are not blocked by the writer, so the library can be browsed
+	// with a separate connection while the library is updating (see Progress::ThreadLibrary)
+	if (isLibraryWAL && dbLibraryRead.OpenRead(profilePath + L"Library.db"))
+	{
+		SQLRequest::Exec(dbLibraryRead, "PRAGMA cache_size = 10000;");
+		CreateFunctions(dbLibraryRead);
+	}
+	else
+		dbLibraryRead = dbLibrary;
+
+	if (!threadStats.IsJoinable())
+		threadStats.StartBackground(std::bind(&DBase::ThreadStats, this));
 }
 
 void DBase::OpenPlaylist(const std::wstring& fileName)
@@ -301,6 +181,8 @@ void DBase::OpenPlaylist(const std::wstring& fileName)
 	file.push_back('\\');
 	file += fileName + L".db";
 
+	FlushStats();
+
 	dbPlaylist.OpenCreate(file);
 
 	CreateTablePlaylist(dbPlaylist);
@@ -308,6 +190,8 @@ void DBase::OpenPlaylist(const std::wstring& fileName)
 
 void DBase::ClosePlaylist()
 {
+	FlushStats();
+
 	if (dbPlaylist)
 	{
 		if (dbPlaylist != dbPlayOpen)
@@ -323,6 +207,8 @@ void DBase::ClosePlaylist()
 
 void DBase::ReturnNowPlaying()
 {
+	FlushStats();
+
 	if (dbPlayOpen)
 	{
 		dbPlaylist = dbPlayOpen;
@@ -335,6 +221,8 @@ void DBase::ReturnNowPlaying()
 
 void DBase::NewNowPlaying()
 {
+	FlushStats();
+
 	if (dbPlaylist) // If playlist is open it becomes Now Playing
 	{
 		// If assert then something bad is happening
@@ -351,6 +239,8 @@ void DBase::NewNowPlaying()
 
 void DBase::CloseNowPlaying()
 {
+	FlushStats();
+
 	if (dbPlayOpen)
 	{
 		if (dbPlayOpen != dbPlaylist)
@@ -373,7 +263,25 @@ void DBase::CreateTableLibrary(const SQLFile& db)
 
 	// Library tables already created
 	if (SQLRequest::ExecRow(db, "SELECT name FROM sqlite_master WHERE type='table' AND name='library';"))
+	{
+		SQLRequest::Exec(db, "BEGIN;");
+
+		// Sort keys were added later, add them to the old library (the keys are computed in UpdateSortKeys)
+		if (!SQLRequest::ExecRow(db, "SELECT name FROM pragma_table_info('library') WHERE name='albumkey';"))
+		{
+			SQLRequest::Exec(db, "ALTER TABLE library ADD COLUMN titlekey BLOB;");
+			SQLRequest::Exec(db, "ALTER TABLE library ADD COLUMN albumkey BLOB;");
+			SQLRequest::Exec(db, "ALTER TABLE library ADD COLUMN artistkey BLOB;");
+			SQLRequest::Exec(db, "ALTER TABLE library ADD COLUMN albumartistkey BLOB;");
+		}
+
+		CreateSortKeys(db);
+
+		SQLRequest::Exec(db, "COMMIT;");
+
+		UpdateSortKeys(db);
 		return;
+	}
 
 	SQLRequest::Exec(db, "BEGIN;");
 
@@ -430,7 +338,11 @@ void DBase::CreateTableLibrary(const SQLFile& db)
 		"bookmark INTEGER,"        // Track bookmark
 		"replaygain TEXT,"         // ReplayGain values
 		"equalizer TEXT,"          // Track equalizer settings
-		"keywords TEXT);"          // Keywords/tags for track
+		"keywords TEXT,"           // Keywords/tags for track
+		"titlekey BLOB,"           // Sort key of title (see SortKey)
+		"albumkey BLOB,"           // Sort key of album
+		"artistkey BLOB,"          // Sort key of artist
+		"albumartistkey BLOB);"    // Sort key of album artist
 	);
 
 	SQLRequest::Exec(db,
@@ -449,6 +361,74 @@ void DBase::CreateTableLibrary(const SQLFile& db)
 	SQLRequest::Exec(db, "CREATE INDEX IF NOT EXISTS sid_index ON storage(sid);");
 	SQLRequest::Exec(db, "CREATE INDEX IF NOT EXISTS skey_index ON storage(skey);");
 
+	CreateSortKeys(db);
+
+	SQLRequest::Exec(db, "COMMIT;");
+
+	UpdateSortKeys(db);
+}
+
+void DBase::CreateSortKeys(const SQLFile& db)
+{
+	// ORDER BY and GROUP BY use these keys instead of MYCASE collation, so sorting doesn't call
+	// CompareStringEx for each comparison. The keys are computed once when a track is added or its tags changed
+	// directly in INSERT/UPDATE requests (see AddFileToLibrary, UpdateTagsFile*, UpdateTagsEditor).
+	SQLRequest::Exec(db, "CREATE INDEX IF NOT EXISTS titlekey_index ON library(titlekey);");
+	SQLRequest::Exec(db, "CREATE INDEX IF NOT EXISTS albumkey_index ON library(albumkey);");
+	SQLRequest::Exec(db, "CREATE INDEX IF NOT EXISTS artistkey_index ON library(IFNULL(albumartistkey,artistkey));");
+	SQLRequest::Exec(db, "CREATE INDEX IF NOT EXISTS albumartistkey_index ON library(albumartistkey);");
+
+	// The keys were computed by triggers before, it was an additional UPDATE for each added track
+	SQLRequest::Exec(db, "DROP TRIGGER IF EXISTS library_sortkey_insert;");
+	SQLRequest::Exec(db, "DROP TRIGGER IF EXISTS library_sortkey_update;");
+
+	SQLRequest::Exec(db, "CREATE TABLE IF NOT EXISTS sortkey (version TEXT);");
+}
+
+std::string DBase::SortKeyVersion()
+{
+	// Sort keys depend on the user locale and on the version of NLS sorting tables,
+	// the keys stored with other locale or NLS version cannot be compared with new keys.
+	std::string version = std::to_string(::GetUserDefaultLCID());
+
+	NLSVERSIONINFO info = {};
+	info.dwNLSVersionInfoSize = sizeof(NLSVERSIONINFO);
+	if (futureWin->IsVistaOrLater() && futureWin->GetNLSVersion(COMPARE_STRING, LOCALE_USER_DEFAULT, &info))
+	{
+		version.push_back(':');
+		version += std::to_string(info.dwNLSVersion);
+		version.push_back(':');
+		version += std::to_string(info.dwDefinedVersion);
+	}
+	else
+		version += ":xp";
+
+	return version;
+}
+
+void DBase::UpdateSortKeys(const SQLFile& db)
+{
+	std::string version = SortKeyVersion();
+
+	SQLRequest sqlSelect(db, "SELECT version FROM sortkey;");
+	if (sqlSelect.StepRow() && sqlSelect.ColumnText8(0) == version)
+		return;
+	sqlSelect.Finalize();
+
+	// Rebuild all keys, it happens only when a new library is created, the old library is updated
+	// or the locale/OS was changed
+	SQLRequest::Exec(db, "BEGIN;");
+
+	SQLRequest::Exec(db, "UPDATE library SET titlekey=SORTKEY(title),albumkey=SORTKEY(album),"
+		"artistkey=SORTKEY(artist),albumartistkey=SORTKEY(albumartist);");
+
+	SQLRequest::Exec(db, "DELETE FROM sortkey;");
+
+	SQLRequest sqlInsert(db, "INSERT INTO sortkey (version) VALUES (?);");
+	sqlInsert.BindText8(1, version);
+	sqlInsert.Step();
+	sqlInsert.Finalize();
+
 	SQLRequest::Exec(db, "COMMIT;");
 }
 
@@ -571,6 +551,125 @@ void DBase::CreateTableCue(const SQLFile& db)
 	SQLRequest::Exec(db, "COMMIT;");
 }
 
+bool DBase::CreateTableSearch(const SQLFile& db)
+{
+	// The index of the previous version was folded by FTS5 itself, it finds other rows than LIKECASE
+	if (SQLRequest::ExecRow(db, "SELECT name FROM sqlite_master WHERE type='table' AND name='library_fts' AND sql NOT LIKE '%case_sensitive%';"))
+	{
+		SQLRequest::Exec(db, "BEGIN;");
+		SQLRequest::Exec(db, "DROP TRIGGER IF EXISTS library_fts_insert;");
+		SQLRequest::Exec(db, "DROP TRIGGER IF EXISTS library_fts_delete;");
+		SQLRequest::Exec(db, "DROP TRIGGER IF EXISTS library_fts_update;");
+		SQLRequest::Exec(db, "DROP TABLE library_fts;");
+		SQLRequest::Exec(db, "COMMIT;");
+	}
+
+	// Search index already created
+	if (SQLRequest::ExecRow(db, "SELECT name FROM sqlite_master WHERE type='table' AND name='library_fts';"))
+	{
+		UpdateTableSearch(db);
+		return true;
+	}
+
+	SQLRequest::Exec(db, "BEGIN;");
+
+	// Contentless table, the text is stored only in the library table.
+	// Trigram tokenizer allows to find any substring (like LIKECASE collation does) by the index.
+	// The text is folded by FOLDCASE the same way as LIKECASE ignores case (and the search value
+	// in SearchMatch), so the tokenizer is case sensitive.
+	if (!SQLRequest::ExecDone(db,
+		"CREATE VIRTUAL TABLE library_fts USING fts5("
+		"title,album,artist,albumartist,composer,genre,"
+		"content='',tokenize='trigram case_sensitive 1');"))
+	{
+		// SQLite is compiled without FTS5 or too old for trigram tokenizer, search without the index
+		SQLRequest::Exec(db, "ROLLBACK;");
+		return false;
+	}
+
+	// Keep the index in sync with all changes of the library (add, rescan, tag editor, delete)
+	SQLRequest::Exec(db,
+		"CREATE TRIGGER IF NOT EXISTS library_fts_insert AFTER INSERT ON library BEGIN"
+		" INSERT INTO library_fts (rowid,title,album,artist,albumartist,composer,genre)"
+		" VALUES (new.id,FOLDCASE(new.title),FOLDCASE(new.album),FOLDCASE(new.artist),"
+		"FOLDCASE(new.albumartist),FOLDCASE(new.composer),FOLDCASE(new.genre));"
+		" END;");
+
+	// The delete command of a contentless table needs the same values that were indexed
+	SQLRequest::Exec(db,
+		"CREATE TRIGGER IF NOT EXISTS library_fts_delete AFTER DELETE ON library BEGIN"
+		" INSERT INTO library_fts (library_fts,rowid,title,album,artist,albumartist,composer,genre)"
+		" VALUES ('delete',old.id,FOLDCASE(old.title),FOLDCASE(old.album),FOLDCASE(old.artist),"
+		"FOLDCASE(old.albumartist),FOLDCASE(old.composer),FOLDCASE(old.genre));"
+		" END;");
+
+	SQLRequest::Exec(db,
+		"CREATE TRIGGER IF NOT EXISTS library_fts_update AFTER UPDATE OF title,album,artist,albumartist,composer,genre ON library BEGIN"
+		" INSERT INTO library_fts (library_fts,rowid,title,album,artist,albumartist,composer,genre)"
+		" VALUES ('delete',old.id,FOLDCASE(old.title),FOLDCASE(old.album),FOLDCASE(old.artist),"
+		"FOLDCASE(old.albumartist),FOLDCASE(old.composer),FOLDCASE(old.genre));"
+		" INSERT INTO library_fts (rowid,title,album,artist,albumartist,composer,genre)"
+		" VALUES (new.id,FOLDCASE(new.title),FOLDCASE(new.album),FOLDCASE(new.artist),"
+		"FOLDCASE(new.albumartist),FOLDCASE(new.composer),FOLDCASE(new.genre));"
+		" END;");
+
+	SQLRequest::Exec(db, "CREATE TABLE IF NOT EXISTS searchfold (version TEXT);");
+	SQLRequest::Exec(db, "DELETE FROM searchfold;");
+
+	SQLRequest::Exec(db, "COMMIT;");
+
+	// Index tracks of the existing library
+	UpdateTableSearch(db);
+
+	return true;
+}
+
+void DBase::UpdateTableSearch(const SQLFile& db)
+{
+	// Folded text depends on the user locale the same as sort keys
+	std::string version = SortKeyVersion();
+
+	SQLRequest sqlSelect(db, "SELECT version FROM searchfold;");
+	if (sqlSelect.StepRow() && sqlSelect.ColumnText8(0) == version)
+		return;
+	sqlSelect.Finalize();
+
+	// Refill the index, it happens only when the index is created or the locale/OS was changed
+	SQLRequest::Exec(db, "BEGIN;");
+
+	SQLRequest::Exec(db, "INSERT INTO library_fts (library_fts) VALUES ('delete-all');");
+	SQLRequest::Exec(db,
+		"INSERT INTO library_fts (rowid,title,album,artist,albumartist,composer,genre)"
+		" SELECT id,FOLDCASE(title),FOLDCASE(album),FOLDCASE(artist),"
+		"FOLDCASE(albumartist),FOLDCASE(composer),FOLDCASE(genre) FROM library;");
+
+	SQLRequest::Exec(db, "DELETE FROM searchfold;");
+
+	SQLRequest sqlInsert(db, "INSERT INTO searchfold (version) VALUES (?);");
+	sqlInsert.BindText8(1, version);
+	sqlInsert.Step();
+	sqlInsert.Finalize();
+
+	SQLRequest::Exec(db, "COMMIT;");
+}
+
+std::wstring DBase::SearchMatch(const char* columns, const std::wstring& value)
+{
+	// Column filter and the value as a phrase, so the value is searched as is (quotes are doubled).
+	// The value is folded the same way as the text in the index.
+	std::wstring match = UTF::UTF16(columns);
+	match += L" : \"";
+	for (wchar_t c : FoldCaseString(value.c_str(), (int)value.size()))
+	{
+		if (c == '"')
+			match.push_back('"');
+		match.push_back(c);
+	}
+	match.push_back('"');
+
+	return match;
+}
+
 TreeNodeUnsafe DBase::CreatePlaylist(SkinTree* skinTree, const std::wstring& name, bool isDefault)
 {
 	if (skinTree == nullptr)
@@ -736,11 +835,14 @@ void DBase::DeletePlaylist(SkinTree* skinTree)
 
 bool DBase::AddFileToLibrary(DATABASE_SONGINFO* tags)
 {
-	SQLRequest sqlInsert(dbLibrary,
+	SQLRequest sqlInsert;
+	sqlInsert.PrepareCached(dbLibrary,
 		"INSERT INTO library (flag,added,cue,filehash,path,file,filesize,modified,trackhash,track,totaltracks,"
 		"disc,totaldiscs,title,album,artist,albumartist,composer,genre,year,bpm,compilation,publisher,conductor,lyricist,"
-		"remixer,grouping,subtitle,copyright,encodedby,comment,duration,channels,bitrate,samplerate)"
-		" VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);");
+		"remixer,grouping,subtitle,copyright,encodedby,comment,duration,channels,bitrate,samplerate,"
+		"titlekey,albumkey,artistkey,albumartistkey)"
+		" VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,"
+		"SORTKEY(?14),SORTKEY(?15),SORTKEY(?16),SORTKEY(?17));"); // Sort keys of title, album, artist, album artist
 
 
 	// 1. Update flag
@@ -930,7 +1032,8 @@ bool DBase::AddFileToLibrary(DATABASE_SONGINFO* tags)
 	{
 		libraryLastInsertID = (long long)sqlite3_last_insert_rowid(dbLibrary.get());
 
-		SQLRequest sqlDeleteM(dbLibrary,
+		SQLRequest sqlDeleteM;
+		sqlDeleteM.PrepareCached(dbLibrary,
 			"DELETE FROM storage WHERE sid=?");
 		sqlDeleteM.BindInt64(1, libraryLastInsertID);
 		sqlDeleteM.Step();
@@ -938,7 +1041,8 @@ bool DBase::AddFileToLibrary(DATABASE_SONGINFO* tags)
 		if (!tags->genres.empty() || !tags->artists.empty() || !tags->composers.empty() ||
 			!tags->albumArtists.empty() || !tags->conductors.empty() || !tags->lyricists.empty())
 		{
-			SQLRequest sqlInsertM(dbLibrary,
+			SQLRequest sqlInsertM;
+			sqlInsertM.PrepareCached(dbLibrary,
 				"INSERT INTO storage (sid,sidx,skey,svalue) VALUES (?,?,?,?);");
 
 			InsertMultipleValues(libraryLastInsertID, sqlInsertM, tags);
@@ -950,7 +1054,8 @@ bool DBase::AddFileToLibrary(DATABASE_SONGINFO* tags)
 
 bool DBase::AddFileToPlaylist(int index, DATABASE_SONGINFO* tags, bool isTemp)
 {
-	SQLRequest sqlInsert(!isTemp ? dbPlaylist : dbPlayTemp,
+	SQLRequest sqlInsert;
+	sqlInsert.PrepareCached(!isTemp ? dbPlaylist : dbPlayTemp,
 		"INSERT INTO playlist (idx,added,cue,filehash,path,file,filesize,modified,trackhash,track,totaltracks,"
 		"disc,totaldiscs,title,album,artist,albumartist,composer,genre,year,bpm,compilation,publisher,conductor,lyricist,"
 		"remixer,grouping,subtitle,copyright,encodedby,comment,duration,channels,bitrate,samplerate)"
@@ -1150,7 +1255,8 @@ bool DBase::AddFileToPlaylist(int index, DATABASE_SONGINFO* tags, bool isTemp)
 		if (!tags->genres.empty() || !tags->artists.empty() || !tags->composers.empty() ||
 			!tags->albumArtists.empty() || !tags->conductors.empty() || !tags->lyricists.empty())
 		{
-			SQLRequest sqlInsertM(!isTemp ? dbPlaylist : dbPlayTemp,
+			SQLRequest sqlInsertM;
+			sqlInsertM.PrepareCached(!isTemp ? dbPlaylist : dbPlayTemp,
 				"INSERT INTO storage (sid,sidx,skey,svalue) VALUES (?,?,?,?);");
 
 			InsertMultipleValues(lastInsert, sqlInsertM, tags);
@@ -1232,10 +1338,12 @@ void DBase::UpdateTagsModified(long long id, DATABASE_SONGINFO* tags)
 	// We skip "file" and "added" because the file was just updated.
 	// Note: We do not change any ratings.
 
-	SQLRequest sqlUpdate(dbLibrary,
+	SQLRequest sqlUpdate;
+	sqlUpdate.PrepareCached(dbLibrary,
 		"UPDATE library SET flag=?,cue=?,filesize=?,modified=?,trackhash=?,track=?,totaltracks=?,disc=?,totaldiscs=?,"
 		"title=?,album=?,artist=?,albumartist=?,composer=?,genre=?,year=?,bpm=?,compilation=?,publisher=?,conductor=?,lyricist=?,"
-		"remixer=?,grouping=?,subtitle=?,copyright=?,encodedby=?,comment=?,duration=?,channels=?,bitrate=?,samplerate=? WHERE id=?;");
+		"remixer=?,grouping=?,subtitle=?,copyright=?,encodedby=?,comment=?,duration=?,channels=?,bitrate=?,samplerate=?,"
+		"titlekey=SORTKEY(?10),albumkey=SORTKEY(?11),artistkey=SORTKEY(?12),albumartistkey=SORTKEY(?13) WHERE id=?;");
 
 	// 17. Track ID which we update
 	sqlUpdate.BindInt64(32, id);
@@ -1411,7 +1519,8 @@ void DBase::UpdateTagsModified(long long id, DATABASE_SONGINFO* tags)
 	{
 		long long lastInsert = (long long)sqlite3_last_insert_rowid(dbLibrary.get());
 
-		SQLRequest sqlDeleteM(dbLibrary,
+		SQLRequest sqlDeleteM;
+		sqlDeleteM.PrepareCached(dbLibrary,
 			"DELETE FROM storage WHERE sid=?");
 		sqlDeleteM.BindInt64(1, lastInsert);
 		sqlDeleteM.Step();
@@ -1419,7 +1528,8 @@ void DBase::UpdateTagsModified(long long id, DATABASE_SONGINFO* tags)
 		if (!tags->genres.empty() || !tags->artists.empty() || !tags->composers.empty() ||
 			!tags->albumArtists.empty() || !tags->conductors.empty() || !tags->lyricists.empty())
 		{
-			SQLRequest sqlInsertM(dbLibrary,
+			SQLRequest sqlInsertM;
+			sqlInsertM.PrepareCached(dbLibrary,
 				"INSERT INTO storage (sid,sidx,skey,svalue) VALUES (?,?,?,?);");
 
 			InsertMultipleValues(lastInsert, sqlInsertM, tags);
@@ -1432,10 +1542,12 @@ void DBase::UpdateTagsFileMove(long long id, DATABASE_SONGINFO* tags)
 	// Update tags because a file was moved
 	// Note: We do not change any ratings.
 
-	SQLRequest sqlUpdate(dbLibrary,
+	SQLRequest sqlUpdate;
+	sqlUpdate.PrepareCached(dbLibrary,
 		"UPDATE library SET flag=?,added=?,cue=?,filehash=?,path=?,file=?,filesize=?,modified=?,trackhash=?,track=?,totaltracks=?,disc=?,totaldiscs=?,"
 		"title=?,album=?,artist=?,albumartist=?,composer=?,genre=?,year=?,bpm=?,compilation=?,publisher=?,conductor=?,lyricist=?,"
-		"remixer=?,grouping=?,subtitle=?,copyright=?,encodedby=?,comment=?,duration=?,channels=?,bitrate=?,samplerate=? WHERE id=?;");
+		"remixer=?,grouping=?,subtitle=?,copyright=?,encodedby=?,comment=?,duration=?,channels=?,bitrate=?,samplerate=?,"
+		"titlekey=SORTKEY(?14),albumkey=SORTKEY(?15),artistkey=SORTKEY(?16),albumartistkey=SORTKEY(?17) WHERE id=?;");
 
 
 	// 26. Track ID which we update
@@ -1624,7 +1736,8 @@ void DBase::UpdateTagsFileMove(long long id, DATABASE_SONGINFO* tags)
 	{
 		long long lastInsert = (long long)sqlite3_last_insert_rowid(dbLibrary.get());
 
-		SQLRequest sqlDeleteM(dbLibrary,
+		SQLRequest sqlDeleteM;
+		sqlDeleteM.PrepareCached(dbLibrary,
 			"DELETE FROM storage WHERE sid=?");
 		sqlDeleteM.BindInt64(1, lastInsert);
 		sqlDeleteM.Step();
@@ -1632,7 +1745,8 @@ void DBase::UpdateTagsFileMove(long long id, DATABASE_SONGINFO* tags)
 		if (!tags->genres.empty() || !tags->artists.empty() || !tags->composers.empty() ||
 			!tags->albumArtists.empty() || !tags->conductors.empty() || !tags->lyricists.empty())
 		{
-			SQLRequest sqlInsertM(dbLibrary,
+			SQLRequest sqlInsertM;
+			sqlInsertM.PrepareCached(dbLibrary,
 				"INSERT INTO storage (sid,sidx,skey,svalue) VALUES (?,?,?,?);");
 
 			InsertMultipleValues(lastInsert, sqlInsertM, tags);
@@ -1642,7 +1756,8 @@ void DBase::UpdateTagsFileMove(long long id, DATABASE_SONGINFO* tags)
 
 void DBase::SetUpdateCueOK(long long id)
 {
-	SQLRequest sqlUpdate(dbCue,
+	SQLRequest sqlUpdate;
+	sqlUpdate.PrepareCached(dbCue,
 		"UPDATE memflag SET fflag=NULL WHERE fid=? AND fflag=1;");
 
 	sqlUpdate.BindInt64(1, id);
@@ -1652,7 +1767,8 @@ void DBase::SetUpdateCueOK(long long id)
 void DBase::AddCueFile(bool noDrive, const std::wstring& path, const std::wstring& file,
 	int hash, long long size, long long modified, const std::wstring& refFile, int refHash)
 {
-	SQLRequest sqlInsert(dbCue,
+	SQLRequest sqlInsert;
+	sqlInsert.PrepareCached(dbCue,
 		"INSERT INTO cue (filehash,path,file,filesize,modified,refhash,reffile) VALUES (?,?,?,?,?,?,?);");
 
 	sqlInsert.BindInt(1, hash);
@@ -1683,7 +1799,8 @@ void DBase::AddCueFile(bool noDrive, const std::wstring& path, const std::wstrin
 
 void DBase::UpdateCueFile(long long id, long long size, long long modified, const std::wstring& refFile, int refHash)
 {
-	SQLRequest sqlUpdate(dbCue,
+	SQLRequest sqlUpdate;
+	sqlUpdate.PrepareCached(dbCue,
 		"UPDATE cue SET filesize=?,modified=?,refhash=?,reffile=? WHERE id=?;");
 
 	sqlUpdate.BindInt64(5, id);
@@ -1706,7 +1823,8 @@ void DBase::UpdateCueFile(long long id, long long size, long long modified, cons
 bool DBase::UpdateCueLibrary(bool noDrive, const std::wstring& path, const std::wstring& file, int hash)
 {
 	// Update library
-	SQLRequest sqlSelectLib(dbLibrary,
+	SQLRequest sqlSelectLib;
+	sqlSelectLib.PrepareCached(dbLibrary,
 		"SELECT id,cue FROM library WHERE filehash=? AND file=? COLLATE FILECASE AND path=? COLLATE FILECASE;");
 
 	sqlSelectLib.BindInt(1, hash);
@@ -1732,7 +1850,8 @@ bool DBase::UpdateCueLibrary(bool noDrive, const std::wstring& path, const std::
 		// DeleteCueImage do the same job, but to make sure also use this
 		if (sqlSelectLib.ColumnIsNull(1))
 		{
-			SQLRequest sqlDeleteLib(dbLibrary,
+			SQLRequest sqlDeleteLib;
+			sqlDeleteLib.PrepareCached(dbLibrary,
 				"DELETE FROM library WHERE id=?;");
 
 			sqlDeleteLib.BindInt64(1, id);
@@ -1745,7 +1864,8 @@ bool DBase::UpdateCueLibrary(bool noDrive, const std::wstring& path, const std::
 
 bool DBase::DeleteCueImage(bool noDrive, const std::wstring& path, const std::wstring& file, int hash)
 {
-	SQLRequest sqlDelete(dbLibrary,
+	SQLRequest sqlDelete;
+	sqlDelete.PrepareCached(dbLibrary,
 		"DELETE FROM library WHERE filehash=? AND cue IS NULL AND file=? COLLATE FILECASE AND path=? COLLATE FILECASE;");
 
 	sqlDelete.BindInt(1, hash);
@@ -1765,7 +1885,8 @@ bool DBase::DeleteCueImage(bool noDrive, const std::wstring& path, const std::ws
 bool DBase::CheckCueFile(bool noDrive, const std::wstring& path, const std::wstring& file,
 	int hash, long long size, long long modified, long long& outID, bool flag, bool isRescanAll)
 {
-	SQLRequest sqlSelect(dbCue,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbCue,
 		"SELECT id,filesize,modified,refhash,reffile FROM cue WHERE filehash=? AND file=? COLLATE FILECASE AND path=? COLLATE FILECASE LIMIT 1;");
 
 	sqlSelect.BindInt(1, hash);
@@ -1812,7 +1933,8 @@ bool DBase::CheckFile(bool noDrive, const std::wstring& path, const std::wstring
 	else
 		select = "SELECT id,cue,filesize,modified FROM library WHERE filehash=?1 AND cue=?4 AND file=?2 COLLATE FILECASE AND path=?3 COLLATE FILECASE LIMIT 1;";
 
-	SQLRequest sqlSelect(dbLibrary, select);
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibrary, select);
 
 	sqlSelect.BindInt(1, hash);
 	sqlSelect.BindText16(2, file);
@@ -1849,7 +1971,8 @@ bool DBase::CheckTags(long long& outID, DATABASE_SONGINFO* tags)
 	else
 		select = "SELECT id FROM library,memflag WHERE trackhash=? AND id=fid AND fflag=1 AND file IS ? AND album IS ? AND artist IS ? AND year IS ? AND track IS ? AND disc IS ? LIMIT 1;";
 
-	SQLRequest sqlSelect(dbLibrary, select);
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibrary, select);
 
 	sqlSelect.BindInt(1, tags->trackHash);
 
@@ -1962,6 +2085,10 @@ void DBase::MemFlagAttach()
 
 void DBase::MemFlagDetach()
 {
+	// Cached statements that use memflag table are useless without memory_db
+	dbLibrary.ClearCache();
+	dbCue.ClearCache();
+
 	SQLRequest::Exec(dbLibrary, "DETACH DATABASE memory_db;");
 	SQLRequest::Exec(dbCue, "DETACH DATABASE memory_db;");
 }
@@ -2011,7 +2138,8 @@ void DBase::SetUpdateEndCue()
 
 void DBase::SetUpdateOK(long long id)
 {
-	SQLRequest sqlUpdate(dbLibrary,
+	SQLRequest sqlUpdate;
+	sqlUpdate.PrepareCached(dbLibrary,
 		"UPDATE memflag SET fflag=NULL WHERE fid=? AND fflag=1;");
 
 	sqlUpdate.BindInt64(1, id);
@@ -2091,12 +2219,18 @@ bool DBase::IsLibraryEmpty()
 
 void DBase::Begin()
 {
+	LockGuard lock(mutexTransaction);
 	SQLRequest::Exec(dbLibrary, "BEGIN;");
 }
 
 void DBase::Commit()
 {
+	mutexTransaction.Lock();
 	SQLRequest::Exec(dbLibrary, "COMMIT;");
+	mutexTransaction.Unlock();
+
+	// Write the updates that wait for the end of the transaction (see WriteStats)
+	eventStats.Set();
 }
 
 void DBase::Vacuum()
@@ -2106,11 +2240,13 @@ void DBase::Vacuum()
 
 void DBase::PlayBegin()
 {
+	LockGuard lock(mutexTransaction);
 	SQLRequest::Exec(dbPlaylist, "BEGIN;");
 }
 
 void DBase::PlayCommit()
 {
+	LockGuard lock(mutexTransaction);
 	SQLRequest::Exec(dbPlaylist, "COMMIT;");
 }
 
@@ -2135,117 +2271,244 @@ void DBase::SetRating(long long idLibrary, long long idPlaylist, int rating, boo
 	rating = std::max(0, std::min(5, rating));
 	rating *= 20;
 
-	if (idLibrary && dbLibrary) // Set rating in the library
-	{
-		SQLRequest sqlUpdate(dbLibrary,
-			"UPDATE library SET rating=? WHERE id=?;");
+	StatsUpdate* update = nullptr;
 
-		sqlUpdate.BindInt(1, rating);
-		sqlUpdate.BindInt64(2, idLibrary);
+	mutexStats.Lock();
 
-		sqlUpdate.Step();
-	}
+	if (idLibrary && dbLibrary) // Set rating in the library
+		update = &statsLibrary[idLibrary];
 	else if (idPlaylist) // Set rating in the playlist
 	{
 		if (isPlay && dbPlayOpen) // In the playing playlist
-		{
-			SQLRequest sqlUpdate(dbPlayOpen,
-				"UPDATE playlist SET rating=? WHERE id=?;");
-
-			sqlUpdate.BindInt(1, rating);
-			sqlUpdate.BindInt64(2, idPlaylist);
-
-			sqlUpdate.Step();
-		}
+			update = &statsPlayOpen[idPlaylist];
 		else if (dbPlaylist) // In the current playlist
-		{
-			SQLRequest sqlUpdate(dbPlaylist,
-				"UPDATE playlist SET rating=? WHERE id=?;");
-
-			sqlUpdate.BindInt(1, rating);
-			sqlUpdate.BindInt64(2, idPlaylist);
+			update = &statsPlaylist[idPlaylist];
+	}
 
-			sqlUpdate.Step();
-		}
+	if (update)
+	{
+		update->isRating = true;
+		update->rating = rating;
 	}
+
+	mutexStats.Unlock();
+
+	if (update)
+		eventStats.Set();
 }
 
 void DBase::IncreaseCount(long long idLibrary, long long idPlaylist)
 {
 	long long timeNow = FileSystem::GetTimeNow();
 
+	StatsUpdate* update = nullptr;
+
+	mutexStats.Lock();
+
 	if (idLibrary && dbLibrary) // Increase play count in the library
+		update = &statsLibrary[idLibrary];
+	else if (idPlaylist && dbPlayOpen) // Increase play count in the playing playlist
+		update = &statsPlayOpen[idPlaylist];
+
+	if (update)
 	{
-		SQLRequest sqlUpdate(dbLibrary,
-			"UPDATE library SET playcount=IFNULL(playcount,0)+1,lastplayed=? WHERE id=?;");
+		update->playCount++;
+		update->lastPlayed = timeNow;
+	}
 
-		sqlUpdate.BindInt64(1, timeNow);
-		sqlUpdate.BindInt64(2, idLibrary);
+	mutexStats.Unlock();
 
-		sqlUpdate.Step();
+	if (update)
+		eventStats.Set();
+}
+
+void DBase::IncreaseSkip(long long idLibrary, long long idPlaylist)
+{
+	long long timeNow = FileSystem::GetTimeNow();
+
+	StatsUpdate* update = nullptr;
+
+	mutexStats.Lock();
+
+	if (idLibrary && dbLibrary) // Increase skip count in the library
+		update = &statsLibrary[idLibrary];
+	else if (idPlaylist && dbPlayOpen) // Increase skip count in the playing playlist
+		update = &statsPlayOpen[idPlaylist];
+
+	if (update)
+	{
+		update->skipCount++;
+		update->lastSkipped = timeNow;
 	}
-	else if (idPlaylist) // Increase play count in the playlist
+
+	mutexStats.Unlock();
+
+	if (update)
+		eventStats.Set();
+}
+
+void DBase::ThreadStats()
+{
+	while (!isStopStats)
 	{
-		if (dbPlayOpen) // In the playing playlist
+		eventStats.Wait();
+
+		// Wait while updates are coming (track changes quickly etc.)
+		auto timeStart = std::chrono::steady_clock::now();
+		while (!isStopStats && eventStats.TryWait(statsIdleDelay))
 		{
-			SQLRequest sqlUpdate(dbPlayOpen,
-				"UPDATE playlist SET playcount=IFNULL(playcount,0)+1,lastplayed=? WHERE id=?;");
+			if (std::chrono::steady_clock::now() - timeStart > std::chrono::milliseconds(statsMaxDelay))
+				break;
+		}
 
-			sqlUpdate.BindInt64(1, timeNow);
-			sqlUpdate.BindInt64(2, idPlaylist);
+		FlushStats();
+	}
+}
 
-			sqlUpdate.Step();
-		}
-		/*else if (dbPlaylist) // In the current playlist
-		{
-			SQLRequest sqlUpdate(dbPlaylist,
-				"UPDATE playlist SET playcount=IFNULL(playcount,0)+1,lastplayed=? WHERE id=?;");
+void DBase::FlushStats()
+{
+	LockGuard lockWrite(mutexStatsWrite);
 
-			sqlUpdate.BindInt64(1, timeNow);
-			sqlUpdate.BindInt64(2, idPlaylist);
+	StatsMap library;
+	StatsMap playOpen;
+	StatsMap playlist;
 
-			sqlUpdate.Step();
-		}*/
+	mutexStats.Lock();
+	library.swap(statsLibrary);
+	playOpen.swap(statsPlayOpen);
+	playlist.swap(statsPlaylist);
+	mutexStats.Unlock();
+
+	if (library.empty() || !dbLibrary || WriteStats(dbLibrary, library, true))
+		library.clear();
+	if (playOpen.empty() || !dbPlayOpen || WriteStats(dbPlayOpen, playOpen, false))
+		playOpen.clear();
+	if (playlist.empty() || !dbPlaylist || WriteStats(dbPlaylist, playlist, false))
+		playlist.clear();
+
+	// Return the updates that are not written to the queue, new updates could come already
+	if (!library.empty())
+	{
+		mutexStats.Lock();
+		MergeStats(statsLibrary, library);
+		mutexStats.Unlock();
 	}
 }
 
-void DBase::IncreaseSkip(long long idLibrary, long long idPlaylist)
+void DBase::GetPendingRatings(std::unordered_map<long long, int>& outRatings)
 {
-	long long timeNow = FileSystem::GetTimeNow();
+	LockGuard lock(mutexStats);
 
-	if (idLibrary && dbLibrary) // Increase skip count in the library
+	for (const auto& stat : statsLibrary)
 	{
-		SQLRequest sqlUpdate(dbLibrary,
-			"UPDATE library SET skipcount=IFNULL(skipcount,0)+1,lastskipped=? WHERE id=?;");
+		if (stat.second.isRating)
+			outRatings[stat.first] = stat.second.rating;
+	}
+}
 
-		sqlUpdate.BindInt64(1, timeNow);
-		sqlUpdate.BindInt64(2, idLibrary);
+void DBase::GetPendingRating(const std::unordered_map<long long, int>& ratings, long long idLibrary, int& rating)
+{
+	auto find = ratings.find(idLibrary);
+	if (find != ratings.end())
+		rating = find->second;
+}
 
-		sqlUpdate.Step();
+void DBase::MergeStats(StatsMap& stats, StatsMap& statsOld)
+{
+	for (auto& stat : statsOld)
+	{
+		auto result = stats.emplace(stat.first, stat.second);
+		if (result.second)
+			continue;
+
+		// Merge with the newer update
+		StatsUpdate& update = result.first->second;
+		const StatsUpdate& updateOld = stat.second;
+
+		if (!update.isRating && updateOld.isRating)
+		{
+			update.isRating = true;
+			update.rating = updateOld.rating;
+		}
+		if (updateOld.playCount)
+		{
+			update.playCount += updateOld.playCount;
+			update.lastPlayed = std::max(update.lastPlayed, updateOld.lastPlayed);
+		}
+		if (updateOld.skipCount)
+		{
+			update.skipCount += updateOld.skipCount;
+			update.lastSkipped = std::max(update.lastSkipped, updateOld.lastSkipped);
+		}
 	}
-	else if (idPlaylist) // Increase skip count in the playlist
+}
+
+bool DBase::WriteStats(const SQLFile& db, StatsMap& stats, bool isLibrary)
+{
+	// Return false if the updates are not written and must stay in the queue
+
+	LockGuard lock(mutexTransaction);
+
+	// If the scan is in a transaction then the updates of the library wait for Commit in the queue,
+	// in the transaction they would be hidden from dbLibraryRead until the end of the scan.
+	// Updates of playlists and all updates at exit go to the transaction so they are not lost
+	// or applied to another playlist.
+	bool isBegin = (sqlite3_get_autocommit(db.get()) != 0);
+
+	if (!isBegin && isLibrary && !isStopStats)
+		return false;
+
+	if (isBegin)
+		SQLRequest::Exec(db, "BEGIN;");
+
+	for (const auto& stat : stats)
 	{
-		if (dbPlayOpen) // In the playing playlist
+		const StatsUpdate& update = stat.second;
+
+		if (update.isRating)
+		{
+			SQLRequest sqlUpdate;
+			sqlUpdate.PrepareCached(db, isLibrary ?
+				"UPDATE library SET rating=? WHERE id=?;" :
+				"UPDATE playlist SET rating=? WHERE id=?;");
+
+			sqlUpdate.BindInt(1, update.rating);
+			sqlUpdate.BindInt64(2, stat.first);
+
+			sqlUpdate.Step();
+		}
+		if (update.playCount)
 		{
-			SQLRequest sqlUpdate(dbPlayOpen,
-				"UPDATE playlist SET skipcount=IFNULL(skipcount,0)+1,lastskipped=? WHERE id=?;");
+			SQLRequest sqlUpdate;
+			sqlUpdate.PrepareCached(db, isLibrary ?
+				"UPDATE library SET playcount=IFNULL(playcount,0)+?,lastplayed=? WHERE id=?;" :
+				"UPDATE playlist SET playcount=IFNULL(playcount,0)+?,lastplayed=? WHERE id=?;");
 
-			sqlUpdate.BindInt64(1, timeNow);
-			sqlUpdate.BindInt64(2, idPlaylist);
+			sqlUpdate.BindInt(1, update.playCount);
+			sqlUpdate.BindInt64(2, update.lastPlayed);
+			sqlUpdate.BindInt64(3, stat.first);
 
 			sqlUpdate.Step();
 		}
-		/*else if (dbPlaylist) // In the current playlist
+		if (update.skipCount)
 		{
-			SQLRequest sqlUpdate(dbPlaylist,
-				"UPDATE playlist SET skipcount=IFNULL(skipcount,0)+1,lastskipped=? WHERE id=?;");
+			SQLRequest sqlUpdate;
+			sqlUpdate.PrepareCached(db, isLibrary ?
+				"UPDATE library SET skipcount=IFNULL(skipcount,0)+?,lastskipped=? WHERE id=?;" :
+				"UPDATE playlist SET skipcount=IFNULL(skipcount,0)+?,lastskipped=? WHERE id=?;");
 
-			sqlUpdate.BindInt64(1, timeNow);
-			sqlUpdate.BindInt64(2, idPlaylist);
+			sqlUpdate.BindInt(1, update.skipCount);
+			sqlUpdate.BindInt64(2, update.lastSkipped);
+			sqlUpdate.BindInt64(3, stat.first);
 
 			sqlUpdate.Step();
-		}*/
+		}
 	}
+
+	if (isBegin)
+		SQLRequest::Exec(db, "COMMIT;");
+
+	return true;
 }
 
 void DBase::GetSongTags(long long idLibrary, long long idPlaylist, std::wstring& file, std::wstring& title,
@@ -2292,13 +2555,123 @@ void DBase::GetSongTags(long long idLibrary, long long idPlaylist, std::wstring&
 	}
 }
 
+void DBase::GetReplayGainAlbums(std::vector<std::vector<ReplayGainTrack>>& outAlbums)
+{
+	outAlbums.clear();
+
+	SQLRequest sqlSelect(dbLibrary,
+		"SELECT id,cue,path,file,filesize,modified,album,albumartist,replaygain FROM library"
+		" WHERE deleted IS NULL ORDER BY path,file;");
+
+	std::unordered_map<std::wstring, std::size_t> albums;
+
+	while (sqlSelect.StepRow())
+	{
+		ReplayGainTrack track;
+		track.id = sqlSelect.ColumnInt64(0);
+		track.cue = sqlSelect.ColumnInt64(1);
+		track.file = sqlSelect.ColumnText16(2);
+		if (isPortableVersion && !track.file.empty() && track.file[0] == '?')
+			track.file[0] = programPath[0];
+		track.size = sqlSelect.ColumnInt64(4);
+		track.modified = sqlSelect.ColumnInt64(5);
+		sqlSelect.ColumnText8(8, track.replayGain);
+
+		// Tracks without album are albums of one track
+		if (sqlSelect.ColumnIsNull(6))
+		{
+			track.file += sqlSelect.ColumnText16(3);
+			outAlbums.emplace_back();
+			outAlbums.back().push_back(std::move(track));
+			continue;
+		}
+
+		std::wstring key = StringEx::ToLowerUS(sqlSelect.ColumnText16(6)) + L'\n';
+		if (!sqlSelect.ColumnIsNull(7))
+			key += StringEx::ToLowerUS(sqlSelect.ColumnText16(7));
+		else
+			key += StringEx::ToLowerUS(track.file);
+
+		track.file += sqlSelect.ColumnText16(3);
+
+		auto find = albums.find(key);
+		if (find == albums.end())
+		{
+			albums.emplace(key, outAlbums.size());
+			outAlbums.emplace_back();
+			outAlbums.back().push_back(std::move(track));
+		}
+		else
+			outAlbums[find->second].push_back(std::move(track));
+	}
+}
+
+void DBase::SetReplayGain(long long idLibrary, const std::string& replayGain)
+{
+	SQLRequest sqlUpdate;
+	sqlUpdate.PrepareCached(dbLibrary,
+		"UPDATE library SET replaygain=? WHERE id=?;");
+
+	sqlUpdate.BindText8(1, replayGain);
+	sqlUpdate.BindInt64(2, idLibrary);
+
+	sqlUpdate.Step();
+
+	ReplayGain::Values values;
+	if (ReplayGain::FromString(replayGain, values))
+	{
+		mutexReplayGain.Lock();
+		replayGains[idLibrary] = values;
+		mutexReplayGain.Unlock();
+	}
+}
+
+bool DBase::GetReplayGain(long long idLibrary, ReplayGain::Values& outValues)
+{
+	bool result = false;
+
+	mutexReplayGain.Lock();
+	auto find = replayGains.find(idLibrary);
+	if (find != replayGains.end())
+	{
+		outValues = find->second;
+		result = true;
+	}
+	mutexReplayGain.Unlock();
+
+	return result;
+}
+
+void DBase::LoadReplayGains()
+{
+	std::unordered_map<long long, ReplayGain::Values> values;
+
+	SQLRequest sqlSelect(dbLibrary,
+		"SELECT id,replaygain FROM library WHERE replaygain IS NOT NULL;");
+
+	std::string replayGain;
+	while (sqlSelect.StepRow())
+	{
+		sqlSelect.ColumnText8(1, replayGain);
+
+		ReplayGain::Values value;
+		if (ReplayGain::FromString(replayGain, value))
+			values.emplace(sqlSelect.ColumnInt64(0), value);
+	}
+
+	mutexReplayGain.Lock();
+	replayGains.swap(values);
+	mutexReplayGain.Unlock();
+}
+
 void DBase::FillTreeAlbum(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		//"SELECT album FROM library WHERE deleted IS NULL GROUP BY album COLLATE MYCASE ORDER BY album COLLATE MYCASE;");
-		"SELECT DISTINCT album COLLATE MYCASE FROM library WHERE deleted IS NULL ORDER BY album COLLATE MYCASE;");
+		"SELECT album FROM library WHERE deleted IS NULL GROUP BY albumkey ORDER BY albumkey;");
 
 	FillTreeNode(skinTree, treeNode, sqlSelect);
 }
@@ -2307,15 +2680,16 @@ void DBase::FillTreeArtist(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		//"SELECT artist FROM library WHERE deleted IS NULL GROUP BY artist COLLATE MYCASE ORDER BY artist COLLATE MYCASE;");
 		//"SELECT DISTINCT IFNULL(albumartist,artist) COLLATE MYCASE FROM library WHERE deleted IS NULL ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE;");
 		"SELECT art FROM ("
-		"SELECT IFNULL(albumartist,artist) AS art FROM library WHERE deleted IS NULL"
+		"SELECT IFNULL(albumartist,artist) AS art,IFNULL(albumartistkey,artistkey) AS artkey FROM library WHERE deleted IS NULL"
 		" UNION ALL "
-		"SELECT svalue AS art FROM storage,library WHERE skey IN (1,2) AND sid=id AND deleted IS NULL"
+		"SELECT svalue AS art,SORTKEY(svalue) AS artkey FROM storage,library WHERE skey IN (1,2) AND sid=id AND deleted IS NULL"
 		" AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END"
-		") GROUP BY art COLLATE MYCASE ORDER BY art COLLATE MYCASE;");
+		") GROUP BY artkey ORDER BY artkey;");
 
 	FillTreeNode(skinTree, treeNode, sqlSelect);
 }
@@ -2324,7 +2698,8 @@ void DBase::FillTreeComposer(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT cmp FROM ("
 		"SELECT composer AS cmp FROM library WHERE deleted IS NULL"
 		" UNION ALL "
@@ -2338,7 +2713,8 @@ void DBase::FillTreeGenre(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		//"SELECT genre FROM library WHERE deleted IS NULL GROUP BY genre COLLATE MYCASE ORDER BY genre COLLATE MYCASE;");
 		//"SELECT DISTINCT genre COLLATE MYCASE FROM library WHERE deleted IS NULL ORDER BY genre COLLATE MYCASE;");
 		"SELECT gen FROM ("
@@ -2354,7 +2730,8 @@ void DBase::FillTreeYear(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		//"SELECT year FROM library WHERE deleted IS NULL GROUP BY year COLLATE MYCASE ORDER BY year DESC;");
 		"SELECT DISTINCT CAST(year AS INTEGER) FROM library WHERE deleted IS NULL ORDER BY CAST(year AS INTEGER) DESC;");
 
@@ -2416,11 +2793,12 @@ void DBase::FillTreeArtistAlbum(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT album FROM library WHERE deleted IS NULL"
 		" AND (IFNULL(albumartist,artist) IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage"
 		" WHERE skey IN (1,2) AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END AND svalue=?1 COLLATE MYCASE))"
-		" GROUP BY album COLLATE MYCASE ORDER BY album COLLATE MYCASE;");
+		" GROUP BY albumkey ORDER BY albumkey;");
 
 	if (!treeNode->GetValue().empty())
 		sqlSelect.BindText16(1, treeNode->GetValue());
@@ -2432,7 +2810,8 @@ void DBase::FillTreeComposerArtist(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT cmp FROM ("
 		"SELECT IFNULL(albumartist,artist) AS cmp FROM library WHERE deleted IS NULL"
 		" AND (composer IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage WHERE skey=3 AND svalue=?1 COLLATE MYCASE))"
@@ -2452,12 +2831,13 @@ void DBase::FillTreeComposerAlbum(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT album FROM library WHERE deleted IS NULL"
 		" AND (composer IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage WHERE skey=3 AND svalue=?1 COLLATE MYCASE))"
 		" AND (IFNULL(albumartist,artist) IS ?2 COLLATE MYCASE OR id IN (SELECT sid FROM storage"
 		" WHERE skey IN (1,2) AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END AND svalue=?2 COLLATE MYCASE))"
-		" GROUP BY album COLLATE MYCASE ORDER BY album COLLATE MYCASE;");
+		" GROUP BY albumkey ORDER BY albumkey;");
 
 	if (!treeNode->GetValue().empty())
 		sqlSelect.BindText16(1, treeNode->GetValue());
@@ -2472,15 +2852,16 @@ void DBase::FillTreeGenreArtist(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT art FROM ("
-		"SELECT IFNULL(albumartist,artist) AS art FROM library WHERE deleted IS NULL"
+		"SELECT IFNULL(albumartist,artist) AS art,IFNULL(albumartistkey,artistkey) AS artkey FROM library WHERE deleted IS NULL"
 		" AND (genre IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage WHERE skey=4 AND svalue=?1 COLLATE MYCASE))"
 		" UNION ALL "
-		"SELECT svalue AS art FROM storage,library WHERE skey IN (1,2) AND sid=id AND deleted IS NULL"
+		"SELECT svalue AS art,SORTKEY(svalue) AS artkey FROM storage,library WHERE skey IN (1,2) AND sid=id AND deleted IS NULL"
 		" AND (genre IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage WHERE skey=4 AND svalue=?1 COLLATE MYCASE))"
 		" AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END"
-		") GROUP BY art COLLATE MYCASE ORDER BY art COLLATE MYCASE;");
+		") GROUP BY artkey ORDER BY artkey;");
 
 	if (!treeNode->GetValue().empty())
 		sqlSelect.BindText16(1, treeNode->GetValue());
@@ -2492,12 +2873,13 @@ void DBase::FillTreeGenreAlbum(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT album FROM library WHERE deleted IS NULL"
 		" AND (genre IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage WHERE skey=4 AND svalue=?1 COLLATE MYCASE))"
 		" AND (IFNULL(albumartist,artist) IS ?2 COLLATE MYCASE OR id IN (SELECT sid FROM storage"
 		" WHERE skey IN (1,2) AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END AND svalue=?2 COLLATE MYCASE))"
-		" GROUP BY album COLLATE MYCASE ORDER BY album COLLATE MYCASE;");
+		" GROUP BY albumkey ORDER BY albumkey;");
 
 	if (!treeNode->GetValue().empty())
 		sqlSelect.BindText16(1, treeNode->GetValue());
@@ -2512,13 +2894,14 @@ void DBase::FillTreeYearArtist(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT art FROM ("
-		"SELECT IFNULL(albumartist,artist) AS art FROM library WHERE deleted IS NULL AND CAST(year AS INTEGER) IS ?1"
+		"SELECT IFNULL(albumartist,artist) AS art,IFNULL(albumartistkey,artistkey) AS artkey FROM library WHERE deleted IS NULL AND CAST(year AS INTEGER) IS ?1"
 		" UNION ALL "
-		"SELECT svalue AS art FROM storage,library WHERE skey IN (1,2) AND sid=id AND deleted IS NULL AND CAST(year AS INTEGER) IS ?1"
+		"SELECT svalue AS art,SORTKEY(svalue) AS artkey FROM storage,library WHERE skey IN (1,2) AND sid=id AND deleted IS NULL AND CAST(year AS INTEGER) IS ?1"
 		" AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END"
-		") GROUP BY art COLLATE MYCASE ORDER BY art COLLATE MYCASE;");
+		") GROUP BY artkey ORDER BY artkey;");
 
 	if (!treeNode->GetValue().empty())
 		sqlSelect.BindText16(1, treeNode->GetValue());
@@ -2530,12 +2913,13 @@ void DBase::FillTreeYearAlbum(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT album FROM library WHERE deleted IS NULL"
 		" AND CAST(year AS INTEGER) IS ?1"
 		" AND (IFNULL(albumartist,artist) IS ?2 COLLATE MYCASE OR id IN (SELECT sid FROM storage"
 		" WHERE skey IN (1,2) AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END AND svalue=?2 COLLATE MYCASE))"
-		" GROUP BY album COLLATE MYCASE ORDER BY album COLLATE MYCASE;");
+		" GROUP BY albumkey ORDER BY albumkey;");
 
 	if (!treeNode->GetValue().empty())
 		sqlSelect.BindText16(1, treeNode->GetValue());
@@ -2555,12 +2939,13 @@ void DBase::FillListAlbum(SkinList* skinList, const std::wstring& value)
 	// As a reminder: ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE can be replaced to
 	// ORDER BY albumartist COLLATE MYCASE,artist COLLATE MYCASE. Need to test perfomance of both.
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
 		" AND album IS ? COLLATE MYCASE"
-		" ORDER BY albumartist COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
+		" ORDER BY albumartistkey,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
 
 	if (!value.empty())
 		sqlSelect.BindText16(1, value);
@@ -2575,13 +2960,14 @@ void DBase::FillListArtist(SkinList* skinList, const std::wstring& value)
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
 		" AND (IFNULL(albumartist,artist) IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage"
 		" WHERE skey IN (1,2) AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END AND svalue=?1 COLLATE MYCASE))"
-		" ORDER BY CAST(year AS INTEGER) DESC,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
+		" ORDER BY CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
 
 	if (!value.empty())
 		sqlSelect.BindText16(1, value);
@@ -2596,7 +2982,8 @@ void DBase::FillListArtistAlbum(SkinList* skinList, const std::wstring& value, c
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
@@ -2621,12 +3008,13 @@ void DBase::FillListComposer(SkinList* skinList, const std::wstring& value)
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
 		" AND (composer IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage WHERE skey=3 AND svalue=?1 COLLATE MYCASE))"
-		" ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,CAST(year AS INTEGER) DESC,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
+		" ORDER BY IFNULL(albumartistkey,artistkey),CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
 
 	if (!value.empty())
 		sqlSelect.BindText16(1, value);
@@ -2643,14 +3031,15 @@ void DBase::FillListComposerArtist(SkinList* skinList, const std::wstring& value
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
 		" AND (composer IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage WHERE skey=3 AND svalue=?1 COLLATE MYCASE))"
 		" AND (IFNULL(albumartist,artist) IS ?2 COLLATE MYCASE OR id IN (SELECT sid FROM storage"
 		" WHERE skey IN (1,2) AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END AND svalue=?2 COLLATE MYCASE))"
-		" ORDER BY CAST(year AS INTEGER) DESC,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
+		" ORDER BY CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
 
 	if (!value.empty())
 		sqlSelect.BindText16(1, value);
@@ -2668,7 +3057,8 @@ void DBase::FillListComposerAlbum(SkinList* skinList, const std::wstring& value,
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
@@ -2697,12 +3087,13 @@ void DBase::FillListGenre(SkinList* skinList, const std::wstring& value)
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
 		" AND (genre IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage WHERE skey=4 AND svalue=?1 COLLATE MYCASE))"
-		" ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,CAST(year AS INTEGER) DESC,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
+		" ORDER BY IFNULL(albumartistkey,artistkey),CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
 
 	if (!value.empty())
 		sqlSelect.BindText16(1, value);
@@ -2719,14 +3110,15 @@ void DBase::FillListGenreArtist(SkinList* skinList, const std::wstring& value, c
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
 		" AND (genre IS ?1 COLLATE MYCASE OR id IN (SELECT sid FROM storage WHERE skey=4 AND svalue=?1 COLLATE MYCASE))"
 		" AND (IFNULL(albumartist,artist) IS ?2 COLLATE MYCASE OR id IN (SELECT sid FROM storage"
 		" WHERE skey IN (1,2) AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END AND svalue=?2 COLLATE MYCASE))"
-		" ORDER BY CAST(year AS INTEGER) DESC,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
+		" ORDER BY CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
 
 	if (!value.empty())
 		sqlSelect.BindText16(1, value);
@@ -2744,7 +3136,8 @@ void DBase::FillListGenreAlbum(SkinList* skinList, const std::wstring& value, co
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
@@ -2773,12 +3166,13 @@ void DBase::FillListYear(SkinList* skinList, const std::wstring& value)
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
 		" AND CAST(year AS INTEGER) IS ?"
-		" ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,CAST(year AS INTEGER) DESC,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
+		" ORDER BY IFNULL(albumartistkey,artistkey),CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
 
 	if (!value.empty())
 		sqlSelect.BindText16(1, value);
@@ -2793,14 +3187,15 @@ void DBase::FillListYearArtist(SkinList* skinList, const std::wstring& value, co
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
 		" AND CAST(year AS INTEGER) IS ?1"
 		" AND (IFNULL(albumartist,artist) IS ?2 COLLATE MYCASE OR id IN (SELECT sid FROM storage"
 		" WHERE skey IN (1,2) AND CASE WHEN albumartist IS NULL THEN skey=1 ELSE skey=2 END AND svalue=?2 COLLATE MYCASE))"
-		" ORDER BY CAST(year AS INTEGER) DESC,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
+		" ORDER BY CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
 
 	if (!value.empty())
 		sqlSelect.BindText16(1, value);
@@ -2818,7 +3213,8 @@ void DBase::FillListYearAlbum(SkinList* skinList, const std::wstring& value, con
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),"
 		"title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating"
 		" FROM library WHERE deleted IS NULL"
@@ -2844,73 +3240,154 @@ void DBase::FillListYearAlbum(SkinList* skinList, const std::wstring& value, con
 
 void DBase::FillListSearchTrack(SkinList* skinList, const std::wstring& value)
 {
-	SQLRequest sqlSelect(dbLibrary,
-		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
-		" WHERE deleted IS NULL AND title IS ? COLLATE LIKECASE ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 1000;");
+	SQLRequest sqlSelect;
 
-	sqlSelect.BindText16(1, value);
+	if (IsSearchIndex(value))
+	{
+		sqlSelect.PrepareCached(dbLibraryRead,
+			"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+			" WHERE id IN (SELECT rowid FROM library_fts WHERE library_fts MATCH ?) AND deleted IS NULL ORDER BY IFNULL(albumartistkey,artistkey),albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 1000;");
+
+		sqlSelect.BindText16(1, SearchMatch("title", value));
+	}
+	else
+	{
+		sqlSelect.PrepareCached(dbLibraryRead,
+			"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+			" WHERE deleted IS NULL AND title IS ? COLLATE LIKECASE ORDER BY IFNULL(albumartistkey,artistkey),albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 1000;");
+
+		sqlSelect.BindText16(1, value);
+	}
 
 	FillList(skinList, sqlSelect);
 }
 
 void DBase::FillListSearchAlbum(SkinList* skinList, const std::wstring& value)
 {
-	SQLRequest sqlSelect(dbLibrary,
-		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
-		" WHERE deleted IS NULL AND album IS ? COLLATE LIKECASE ORDER BY albumartist COLLATE MYCASE, album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 1000;");
+	SQLRequest sqlSelect;
+
+	if (IsSearchIndex(value))
+	{
+		sqlSelect.PrepareCached(dbLibraryRead,
+			"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+			" WHERE id IN (SELECT rowid FROM library_fts WHERE library_fts MATCH ?) AND deleted IS NULL ORDER BY albumartistkey, albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 1000;");
+
+		sqlSelect.BindText16(1, SearchMatch("album", value));
+	}
+	else
+	{
+		sqlSelect.PrepareCached(dbLibraryRead,
+			"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+			" WHERE deleted IS NULL AND album IS ? COLLATE LIKECASE ORDER BY albumartistkey, albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 1000;");
 
-	sqlSelect.BindText16(1, value);
+		sqlSelect.BindText16(1, value);
+	}
 
 	FillList(skinList, sqlSelect);
 }
 
 void DBase::FillListSearchArtist(SkinList* skinList, const std::wstring& value)
 {
-	SQLRequest sqlSelect(dbLibrary,
-		//"SELECT id,file,size,number,title,artist,albumartist,album,year,genre,time,rating FROM library WHERE deleted IS NULL AND IFNULL(albumartist,artist)=? COLLATE LIKECASE ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,year DESC,album COLLATE MYCASE,number LIMIT 1000;");
-		// Further I noticed, if we need to find artist and albumartist separately, if we use "=" then it does not work, but if we use "IS" then it does, I don't know why. Affect our collation LIKECASE, which doesn't compare but find the substring.
-		//"SELECT id,file,size,number,title,artist,albumartist,album,year,genre,time,rating FROM library WHERE deleted IS NULL AND (artist IS ?1 COLLATE LIKECASE OR albumartist IS ?1 COLLATE LIKECASE) ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,year DESC,album COLLATE MYCASE,number LIMIT 500;");
-		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
-		" WHERE deleted IS NULL AND (artist IS ?1 COLLATE LIKECASE OR albumartist IS ?1 COLLATE LIKECASE) ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,CAST(year AS INTEGER) DESC,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 1000;");
+	SQLRequest sqlSelect;
 
-	// Reminder: artist LIKE '%'||?||'%'
+	if (IsSearchIndex(value))
+	{
+		sqlSelect.PrepareCached(dbLibraryRead,
+			"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+			" WHERE id IN (SELECT rowid FROM library_fts WHERE library_fts MATCH ?) AND deleted IS NULL ORDER BY IFNULL(albumartistkey,artistkey),CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 1000;");
+
+		sqlSelect.BindText16(1, SearchMatch("{artist albumartist}", value));
+	}
+	else
+	{
+		sqlSelect.PrepareCached(dbLibraryRead,
+			//"SELECT id,file,size,number,title,artist,albumartist,album,year,genre,time,rating FROM library WHERE deleted IS NULL AND IFNULL(albumartist,artist)=? COLLATE LIKECASE ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,year DESC,album COLLATE MYCASE,number LIMIT 1000;");
+			// Further I noticed, if we need to find artist and albumartist separately, if we use "=" then it does not work, but if we use "IS" then it does, I don't know why. Affect our collation LIKECASE, which doesn't compare but find the substring.
+			//"SELECT id,file,size,number,title,artist,albumartist,album,year,genre,time,rating FROM library WHERE deleted IS NULL AND (artist IS ?1 COLLATE LIKECASE OR albumartist IS ?1 COLLATE LIKECASE) ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,year DESC,album COLLATE MYCASE,number LIMIT 500;");
+			"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+			" WHERE deleted IS NULL AND (artist IS ?1 COLLATE LIKECASE OR albumartist IS ?1 COLLATE LIKECASE) ORDER BY IFNULL(albumartistkey,artistkey),CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 1000;");
 
-	sqlSelect.BindText16(1, value);
+		// Reminder: artist LIKE '%'||?||'%'
+
+		sqlSelect.BindText16(1, value);
+	}
 
 	FillList(skinList, sqlSelect);
 }
 
 void DBase::FillListSearchAll(SkinList* skinList, const std::wstring& value)
 {
+	// Search by the index if possible, the order of results is the same as for the full scan
+	bool isIndex = IsSearchIndex(value);
+
 	if (!isStopSearch)
 	{
-		SQLRequest sqlSelect(dbLibrary,
-		   "SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
-		   " WHERE deleted IS NULL AND title IS ? COLLATE LIKECASE ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 200;");
+		SQLRequest sqlSelect;
 
-		sqlSelect.BindText16(1, value);
+		if (isIndex)
+		{
+			sqlSelect.PrepareCached(dbLibraryRead,
+				"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+				" WHERE id IN (SELECT rowid FROM library_fts WHERE library_fts MATCH ?) AND deleted IS NULL ORDER BY IFNULL(albumartistkey,artistkey),albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 200;");
+
+			sqlSelect.BindText16(1, SearchMatch("title", value));
+		}
+		else
+		{
+			sqlSelect.PrepareCached(dbLibraryRead,
+			   "SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+			   " WHERE deleted IS NULL AND title IS ? COLLATE LIKECASE ORDER BY IFNULL(albumartistkey,artistkey),albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 200;");
+
+			sqlSelect.BindText16(1, value);
+		}
 
 		FillList(skinList, sqlSelect);
 	}
 
 	if (!isStopSearch)
 	{
-		SQLRequest sqlSelect(dbLibrary,
-			"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
-			" WHERE deleted IS NULL AND album IS ? COLLATE LIKECASE ORDER BY albumartist COLLATE MYCASE, album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 300;");
+		SQLRequest sqlSelect;
 
-		sqlSelect.BindText16(1, value);
+		if (isIndex)
+		{
+			sqlSelect.PrepareCached(dbLibraryRead,
+				"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+				" WHERE id IN (SELECT rowid FROM library_fts WHERE library_fts MATCH ?) AND deleted IS NULL ORDER BY albumartistkey, albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 300;");
+
+			sqlSelect.BindText16(1, SearchMatch("album", value));
+		}
+		else
+		{
+			sqlSelect.PrepareCached(dbLibraryRead,
+				"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+				" WHERE deleted IS NULL AND album IS ? COLLATE LIKECASE ORDER BY albumartistkey, albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 300;");
+
+			sqlSelect.BindText16(1, value);
+		}
 
 		FillList(skinList, sqlSelect);
 	}
 
 	if (!isStopSearch)
 	{
-		SQLRequest sqlSelect(dbLibrary,
-			"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
-			" WHERE deleted IS NULL AND (artist IS ?1 COLLATE LIKECASE OR albumartist IS ?1 COLLATE LIKECASE) ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,CAST(year AS INTEGER) DESC,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 500;");
+		SQLRequest sqlSelect;
 
-		sqlSelect.BindText16(1, value);
+		if (isIndex)
+		{
+			sqlSelect.PrepareCached(dbLibraryRead,
+				"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+				" WHERE id IN (SELECT rowid FROM library_fts WHERE library_fts MATCH ?) AND deleted IS NULL ORDER BY IFNULL(albumartistkey,artistkey),CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 500;");
+
+			sqlSelect.BindText16(1, SearchMatch("{artist albumartist}", value));
+		}
+		else
+		{
+			sqlSelect.PrepareCached(dbLibraryRead,
+				"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
+				" WHERE deleted IS NULL AND (artist IS ?1 COLLATE LIKECASE OR albumartist IS ?1 COLLATE LIKECASE) ORDER BY IFNULL(albumartistkey,artistkey),CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER) LIMIT 500;");
+
+			sqlSelect.BindText16(1, value);
+		}
 
 		FillList(skinList, sqlSelect);
 	}
@@ -2918,6 +3395,12 @@ void DBase::FillListSearchAll(SkinList* skinList, const std::wstring& value)
 
 void DBase::FillList(SkinList* skinList, SQLRequest& sqlSelect, bool isPlaylist)
 {
+	FlushStats();
+
+	// Ratings that wait for the end of the scan are not in the database yet (see WriteStats)
+	std::unordered_map<long long, int> pendingRatings;
+	GetPendingRatings(pendingRatings);
+
 	ListNodeUnsafe headNode = nullptr;
 	ListNodeUnsafe oldHeadNode = nullptr;
 	std::wstring oldAlbum;
@@ -2983,13 +3466,13 @@ void DBase::FillList(SkinList* skinList, SQLRequest& sqlSelect, bool isPlaylist)
 				{
 					const char* text = sqlSelect.ColumnTextRaw(12);
 					if (text)
-						skinList->SetNodeString(headNode, type, UTF::UTF16(text));
+						skinList->SetNodeString(headNode, type, text);
 				}
 				else if (type == SkinListElement::Type::Genre)
 				{
 					const char* text = sqlSelect.ColumnTextRaw(11);
 					if (text)
-						skinList->SetNodeString(headNode, type, UTF::UTF16(text));
+						skinList->SetNodeString(headNode, type, text);
 				}
 				else if (type == SkinListElement::Type::ArtistAlbum)
 				{
@@ -3038,6 +3521,8 @@ void DBase::FillList(SkinList* skinList, SQLRequest& sqlSelect, bool isPlaylist)
 				idPlaylist = sqlSelect.ColumnInt64(15);
 
 			int rating = sqlSelect.ColumnInt(14);
+			if (!pendingRatings.empty())
+				GetPendingRating(pendingRatings, idLibrary, rating);
 
 			// Adjust the rating
 			rating /= 20;
@@ -3092,7 +3577,7 @@ void DBase::FillList(SkinList* skinList, SQLRequest& sqlSelect, bool isPlaylist)
 					}
 
 					if (text)
-						skinList->SetNodeString(trackNode, type, UTF::UTF16(text));
+						skinList->SetNodeString(trackNode, type, text);
 				}
 				else if (type == SkinListElement::Type::ArtistTitle)
 				{
@@ -3102,10 +3587,10 @@ void DBase::FillList(SkinList* skinList, SQLRequest& sqlSelect, bool isPlaylist)
 					if (title == nullptr) title = sqlSelect.ColumnTextRaw(3); // File Name
 
 					if (artist)
-						skinList->SetNodeString(trackNode, SkinListElement::Type::Artist, UTF::UTF16(artist));
+						skinList->SetNodeString(trackNode, SkinListElement::Type::Artist, artist);
 
 					if (title)
-						skinList->SetNodeString(trackNode, SkinListElement::Type::Title, UTF::UTF16(title));
+						skinList->SetNodeString(trackNode, SkinListElement::Type::Title, title);
 				}
 			}
 		}
@@ -3114,6 +3599,8 @@ void DBase::FillList(SkinList* skinList, SQLRequest& sqlSelect, bool isPlaylist)
 
 void DBase::GetLibFile(long long idLibrary, long long idPlaylist, DATABASE_GETINFO* info)
 {
+	FlushStats();
+
 	SQLRequest sqlSelect;
 	SQLRequest sqlSelectM;
 	const char *selectM = "SELECT svalue FROM storage WHERE skey=? AND sid=? ORDER BY sidx;";
@@ -3305,6 +3792,12 @@ void DBase::FillPlaylistNowPlaying(SkinList* skinList, const std::wstring& file,
 
 void DBase::FillPlay(SkinList* skinList, SQLRequest& sqlSelect, bool isPlaylist, bool isSelect, bool isNowPlaying)
 {
+	FlushStats();
+
+	// Ratings that wait for the end of the scan are not in the database yet (see WriteStats)
+	std::unordered_map<long long, int> pendingRatings;
+	GetPendingRatings(pendingRatings);
+
 	if (!isNowPlaying)
 		skinList->SetViewPlaylist(true);
 
@@ -3317,6 +3810,8 @@ void DBase::FillPlay(SkinList* skinList, SQLRequest& sqlSelect, bool isPlaylist,
 			idPlaylist = sqlSelect.ColumnInt64(15);
 
 		int rating = sqlSelect.ColumnInt(14);
+		if (!pendingRatings.empty())
+			GetPendingRating(pendingRatings, idLibrary, rating);
 
 		// Adjust the rating
 		rating /= 20;
@@ -3379,7 +3874,7 @@ void DBase::FillPlay(SkinList* skinList, SQLRequest& sqlSelect, bool isPlaylist,
 				}
 
 				if (text)
-					skinList->SetNodeString(trackNode, type, UTF::UTF16(text));
+					skinList->SetNodeString(trackNode, type, text);
 			}
 			else if (type == SkinListElement::Type::ArtistTitle)
 			{
@@ -3389,10 +3884,10 @@ void DBase::FillPlay(SkinList* skinList, SQLRequest& sqlSelect, bool isPlaylist,
 				if (title == nullptr) title = sqlSelect.ColumnTextRaw(3); // File Name
 
 				if (artist)
-					skinList->SetNodeString(trackNode, SkinListElement::Type::Artist, UTF::UTF16(artist));
+					skinList->SetNodeString(trackNode, SkinListElement::Type::Artist, artist);
 
 				if (title)
-					skinList->SetNodeString(trackNode, SkinListElement::Type::Title, UTF::UTF16(title));
+					skinList->SetNodeString(trackNode, SkinListElement::Type::Title, title);
 			}
 		}
 	}
@@ -3544,7 +4039,8 @@ void DBase::AddFileToPlaylistFrom(long long id, int index, long long added, bool
 {
 	assert(id != 0);
 
-	SQLRequest sqlInsert(!isTemp ? dbPlaylist : dbPlayTemp,
+	SQLRequest sqlInsert;
+	sqlInsert.PrepareCached(!isTemp ? dbPlaylist : dbPlayTemp,
 		"INSERT INTO playlist (idlib,idx,added) VALUES (?,?,?);");
 
 	sqlInsert.BindInt64(1, id);
@@ -3811,10 +4307,7 @@ void DBase::SortPlaylist(int start, const std::wstring& name)
 		return;
 
 	//sqlite3_create_collation(dbPlaylist.get(), "MYNUM", SQLITE_UTF8, nullptr, CompareStringsNum);
-	if (futureWin->IsVistaOrLater())
-		sqlite3_create_collation(dbPlaylist.get(), "MYCASE", SQLITE_UTF16LE, nullptr, CompareStrings);
-	else
-		sqlite3_create_collation(dbPlaylist.get(), "MYCASE", SQLITE_UTF16LE, nullptr, CompareStringsXP);
+	sqlite3_create_function(dbPlaylist.get(), "SORTKEY", 1, SQLITE_UTF16LE|SQLITE_DETERMINISTIC, nullptr, SortKey, nullptr, nullptr);
 
 	//std::wstring fileDB = profilePath + L"Playlists" + L"\\" + name + L".db";
 	//SQLRequest::Exec(dbLibrary, ("ATTACH DATABASE '" + UTF::UTF8S(fileDB) + "' AS playlist_db;").c_str());
@@ -3822,11 +4315,14 @@ void DBase::SortPlaylist(int start, const std::wstring& name)
 	SQLRequest sqlSelect(dbPlaylist,
 		//"SELECT id FROM playlist WHERE idx>? ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,year DESC,album COLLATE MYCASE,number,title COLLATE MYCASE;");
 		//"SELECT id FROM playlist WHERE idx>? ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,CAST(year AS INTEGER) DESC,album COLLATE MYCASE,path,CAST(disc AS INTEGER),CAST(track AS INTEGER),file;");
+		// ORDER BY of a compound SELECT can only use result columns, so the union is in a subquery
+		"SELECT * FROM ("
 		"SELECT playlist.id,library.path,library.file,CAST(library.track AS INTEGER) AS track2,CAST(library.disc AS INTEGER) as disc2,library.album,"
 		"IFNULL(library.albumartist,library.artist) AS artist2,CAST(library.year AS INTEGER) AS year2 FROM playlist,library WHERE playlist.idx>?1 AND playlist.idlib=library.id"
 		" UNION ALL "
-		"SELECT id,path,file,CAST(track AS INTEGER) AS track2,CAST(disc AS INTEGER) as disc2,album,IFNULL(albumartist,artist) AS artist2,CAST(year AS INTEGER) AS year2 FROM playlist WHERE idx>?1 AND idlib IS NULL"
-		" ORDER BY artist2 COLLATE MYCASE,year2 DESC,album COLLATE MYCASE,path,disc2,track2,file;");
+		"SELECT id,path,file,CAST(track AS INTEGER) AS track2,CAST(disc AS INTEGER) as disc2,album,IFNULL(albumartist,artist) AS artist2,CAST(year AS INTEGER) AS year2 FROM playlist WHERE idx>?1 AND idlib IS NULL)"
+		// Sort keys are computed once per row, the playlist tracks not from the library don't have stored keys
+		" ORDER BY SORTKEY(artist2),year2 DESC,SORTKEY(album),path,disc2,track2,file;");
 
 	sqlSelect.BindInt(1, start);
 
@@ -3882,7 +4378,8 @@ void DBase::FillTreeFolderSub(SkinTree* skinTree, TreeNodeUnsafe treeNode)
 {
 	skinTree->SetControlRedraw(false);
 
-	SQLRequest sqlSelect(dbLibrary,
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT path FROM library WHERE deleted IS NULL AND path=? COLLATE FSELECT GROUP BY path COLLATE FILECASE ORDER BY path COLLATE FILECASE;");// GROUP BY file COLLATE FOLDER2 ORDER BY file COLLATE FOLDER3;");// GROUP BY album COLLATE MYCASE ORDER BY album COLLATE MYCASE;");
 
 	sqlSelect.BindText16(1, treeNode->GetValue());
@@ -3993,7 +4490,14 @@ void DBase::FillListFolder(SkinList* skinList, const std::wstring& value)
 	skinList->SetControlRedraw(false);
 	skinList->DeleteAllNode();
 
-	SQLRequest sqlSelect(dbLibrary,
+	FlushStats();
+
+	// Ratings that wait for the end of the scan are not in the database yet (see WriteStats)
+	std::unordered_map<long long, int> pendingRatings;
+	GetPendingRatings(pendingRatings);
+
+	SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(dbLibraryRead,
 		"SELECT id,cue,path,file,filesize,CAST(track AS INTEGER),CAST(disc AS INTEGER),title,album,artist,albumartist,genre,CAST(year AS INTEGER),duration,rating FROM library"
 		" WHERE deleted IS NULL AND path=? COLLATE FSELECT ORDER BY path COLLATE FILECASE,CAST(disc AS INTEGER),CAST(track AS INTEGER),file;");// LIMIT 5000;");
 
@@ -4079,6 +4583,8 @@ void DBase::FillListFolder(SkinList* skinList, const std::wstring& value)
 			// Get track rating and track ID
 			long long idLibrary = sqlSelect.ColumnInt64(0);
 			int rating = sqlSelect.ColumnInt(14);
+			if (!pendingRatings.empty())
+				GetPendingRating(pendingRatings, idLibrary, rating);
 
 			// Adjust the rating
 			rating /= 20;
@@ -4133,7 +4639,7 @@ void DBase::FillListFolder(SkinList* skinList, const std::wstring& value)
 					}
 
 					if (text)
-						skinList->SetNodeString(trackNode, type, UTF::UTF16(text));
+						skinList->SetNodeString(trackNode, type, text);
 				}
 				else if (type == SkinListElement::Type::ArtistTitle)
 				{
@@ -4143,10 +4649,10 @@ void DBase::FillListFolder(SkinList* skinList, const std::wstring& value)
 					if (title == nullptr) title = sqlSelect.ColumnTextRaw(3); // File Name
 
 					if (artist)
-						skinList->SetNodeString(trackNode, SkinListElement::Type::Artist, UTF::UTF16(artist));
+						skinList->SetNodeString(trackNode, SkinListElement::Type::Artist, artist);
 
 					if (title)
-						skinList->SetNodeString(trackNode, SkinListElement::Type::Title, UTF::UTF16(title));
+						skinList->SetNodeString(trackNode, SkinListElement::Type::Title, title);
 				}
 			}
 		}
@@ -4633,6 +5139,8 @@ void DBase::SmartFilterTracks(SmartList &smart, std::string& select, std::vector
 
 void DBase::FillSmartlist(SkinList* skinList, const std::wstring& fileName, bool isUpdate)
 {
+	FlushStats();
+
 	isSmartlistOpen = true;
 
 	SmartList smart;
@@ -5236,6 +5744,9 @@ void DBase::DeleteFromSmartlist(SkinList* skinList, const std::wstring& file)
 
 void DBase::UpdateTagsBegin()
 {
+	FlushStats();
+
+	LockGuard lock(mutexTransaction);
 	SQLRequest::Exec(dbLibrary, "SAVEPOINT spupdatetags");
 	if (dbPlaylist)
 		SQLRequest::Exec(dbPlaylist, "SAVEPOINT spupdatetags");
@@ -5243,6 +5754,7 @@ void DBase::UpdateTagsBegin()
 
 void DBase::UpdateTagsCommit()
 {
+	LockGuard lock(mutexTransaction);
 	SQLRequest::Exec(dbLibrary, "RELEASE spupdatetags");
 	if (dbPlaylist)
 		SQLRequest::Exec(dbPlaylist, "RELEASE spupdatetags");
@@ -5260,7 +5772,8 @@ void DBase::UpdateTagsEditor(long long id, DATABASE_SONGINFO* tags, bool isPlayl
 	{
 		update = "UPDATE library SET filesize=?,modified=?,trackhash=?,track=?,totaltracks=?,disc=?,totaldiscs=?,"
 				"title=?,album=?,artist=?,albumartist=?,composer=?,genre=?,year=?,bpm=?,compilation=?,publisher=?,"
-				"conductor=?,lyricist=?,remixer=?,grouping=?,subtitle=?,copyright=?,encodedby=?,comment=? WHERE id=?;";
+				"conductor=?,lyricist=?,remixer=?,grouping=?,subtitle=?,copyright=?,encodedby=?,comment=?,"
+				"titlekey=SORTKEY(?8),albumkey=SORTKEY(?9),artistkey=SORTKEY(?10),albumartistkey=SORTKEY(?11) WHERE id=?;";
 	}
 	else
 	{
@@ -5422,7 +5935,8 @@ void DBase::UpdateTagsEditor(long long id, DATABASE_SONGINFO* tags, bool isPlayl
 
 	if (stepDone)
 	{
-		SQLRequest sqlDeleteM(!isPlaylist ? dbLibrary : dbPlaylist,
+		SQLRequest sqlDeleteM;
+		sqlDeleteM.PrepareCached(!isPlaylist ? dbLibrary : dbPlaylist,
 			"DELETE FROM storage WHERE sid=?");
 		sqlDeleteM.BindInt64(1, id);
 		sqlDeleteM.Step();
@@ -5430,7 +5944,8 @@ void DBase::UpdateTagsEditor(long long id, DATABASE_SONGINFO* tags, bool isPlayl
 		if (!tags->genres.empty() || !tags->artists.empty() || !tags->composers.empty() ||
 			!tags->albumArtists.empty() || !tags->conductors.empty() || !tags->lyricists.empty())
 		{
-			SQLRequest sqlInsertM(!isPlaylist ? dbLibrary : dbPlaylist,
+			SQLRequest sqlInsertM;
+			sqlInsertM.PrepareCached(!isPlaylist ? dbLibrary : dbPlaylist,
 				"INSERT INTO storage (sid,sidx,skey,svalue) VALUES (?,?,?,?);");
 
 			InsertMultipleValues(id, sqlInsertM, tags);
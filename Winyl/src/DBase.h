@@ -20,12 +20,16 @@
 #include "stdafx.h"
 #include <random>
 #include <chrono>
+#include <memory>
+#include <unordered_map>
+#include "Threading.h"
 #include "XmlFile.h"
 #include "sqlite3/sqlite3/src/sqlite3.h"
 #include "SkinList.h"
 #include "SkinTree.h"
 #include "Language.h"
 #include "UTF.h"
+#include "ReplayGain.h"
 
 class DBase
 {
@@ -41,6 +45,37 @@ public:
 	friend class SQLRequest;
 	private:
 		sqlite3* db = nullptr;
+
+		// Cache of prepared statements for this connection, keyed by SQL text (see SQLRequest::PrepareCached).
+		// A statement is taken out of its slot while a request uses it and is returned to the slot after,
+		// so if the same SQL is used at the same time (nested or from another thread) a temporary statement is prepared.
+		struct SQLCache
+		{
+			Threading::Mutex mutex;
+			std::unordered_map<std::string, sqlite3_stmt*> statements;
+			std::atomic<long long> hits = 0;
+			std::atomic<long long> misses = 0;
+		};
+		std::shared_ptr<SQLCache> cache; // Shared between copies of the connection (see operator=)
+
+		inline void FinalizeCache(bool clearSlots)
+		{
+			if (!cache)
+				return;
+
+			LockGuard lock(cache->mutex);
+			for (auto& statement : cache->statements)
+			{
+				if (statement.second)
+				{
+					sqlite3_finalize(statement.second);
+					statement.second = nullptr;
+				}
+			}
+			// Slots can be removed only when no requests can use them (they keep pointers to the slots)
+			if (clearSlots)
+				cache->statements.clear();
+		}
 	public:
 		inline SQLFile()
 		{
@@ -55,9 +90,14 @@ public:
 		bool operator==(const SQLFile& r) {return db == r.db;}
 		bool operator!=(const SQLFile& r) {return !(*this == r);}
 		explicit operator bool() {return (db ? true : false);}
-		inline void Null() {db = nullptr;} // Beware
+		inline void Null() {db = nullptr; cache.reset();} // Beware
 		sqlite3* get() {return db;}
 
+		// Finalize all cached statements that are not in use right now
+		inline void ClearCache() {FinalizeCache(false);}
+		inline long long GetCacheHits() {return cache ? cache->hits.load() : 0;}
+		inline long long GetCacheMisses() {return cache ? cache->misses.load() : 0;}
+
 		inline bool OpenCreate(const std::string& file)
 		{
 			assert(db == nullptr);
@@ -68,6 +108,7 @@ public:
 				db = nullptr;
 			}
 			assert(result == true);
+			if (result) cache = std::make_shared<SQLCache>();
 			return result;
 		}
 		inline bool OpenWrite(const std::string& file)
@@ -80,6 +121,7 @@ public:
 				db = nullptr;
 			}
 			assert(result == true);
+			if (result) cache = std::make_shared<SQLCache>();
 			return result;
 		}
 		inline bool OpenRead(const std::string& file)
@@ -92,6 +134,7 @@ public:
 				db = nullptr;
 			}
 			assert(result == true);
+			if (result) cache = std::make_shared<SQLCache>();
 			return result;
 		}
 		inline bool Close()
@@ -99,9 +142,10 @@ public:
 			assert(db != nullptr);
 			if (db)
 			{
+				FinalizeCache(true);
 				bool result = sqlite3_close(db) == SQLITE_OK;
 				assert(result == true);
-				if (result) db = nullptr;
+				if (result) {db = nullptr; cache.reset();}
 				return result;
 			}
 			return false;
@@ -116,6 +160,7 @@ public:
 	Language* lang = nullptr;
 
 	SQLFile dbLibrary;  // Library database (always open)
+	SQLFile dbLibraryRead; // Read only connection to browse the library (in WAL mode, otherwise the same as dbLibrary)
 	SQLFile dbPlaylist; // Opened playlist database
 	SQLFile dbPlayOpen; // Playing playlist database
 	SQLFile dbPlayTemp; // Additional database for advanced actions in the playlist
@@ -133,6 +178,10 @@ public:
 	bool isPortableVersion = false;
 	void SetPortableVersion(bool isPortable) {isPortableVersion = isPortable;}
 
+	bool isLibraryWAL = false;
+	int libraryWALCheckpoint = 1000;
+	void SetLibraryWAL(bool isWAL, int checkpoint) {isLibraryWAL = isWAL; libraryWALCheckpoint = checkpoint;}
+
 	struct DATABASE_SONGINFO
 	{
 		std::string file;
@@ -275,10 +324,20 @@ public:
 		UserRadio = 11
 	};
 
+	static void CreateFunctions(SQLFile& db); // Register collations and functions for the library connection (see DBaseFunctions.cpp)
 	void CreateTableLibrary(const SQLFile& db); // Create table for the library
+	void CreateSortKeys(const SQLFile& db); // Create indexes for sort keys of the library
+	void UpdateSortKeys(const SQLFile& db); // Rebuild sort keys if the locale or NLS version is changed
+	static std::string SortKeyVersion();
 	void CreateTablePlaylist(const SQLFile& db); // Create table for a playlist
 	void CreateTableSmartlist(const SQLFile& db); // Create table for a smartlist (not auto updating, for auto updating we no need table)
 	void CreateTableCue(const SQLFile& db); // Create table for cue sheets cache
+	bool CreateTableSearch(const SQLFile& db); // Create full-text search index for the library (return false if not supported)
+	void UpdateTableSearch(const SQLFile& db); // Refill the search index if the locale or NLS version is changed
+
+	bool isSearchIndex = false; // Full-text search index is available
+	bool IsSearchIndex(const std::wstring& value) {return isSearchIndex && value.size() >= 3;} // Trigrams need 3 chars
+	static std::wstring SearchMatch(const char* columns, const std::wstring& value);
 
 	void InsertMultipleValues(long long id, SQLRequest& sqlInsert, DATABASE_SONGINFO* tags);
 
@@ -405,6 +464,22 @@ public:
 	void GetSongTags(long long idLibrary, long long idPlaylist, std::wstring& file, std::wstring& title, std::wstring& album,
 					std::wstring& artist, std::wstring& genre, std::wstring& year, bool isPlay = true);
 
+	// Track of the library to analyze ReplayGain (see Progress::AnalyzeReplayGain)
+	struct ReplayGainTrack
+	{
+		long long id = 0;
+		long long cue = 0;
+		std::wstring file;
+		long long size = 0;
+		long long modified = 0;
+		std::string replayGain;
+	};
+	// Return all tracks of the library grouped by albums (album + album artist, or album + folder without album artist)
+	void GetReplayGainAlbums(std::vector<std::vector<ReplayGainTrack>>& outAlbums);
+	void SetReplayGain(long long idLibrary, const std::string& replayGain);
+	// Return ReplayGain values of a track, false if not analyzed (from memory, any thread)
+	bool GetReplayGain(long long idLibrary, ReplayGain::Values& outValues);
+
 
 	void OpenLibrary();
 
@@ -468,6 +543,7 @@ public:
 	void SetRating(long long idLibrary, long long idPlaylist, int rating, bool isPlay); // Set track rating
 	void IncreaseCount(long long idLibrary, long long idPlaylist); // Increase track play count
 	void IncreaseSkip(long long idLibrary, long long idPlaylist); // Increase track skip count
+	void FlushStats(); // Write all pending statistics now (see ThreadStats)
 
 	bool IsLibraryEmpty(); // The library is empty?
 	void RestoreDeleted(); // Restore tracks deleted from the library
@@ -524,11 +600,66 @@ public:
 	static int CompareStringsFolderGroup(void* context, int len1, const void* str1, int len2, const void* str2);
 	static int CompareStringsFile(void* context, int len1, const void* str1, int len2, const void* str2);
 
+	// Binary sort key of a string, the keys are compared by memcmp in the same order as MYCASE collation
+	static void SortKey(sqlite3_context* context, int argc, sqlite3_value** argv);
+	// Lower case of a string the same way as LIKECASE collation ignores case, for the search index
+	static void FoldCase(sqlite3_context* context, int argc, sqlite3_value** argv);
+	static std::wstring FoldCaseString(const wchar_t* str, int len);
+
 	//static int CompareStringsNum(void* context, int len1, const void* str1, int len2, const void* str2);
 	//static int CompareStringToNum(const char* str, int len);
 
 	bool IsEqualPaths(const std::wstring& str1, size_t len1, const std::wstring& str2, size_t len2);
 
+private:
+	// Write-behind queue for ratings, play counts and skip counts.
+	// SetRating, IncreaseCount and IncreaseSkip only put updates to the queue (updates of the same track are merged)
+	// and the stats thread writes them in one transaction when no new updates come for a while (idle),
+	// but not later than statsMaxDelay after the first update. So the UI thread doesn't wait for the library
+	// database while it is busy with the scan (see Progress). FlushStats writes the queue immediately,
+	// it is called before the statistics are read back (fill a list, properties), before a playlist connection
+	// is changed and at exit, so an update is never lost or applied to another playlist.
+	// While the scan holds a transaction the updates of the library stay in the queue until Commit,
+	// in the transaction they would not be seen by dbLibraryRead until the end of the scan.
+	// Lists filled meanwhile take the pending ratings from the queue (see GetPendingRatings),
+	// but smartlists are still selected and sorted by the values from the database.
+	struct StatsUpdate
+	{
+		bool isRating = false;
+		int rating = 0;
+		int playCount = 0; // Increment
+		long long lastPlayed = 0;
+		int skipCount = 0; // Increment
+		long long lastSkipped = 0;
+	};
+	typedef std::unordered_map<long long, StatsUpdate> StatsMap;
+
+	static const int statsIdleDelay = 2000; // ms
+	static const int statsMaxDelay = 10000; // ms
+
+	StatsMap statsLibrary; // Pending updates for dbLibrary by idLibrary
+	StatsMap statsPlayOpen; // Pending updates for dbPlayOpen by idPlaylist
+	StatsMap statsPlaylist; // Pending updates for dbPlaylist by idPlaylist
+	Threading::Mutex mutexStats; // Protects the maps above
+	Threading::Mutex mutexStatsWrite; // Held while the pending updates are written (by the stats thread or FlushStats)
+	Threading::Mutex mutexTransaction; // Transaction of the stats thread must not mix with Begin/Commit from other threads
+	Threading::Thread threadStats;
+	Threading::Event eventStats;
+	std::atomic<bool> isStopStats = false;
+
+	void ThreadStats();
+	bool WriteStats(const SQLFile& db, StatsMap& stats, bool isLibrary);
+	static void MergeStats(StatsMap& stats, StatsMap& statsOld);
+	void GetPendingRatings(std::unordered_map<long long, int>& outRatings);
+	static void GetPendingRating(const std::unordered_map<long long, int>& ratings, long long idLibrary, int& rating);
+
+	// ReplayGain of the analyzed tracks by idLibrary, loaded with the library and updated by SetReplayGain,
+	// so LibAudio preloads the next track without a query (see WinylWnd::ChangeFile)
+	std::unordered_map<long long, ReplayGain::Values> replayGains;
+	Threading::Mutex mutexReplayGain;
+
+	void LoadReplayGains();
+
 public:
 	void MemFlagAttach();
 	void MemFlagDetach();
@@ -547,6 +678,24 @@ public:
 	{
 	private:
 		sqlite3_stmt* ppVm = nullptr;
+		sqlite3_stmt** cacheSlot = nullptr; // Slot to return the statement to if it is from the cache
+		SQLFile::SQLCache* cache = nullptr;
+
+		inline void ReleaseCached()
+		{
+			sqlite3_reset(ppVm);
+			sqlite3_clear_bindings(ppVm);
+
+			LockGuard lock(cache->mutex);
+			if (*cacheSlot == nullptr)
+				*cacheSlot = ppVm;
+			else // The slot was refilled while we used the statement
+				sqlite3_finalize(ppVm);
+
+			cacheSlot = nullptr;
+			cache = nullptr;
+			ppVm = nullptr;
+		}
 
 	public:
 		SQLRequest()
@@ -562,7 +711,8 @@ public:
 		}
 		~SQLRequest()
 		{
-			if (ppVm) sqlite3_finalize(ppVm);
+			if (cacheSlot) ReleaseCached();
+			else if (ppVm) sqlite3_finalize(ppVm);
 		}
 		inline void Prepare(const SQLFile& db, const char* text)
 		{
@@ -570,6 +720,43 @@ public:
 			assert(db.db != nullptr);
 			if (db.db) sqlite3_prepare_v2(db.db, text, -1, &ppVm, &text);
 		}
+		// Same as Prepare but takes the statement from the connection cache (and returns it there
+		// reset and cleared on Finalize or destruction) instead of compiling SQL each time.
+		// Use it only for constant SQL text that is executed often.
+		inline void PrepareCached(const SQLFile& db, const char* text)
+		{
+			assert(ppVm == nullptr);
+			assert(db.db != nullptr);
+			if (!db.db)
+				return;
+
+			if (db.cache)
+			{
+				LockGuard lock(db.cache->mutex);
+				sqlite3_stmt*& slot = db.cache->statements[text];
+				if (slot)
+				{
+					db.cache->hits++;
+					ppVm = slot;
+					slot = nullptr;
+					cacheSlot = &slot;
+					cache = db.cache.get();
+					return;
+				}
+				db.cache->misses++;
+				// Do not hold the lock while compiling, the slot stays in place anyway
+				cacheSlot = &slot;
+				cache = db.cache.get();
+			}
+
+			sqlite3_prepare_v2(db.db, text, -1, &ppVm, &text);
+
+			if (!ppVm)
+			{
+				cacheSlot = nullptr;
+				cache = nullptr;
+			}
+		}
 		inline bool IsPrepared()
 		{
 			return ppVm ? true : false;
@@ -577,7 +764,9 @@ public:
 		inline void Finalize()
 		{
 			assert(ppVm != nullptr);
-			if (ppVm)
+			if (cacheSlot)
+				ReleaseCached();
+			else if (ppVm)
 			{
 				sqlite3_finalize(ppVm);
 				ppVm = nullptr;
@@ -0,0 +1,276 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "DBase.h"
+
+// Collations and functions of SQLite for the library and playlists (see CreateFunctions).
+// They are in a separate file so the tests and benchmarks can use them without the rest of DBase.
+
+void DBase::CreateFunctions(SQLFile& db)
+{
+	//sqlite3_create_collation(db.get(), "MYNUM", SQLITE_UTF8, nullptr, CompareStringsNum);
+	if (futureWin->IsVistaOrLater())
+	{
+		sqlite3_create_collation(db.get(), "MYCASE", SQLITE_UTF16LE, nullptr, CompareStrings);
+		sqlite3_create_collation(db.get(), "LIKECASE", SQLITE_UTF16LE, nullptr, CompareStringsLike);
+		sqlite3_create_collation(db.get(), "FSELECT", SQLITE_UTF16LE, nullptr, CompareStringsFolderSelect);
+		sqlite3_create_collation(db.get(), "FGROUP", SQLITE_UTF16LE, nullptr, CompareStringsFolderGroup);
+		sqlite3_create_collation(db.get(), "FILECASE", SQLITE_UTF16LE, nullptr, CompareStringsFile);
+	}
+	else
+	{
+		sqlite3_create_collation(db.get(), "MYCASE", SQLITE_UTF16LE, nullptr, CompareStringsXP);
+		sqlite3_create_collation(db.get(), "LIKECASE", SQLITE_UTF16LE, nullptr, CompareStringsLikeXP);
+		sqlite3_create_collation(db.get(), "FSELECT", SQLITE_UTF16LE, nullptr, CompareStringsFolderSelectXP);
+		sqlite3_create_collation(db.get(), "FGROUP", SQLITE_UTF16LE, nullptr, CompareStringsFolderGroupXP);
+		sqlite3_create_collation(db.get(), "FILECASE", SQLITE_UTF16LE, nullptr, CompareStringsFileXP);
+	}
+
+	sqlite3_create_function(db.get(), "SORTKEY", 1, SQLITE_UTF16LE|SQLITE_DETERMINISTIC, nullptr, SortKey, nullptr, nullptr);
+	sqlite3_create_function(db.get(), "FOLDCASE", 1, SQLITE_UTF16LE|SQLITE_DETERMINISTIC, nullptr, FoldCase, nullptr, nullptr);
+}
+
+/*
+int DBase::CompareStringToNum(const char* str, int len)
+{
+	int value = 0;
+	int sign = 1;
+	int cnt = 0;
+
+	while (cnt < len && *str == ' ')
+	{
+		cnt++;
+		str++;
+	}
+
+	if (cnt < len && *str == '-')
+		sign = -1;
+
+	while (cnt < len && *str != '\0')
+	{
+		if (*str >= '0' && *str <= '9')
+			value = (value * 10) + (*str - '0');
+		else
+			break;
+
+		cnt++;
+		str++;
+	}
+
+	return value * sign;
+}
+
+int DBase::CompareStringsNum(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	int i1 = CompareStringToNum((const char*)str1, len1);
+	int i2 = CompareStringToNum((const char*)str2, len2);
+
+	if (i1 > i2)
+		return 1;
+	else if (i1 < i2)
+		return -1;
+
+	return 0;
+}
+*/
+int DBase::CompareStringsXP(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	//return lstrcmpi((const wchar_t*)str1, (const wchar_t*)str2);
+	return CompareStringW(LOCALE_USER_DEFAULT, NORM_IGNORECASE, (LPCWSTR)str1, -1, (LPCWSTR)str2, -1) - CSTR_EQUAL;
+}
+
+int DBase::CompareStringsLikeXP(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	if (len1 < len2)
+		return -1;
+
+	// Find substring
+	int i = 0, size = len1/2 - len2/2; // see assert
+	for (wchar_t* first = (wchar_t*)str1;*first && i <= size; ++first, ++i)
+	{
+		//assert((size_t)len2/2 <= wcslen(first));
+		if (CompareStringW(LOCALE_USER_DEFAULT, NORM_IGNORECASE, (LPCWSTR)first, len2/2, (LPCWSTR)str2, len2/2) == CSTR_EQUAL)
+			return 0;
+	}
+
+	return -1;
+}
+
+int DBase::CompareStringsFolderSelectXP(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	if (len1 < len2)
+		return -1;
+
+	if (CompareStringW(LOCALE_INVARIANT, NORM_IGNORECASE, (LPCWSTR)str1, len2/2, (LPCWSTR)str2, len2/2) == CSTR_EQUAL)
+		return 0;
+
+	return -1;
+}
+
+int DBase::CompareStringsFolderGroupXP(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	const wchar_t* find1 = wcsrchr((const wchar_t*)str1, '\\');
+	const wchar_t* find2 = wcsrchr((const wchar_t*)str2, '\\');
+
+	return CompareStringW(LOCALE_INVARIANT, NORM_IGNORECASE,
+		(LPWSTR)str1, (DWORD)(find1 - (LPWSTR)str1) + 1, (LPWSTR)str2, (DWORD)(find2 - (LPWSTR)str2) + 1) - CSTR_EQUAL;
+
+
+	// Test
+	//const wchar_t* find1 = wcsrchr((const wchar_t*)str1, '\\');
+	//const wchar_t* find2 = wcsrchr((const wchar_t*)str2, '\\');
+
+	//unsigned int count1 = find1 ? find1 - (const wchar_t*)str1 + 1 : 0;
+	//unsigned int count2 = find2 ? find2 - (const wchar_t*)str2 + 1 : 0;
+
+	//int ret = 0;
+	//if (count1 <= count2)
+	//	ret = wcsncmp((const wchar_t*)str1, (const wchar_t*)str2, count1);
+	//else
+	//	ret = wcsncmp((const wchar_t*)str1, (const wchar_t*)str2, count2);
+
+	//if (ret == 0)
+	//	ret = count1 - count2;
+
+	//return ret;
+}
+
+int DBase::CompareStringsFileXP(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	return CompareStringW(LOCALE_INVARIANT, NORM_IGNORECASE, (LPCWSTR)str1, -1, (LPCWSTR)str2, -1) - CSTR_EQUAL;
+}
+
+int DBase::CompareStrings(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	return futureWin->CompareStringEx(LOCALE_NAME_USER_DEFAULT, LINGUISTIC_IGNORECASE, (LPCWSTR)str1, -1, (LPCWSTR)str2, -1, 0, 0, 0) - CSTR_EQUAL;
+}
+
+int DBase::CompareStringsLike(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	if (len1 < len2)
+		return -1;
+
+	if (futureWin->FindNLSStringEx(LOCALE_NAME_USER_DEFAULT, FIND_FROMSTART|LINGUISTIC_IGNORECASE, (LPCWSTR)str1, -1, (LPCWSTR)str2, -1,
+		NULL, 0, 0, 0) > -1)
+		return 0;
+
+	return -1;
+}
+
+int DBase::CompareStringsFolderSelect(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	if (len1 < len2)
+		return -1;
+
+	if (futureWin->CompareStringOrdinal((LPCWSTR)str1, len2/2, (LPCWSTR)str2, len2/2, TRUE) == CSTR_EQUAL)
+		return 0;
+
+	return -1;
+}
+
+int DBase::CompareStringsFolderGroup(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	const wchar_t* find1 = wcsrchr((const wchar_t*)str1, '\\');
+	const wchar_t* find2 = wcsrchr((const wchar_t*)str2, '\\');
+
+	return futureWin->CompareStringOrdinal(
+		(LPCWSTR)str1, (DWORD)(find1 - (LPCWSTR)str1) + 1, (LPCWSTR)str2, (DWORD)(find2 - (LPCWSTR)str2) + 1, TRUE) - CSTR_EQUAL;
+}
+
+int DBase::CompareStringsFile(void* context, int len1, const void* str1, int len2, const void* str2)
+{
+	return futureWin->CompareStringOrdinal((LPCWSTR)str1, len1/2, (LPCWSTR)str2, len2/2, TRUE) - CSTR_EQUAL;
+}
+
+void DBase::SortKey(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+	const wchar_t* str = (const wchar_t*)sqlite3_value_text16(argv[0]);
+	if (str == nullptr)
+	{
+		sqlite3_result_null(context);
+		return;
+	}
+
+	int len = sqlite3_value_bytes16(argv[0]) / 2;
+	if (len == 0)
+	{
+		sqlite3_result_zeroblob(context, 0);
+		return;
+	}
+
+	// For LCMAP_SORTKEY the size of the key is in bytes
+	DWORD flags = futureWin->IsVistaOrLater() ? LCMAP_SORTKEY|LINGUISTIC_IGNORECASE : LCMAP_SORTKEY|NORM_IGNORECASE;
+
+	int size = 0;
+	if (futureWin->IsVistaOrLater())
+		size = futureWin->LCMapStringEx(LOCALE_NAME_USER_DEFAULT, flags, (LPCWSTR)str, len, NULL, 0, NULL, NULL, 0);
+	else
+		size = LCMapStringW(LOCALE_USER_DEFAULT, flags, (LPCWSTR)str, len, NULL, 0);
+
+	if (size <= 0)
+	{
+		sqlite3_result_zeroblob(context, 0);
+		return;
+	}
+
+	std::unique_ptr<BYTE[]> key(new BYTE[size]);
+
+	if (futureWin->IsVistaOrLater())
+		size = futureWin->LCMapStringEx(LOCALE_NAME_USER_DEFAULT, flags, (LPCWSTR)str, len, (LPWSTR)key.get(), size, NULL, NULL, 0);
+	else
+		size = LCMapStringW(LOCALE_USER_DEFAULT, flags, (LPCWSTR)str, len, (LPWSTR)key.get(), size);
+
+	sqlite3_result_blob(context, key.get(), size, SQLITE_TRANSIENT);
+}
+
+std::wstring DBase::FoldCaseString(const wchar_t* str, int len)
+{
+	// LIKECASE uses LINGUISTIC_IGNORECASE (NORM_IGNORECASE on XP) of the user locale,
+	// it is the same as the lower case with linguistic casing. The length is not changed.
+	std::wstring result(len, '\0');
+	if (len == 0)
+		return result;
+
+	int size = 0;
+	if (futureWin->IsVistaOrLater())
+		size = futureWin->LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_LOWERCASE|LCMAP_LINGUISTIC_CASING,
+			str, len, &result[0], len, NULL, NULL, 0);
+	else
+		size = LCMapStringW(LOCALE_USER_DEFAULT, LCMAP_LOWERCASE, str, len, &result[0], len);
+
+	if (size <= 0)
+		result.assign(str, len);
+	else
+		result.resize(size);
+
+	return result;
+}
+
+void DBase::FoldCase(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+	const wchar_t* str = (const wchar_t*)sqlite3_value_text16(argv[0]);
+	if (str == nullptr)
+	{
+		sqlite3_result_null(context);
+		return;
+	}
+
+	std::wstring result = FoldCaseString(str, sqlite3_value_bytes16(argv[0]) / 2);
+
+	sqlite3_result_text16(context, result.c_str(), (int)(result.size() * sizeof(wchar_t)), SQLITE_TRANSIENT);
+}
@@ -257,7 +257,8 @@ void DlgSkin::LoadSkinInfo(const std::wstring& folder, ZipFile* zipFile)
 
 	XmlFile xmlFile;
 
-	if (xmlFile.LoadEx(file, zipFile))
+	// Not from the skin cache, it is opened for the current skin
+	if (xmlFile.LoadExNoCache(file, zipFile))
 	{	
 		XmlNode xmlMain = xmlFile.RootNode().FirstChild("SkinInfo");
 
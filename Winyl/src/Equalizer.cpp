@@ -0,0 +1,294 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "Equalizer.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define EQUALIZER_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	const float maxGainStep = 1.0f; // dB per block when smoothing
+	const double bandwidth = 1.5; // In octaves, the same as 18 semitones of DX8 ParamEQ that was used before
+	const double pi = 3.14159265358979323846;
+}
+
+Equalizer::Equalizer(const float* frequencies)
+{
+	for (int i = 0; i < BandCount; ++i)
+	{
+		bandFrequencies[i] = frequencies[i];
+		targetGains[i].store(0.0f);
+	}
+	targetPreamp.store(1.0f);
+}
+
+Equalizer::~Equalizer()
+{
+
+}
+
+void Equalizer::SetBand(int band, float gain)
+{
+	if (band >= 0 && band < BandCount)
+		targetGains[band].store(gain, std::memory_order_relaxed);
+}
+
+void Equalizer::SetPreamp(float gain)
+{
+	targetPreamp.store((float)std::pow(10.0, gain / 20.0), std::memory_order_relaxed);
+}
+
+void Equalizer::SetFormat(int rate, int chans)
+{
+	sampleRate = rate;
+	channels = chans;
+
+	for (int i = 0; i < BandCount; ++i)
+	{
+		for (int j = 0; j < maxChannels; ++j)
+		{
+			z1[i][j] = 0.0f;
+			z2[i][j] = 0.0f;
+		}
+	}
+
+	currentPreamp = targetPreamp.load(std::memory_order_relaxed);
+	UpdateGains(false);
+}
+
+void Equalizer::UpdateGains(bool isSmooth)
+{
+	bool isChanged = !isSmooth;
+
+	for (int i = 0; i < BandCount; ++i)
+	{
+		float target = targetGains[i].load(std::memory_order_relaxed);
+
+		if (isSmooth)
+		{
+			if (currentGains[i] == target)
+				continue;
+
+			if (target > currentGains[i] + maxGainStep)
+				currentGains[i] += maxGainStep;
+			else if (target < currentGains[i] - maxGainStep)
+				currentGains[i] -= maxGainStep;
+			else
+				currentGains[i] = target;
+		}
+		else
+			currentGains[i] = target;
+
+		CalcCoefs(i);
+		isChanged = true;
+	}
+
+	if (!isChanged)
+		return;
+
+	// Skip flat bands and bands above Nyquist, the state of a band that goes in or out is reset
+	// so the band does not start again with the state left from other coefficients long ago
+	activeCount = 0;
+	for (int i = 0; i < BandCount; ++i)
+	{
+		bool isBandActive = (currentGains[i] != 0.0f && bandFrequencies[i] < sampleRate * 0.45f);
+
+		if (isActive[i] != isBandActive)
+		{
+			isActive[i] = isBandActive;
+			for (int j = 0; j < maxChannels; ++j)
+			{
+				z1[i][j] = 0.0f;
+				z2[i][j] = 0.0f;
+			}
+		}
+
+		if (isBandActive)
+			activeBands[activeCount++] = i;
+	}
+}
+
+void Equalizer::CalcCoefs(int band)
+{
+	// Peaking EQ from Audio EQ Cookbook by Robert Bristow-Johnson
+	double A = std::pow(10.0, currentGains[band] / 40.0);
+	double w0 = 2.0 * pi * bandFrequencies[band] / sampleRate;
+	double sinw0 = std::sin(w0);
+	double cosw0 = std::cos(w0);
+	double alpha = sinw0 * std::sinh(std::log(2.0) / 2.0 * bandwidth * w0 / sinw0);
+
+	double a0 = 1.0 + alpha / A;
+
+	Coefs& c = coefs[band];
+	c.b0 = (float)((1.0 + alpha * A) / a0);
+	c.b1 = (float)((-2.0 * cosw0) / a0);
+	c.b2 = (float)((1.0 - alpha * A) / a0);
+	c.a1 = c.b1;
+	c.a2 = (float)((1.0 - alpha / A) / a0);
+}
+
+void Equalizer::Process(float* samples, std::size_t frames)
+{
+	if (channels <= 0 || channels > maxChannels)
+		return;
+
+#ifdef EQUALIZER_SSE
+	// Denormals in the filter state slow down the processing a lot on silence
+	unsigned int csr = _mm_getcsr();
+	_mm_setcsr(csr | _MM_FLUSH_ZERO_ON);
+#endif
+
+	while (frames > 0)
+	{
+		std::size_t count = std::min(frames, (std::size_t)blockFrames);
+
+		UpdateGains(true);
+
+		float preampFrom = currentPreamp;
+		float preampTo = targetPreamp.load(std::memory_order_relaxed);
+		currentPreamp = preampTo;
+
+		if (activeCount > 0 || preampFrom != 1.0f || preampTo != 1.0f)
+		{
+#ifdef EQUALIZER_SSE
+			if (channels <= 4)
+				ProcessBlockSSE(samples, count, preampFrom, preampTo);
+			else
+#endif
+				ProcessBlock(samples, count, preampFrom, preampTo);
+		}
+
+		samples += count * channels;
+		frames -= count;
+	}
+
+#ifdef EQUALIZER_SSE
+	_mm_setcsr(csr);
+#endif
+}
+
+void Equalizer::ProcessBlock(float* samples, std::size_t frames, float preampFrom, float preampTo)
+{
+	// Transposed Direct Form II, the same as the SSE version but channel by channel
+
+	float preampStep = (preampTo - preampFrom) / frames;
+
+	for (int ch = 0; ch < channels; ++ch)
+	{
+		float* p = samples + ch;
+
+		for (std::size_t i = 0; i < frames; ++i, p += channels)
+		{
+			float x = *p * (preampFrom + preampStep * (i + 1));
+
+			for (int k = 0; k < activeCount; ++k)
+			{
+				int b = activeBands[k];
+				const Coefs& c = coefs[b];
+
+				float y = c.b0 * x + z1[b][ch];
+				z1[b][ch] = c.b1 * x - c.a1 * y + z2[b][ch];
+				z2[b][ch] = c.b2 * x - c.a2 * y;
+				x = y;
+			}
+
+			*p = x;
+		}
+	}
+}
+
+#ifdef EQUALIZER_SSE
+void Equalizer::ProcessBlockSSE(float* samples, std::size_t frames, float preampFrom, float preampTo)
+{
+	// All channels of a frame are in one vector, so all bands are applied to all channels at once
+
+	__m128 b0[BandCount], b1[BandCount], b2[BandCount], a1[BandCount], a2[BandCount];
+	__m128 s1[BandCount], s2[BandCount];
+
+	for (int k = 0; k < activeCount; ++k)
+	{
+		int b = activeBands[k];
+		b0[k] = _mm_set1_ps(coefs[b].b0);
+		b1[k] = _mm_set1_ps(coefs[b].b1);
+		b2[k] = _mm_set1_ps(coefs[b].b2);
+		a1[k] = _mm_set1_ps(coefs[b].a1);
+		a2[k] = _mm_set1_ps(coefs[b].a2);
+		s1[k] = _mm_loadu_ps(z1[b]);
+		s2[k] = _mm_loadu_ps(z2[b]);
+	}
+
+	float preampStep = (preampTo - preampFrom) / frames;
+
+	float* p = samples;
+	for (std::size_t i = 0; i < frames; ++i, p += channels)
+	{
+		__m128 x;
+		if (channels == 2)
+			x = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)p);
+		else if (channels == 4)
+			x = _mm_loadu_ps(p);
+		else
+		{
+			float frame[4] = {};
+			for (int ch = 0; ch < channels; ++ch)
+				frame[ch] = p[ch];
+			x = _mm_loadu_ps(frame);
+		}
+
+		x = _mm_mul_ps(x, _mm_set1_ps(preampFrom + preampStep * (i + 1)));
+
+		for (int k = 0; k < activeCount; ++k)
+		{
+			__m128 y = _mm_add_ps(_mm_mul_ps(b0[k], x), s1[k]);
+			s1[k] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1[k], x), _mm_mul_ps(a1[k], y)), s2[k]);
+			s2[k] = _mm_sub_ps(_mm_mul_ps(b2[k], x), _mm_mul_ps(a2[k], y));
+			x = y;
+		}
+
+		if (channels == 2)
+			_mm_storel_pi((__m64*)p, x);
+		else if (channels == 4)
+			_mm_storeu_ps(p, x);
+		else
+		{
+			float frame[4];
+			_mm_storeu_ps(frame, x);
+			for (int ch = 0; ch < channels; ++ch)
+				p[ch] = frame[ch];
+		}
+	}
+
+	for (int k = 0; k < activeCount; ++k)
+	{
+		int b = activeBands[k];
+		_mm_storeu_ps(z1[b], s1[k]);
+		_mm_storeu_ps(z2[b], s2[k]);
+	}
+}
+#else
+void Equalizer::ProcessBlockSSE(float* samples, std::size_t frames, float preampFrom, float preampTo)
+{
+	ProcessBlock(samples, frames, preampFrom, preampTo);
+}
+#endif
@@ -0,0 +1,87 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Equalizer DSP with peaking biquad filters for all bands and preamp in one pass over the buffer.
+// Works with interleaved float samples, channels are processed together with SSE (up to 4 channels).
+// Gains can be changed from any thread while Process works in the audio thread,
+// changes are smoothed to avoid clicks.
+
+class Equalizer
+{
+
+public:
+	static const int BandCount = 10;
+
+	Equalizer(const float* frequencies);
+	virtual ~Equalizer();
+	Equalizer(const Equalizer&) = delete;
+	Equalizer& operator=(const Equalizer&) = delete;
+
+	// Call before Process, resets filters and applies gains without smoothing
+	void SetFormat(int sampleRate, int channels);
+	inline int GetChannels() {return channels;}
+
+	// Gains in dB
+	void SetBand(int band, float gain);
+	void SetPreamp(float gain);
+
+	void Process(float* samples, std::size_t frames);
+
+private:
+	static const int blockFrames = 64; // Gains are smoothed once per block
+	static const int maxChannels = 8;
+
+	struct Coefs
+	{
+		float b0 = 1.0f;
+		float b1 = 0.0f;
+		float b2 = 0.0f;
+		float a1 = 0.0f;
+		float a2 = 0.0f;
+	};
+
+	float bandFrequencies[BandCount] = {};
+
+	std::atomic<float> targetGains[BandCount];
+	std::atomic<float> targetPreamp;
+
+	float currentGains[BandCount] = {};
+	float currentPreamp = 1.0f; // Linear
+
+	Coefs coefs[BandCount];
+	int activeBands[BandCount] = {}; // Bands with gain != 0
+	int activeCount = 0;
+	bool isActive[BandCount] = {}; // The band is in activeBands
+
+	// Filter state [band][channel]
+	float z1[BandCount][maxChannels] = {};
+	float z2[BandCount][maxChannels] = {};
+
+	int sampleRate = 44100;
+	int channels = 2;
+
+	void UpdateGains(bool isSmooth);
+	void CalcCoefs(int band);
+	void ProcessBlock(float* samples, std::size_t frames, float preampFrom, float preampTo);
+	void ProcessBlockSSE(float* samples, std::size_t frames, float preampFrom, float preampTo);
+};
@@ -17,6 +17,7 @@
 
 #include "stdafx.h"
 #include "ExImage.h"
+#include "SkinCache.h"
 
 ExImage::ExImage()
 {
@@ -53,6 +54,10 @@ bool ExImage::LoadEx(const std::wstring& file, ZipFile* zipFile)
 {
 	Clear();
 
+	// Only skin images are loaded with this function, try the decoded image from the cache first
+	if (SkinCache::Instance().Load(file, *this))
+		return true;
+
 	ExImage::Source image;
 	if (image.LoadEx(file, zipFile))
 	{
@@ -62,6 +67,8 @@ bool ExImage::LoadEx(const std::wstring& file, ZipFile* zipFile)
 		{
 			image.GetSize(&bitmapWidth, &bitmapHeight);
 
+			SkinCache::Instance().Save(file, *this);
+
 			return true;
 		}
 	}
@@ -143,6 +150,68 @@ bool ExImage::ThumbnailFromSource(const ExImage::Source& image, int cx, int cy)
 	return false;
 }
 
+bool ExImage::LoadFromBits(const char* bits, int width, int height)
+{
+	Clear();
+
+	if (width <= 0 || height <= 0)
+		return false;
+
+	BITMAPINFO bmi = {};
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = width;
+	bmi.bmiHeader.biHeight = -height;
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	void* dibBits = nullptr;
+	bitmapHandle = ::CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, &dibBits, NULL, 0);
+
+	if (bitmapHandle)
+	{
+		memcpy(dibBits, bits, (std::size_t)width * height * 4);
+
+		bitmapWidth = width;
+		bitmapHeight = height;
+
+		return true;
+	}
+
+	return false;
+}
+
+bool ExImage::GetBits(std::vector<char>& bits)
+{
+	if (!bitmapHandle)
+		return false;
+
+	DIBSECTION ds = {};
+	if (::GetObjectW(bitmapHandle, sizeof(DIBSECTION), &ds) != sizeof(DIBSECTION) ||
+		ds.dsBm.bmBits == nullptr || ds.dsBm.bmBitsPixel != 32)
+		return false;
+
+	const int width = ds.dsBm.bmWidth;
+	const int height = ds.dsBm.bmHeight;
+	const std::size_t stride = (std::size_t)width * 4;
+
+	::GdiFlush();
+
+	bits.resize(stride * height);
+
+	// The bitmap can be bottom-up or top-down, always return top-down
+	const char* src = static_cast<const char*>(ds.dsBm.bmBits);
+	if (ds.dsBmih.biHeight < 0)
+		memcpy(bits.data(), src, bits.size());
+	else
+	{
+		for (int i = 0; i < height; ++i)
+			memcpy(bits.data() + stride * i, src + stride * (height - 1 - i), stride);
+	}
+
+	return true;
+}
+
 void ExImage::Tile(HDC dc, int x, int y, int cx, int cy)
 {
 	if (cx == 0 || cy == 0)
@@ -407,6 +476,28 @@ bool ExImage::Source::LoadBuffer(const char* buffer, int size)
 {
 	assert(bitmap == nullptr);
 
+	if (!ImagingFactory::Instance().Get())
+		return false;
+
+	// The stream reads the buffer directly without a copy (the buffer is a file in the mapped skin pack)
+	IWICStream* wicStream = nullptr;
+	HRESULT hr = ImagingFactory::Instance().Get()->CreateStream(&wicStream);
+	if (SUCCEEDED(hr))
+	{
+		hr = wicStream->InitializeFromMemory((BYTE*)buffer, (DWORD)size);
+		if (SUCCEEDED(hr))
+			bitmap = LoadBitmapFromStream(wicStream);
+
+		wicStream->Release();
+	}
+
+	return bitmap ? true : false;
+}
+
+bool ExImage::Source::LoadBufferCopy(const char* buffer, int size)
+{
+	assert(bitmap == nullptr);
+
 	IStream* stream = nullptr;
 	if (::CreateStreamOnHGlobal(NULL, TRUE, &stream) == S_OK)
 	{
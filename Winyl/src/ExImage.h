@@ -34,6 +34,9 @@ public:
 	bool LoadFromSource(const ExImage::Source& image);
 	bool ThumbnailFromFile(const std::wstring& file, ZipFile* zipFile, int cx, int cy);
 	bool ThumbnailFromSource(const ExImage::Source& image, int cx, int cy);
+	// Raw 32 bpp premultiplied BGRA pixels, top-down (used by CoverCache)
+	bool LoadFromBits(const char* bits, int width, int height);
+	bool GetBits(std::vector<char>& bits);
 	bool LoadEx(const std::wstring& file, ZipFile* zipFile);
 	void MoveTo(ExImage* image);
 	void Clear();
@@ -87,7 +90,10 @@ public:
 		Source& operator=(const Source&) = delete;
 
 		bool LoadFile(const std::wstring& file);
+		// The image is decoded on demand so the buffer must stay valid while the source is used,
+		// use LoadBufferCopy if the buffer is freed before
 		bool LoadBuffer(const char* buffer, int size);
+		bool LoadBufferCopy(const char* buffer, int size);
 		bool LoadEx(const std::wstring& file, ZipFile* zipFile);
 		void Free();
 		bool IsValid() const;
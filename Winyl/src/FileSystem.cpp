@@ -31,6 +31,20 @@ bool Exists(const std::wstring& file)
 	return false;
 }
 
+long long GetModified(const std::wstring& file)
+{
+	WIN32_FILE_ATTRIBUTE_DATA fd;
+	if (::GetFileAttributesExW(file.c_str(), GetFileExInfoStandard, &fd))
+	{
+		ULARGE_INTEGER ull;
+		ull.LowPart = fd.ftLastWriteTime.dwLowDateTime;
+		ull.HighPart = fd.ftLastWriteTime.dwHighDateTime;
+		return (long long)(ull.QuadPart / 10000000ULL - 11644473600ULL);
+	}
+
+	return 0;
+}
+
 bool CreateDir(const std::wstring& path)
 {
 	if (::CreateDirectoryW(path.c_str(), NULL))
@@ -26,6 +26,7 @@ namespace FileSystem
 {
 
 bool Exists(const std::wstring& file);
+long long GetModified(const std::wstring& file); // 0 if not found
 bool CreateDir(const std::wstring& path);
 bool RemoveDir(const std::wstring& path);
 bool RemoveFile(const std::wstring& file);
@@ -78,12 +78,15 @@ bool FontsLoader::LoadSkinFonts(const std::wstring& programPath, const std::wstr
 					}
 					else
 					{
-						zipFile->UnzipToBuffer(attr);
-						DWORD numberFonts = 0;
-						HANDLE fontHandle = AddFontMemResourceEx(zipFile->GetBuffer(), zipFile->GetBufferSize(), 0, &numberFonts);						
-						zipFile->FreeBuffer();
-						if (fontHandle)
-							fontHandles.push_back(fontHandle);
+						if (zipFile->UnzipToBuffer(attr))
+						{
+							// The font is copied by the system so the buffer is not modified
+							DWORD numberFonts = 0;
+							HANDLE fontHandle = AddFontMemResourceEx(const_cast<char*>(zipFile->GetBuffer()), zipFile->GetBufferSize(), 0, &numberFonts);
+							zipFile->FreeBuffer();
+							if (fontHandle)
+								fontHandles.push_back(fontHandle);
+						}
 					}
 				}
 			}
@@ -104,6 +104,7 @@ void FutureWin::LoadKernel32Functions()
 	funcFindNLSStringEx = (FIND_NLS_STRING_EX)::GetProcAddress(libKernel32, "FindNLSStringEx");
 	funcCompareStringOrdinal = (COMPARE_STRING_ORDINAL)::GetProcAddress(libKernel32, "CompareStringOrdinal");
 	funcFindStringOrdinal = (FIND_STRING_ORDINAL)::GetProcAddress(libKernel32, "FindStringOrdinal");
+	funcGetNLSVersion = (GET_NLS_VERSION)::GetProcAddress(libKernel32, "GetNLSVersion");
 
 	funcInitializeConditionVariable = (INITIALIZE_CONDITION_VARIABLE)::GetProcAddress(libKernel32, "InitializeConditionVariable");
 	funcSleepConditionVariableCS = (SLEEP_CONDITION_VARIABLE_CS)::GetProcAddress(libKernel32, "SleepConditionVariableCS");
@@ -198,6 +199,14 @@ int FutureWin::FindStringOrdinal(DWORD dwFindStringOrdinalFlags, LPCWSTR lpStrin
 	return funcFindStringOrdinal(dwFindStringOrdinalFlags, lpStringSource, cchSource, lpStringValue, cchValue, bIgnoreCase);
 }
 
+BOOL FutureWin::GetNLSVersion(NLS_FUNCTION Function, LCID Locale, LPNLSVERSIONINFO lpVersionInformation)
+{
+	if (funcGetNLSVersion == nullptr) // Not available on WinXP without the NLS redistributable
+		return FALSE;
+
+	return funcGetNLSVersion(Function, Locale, lpVersionInformation);
+}
+
 VOID FutureWin::InitializeConditionVariable(PCONDITION_VARIABLE ConditionVariable)
 {
 	//if (!funcInitializeConditionVariable)
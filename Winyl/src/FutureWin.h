@@ -95,6 +95,7 @@ class FutureWin
 		int FindNLSStringEx(LPCWSTR lpLocaleName, DWORD dwFindNLSStringFlags, LPCWSTR lpStringSource, int cchSource, LPCWSTR lpStringValue, int cchValue, LPINT pcchFound, LPNLSVERSIONINFO lpVersionInformation, LPVOID lpReserved, LPARAM sortHandle);
 		int CompareStringOrdinal(LPCWSTR lpString1, int cchCount1, LPCWSTR lpString2, int cchCount2, BOOL bIgnoreCase);
 		int FindStringOrdinal(DWORD dwFindStringOrdinalFlags, LPCWSTR lpStringSource, int cchSource, LPCWSTR lpStringValue, int cchValue, BOOL bIgnoreCase); // Windows 7
+		BOOL GetNLSVersion(NLS_FUNCTION Function, LCID Locale, LPNLSVERSIONINFO lpVersionInformation);
 
 		VOID InitializeConditionVariable(PCONDITION_VARIABLE ConditionVariable);
 		BOOL SleepConditionVariableCS(PCONDITION_VARIABLE ConditionVariable, PCRITICAL_SECTION CriticalSection, DWORD dwMilliseconds);
@@ -145,6 +146,7 @@ private:
 		typedef int (__stdcall* FIND_NLS_STRING_EX)(LPCWSTR lpLocaleName, DWORD dwFindNLSStringFlags, LPCWSTR lpStringSource, int cchSource, LPCWSTR lpStringValue, int cchValue, LPINT pcchFound, LPNLSVERSIONINFO lpVersionInformation, LPVOID lpReserved, LPARAM sortHandle);
 		typedef int (__stdcall* COMPARE_STRING_ORDINAL)(LPCWSTR lpString1, int cchCount1, LPCWSTR lpString2, int cchCount2, BOOL bIgnoreCase);
 		typedef int (__stdcall* FIND_STRING_ORDINAL)(DWORD dwFindStringOrdinalFlags, LPCWSTR lpStringSource, int cchSource, LPCWSTR lpStringValue, int cchValue, BOOL bIgnoreCase);
+		typedef BOOL (__stdcall* GET_NLS_VERSION)(NLS_FUNCTION Function, LCID Locale, LPNLSVERSIONINFO lpVersionInformation);
 
 		typedef VOID (__stdcall* INITIALIZE_CONDITION_VARIABLE)(PCONDITION_VARIABLE ConditionVariable);
 		typedef BOOL (__stdcall* SLEEP_CONDITION_VARIABLE_CS)(PCONDITION_VARIABLE ConditionVariable, PCRITICAL_SECTION CriticalSection, DWORD dwMilliseconds);
@@ -196,6 +198,7 @@ private:
 		FIND_NLS_STRING_EX funcFindNLSStringEx = nullptr;
 		COMPARE_STRING_ORDINAL funcCompareStringOrdinal = nullptr;
 		FIND_STRING_ORDINAL funcFindStringOrdinal = nullptr;
+		GET_NLS_VERSION funcGetNLSVersion = nullptr;
 
 		INITIALIZE_CONDITION_VARIABLE funcInitializeConditionVariable = nullptr;
 		SLEEP_CONDITION_VARIABLE_CS funcSleepConditionVariableCS = nullptr;
@@ -19,6 +19,116 @@
 #include "HttpClient.h"
 #include "winhttp.h"
 #include "UTF.h"
+#include "Threading.h"
+#include <map>
+#include <algorithm>
+
+#ifndef WINHTTP_OPTION_DECOMPRESSION // Not in old SDK
+#define WINHTTP_OPTION_DECOMPRESSION 118
+#define WINHTTP_DECOMPRESSION_FLAG_GZIP 0x00000001
+#define WINHTTP_DECOMPRESSION_FLAG_DEFLATE 0x00000002
+#define WINHTTP_DECOMPRESSION_FLAG_ALL (WINHTTP_DECOMPRESSION_FLAG_GZIP|WINHTTP_DECOMPRESSION_FLAG_DEFLATE)
+#endif
+
+// WinHTTP session with connection handles by host (used by many threads at the same time)
+class HttpClient::Session final
+{
+public:
+	Session(HINTERNET handle) : sessionHandle(handle) {}
+	~Session()
+	{
+		for (auto& connection : connections)
+			WinHttpCloseHandle(connection.second);
+		WinHttpCloseHandle(sessionHandle);
+	}
+	Session(const Session&) = delete;
+	Session& operator=(const Session&) = delete;
+
+	HINTERNET GetConnection(const std::wstring& server, INTERNET_PORT port)
+	{
+		std::wstring key = server + L':' + std::to_wstring(port);
+
+		LockGuard lock(mutex);
+
+		auto find = connections.find(key);
+		if (find != connections.end())
+			return find->second;
+
+		HINTERNET connectHandle = WinHttpConnect(sessionHandle, server.c_str(), port, 0);
+		if (connectHandle)
+			connections.emplace(key, connectHandle);
+
+		return connectHandle;
+	}
+
+	const HINTERNET sessionHandle;
+
+private:
+	Threading::Mutex mutex;
+	std::map<std::wstring, HINTERNET> connections;
+};
+
+class HttpClient::Pool final
+{
+public:
+	Pool()
+	{
+		semaphore = ::CreateSemaphoreW(NULL, maxRequests, maxRequests, NULL);
+	}
+	~Pool()
+	{
+		session.reset();
+		if (semaphore)
+			::CloseHandle(semaphore);
+	}
+	Pool(const Pool&) = delete;
+	Pool& operator=(const Pool&) = delete;
+
+	Threading::Mutex mutex;
+	HANDLE semaphore = NULL;
+	std::shared_ptr<Session> session;
+};
+
+// State of one request, the callback of WinHTTP wakes up the thread of the request
+class HttpClient::Request final
+{
+public:
+	Request()
+	{
+		event = ::CreateEventW(NULL, FALSE, FALSE, NULL);
+		eventClosed = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+	}
+	~Request()
+	{
+		if (event)
+			::CloseHandle(event);
+		if (eventClosed)
+			::CloseHandle(eventClosed);
+	}
+	Request(const Request&) = delete;
+	Request& operator=(const Request&) = delete;
+
+	// Wait for the callback of the last call, return false if the call failed or the request is aborted
+	bool Wait(Cancel* cancel)
+	{
+		HANDLE handles[2] = {event, NULL};
+		DWORD count = 1;
+		if (cancel && cancel->eventAbort)
+			handles[count++] = cancel->eventAbort;
+
+		if (::WaitForMultipleObjects(count, handles, FALSE, INFINITE) != WAIT_OBJECT_0)
+			return false;
+
+		return !isError;
+	}
+
+	HANDLE event = NULL; // Auto reset, the call is complete
+	HANDLE eventClosed = NULL; // The handle is closed, no more callbacks
+	DWORD value = 0; // Bytes available or read
+	bool isError = false;
+};
+
+HttpClient::Pool HttpClient::pool;
 
 HttpClient::HttpClient(void)
 {
@@ -38,20 +148,89 @@ std::wstring HttpClient::proxyPass;
 
 void HttpClient::SetProxy(int proxy, const std::wstring& host, const std::wstring& port, const std::wstring& login, const std::wstring& pass)
 {
+	LockGuard lock(pool.mutex);
+
 	proxyType = proxy;
 	proxyHost = host;
 	proxyPort = port;
 	proxyLogin = login;
 	proxyPass = pass;
+
+	// The next request creates a new session with the new proxy
+	pool.session.reset();
+}
+
+void HttpClient::CloseSession()
+{
+	LockGuard lock(pool.mutex);
+	pool.session.reset();
+}
+
+void HttpClient::Cancel::Abort()
+{
+	// The requests see the event in Request::Wait and close their handles themselves
+	isAborted = true;
+	if (eventAbort)
+		::SetEvent(eventAbort);
 }
 
-bool HttpClient::GetHttpPage(const std::string& url, std::string& outPage)
+void CALLBACK HttpClient::RequestCallback(void* handle, DWORD_PTR context, DWORD status, void* info, DWORD infoLength)
 {
-	return GetHttpPage(UTF::UTF16S(url), outPage);
+	// The session and connection handles do not have the context
+	Request* request = reinterpret_cast<Request*>(context);
+	if (request == nullptr)
+		return;
+
+	switch (status)
+	{
+	case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+	case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+		break;
+	case WINHTTP_CALLBACK_STATUS_DATA_AVAILABLE:
+		request->value = *static_cast<DWORD*>(info);
+		break;
+	case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+		request->value = infoLength;
+		break;
+	case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+		request->isError = true;
+		break;
+	case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+		::SetEvent(request->eventClosed);
+		return;
+	default:
+		return;
+	}
+
+	::SetEvent(request->event);
 }
 
-bool HttpClient::GetHttpPage(const std::wstring& url, std::string& outPage)
+bool HttpClient::GetHttpPage(const std::string& url, std::string& outPage, Cancel* cancel, DWORD* outStatusCode)
 {
+	return GetHttpPage(UTF::UTF16S(url), outPage, cancel, outStatusCode);
+}
+
+std::future<HttpClient::HttpPage> HttpClient::GetHttpPageAsync(const std::string& url)
+{
+	return GetHttpPageAsync(UTF::UTF16S(url));
+}
+
+std::future<HttpClient::HttpPage> HttpClient::GetHttpPageAsync(const std::wstring& url)
+{
+	return std::async(std::launch::async, [url]()
+	{
+		HttpPage httpPage;
+		httpPage.result = GetHttpPage(url, httpPage.page);
+		return httpPage;
+	});
+}
+
+bool HttpClient::GetHttpPage(const std::wstring& url, std::string& outPage, Cancel* cancel, DWORD* outStatusCode)
+{
+	outPage.clear();
+	if (outStatusCode)
+		*outStatusCode = 0;
+
 	std::wstring server;
 	std::wstring path;
 	bool https = false;
@@ -72,51 +251,111 @@ bool HttpClient::GetHttpPage(const std::wstring& url, std::string& outPage)
 			server = url.substr(start);
 	}
 
+	// Port in the url (http://127.0.0.1:8080/ for example)
+	INTERNET_PORT port = https ? INTERNET_DEFAULT_HTTPS_PORT : INTERNET_DEFAULT_HTTP_PORT;
+	find = server.find(':');
+	if (find != std::string::npos)
+	{
+		int value = _wtoi(server.c_str() + find + 1);
+		if (value > 0 && value <= 0xFFFF)
+			port = (INTERNET_PORT)value;
+		server.resize(find);
+	}
+
 	if (server.empty())
 		return false;
 
-	//const std::wstring userAgent = L"Mozilla/5.0 (Windows NT 6.1; rv:28.0) Gecko/20100101 Firefox/28.0";
-	const std::wstring userAgent = L"Mozilla/5.0 (Windows NT 6.1; WOW64; Trident/7.0; rv:11.0) like Gecko";
+	if (!pool.semaphore || (cancel && cancel->IsAborted()))
+		return false;
 
-	HINTERNET sessionHandle = NULL;
-	HINTERNET connectHandle = NULL;
-	HINTERNET requestHandle = NULL;
+	// Limit the number of requests at the same time (an aborted request does not wait for the slot)
+	HANDLE handles[2] = {pool.semaphore, NULL};
+	DWORD count = 1;
+	if (cancel && cancel->eventAbort)
+		handles[count++] = cancel->eventAbort;
+
+	if (::WaitForMultipleObjects(count, handles, FALSE, INFINITE) != WAIT_OBJECT_0)
+		return false;
+
+	std::shared_ptr<Session> session;
+	bool isProxyAuth = false;
+	std::wstring login;
+	std::wstring pass;
 
-	if (proxyType == 0)
-		sessionHandle = WinHttpOpen(userAgent.c_str(), WINHTTP_ACCESS_TYPE_NO_PROXY, 0, WINHTTP_NO_PROXY_BYPASS, 0);
-	else
-		sessionHandle = WinHttpOpen(userAgent.c_str(), WINHTTP_ACCESS_TYPE_NAMED_PROXY, (proxyHost + L':' + proxyPort).c_str(), WINHTTP_NO_PROXY_BYPASS, 0);
+	pool.mutex.Lock();
 
-	if (sessionHandle)
+	if (!pool.session)
 	{
-		if (!WinHttpSetTimeouts(sessionHandle, 5000, 5000, 5000, 5000))
-		{
-			WinHttpCloseHandle(sessionHandle);
-			return false;
-		}
+		//const std::wstring userAgent = L"Mozilla/5.0 (Windows NT 6.1; rv:28.0) Gecko/20100101 Firefox/28.0";
+		const std::wstring userAgent = L"Mozilla/5.0 (Windows NT 6.1; WOW64; Trident/7.0; rv:11.0) like Gecko";
 
-		// By default only SSL3 and TLS1 are enabled in Windows 7 so enable TLS1.1 and TLS1.2 too
-		if (https)
+		HINTERNET sessionHandle = NULL;
+
+		if (proxyType == 0)
+			sessionHandle = WinHttpOpen(userAgent.c_str(), WINHTTP_ACCESS_TYPE_NO_PROXY, 0, WINHTTP_NO_PROXY_BYPASS, WINHTTP_FLAG_ASYNC);
+		else
+			sessionHandle = WinHttpOpen(userAgent.c_str(), WINHTTP_ACCESS_TYPE_NAMED_PROXY, (proxyHost + L':' + proxyPort).c_str(), WINHTTP_NO_PROXY_BYPASS, WINHTTP_FLAG_ASYNC);
+
+		if (sessionHandle)
 		{
-			DWORD flags = WINHTTP_FLAG_SECURE_PROTOCOL_SSL3|WINHTTP_FLAG_SECURE_PROTOCOL_TLS1|WINHTTP_FLAG_SECURE_PROTOCOL_TLS1_1|WINHTTP_FLAG_SECURE_PROTOCOL_TLS1_2;
-			WinHttpSetOption(sessionHandle, WINHTTP_OPTION_SECURE_PROTOCOLS, &flags, sizeof(flags));
+			// The callback is inherited by all request handles of the session
+			if (WinHttpSetTimeouts(sessionHandle, 5000, 5000, 5000, 5000) &&
+				WinHttpSetStatusCallback(sessionHandle, RequestCallback,
+					WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS|WINHTTP_CALLBACK_FLAG_HANDLES, 0) != WINHTTP_INVALID_STATUS_CALLBACK)
+			{
+				// By default only SSL3 and TLS1 are enabled in Windows 7 so enable TLS1.1 and TLS1.2 too
+				DWORD flags = WINHTTP_FLAG_SECURE_PROTOCOL_SSL3|WINHTTP_FLAG_SECURE_PROTOCOL_TLS1|WINHTTP_FLAG_SECURE_PROTOCOL_TLS1_1|WINHTTP_FLAG_SECURE_PROTOCOL_TLS1_2;
+				WinHttpSetOption(sessionHandle, WINHTTP_OPTION_SECURE_PROTOCOLS, &flags, sizeof(flags));
+
+				pool.session.reset(new Session(sessionHandle));
+
+				// WinHTTP adds Accept-Encoding header and decodes the page itself (fails before Windows 8.1, then pages are not encoded)
+				flags = WINHTTP_DECOMPRESSION_FLAG_ALL;
+				WinHttpSetOption(sessionHandle, WINHTTP_OPTION_DECOMPRESSION, &flags, sizeof(flags));
+			}
+			else
+				WinHttpCloseHandle(sessionHandle);
 		}
+	}
 
-		connectHandle = WinHttpConnect(sessionHandle, server.c_str(), https ? INTERNET_DEFAULT_HTTPS_PORT : INTERNET_DEFAULT_HTTP_PORT, 0);
+	session = pool.session;
+
+	if (proxyType == 2)
+	{
+		isProxyAuth = true;
+		login = proxyLogin;
+		pass = proxyPass;
 	}
 
-	if (connectHandle)
+	pool.mutex.Unlock();
+
+	HINTERNET connectHandle = NULL;
+	HINTERNET requestHandle = NULL;
+	Request request;
+
+	if (session)
+		connectHandle = session->GetConnection(server, port);
+
+	if (connectHandle && request.event && request.eventClosed)
 	{
 		requestHandle = WinHttpOpenRequest(connectHandle, L"GET", path.c_str(),
 			NULL, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, https ? WINHTTP_FLAG_SECURE : 0);
+
+		// The context is set before any call so the callback knows the request (and its closing) from the start
+		DWORD_PTR context = (DWORD_PTR)&request;
+		if (requestHandle && !WinHttpSetOption(requestHandle, WINHTTP_OPTION_CONTEXT_VALUE, &context, sizeof(context)))
+		{
+			WinHttpCloseHandle(requestHandle);
+			requestHandle = NULL;
+		}
 	}
 
 	bool result = false;
 
 	if (requestHandle)
 	{
-		if (proxyType == 2)
-			WinHttpSetCredentials(requestHandle, WINHTTP_AUTH_TARGET_PROXY, WINHTTP_AUTH_SCHEME_BASIC, proxyLogin.c_str(), proxyPass.c_str(), NULL);
+		if (isProxyAuth)
+			WinHttpSetCredentials(requestHandle, WINHTTP_AUTH_TARGET_PROXY, WINHTTP_AUTH_SCHEME_BASIC, login.c_str(), pass.c_str(), NULL);
 
 		// Test
 		//if (https)
@@ -127,9 +366,10 @@ bool HttpClient::GetHttpPage(const std::wstring& url, std::string& outPage)
 		//	//WinHttpSetStatusCallback(requestHandle, callback, WINHTTP_CALLBACK_FLAG_SECURE_FAILURE, NULL);
 		//}
 
-		if (WinHttpSendRequest(requestHandle, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0))
+		if (WinHttpSendRequest(requestHandle, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, (DWORD_PTR)&request) &&
+			request.Wait(cancel))
 		{
-			if (WinHttpReceiveResponse(requestHandle, NULL))
+			if (WinHttpReceiveResponse(requestHandle, NULL) && request.Wait(cancel))
 			{
 				DWORD statusCode = 0;
 				DWORD statusCodeSize = sizeof(statusCode);
@@ -137,65 +377,64 @@ bool HttpClient::GetHttpPage(const std::wstring& url, std::string& outPage)
 				WinHttpQueryHeaders(requestHandle, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
 					WINHTTP_HEADER_NAME_BY_INDEX, &statusCode, &statusCodeSize, WINHTTP_NO_HEADER_INDEX);
 
+				if (outStatusCode)
+					*outStatusCode = statusCode;
+
+				// Read the whole response, otherwise the socket is not reused (keep-alive).
+				// The body of an error (404 from a lyrics site for example) is read too and thrown away,
+				// a big one is not worth it and the socket is closed then.
 				if (statusCode == 200)
+					result = ReadData(requestHandle, request, cancel, outPage, maxPageSize);
+				else
 				{
-					int limiter = 0;
-
-					while (true)
-					{
-						DWORD size = 0;
-						if (!WinHttpQueryDataAvailable(requestHandle, &size))
-							break;
-
-						if (size == 0)
-						{
-							result = true;
-							break;
-						}
-
-						limiter += size;
-						if (limiter > 500 * 1024)
-						{
-							assert(false);
-							break;
-						}
-
-						char *buffer = new char[size + 1];
-						//buffer[0] = '\0';
-						ZeroMemory(buffer, size + 1);
-
-						DWORD read = 0;
-						if (!WinHttpReadData(requestHandle, (LPVOID)buffer, size, &read))
-						{
-							delete[] buffer;
-							break;
-						}
-
-						// This condition should never be reached since WinHttpQueryDataAvailable
-						// reported that there are bits to read.
-						if (read == 0)
-						{
-							delete[] buffer;
-							result = true;
-							break;
-						}
-
-						buffer[read] = '\0';
-						outPage += buffer;
-
-						delete[] buffer;
-					}
+					std::string errorPage;
+					ReadData(requestHandle, request, cancel, errorPage, maxErrorPageSize);
 				}
 			}
 		}
 	}
 
-	if (requestHandle) WinHttpCloseHandle(requestHandle);
-	if (connectHandle) WinHttpCloseHandle(connectHandle);
-	if (sessionHandle) WinHttpCloseHandle(sessionHandle);
+	// Closing cancels a pending call, the buffer of the call and the request must stay until the last callback
+	if (requestHandle)
+	{
+		WinHttpCloseHandle(requestHandle);
+		::WaitForSingleObject(request.eventClosed, INFINITE);
+	}
+
+	::ReleaseSemaphore(pool.semaphore, 1, NULL);
 
 	if (!result)
 		outPage.clear();
 
 	return result;
 }
+
+bool HttpClient::ReadData(void* requestHandle, Request& request, Cancel* cancel, std::string& outData, std::size_t maxSize)
+{
+	while (true)
+	{
+		if (!WinHttpQueryDataAvailable(requestHandle, NULL) || !request.Wait(cancel))
+			return false;
+
+		DWORD size = request.value;
+		if (size == 0)
+			return true;
+
+		if (outData.size() + size > maxSize)
+			return false;
+
+		std::size_t oldSize = outData.size();
+		outData.resize(oldSize + size);
+
+		if (!WinHttpReadData(requestHandle, &outData[oldSize], size, NULL) || !request.Wait(cancel))
+			return false;
+
+		DWORD read = request.value;
+		outData.resize(oldSize + read);
+
+		// This condition should never be reached since WinHttpQueryDataAvailable
+		// reported that there are bits to read.
+		if (read == 0)
+			return true;
+	}
+}
@@ -18,6 +18,18 @@
 #pragma once
 
 #include "UTF.h"
+#include "Threading.h"
+#include <memory>
+#include <future>
+#include <vector>
+
+// All requests go through one WinHTTP session for the process with one connection handle per host,
+// so WinHTTP keeps sockets alive between requests and reuses them (no new DNS/TCP/TLS handshake
+// for each lyrics lookup). The session is created on the first request and recreated when the proxy is changed,
+// requests in progress finish with the old session. The number of requests at the same time is limited by maxRequests.
+// Pages are requested with gzip/deflate encoding if WinHTTP can decode it (Windows 8.1 and later).
+// WinHTTP works in async mode: the thread of a request waits for the callback or for Cancel and only
+// this thread closes the handle of the request, so a handle is never closed while another thread uses it.
 
 class HttpClient
 {
@@ -25,10 +37,41 @@ public:
 	HttpClient(void);
 	virtual ~HttpClient(void);
 
+	// Requests that use the same Cancel object can be aborted from another thread
+	class Cancel final
+	{
+	friend class HttpClient;
+	public:
+		Cancel() {eventAbort = ::CreateEventW(NULL, TRUE, FALSE, NULL);}
+		~Cancel() {if (eventAbort) ::CloseHandle(eventAbort);}
+		Cancel(const Cancel&) = delete;
+		Cancel& operator=(const Cancel&) = delete;
+
+		void Abort(); // Wake up all requests in progress (they close themselves), new requests fail at once
+		inline bool IsAborted() {return isAborted;}
+
+	private:
+		std::atomic<bool> isAborted = false;
+		HANDLE eventAbort = NULL; // Manual reset, set by Abort
+	};
+
 	// Global set proxy for this class
 	static void SetProxy(int proxy, const std::wstring& host, const std::wstring& port, const std::wstring& login, const std::wstring& pass);
-	static bool GetHttpPage(const std::wstring& url, std::string& outPage);
-	static bool GetHttpPage(const std::string& url, std::string& outPage);
+	// outStatusCode is the HTTP status code of the response or 0 if there is no response (no connection, timeout, aborted)
+	static bool GetHttpPage(const std::wstring& url, std::string& outPage, Cancel* cancel = nullptr, DWORD* outStatusCode = nullptr);
+	static bool GetHttpPage(const std::string& url, std::string& outPage, Cancel* cancel = nullptr, DWORD* outStatusCode = nullptr);
+
+	struct HttpPage
+	{
+		bool result = false;
+		std::string page;
+	};
+	// Load the page in another thread, the caller waits for the future only when it needs the page
+	static std::future<HttpPage> GetHttpPageAsync(const std::wstring& url);
+	static std::future<HttpPage> GetHttpPageAsync(const std::string& url);
+
+	// Close the session and all connections (requests in progress still finish)
+	static void CloseSession();
 
 protected:
 	static int proxyType;
@@ -36,5 +79,18 @@ protected:
 	static std::wstring proxyPort;
 	static std::wstring proxyLogin;
 	static std::wstring proxyPass;
+
+	static const int maxRequests = 4;
+	static const int maxPageSize = 500 * 1024;
+	static const int maxErrorPageSize = 64 * 1024;
+
+	class Session;
+	class Pool;
+	class Request;
+	static Pool pool;
+
+	static void CALLBACK RequestCallback(void* handle, DWORD_PTR context, DWORD status, void* info, DWORD infoLength);
+	// Read the body of the response to the end, return false if it is bigger than maxSize or the read failed
+	static bool ReadData(void* requestHandle, Request& request, Cancel* cancel, std::string& outData, std::size_t maxSize);
 };
 
@@ -71,9 +71,6 @@ LibAudio::LibAudio()
 {
 	BASS_SetConfig(BASS_CONFIG_UNICODE, TRUE);
 	BASS_ASIO_SetUnicode(TRUE);
-	
-	// Initialize equalizer effect handles to NULL
-	InitializeEqHandles();
 }
 
 LibAudio::~LibAudio()
@@ -228,9 +225,23 @@ bool LibAudio::Init(WinylWnd* wnd, int driver, int device, bool isBit32, bool is
 		mutexBuffer.reset(new Threading::Mutex());
 		threadBuffer.reset(new Threading::Thread());
 		threadBuffer->Start(std::bind(&LibAudio::RunThreadBuffer, this), Threading::Thread::Priority::TimeCritical);
+
+		stopThreadCrossfade = false;
+		eventCrossfade.reset(new Threading::Event());
+		mutexCrossfade.reset(new Threading::Mutex());
+		threadCrossfade.Start(std::bind(&LibAudio::RunThreadCrossfade, this));
 		DEBUG_LOG("High-performance audio buffer thread started");
 	}
 
+	// The thread loads files to memory for all drivers (see OpenMemoryFile)
+	if (!threadMemory.IsJoinable())
+	{
+		stopThreadMemory = false;
+		eventMemory.reset(new Threading::Event());
+		mutexMemory.reset(new Threading::Mutex());
+		threadMemory.StartBackground(std::bind(&LibAudio::RunThreadMemory, this));
+	}
+
 	
 	DEBUG_LOG("Configuring BASS audio settings...");
 	BASS_SetConfig(BASS_CONFIG_BUFFER, Buffer::DirectSound); // DirectSound buffer size (1000 ms should be enought to preload track)
@@ -240,7 +251,7 @@ bool LibAudio::Init(WinylWnd* wnd, int driver, int device, bool isBit32, bool is
 	DEBUG_LOGF("Async file buffer: %d bytes", Buffer::BassRead);
 	BASS_SetConfig(BASS_CONFIG_SRC, 2); // for WASAPI mixer if freq is not supported, default is 1
 	DEBUG_LOG("Sample rate conversion: High quality (2)");
-	//if (!isBassFX) BASS_SetConfig(BASS_CONFIG_FLOATDSP, TRUE);
+	BASS_SetConfig(BASS_CONFIG_FLOATDSP, TRUE); // Equalizer DSP works only with float samples
 
 	if (wnd) // if wnd == nullptr then ReInit and we don't need to load plugins again
 	{
@@ -340,6 +351,17 @@ void LibAudio::SetProxy(int proxy, const std::wstring& host, const std::wstring&
 
 void LibAudio::Free()
 {
+	// The crossfade thread wakes up the reading thread so stop it first
+	if (threadCrossfade.IsJoinable())
+	{
+		stopThreadCrossfade = true;
+		eventCrossfade->Set();
+		threadCrossfade.Join();
+	}
+	eventCrossfade.reset();
+	mutexCrossfade.reset();
+	crossfadeJob = CrossfadeJob();
+
 	if (threadBuffer)
 	{
 		stopThreadBuffer = true;
@@ -349,12 +371,14 @@ void LibAudio::Free()
 			threadBuffer->Join();
 		threadBuffer.reset();
 
+		bufferStreams.insert(bufferStreams.end(), bufferStreamsNew.begin(), bufferStreamsNew.end());
+		bufferStreamsNew.clear();
+
 		for (std::size_t i = 0; i < bufferStreams.size(); ++i)
 		{
-			// Free buffer stream
-			verify(BASS_StreamFree(bufferStreams[i]->streamFile));
-			delete[] bufferStreams[i]->buffer;
-			delete bufferStreams[i];
+			// The buffer stream uses the struct so free it first (it can be already freed)
+			BASS_StreamFree(bufferStreams[i]->streamBuffer);
+			FreeBufferStream(bufferStreams[i]);
 		}
 		bufferStreams.clear();
 	}
@@ -362,6 +386,21 @@ void LibAudio::Free()
 	eventBuffer.reset();
 	mutexBuffer.reset();
 
+	if (threadMemory.IsJoinable())
+	{
+		stopThreadMemory = true;
+		eventMemory->Set();
+		threadMemory.Join();
+
+		// The streams keep their own references (the streams are freed by BASS_Free)
+		for (std::size_t i = 0; i < memoryFilesNew.size(); ++i)
+			ReleaseMemoryFile(memoryFilesNew[i]);
+		memoryFilesNew.clear();
+	}
+
+	eventMemory.reset();
+	mutexMemory.reset();
+
 	////////
 
 	if (bassDriver == 1)
@@ -370,6 +409,10 @@ void LibAudio::Free()
 		BASS_ASIO_Free();
 
 	BASS_Free();
+	eqDSPs.clear(); // All channels are freed so DSPs are not called anymore
+	spectrumChannel = NULL;
+	spectrumDSP = NULL;
+	streamFade = NULL;
 
 	if (threadRadio.IsJoinable())
 	{
@@ -583,6 +626,195 @@ void LibAudio::SyncProcGaplessCueWA(HSYNC handle, DWORD channel, DWORD data, voi
 	libAudio->eventBuffer->Set();
 }
 
+void LibAudio::SetCrossfadeSync()
+{
+	// Crossfade needs the reading thread of WASAPI/ASIO, tracks of cue and radio are played gapless
+	if (!crossfade.IsEnable() || !threadBuffer || !streamPlay || cueThis || isMediaRadio)
+		return;
+
+	// Fade points are not known yet, so prepare the crossfade before the earliest start of it
+	double before = crossfade.GetTime() + Crossfade::MaxTrailSilence + Crossfade::MaxLeadSilence + 3.0;
+
+	QWORD length = byteLength - posPlus;
+	QWORD prepare = BASS_ChannelSeconds2Bytes(streamPlay, before);
+	if (length <= prepare) // The track is too short or the position is near the end
+		return;
+
+	BASS_ChannelSetSync(streamPlay, BASS_SYNC_POS|BASS_SYNC_MIXTIME|BASS_SYNC_ONETIME, length - prepare, SyncProcCrossfadePrepare, this);
+}
+
+void LibAudio::SyncProcCrossfadePrepare(HSYNC handle, DWORD channel, DWORD data, void* user)
+{
+	LibAudio* libAudio = static_cast<LibAudio*>(user);
+
+	// The stream can be fading out after the track is changed
+	if (channel != libAudio->streamPlay)
+		return;
+
+	libAudio->nextCrossfade = true;
+	libAudio->eventBuffer->Set();
+}
+
+void LibAudio::PrepareCrossfade()
+{
+	HSTREAM stream = streamPlay;
+
+	if (!isMediaPlay || isMediaRadio || cueThis || !stream)
+		return;
+
+	STRUCTBUFFER* bufThis = FindBufferStream(stream);
+	if (bufThis == nullptr || bufThis->faderDSP == NULL || bufThis->isCrossfade)
+		return;
+
+	// The next file is preloaded here so it is not preloaded again at the end of the file
+	if (filePreload.empty() && !streamPreload && !cuePreload)
+		SyncProcPreloadImpl();
+	bufThis->isCrossfade = true;
+
+	// Only two files with the same format, otherwise the next track starts as usual at the end
+	if (!streamPreload || !isPreloadRate || cuePreload)
+		return;
+
+	STRUCTBUFFER* bufNext = FindBufferStream(streamPreload);
+	if (bufNext == nullptr || bufNext->faderDSP == NULL)
+		return;
+
+	BASS_CHANNELINFO ci;
+	if (!BASS_ChannelGetInfo(stream, &ci))
+		return;
+
+	// Decoding of the files to find fade points takes time and the ring holds only a second,
+	// so it goes to the crossfade thread, the fade is started when it is done (see StartCrossfade)
+	CrossfadeJob job;
+	job.stream = stream;
+	job.streamNext = streamPreload;
+	job.file = fileThis;
+	job.fileNext = filePreload;
+	job.timeSecond = timeSecond;
+	job.timeSecondNext = timeSecondPreload;
+	job.posPlus = posPlus;
+	job.freq = ci.freq;
+	job.chans = ci.chans;
+
+	mutexCrossfade->Lock();
+	crossfadeJob = std::move(job);
+	mutexCrossfade->Unlock();
+
+	eventCrossfade->Set();
+}
+
+void LibAudio::RunThreadCrossfade()
+{
+	while (!stopThreadCrossfade)
+	{
+		eventCrossfade->Wait();
+
+		if (stopThreadCrossfade)
+			break;
+
+		mutexCrossfade->Lock();
+		CrossfadeJob job = crossfadeJob;
+		mutexCrossfade->Unlock();
+
+		if (job.stream == NULL || job.isReady)
+			continue;
+
+		double fadeTime = std::min(crossfade.GetTime(), job.timeSecondNext / 2);
+
+		double soundEnd = crossfade.FindSoundEnd(job.file, std::max(0.0, job.timeSecond - fadeTime - Crossfade::MaxTrailSilence));
+		double soundStart = crossfade.FindSoundStart(job.fileNext);
+		if (soundEnd < 0.0 || soundStart < 0.0)
+			continue;
+
+		QWORD frameBytes = job.chans * sizeof(float);
+
+		// In frames of the buffer streams, the current stream starts from posPlus of the file
+		job.endFrame = (long long)(soundEnd * job.freq) - (long long)(job.posPlus / frameBytes);
+		job.fadeFrames = (long long)(fadeTime * job.freq);
+		job.leadFrames = (long long)(soundStart * job.freq);
+		job.isReady = true;
+
+		// Only if it is still the same job (the next job can come while the files are decoded)
+		mutexCrossfade->Lock();
+		bool isSame = (crossfadeJob.stream == job.stream && crossfadeJob.streamNext == job.streamNext);
+		if (isSame)
+			crossfadeJob = std::move(job);
+		mutexCrossfade->Unlock();
+
+		if (isSame)
+		{
+			readyCrossfade = true;
+			eventBuffer->Set();
+		}
+	}
+}
+
+void LibAudio::StartCrossfade()
+{
+	mutexCrossfade->Lock();
+	CrossfadeJob job = crossfadeJob;
+	crossfadeJob = CrossfadeJob();
+	mutexCrossfade->Unlock();
+
+	// The track or the position is changed while fade points are found
+	if (!job.isReady || !isMediaPlay || job.stream != streamPlay || job.streamNext != streamPreload)
+		return;
+
+	STRUCTBUFFER* bufThis = FindBufferStream(job.stream);
+	STRUCTBUFFER* bufNext = FindBufferStream(job.streamNext);
+	if (bufThis == nullptr || bufThis->faderDSP == NULL || bufNext == nullptr || bufNext->faderDSP == NULL)
+		return;
+
+	QWORD frameBytes = job.chans * sizeof(float);
+
+	// The next track is added to the mixer earlier by its leading silence,
+	// so its sound comes in at the same time when the current track starts to fade out
+	long long startFrame = job.endFrame - job.fadeFrames - job.leadFrames;
+
+	// Too late, the next track will start at the end
+	long long playFrame = (long long)(BASS_Mixer_ChannelGetPosition(job.stream, BASS_POS_BYTE) / frameBytes);
+	if (startFrame < playFrame + job.freq / 2)
+		return;
+
+	if (!BASS_ChannelSetSync(job.stream, BASS_SYNC_POS|BASS_SYNC_MIXTIME|BASS_SYNC_ONETIME, (QWORD)startFrame * frameBytes, SyncProcCrossfade, this))
+		return;
+
+	bufThis->fader.FadeOut(crossfade.GetCurve(), job.endFrame - job.fadeFrames, job.fadeFrames);
+	bufNext->fader.FadeIn(crossfade.GetCurve(), job.leadFrames, job.fadeFrames);
+}
+
+void LibAudio::SyncProcCrossfade(HSYNC handle, DWORD channel, DWORD data, void* user)
+{
+	LibAudio* libAudio = static_cast<LibAudio*>(user);
+
+	// The track or the position is changed after the crossfade is prepared
+	if (!libAudio->isMediaPlay || !libAudio->streamPreload || channel != libAudio->streamPlay)
+		return;
+
+	BASS_ChannelSetAttribute(libAudio->streamPreload, BASS_ATTRIB_VOL, libAudio->realVolume);
+	BASS_Mixer_StreamAddChannel(libAudio->streamMixer, libAudio->streamPreload, BASS_MIXER_NORAMPIN|BASS_MIXER_BUFFER);
+
+	// The current stream stays in the mixer until the fade out ends (see SyncProcEndImpl)
+	libAudio->isCrossfadeNext = true;
+	::PostMessage(libAudio->wndWinyl->Wnd(), UWM_BASSNEXT, 0, 0);
+}
+
+void CALLBACK LibAudio::DSPCrossfade(HDSP handle, DWORD channel, void* buffer, DWORD length, void* user)
+{
+	Crossfade::Fader* fader = static_cast<Crossfade::Fader*>(user);
+
+	fader->Process(static_cast<float*>(buffer), length / (sizeof(float) * fader->GetChannels()));
+}
+
+void LibAudio::FreeFade()
+{
+	if (streamFade)
+	{
+		BASS_StreamFree(streamFade);
+		streamFade = NULL;
+	}
+}
+
 void LibAudio::SyncProcPreloadImpl()
 {
 	assert(filePreload.empty() && streamPreload == NULL && cuePreload == 0);
@@ -598,14 +830,14 @@ void LibAudio::SyncProcPreloadImpl()
 
 	// Get the next track
 	//::SendMessage(hParent, UWM_NEXTFILE, (LPARAM)&csFile, 0);
-	file = wndWinyl->ChangeFile(cuePreload);
+	file = wndWinyl->ChangeFile(cuePreload, replayGainPreload);
 
 	if (!file.empty())
 	{
 		//Sleep(2000); // Test slow file load
 
 		if (!cuePreload)
-			streamPreload = OpenMediaFile(file, &byteLengthPreload, &timeSecondPreload);
+			streamPreload = OpenMediaFile(file, &byteLengthPreload, &timeSecondPreload, nullptr, nullptr, nullptr, replayGainPreload);
 		else // CUE
 		{
 			double offset = CueFile::GetOffset(cuePreload);
@@ -614,7 +846,7 @@ void LibAudio::SyncProcPreloadImpl()
 			if (cueThis && file == fileThis && CueFile::IsNextCue(cueThis, cuePreload))
 				cueOffsetPreload = BASS_ChannelSeconds2Bytes(streamPlay, offset);
 			else // New CUE file
-				streamPreload = OpenMediaFile(file, &byteLengthCue, &timeSecondCue, &offset, &cueOffsetPreload);
+				streamPreload = OpenMediaFile(file, &byteLengthCue, &timeSecondCue, &offset, &cueOffsetPreload, nullptr, replayGainPreload);
 
 			if (CueFile::IsLenght(cuePreload))
 			{
@@ -668,7 +900,15 @@ void LibAudio::SyncProcEndImpl()
 		{
 			if (streamPreload) // File is preloaded
 			{
-				BASS_StreamFree(streamPlay);
+				// After the crossfade the previous stream is still fading out in the mixer
+				FreeFade();
+				if (isCrossfadeNext)
+				{
+					streamFade = streamPlay;
+					isCrossfadeNext = false;
+				}
+				else
+					BASS_StreamFree(streamPlay);
 
 				streamPlay = streamPreload;
 				streamPreload = NULL;
@@ -676,6 +916,9 @@ void LibAudio::SyncProcEndImpl()
 				fileThis = filePreload;
 				filePreload.clear();
 
+				replayGainThis = replayGainPreload;
+				replayGainPreload = 1.0f;
+
 				byteLength = byteLengthPreload;//BASS_ChannelGetLength(streamPlay, BASS_POS_BYTE);
 				timeSecond = timeSecondPreload;//BASS_ChannelBytes2Seconds(streamPlay, byteLength);
 
@@ -698,7 +941,10 @@ void LibAudio::SyncProcEndImpl()
 						StartPlayASIO(true, false, true);
 				}
 				else
+				{
 					isPreloadRate = false;
+					SetCrossfadeSync();
+				}
 
 				//::SendMessage(hParent, UWM_PLAYDRAW, 0, 0);
 				wndWinyl->ChangeNode(false, false);
@@ -752,6 +998,7 @@ void LibAudio::SyncProcEndImpl()
 	}
 
 	ResetCueSync();
+	FreeFade();
 
 	if (streamMixer)
 	{
@@ -775,6 +1022,7 @@ void LibAudio::SyncProcEndImpl()
 void LibAudio::PrepareOpen(bool needFade)
 {
 	ResetCueSync();
+	FreeFade();
 
 	if (bassDriver == 0) // DirectSound
 	{	
@@ -833,72 +1081,33 @@ void LibAudio::RunThreadBuffer()
 {
 	while (!stopThreadBuffer)
 	{
-		mutexBuffer->Lock();
+		AddBufferStreamsNew();
+
+		bool isWaitData = false;
+
 		for (std::size_t i = 0; i < bufferStreams.size();)
 		{
 			STRUCTBUFFER* buf = bufferStreams[i];
-			mutexBuffer->Unlock();
 
-			// Check how much data is currently buffered
-			int c = (int)BASS_StreamPutData(buf->streamBuffer, 0, 0);
-			if (c == -1) // 
+			if (buf->isFreed) // The buffer stream is freed by the player
 			{
-				// Free buffer stream
-				verify(BASS_StreamFree(buf->streamFile));
-
-				mutexBuffer->Lock();
-				delete[] buf->buffer;
-				delete buf;
+				FreeBufferStream(buf);
 				bufferStreams.erase(bufferStreams.begin() + i);
-				//printf("FREE1\n");
 				continue;
 			}
-			else
-			{
-				//AllocConsole();
-				//freopen ("CONOUT$", "w", stdout);
-				//printf("LEN: %u,        %i,%i\n", buf->streamBuffer, c, buf->bytes);
 
-				if (buf->bytes > c) // Less data than wanted
-				{
-					// Get more data from the file
-					c = BASS_ChannelGetData(buf->streamFile, buf->buffer, buf->bytes - c);
-
-					if (c == -1) // File end
-					{
-						verify(BASS_StreamFree(buf->streamFile));
-
-						// Preload next file
-						//::PostMessage(libAudio->hParent, UWM_BASSPRELOAD, 0, 0);
-						SyncProcPreloadImpl();
-
-						// Signal to end stream
-						BASS_StreamPutData(buf->streamBuffer, buf->buffer, BASS_STREAMPROC_END);
-
-						// Free buffer stream
-						mutexBuffer->Lock();
-						delete[] buf->buffer;
-						delete buf;
-						bufferStreams.erase(bufferStreams.begin() + i);
-						//printf("FREE2\n");
-						continue;
-					}
-					else // Pass data to the buffer stream
-						BASS_StreamPutData(buf->streamBuffer, buf->buffer, c);
-				}
-			}
+			if (!buf->readAhead->IsEnd() && !FillBufferStream(buf))
+				isWaitData = true;
 
 			++i;
-			mutexBuffer->Lock();
 		}
 
-		bool isEmptyBufferStreams = bufferStreams.empty();
-		mutexBuffer->Unlock();
-
-		if (isEmptyBufferStreams)
-			eventBuffer->Wait();
-		else
+		// Sleep until a buffer stream goes below the low watermark (see StreamProcBuffer),
+		// only check again by timeout if some file does not have data yet
+		if (isWaitData)
 			eventBuffer->TryWait(100);
+		else
+			eventBuffer->Wait();
 
 		eventPause->Wait();
 
@@ -907,16 +1116,134 @@ void LibAudio::RunThreadBuffer()
 			SyncProcPreloadImpl();
 			nextCueTrack = false;
 		}
+
+		if (nextCrossfade)
+		{
+			PrepareCrossfade();
+			nextCrossfade = false;
+		}
+
+		if (readyCrossfade)
+		{
+			readyCrossfade = false;
+			StartCrossfade();
+		}
+	}
+}
+
+void LibAudio::AddBufferStreamsNew()
+{
+	if (isBufferStreamsNew)
+	{
+		mutexBuffer->Lock();
+		bufferStreams.insert(bufferStreams.end(), bufferStreamsNew.begin(), bufferStreamsNew.end());
+		bufferStreamsNew.clear();
+		isBufferStreamsNew = false;
+		mutexBuffer->Unlock();
+	}
+}
+
+LibAudio::STRUCTBUFFER* LibAudio::FindBufferStream(HSTREAM stream)
+{
+	// Only for RunThreadBuffer, the stream can be just opened so add new buffer streams first
+	AddBufferStreamsNew();
+
+	for (std::size_t i = 0; i < bufferStreams.size(); ++i)
+	{
+		if (bufferStreams[i]->streamBuffer == stream && !bufferStreams[i]->isFreed)
+			return bufferStreams[i];
+	}
+
+	return nullptr;
+}
+
+bool LibAudio::FillBufferStream(STRUCTBUFFER* buf)
+{
+	// Return false if the file does not have data right now
+
+	ReadAhead::Result result = buf->readAhead->Fill([buf](float* data, std::size_t count)
+	{
+		DWORD c = BASS_ChannelGetData(buf->streamFile, data, (DWORD)(count * sizeof(float)));
+		return (c == (DWORD)-1) ? ReadAhead::DecodeEnd : (std::size_t)(c / sizeof(float));
+	});
+
+	if (result == ReadAhead::Result::End) // File end
+	{
+		verify(BASS_StreamFree(buf->streamFile));
+		buf->streamFile = NULL;
+
+		// Preload next file (if it is not preloaded for the crossfade already)
+		if (!buf->isCrossfade)
+			SyncProcPreloadImpl();
+
+		// Signal to end stream
+		buf->readAhead->SetEnd();
 	}
+
+	return result != ReadAhead::Result::NoData;
+}
+
+void LibAudio::FreeBufferStream(STRUCTBUFFER* buf)
+{
+	if (buf->streamFile)
+		verify(BASS_StreamFree(buf->streamFile));
+
+	DEBUG_LOGF("Buffer stream freed: underruns=%u", (unsigned)bufferUnderruns);
+
+	delete buf;
+}
+
+DWORD CALLBACK LibAudio::StreamProcBuffer(HSTREAM handle, void* buffer, DWORD length, void* user)
+{
+	STRUCTBUFFER* buf = static_cast<STRUCTBUFFER*>(user);
+
+	bool isEnd = false;
+	bool isWakeUp = false;
+	DWORD c = (DWORD)(buf->readAhead->Read(static_cast<float*>(buffer), length / sizeof(float), isEnd, isWakeUp) * sizeof(float));
+
+	buf->libAudio->bufferFill = buf->readAhead->GetFillPercent();
+
+	if (isEnd)
+		return c|BASS_STREAMPROC_END;
+
+	if (c < length)
+		++buf->libAudio->bufferUnderruns;
+
+	if (isWakeUp)
+		buf->libAudio->eventBuffer->Set();
+
+	return c;
 }
 
-HSTREAM LibAudio::OpenMediaFile(const std::wstring& file, QWORD* outByteLength, double* outTimeSecond, double* position, QWORD* outBytePosition, int* outError)
+void CALLBACK LibAudio::SyncFreeBuffer(HSYNC handle, DWORD channel, DWORD data, void* user)
 {
+	STRUCTBUFFER* buf = static_cast<STRUCTBUFFER*>(user);
+
+	// RunThreadBuffer can delete the buffer as soon as isFreed is set
+	LibAudio* libAudio = buf->libAudio;
+	buf->isFreed = true;
+	libAudio->eventBuffer->Set();
+}
+
+HSTREAM LibAudio::OpenMediaFile(const std::wstring& file, QWORD* outByteLength, double* outTimeSecond, double* position, QWORD* outBytePosition, int* outError, float replayGain)
+{
+	// Load the whole file to memory if enabled (files that do not fit in the budget are played from disk)
 	HSTREAM streamFile = NULL;
-	if (bassDriver == 0)
-		streamFile = BASS_StreamCreateFile(FALSE, file.c_str(), 0, 0, BASS_ASYNCFILE|BASS_UNICODE|BASS_STREAM_DECODE|dwSampleEx);
-	else
-		streamFile = BASS_StreamCreateFile(FALSE, file.c_str(), 0, 0, BASS_ASYNCFILE|BASS_UNICODE|BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT);
+	if (isPlayMemory)
+	{
+		if (bassDriver == 0)
+			streamFile = OpenMemoryFile(file, BASS_STREAM_DECODE|dwSampleEx);
+		else
+			streamFile = OpenMemoryFile(file, BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT);
+	}
+
+	if (streamFile == NULL)
+	{
+		if (bassDriver == 0)
+			streamFile = BASS_StreamCreateFile(FALSE, file.c_str(), 0, 0, BASS_ASYNCFILE|BASS_UNICODE|BASS_STREAM_DECODE|dwSampleEx);
+		else
+			streamFile = BASS_StreamCreateFile(FALSE, file.c_str(), 0, 0, BASS_ASYNCFILE|BASS_UNICODE|BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT);
+	}
 
 	if (streamFile == NULL)
 	{
@@ -926,6 +1253,21 @@ HSTREAM LibAudio::OpenMediaFile(const std::wstring& file, QWORD* outByteLength,
 		return NULL;
 	}
 
+	// ReplayGain is applied to the file stream so it goes before the mixer and the equalizer
+	if (replayGain != 1.0f)
+	{
+		HFX fxGain = BASS_ChannelSetFX(streamFile, BASS_FX_VOLUME, 1);
+		if (fxGain)
+		{
+			BASS_FX_VOLUME_PARAM fv;
+			fv.fTarget = replayGain;
+			fv.fCurrent = replayGain;
+			fv.fTime = 0;
+			fv.lCurve = 0;
+			BASS_FXSetParameters(fxGain, (void*)&fv);
+		}
+	}
+
 	// Get length of the stream in bytes and seconds
 	*outByteLength = BASS_ChannelGetLength(streamFile, BASS_POS_BYTE);
 	*outTimeSecond = BASS_ChannelBytes2Seconds(streamFile, *outByteLength);
@@ -956,28 +1298,221 @@ HSTREAM LibAudio::OpenMediaFile(const std::wstring& file, QWORD* outByteLength,
 	BASS_CHANNELINFO ci;
 	BASS_ChannelGetInfo(streamFile, &ci);
 
-	HSTREAM streamBuffer = BASS_StreamCreate(ci.freq, ci.chans, BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT, STREAMPROC_PUSH, NULL);
-
 	STRUCTBUFFER* buf = new STRUCTBUFFER;
 
+	buf->libAudio = this;
 	buf->streamFile = streamFile;
+
+	// BASS_ChannelGetData returns only whole frames so the ring is written by frames
+	std::size_t bytes = (std::size_t)BASS_ChannelSeconds2Bytes(streamFile, Buffer::WasapiAsio);
+	buf->readAhead.reset(new ReadAhead(bytes / sizeof(float), ci.chans));
+
+	HSTREAM streamBuffer = BASS_StreamCreate(ci.freq, ci.chans, BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT, StreamProcBuffer, buf);
+	if (streamBuffer == NULL)
+	{
+		if (outError)
+			*outError = BASS_ErrorGetCode();
+
+		verify(BASS_StreamFree(streamFile));
+		delete buf;
+		return NULL;
+	}
+
 	buf->streamBuffer = streamBuffer;
+	BASS_ChannelSetSync(streamBuffer, BASS_SYNC_FREE|BASS_SYNC_MIXTIME, 0, SyncFreeBuffer, buf);
 
-	buf->bytes = (int)BASS_ChannelSeconds2Bytes(streamFile, Buffer::WasapiAsio);
-	buf->buffer = new char[buf->bytes];
+	// The fader does nothing until the crossfade is prepared (see PrepareCrossfade)
+	if (crossfade.IsEnable())
+	{
+		buf->fader.SetChannels((int)ci.chans);
+		buf->faderDSP = BASS_ChannelSetDSP(streamBuffer, DSPCrossfade, &buf->fader, 0);
+	}
+
+	// Add first portion of the data to buffer here (to fill buffer faster),
+	// RunThreadBuffer doesn't know about the buffer yet so it's safe to write to the ring from this thread.
+	// The end of the file is handled by RunThreadBuffer.
+	buf->readAhead->FillFirst([buf](float* data, std::size_t count)
+	{
+		DWORD c = BASS_ChannelGetData(buf->streamFile, data, (DWORD)(count * sizeof(float)));
+		return (c == (DWORD)-1) ? ReadAhead::DecodeEnd : (std::size_t)(c / sizeof(float));
+	});
 
 	// Add buffer stream to buffer streams queue (RunThreadBuffer does everything else)
 	mutexBuffer->Lock();
-	bufferStreams.push_back(buf);
+	bufferStreamsNew.push_back(buf);
+	isBufferStreamsNew = true;
 	mutexBuffer->Unlock();
 
-	// Add first portion of the data to buffer here (to fill buffer faster)
-	DWORD c = BASS_ChannelGetData(buf->streamFile, buf->buffer, buf->bytes);
-	BASS_StreamPutData(buf->streamBuffer, buf->buffer, c);
+	eventBuffer->Set();
 
 	return streamBuffer;
 }
 
+HSTREAM LibAudio::OpenMemoryFile(const std::wstring& file, DWORD flags)
+{
+	if (!threadMemory.IsJoinable())
+		return NULL;
+
+	MemoryFile* memoryFile = new MemoryFile;
+	memoryFile->fileHandle.reset(::CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL));
+
+	LARGE_INTEGER fileSize = {};
+	if (!memoryFile->fileHandle || !::GetFileSizeEx(memoryFile->fileHandle.get(), &fileSize) ||
+		fileSize.QuadPart <= 0 || (unsigned long long)fileSize.QuadPart > playMemoryBudget)
+	{
+		delete memoryFile;
+		return NULL;
+	}
+
+	// Reserve the memory in the budget (the playing and the preloaded files are opened from different threads)
+	memoryFile->libAudio = this;
+	memoryFile->file = file;
+	memoryFile->size = (std::size_t)fileSize.QuadPart;
+
+	if (playMemoryUsed.fetch_add(memoryFile->size) + memoryFile->size > playMemoryBudget)
+	{
+		ReleaseMemoryFile(memoryFile);
+		return NULL;
+	}
+
+	// Only the address space is allocated here, the pages are committed when RunThreadMemory reads the file
+	memoryFile->data.reset(new (std::nothrow) char[memoryFile->size]);
+	if (!memoryFile->data)
+	{
+		ReleaseMemoryFile(memoryFile);
+		return NULL;
+	}
+
+	BASS_FILEPROCS fileProcs = {FileCloseProc, FileLenProc, FileReadProc, FileSeekProc};
+	HSTREAM streamFile = BASS_StreamCreateFileUser(STREAMFILE_NOBUFFER, flags, &fileProcs, memoryFile);
+	if (streamFile == NULL)
+	{
+		// BASS can call the close function when the stream is not created
+		if (!memoryFile->isClosed.exchange(true))
+			ReleaseMemoryFile(memoryFile);
+		return NULL;
+	}
+
+	// The memory stays until the stream is freed (see FileCloseProc)
+	++memoryFile->refCount;
+	mutexMemory->Lock();
+	memoryFilesNew.push_back(memoryFile);
+	mutexMemory->Unlock();
+
+	eventMemory->Set();
+
+	return streamFile;
+}
+
+void LibAudio::RunThreadMemory()
+{
+	while (!stopThreadMemory)
+	{
+		eventMemory->Wait();
+
+		std::vector<MemoryFile*> memoryFiles;
+		mutexMemory->Lock();
+		memoryFiles.swap(memoryFilesNew);
+		mutexMemory->Unlock();
+
+		for (std::size_t i = 0; i < memoryFiles.size(); ++i)
+		{
+			LoadMemoryFile(memoryFiles[i]);
+			ReleaseMemoryFile(memoryFiles[i]);
+		}
+	}
+}
+
+void LibAudio::LoadMemoryFile(MemoryFile* memoryFile)
+{
+	FileHandle fileHandle(::CreateFileW(memoryFile->file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+	if (!fileHandle)
+		return;
+
+	// Stop if the stream is freed already, the stream reads the part that is not loaded from the file
+	const DWORD chunkSize = 4 * 1024 * 1024;
+	for (std::size_t offset = 0; offset < memoryFile->size;)
+	{
+		if (stopThreadMemory || memoryFile->isClosed)
+			return;
+
+		DWORD bytesRead = 0;
+		DWORD bytesToRead = (DWORD)std::min((std::size_t)chunkSize, memoryFile->size - offset);
+		if (!::ReadFile(fileHandle.get(), memoryFile->data.get() + offset, bytesToRead, &bytesRead, NULL) || bytesRead == 0)
+			return;
+
+		offset += bytesRead;
+		memoryFile->loaded = offset;
+	}
+}
+
+void LibAudio::ReleaseMemoryFile(MemoryFile* memoryFile)
+{
+	if (--memoryFile->refCount == 0)
+	{
+		memoryFile->libAudio->playMemoryUsed -= memoryFile->size;
+		delete memoryFile;
+	}
+}
+
+void CALLBACK LibAudio::FileCloseProc(void* user)
+{
+	MemoryFile* memoryFile = static_cast<MemoryFile*>(user);
+
+	if (!memoryFile->isClosed.exchange(true))
+		ReleaseMemoryFile(memoryFile);
+}
+
+QWORD CALLBACK LibAudio::FileLenProc(void* user)
+{
+	MemoryFile* memoryFile = static_cast<MemoryFile*>(user);
+
+	return memoryFile->size;
+}
+
+DWORD CALLBACK LibAudio::FileReadProc(void* buffer, DWORD length, void* user)
+{
+	MemoryFile* memoryFile = static_cast<MemoryFile*>(user);
+
+	std::size_t count = std::min((std::size_t)length, memoryFile->size - memoryFile->position);
+	std::size_t loaded = memoryFile->loaded;
+
+	if (memoryFile->position + count <= loaded) // Already in memory
+	{
+		memcpy(buffer, memoryFile->data.get() + memoryFile->position, count);
+
+		// The whole file is in memory, the file is not needed anymore
+		if (loaded == memoryFile->size && memoryFile->fileHandle)
+			memoryFile->fileHandle.reset();
+	}
+	else
+	{
+		LARGE_INTEGER li = {};
+		li.QuadPart = (LONGLONG)memoryFile->position;
+
+		DWORD bytesRead = 0;
+		if (!::SetFilePointerEx(memoryFile->fileHandle.get(), li, NULL, FILE_BEGIN) ||
+			!::ReadFile(memoryFile->fileHandle.get(), buffer, (DWORD)count, &bytesRead, NULL))
+			return (DWORD)-1;
+
+		count = bytesRead;
+	}
+
+	memoryFile->position += count;
+	return (DWORD)count;
+}
+
+BOOL CALLBACK LibAudio::FileSeekProc(QWORD offset, void* user)
+{
+	MemoryFile* memoryFile = static_cast<MemoryFile*>(user);
+
+	if (offset > memoryFile->size)
+		return FALSE;
+
+	memoryFile->position = (std::size_t)offset;
+	return TRUE;
+}
+
 HSTREAM LibAudio::OpenMediaURL(const std::wstring& url, int* outError)
 {
 	HSTREAM streamFile = NULL;
@@ -1006,9 +1541,11 @@ void LibAudio::FreePreload()
 		cuePreload = 0;
 		cueOffsetPreload = 0;
 	}
+
+	isCrossfadeNext = false;
 }
 
-LibAudio::Error LibAudio::PlayFile(const std::wstring& file, long long cue)
+LibAudio::Error LibAudio::PlayFile(const std::wstring& file, long long cue, float replayGain)
 {
 	// When Gapless Playback if a new file is already preloaded then free it
 	FreePreload();
@@ -1017,6 +1554,7 @@ LibAudio::Error LibAudio::PlayFile(const std::wstring& file, long long cue)
 	PrepareOpen(true);
 
 	fileThis = file;
+	replayGainThis = replayGain;
 	urlThis.clear();
 	posPlus = 0;
 	cueThis = cue;
@@ -1025,11 +1563,11 @@ LibAudio::Error LibAudio::PlayFile(const std::wstring& file, long long cue)
 	int error = 0;
 
 	if (!cue)
-		streamPlay = OpenMediaFile(file, &byteLength, &timeSecond, nullptr, nullptr, &error);
+		streamPlay = OpenMediaFile(file, &byteLength, &timeSecond, nullptr, nullptr, &error, replayGain);
 	else
 	{
 		double offset = CueFile::GetOffset(cue);
-		streamPlay = OpenMediaFile(file, &byteLengthCue, &timeSecondCue, &offset, &cueOffset, &error);
+		streamPlay = OpenMediaFile(file, &byteLengthCue, &timeSecondCue, &offset, &cueOffset, &error, replayGain);
 
 		posPlus = cueOffset;
 
@@ -1129,6 +1667,7 @@ bool LibAudio::StartPlayDS(bool isFile, bool needFade, bool gaplessResume)
 		BASS_Mixer_StreamAddChannel(streamMixer, streamPlay, BASS_MIXER_BUFFER);
 
 		ApplyEqualizer();
+		ApplySpectrum();
 
 		syncEnd = BASS_ChannelSetSync(streamMixer, BASS_SYNC_END, 0, SyncProcEnd, this);
 		syncEndMix = BASS_ChannelSetSync(streamMixer, BASS_SYNC_END|BASS_SYNC_MIXTIME, 0, SyncProcGaplessDS, this);
@@ -1185,6 +1724,7 @@ bool LibAudio::StartPlayWASAPI(bool isFile, bool needFade, bool gaplessResume)
 				BASS_Mixer_StreamAddChannel(streamMixer, streamPlay, BASS_MIXER_BUFFER|BASS_MIXER_NORAMPIN);
 				BASS_ChannelSetPosition(streamMixer, 0, BASS_POS_BYTE);
 				ResetCueSync(cueThis, timeSecond, posPlus, cueOffset);
+				SetCrossfadeSync();
 				if (!BASS_WASAPI_IsStarted()) // If paused
 					BASS_WASAPI_Start();
 				eventBuffer->Set();
@@ -1270,10 +1810,13 @@ bool LibAudio::StartPlayWASAPI(bool isFile, bool needFade, bool gaplessResume)
 	ResetCueSync(cueThis, timeSecond, posPlus, cueOffset);
 
 	ApplyEqualizer();
+	ApplySpectrum();
 
 	BASS_Mixer_StreamAddChannel(streamMixer, streamPlay, BASS_MIXER_DOWNMIX|BASS_MIXER_BUFFER);
 	streamMixerCopyWASAPI = streamMixer;
 
+	SetCrossfadeSync();
+
 	if (!isMediaPause)
 	{
 		BASS_WASAPI_Start();
@@ -1312,6 +1855,7 @@ bool LibAudio::StartPlayASIO(bool isFile, bool needFade, bool gaplessResume)
 				BASS_Mixer_StreamAddChannel(streamMixer, streamPlay, BASS_MIXER_BUFFER|BASS_MIXER_NORAMPIN);
 				BASS_ChannelSetPosition(streamMixer, 0, BASS_POS_BYTE);
 				ResetCueSync(cueThis, timeSecond, posPlus, cueOffset);
+				SetCrossfadeSync();
 				if (!BASS_ASIO_IsStarted()) // If paused
 					BASS_ASIO_Start(0, 0);
 				eventBuffer->Set();
@@ -1345,9 +1889,12 @@ bool LibAudio::StartPlayASIO(bool isFile, bool needFade, bool gaplessResume)
 	ResetCueSync(cueThis, timeSecond, posPlus, cueOffset);
 
 	ApplyEqualizer();
+	ApplySpectrum();
 
 	BASS_Mixer_StreamAddChannel(streamMixer, streamPlay, BASS_MIXER_BUFFER);
 
+	SetCrossfadeSync();
+
 	// Reset all channels
 	if (!BASS_ASIO_Stop())
 	{
@@ -1655,12 +2202,12 @@ void LibAudio::SetPosition(int position)
 	double pos = std::min((double)position * timeSecond / 100000.0, timeSecond - 0.1);
 	
 	if (!cueThis)
-		streamPlay = OpenMediaFile(fileThis, &byteLength, &timeSecond, &pos, &posPlus);
+		streamPlay = OpenMediaFile(fileThis, &byteLength, &timeSecond, &pos, &posPlus, nullptr, replayGainThis);
 	else
 	{
 		double offset = CueFile::GetOffset(cueThis);
 		double newpos = offset + pos;
-		streamPlay = OpenMediaFile(fileThis, &byteLengthCue, &timeSecondCue, &newpos, &posPlus);
+		streamPlay = OpenMediaFile(fileThis, &byteLengthCue, &timeSecondCue, &newpos, &posPlus, nullptr, replayGainThis);
 
 		cueOffset = BASS_ChannelSeconds2Bytes(streamPlay, offset);
 
@@ -1702,7 +2249,11 @@ void LibAudio::SetVolume(int volume)
 		if (bassDriver == 0)
 			BASS_ChannelSetAttribute(streamMixer, BASS_ATTRIB_VOL, realVolume);
 		else
+		{
 			BASS_ChannelSetAttribute(streamPlay, BASS_ATTRIB_VOL, realVolume);
+			if (streamFade)
+				BASS_ChannelSetAttribute(streamFade, BASS_ATTRIB_VOL, realVolume);
+		}
 	}
 }
 
@@ -1716,6 +2267,7 @@ void LibAudio::Stop()
 	// When Gapless Playback if a new file is already preloaded then free it
 	FreePreload();
 	ResetCueSync();
+	FreeFade();
 
 	if (!isMediaPlay)
 		return;
@@ -1784,6 +2336,7 @@ void LibAudio::Pause()
 		return;
 
 	isMediaPause = true;
+	spectrum.SetPause(true);
 
 	if (bassDriver == 0)
 	{
@@ -1803,6 +2356,8 @@ void LibAudio::Pause()
 		{
 			BASS_ChannelSetSync(streamPlay, BASS_SYNC_SLIDE, 0, SyncWASAPIPause, this);
 			BASS_ChannelSlideAttribute(streamPlay, BASS_ATTRIB_VOL, 0.0f, FadeTime::Pause);
+			if (streamFade)
+				BASS_ChannelSlideAttribute(streamFade, BASS_ATTRIB_VOL, 0.0f, FadeTime::Pause);
 		}
 	}
 	else if (bassDriver == 2)
@@ -1816,6 +2371,8 @@ void LibAudio::Pause()
 		{
 			BASS_ChannelSetSync(streamPlay, BASS_SYNC_SLIDE, 0, SyncASIOPause, this);
 			BASS_ChannelSlideAttribute(streamPlay, BASS_ATTRIB_VOL, 0.0f, FadeTime::Pause);
+			if (streamFade)
+				BASS_ChannelSlideAttribute(streamFade, BASS_ATTRIB_VOL, 0.0f, FadeTime::Pause);
 		}
 	}
 }
@@ -1828,6 +2385,7 @@ void LibAudio::Play()
 		return;
 
 	isMediaPause = false;
+	spectrum.SetPause(false);
 
 	if (bassDriver == 0)
 	{
@@ -1853,6 +2411,8 @@ void LibAudio::Play()
 			//	BASS_ChannelSetPosition(streamMixer, 0, BASS_POS_BYTE);
 
 			BASS_ChannelSlideAttribute(streamPlay, BASS_ATTRIB_VOL, realVolume, FadeTime::Pause);
+			if (streamFade)
+				BASS_ChannelSlideAttribute(streamFade, BASS_ATTRIB_VOL, realVolume, FadeTime::Pause);
 			BASS_WASAPI_Start();
 		}
 	}
@@ -1870,6 +2430,8 @@ void LibAudio::Play()
 			//	BASS_ChannelSetPosition(streamMixer, 0, BASS_POS_BYTE);
 
 			BASS_ChannelSlideAttribute(streamPlay, BASS_ATTRIB_VOL, realVolume, FadeTime::Pause);
+			if (streamFade)
+				BASS_ChannelSlideAttribute(streamFade, BASS_ATTRIB_VOL, realVolume, FadeTime::Pause);
 			BASS_ASIO_Start(0, 0);
 		}
 	}
@@ -1986,7 +2548,11 @@ void LibAudio::SetMute(bool isMute)
 		if (bassDriver == 0)
 			BASS_ChannelSlideAttribute(streamMixer, BASS_ATTRIB_VOL, 0.0f, FadeTime::Mute);
 		else
+		{
 			BASS_ChannelSlideAttribute(streamPlay, BASS_ATTRIB_VOL, 0.0f, FadeTime::Mute);
+			if (streamFade)
+				BASS_ChannelSlideAttribute(streamFade, BASS_ATTRIB_VOL, 0.0f, FadeTime::Mute);
+		}
 	}
 	else
 	{
@@ -1995,18 +2561,17 @@ void LibAudio::SetMute(bool isMute)
 		if (bassDriver == 0)
 			BASS_ChannelSlideAttribute(streamMixer, BASS_ATTRIB_VOL, realVolume, FadeTime::Mute);
 		else
+		{
 			BASS_ChannelSlideAttribute(streamPlay, BASS_ATTRIB_VOL, realVolume, FadeTime::Mute);
+			if (streamFade)
+				BASS_ChannelSlideAttribute(streamFade, BASS_ATTRIB_VOL, realVolume, FadeTime::Mute);
+		}
 	}
 }
 
-void LibAudio::GetFFT(float* fft)
-{
-	BASS_Mixer_ChannelGetData(streamPlay, fft, BASS_DATA_FFT2048);
-}
-
-void LibAudio::GetFFT2(float* fft, int size)
+void LibAudio::GetSpectrum(float* bands)
 {
-	BASS_Mixer_ChannelGetData(streamPlay, fft, size|BASS_DATA_FLOAT);
+	spectrum.Read(bands);
 }
 
 void LibAudio::SetEq(int band, float gain)
@@ -2026,27 +2591,13 @@ void LibAudio::SetEq(int band, float gain)
 		return;
 	}
 
-	// Check if the effect handle for this band is valid
-	if (fxEqualizer[band] == 0) {
-		EQ_DEBUG_LOGF("ERROR: fxEqualizer[%d] is 0 - EQ effect not initialized!", band);
+	if (eqDSPs.empty()) {
+		EQ_DEBUG_LOGF("ERROR: Equalizer DSP is not initialized for band %d!", band);
 		return;
 	}
 
-	// Use BASS_DX8_PARAMEQ structure for built-in BASS effect
-	BASS_DX8_PARAMEQ eq;
-	eq.fCenter = eqFrequencies[band];  // Use frequency from our array
-	eq.fGain = gain;                  // Gain in dB 
-	
-	// CRITICAL FIX: Use valid DirectX 8 bandwidth value (1.0-36.0 semitones)
-	// Bandwidth options: 6.0f (narrow/surgical), 12.0f (default/balanced), 18.0f (wide/musical)
-	eq.fBandwidth = 18.0f;  // Wide bandwidth for musical EQ character (original Winyl approach)
-	
-	// Apply the parameters to the specific band effect
-	if (!BASS_FXSetParameters(fxEqualizer[band], (void*)&eq)) {
-		int error = BASS_ErrorGetCode();
-		EQ_DEBUG_LOGF("ERROR: EQ band %d (%.0f Hz, %.1f dB) failed with BASS error %d", band, eq.fCenter, eq.fGain, error);
-	}
-	// Note: Success case logging removed to reduce noise
+	// The change is smoothed by the DSP itself, only for the current channel
+	eqDSPs.back().equalizer->SetBand(band, gain);
 }
 
 void LibAudio::SetPreamp(float preamp)
@@ -2059,17 +2610,12 @@ void LibAudio::SetPreamp(float preamp)
 		return;
 	}
 
-	BASS_FX_VOLUME_PARAM fv;
-	fv.fTarget = (float)pow(10, (preamp / 20));
-	fv.fCurrent = fv.fTarget;  // Set current to target (no fade)
-	fv.fTime = 0;              // No fade time
-	fv.lCurve = 0;             // Linear curve
-
-	EQ_DEBUG_LOGF("Calling BASS_FXSetParameters with fxPreamp=%d, volume=%.3f", fxPreamp, fv.fTarget);
-	if (fxPreamp == 0) {
-		EQ_DEBUG_LOG("ERROR: fxPreamp is 0 - Preamp effect not initialized!");
+	if (eqDSPs.empty()) {
+		EQ_DEBUG_LOG("ERROR: Equalizer DSP is not initialized for preamp!");
+		return;
 	}
-	BASS_FXSetParameters(fxPreamp, (void*)&fv);
+
+	eqDSPs.back().equalizer->SetPreamp(preamp);
 }
 
 void LibAudio::EnableEq(bool enable)
@@ -2077,6 +2623,8 @@ void LibAudio::EnableEq(bool enable)
 	EQ_DEBUG_LOGF("EnableEq called with enable=%d", enable);
 	isEqEnable = enable;
 
+	FreeEqualizers();
+
 	if (!isMediaPlay) {
 		EQ_DEBUG_LOG("No media playing, equalizer not applied");
 		return;
@@ -2106,7 +2654,12 @@ void LibAudio::EnableEq(bool enable)
 
 	if (enable)
 	{
-		EQ_DEBUG_LOG("Attempting to create BASS_FX equalizer effects...");
+		if (GetEqualizer(hChannel)) {
+			EQ_DEBUG_LOG("Equalizer DSP is already attached to the stream");
+			return;
+		}
+
+		EQ_DEBUG_LOG("Attempting to create equalizer DSP...");
 		
 		// Check if channel is valid first
 		BASS_CHANNELINFO ci;
@@ -2116,50 +2669,106 @@ void LibAudio::EnableEq(bool enable)
 		} else {
 			int error = BASS_ErrorGetCode();
 			EQ_DEBUG_LOGF("ERROR: BASS_ChannelGetInfo failed with error %d", error);
+			return;
 		}
-		
-		// Try built-in BASS effects instead of BASS_FX library
-		EQ_DEBUG_LOG("Creating built-in BASS effects...");
-		
-		fxPreamp = BASS_ChannelSetFX(hChannel, BASS_FX_VOLUME, 0);
-		if (fxPreamp == 0) {
+
+		// Apply the current settings before the DSP starts so the new track doesn't fade in from flat
+		EqualizerDSP eqDSP;
+		eqDSP.channel = hChannel;
+		eqDSP.equalizer.reset(new Equalizer(eqFrequencies));
+		eqDSP.equalizer->SetPreamp(eqPreamp);
+		for (int i = 0; i < 10; i++)
+			eqDSP.equalizer->SetBand(i, eqValues[i]);
+		eqDSP.equalizer->SetFormat((int)ci.freq, (int)ci.chans);
+
+		eqDSP.dsp = BASS_ChannelSetDSP(hChannel, DSPEqualizer, eqDSP.equalizer.get(), 0);
+		if (eqDSP.dsp == 0) {
 			int error = BASS_ErrorGetCode();
-			EQ_DEBUG_LOGF("ERROR: BASS_FX_VOLUME creation failed with error %d", error);
-		}
-		
-		// Create 10 separate BASS_FX_DX8_PARAMEQ effects for 10-band equalizer
-		int failedBands = 0;
-		for (int i = 0; i < 10; i++) {
-			fxEqualizer[i] = BASS_ChannelSetFX(hChannel, BASS_FX_DX8_PARAMEQ, i + 2); // Priority 2-11
-			if (fxEqualizer[i] == 0) {
-				int error = BASS_ErrorGetCode();
-				EQ_DEBUG_LOGF("ERROR: EQ band %d (%.0f Hz) creation failed with error %d", i, eqFrequencies[i], error);
-				failedBands++;
-			}
-		}
-		
-		if (failedBands == 0) {
-			EQ_DEBUG_LOG("SUCCESS: All EQ effects created successfully");
-		} else {
-			EQ_DEBUG_LOGF("WARNING: %d EQ bands failed to create", failedBands);
+			EQ_DEBUG_LOGF("ERROR: Equalizer DSP creation failed with error %d", error);
+			return;
 		}
-		
-		// Note: Settings will be applied when SetEq/SetPreamp are called
+
+		eqDSPs.push_back(std::move(eqDSP));
+		EQ_DEBUG_LOG("SUCCESS: Equalizer DSP created successfully");
 	}
 	else
 	{
-		EQ_DEBUG_LOG("Disabling equalizer effects");
-		BASS_ChannelRemoveFX(hChannel, fxPreamp);
-		for (int i = 0; i < 10; i++) {
-			if (fxEqualizer[i] != 0) {
-				BASS_ChannelRemoveFX(hChannel, fxEqualizer[i]);
-				fxEqualizer[i] = 0;
-			}
-		}
-		fxPreamp = 0;
+		EQ_DEBUG_LOG("Disabling equalizer DSP");
+		for (std::size_t i = 0; i < eqDSPs.size(); ++i)
+			BASS_ChannelRemoveDSP(eqDSPs[i].channel, eqDSPs[i].dsp);
+		eqDSPs.clear();
+	}
+}
+
+Equalizer* LibAudio::GetEqualizer(HSTREAM channel)
+{
+	for (std::size_t i = 0; i < eqDSPs.size(); ++i)
+	{
+		if (eqDSPs[i].channel == channel)
+			return eqDSPs[i].equalizer.get();
+	}
+
+	return nullptr;
+}
+
+void LibAudio::FreeEqualizers()
+{
+	// DSP is not called after the channel is freed, so the equalizer can be deleted
+	for (std::size_t i = 0; i < eqDSPs.size();)
+	{
+		BASS_CHANNELINFO ci;
+		if (!BASS_ChannelGetInfo(eqDSPs[i].channel, &ci))
+			eqDSPs.erase(eqDSPs.begin() + i);
+		else
+			++i;
 	}
 }
 
+void CALLBACK LibAudio::DSPEqualizer(HDSP handle, DWORD channel, void* buffer, DWORD length, void* user)
+{
+	Equalizer* equalizer = static_cast<Equalizer*>(user);
+
+	equalizer->Process(static_cast<float*>(buffer), length / (sizeof(float) * equalizer->GetChannels()));
+}
+
+void LibAudio::ApplySpectrum()
+{
+	// The spectrum is taken from the mixer because it is the output channel for all drivers
+	if (!streamMixer || (spectrumChannel == streamMixer && spectrumDSP))
+		return;
+
+	// Only one DSP feeds the spectrum, the previous channel can be already freed
+	if (spectrumDSP)
+		BASS_ChannelRemoveDSP(spectrumChannel, spectrumDSP);
+	spectrumChannel = NULL;
+	spectrumDSP = NULL;
+
+	BASS_CHANNELINFO ci;
+	if (!BASS_ChannelGetInfo(streamMixer, &ci))
+		return;
+
+	double latency = 0.0;
+	if (bassDriver == 0)
+		latency = Buffer::DirectSound / 1000.0;
+	else if (bassDriver == 1)
+		latency = 0.05; // See BASS_WASAPI_Init
+
+	spectrum.SetFormat((int)ci.freq, (int)ci.chans, latency);
+	spectrum.SetPause(isMediaPause);
+
+	// Lower priority than the equalizer so the spectrum is after it
+	spectrumDSP = BASS_ChannelSetDSP(streamMixer, DSPSpectrum, &spectrum, -1);
+	if (spectrumDSP)
+		spectrumChannel = streamMixer;
+}
+
+void CALLBACK LibAudio::DSPSpectrum(HDSP handle, DWORD channel, void* buffer, DWORD length, void* user)
+{
+	Spectrum* spectrum = static_cast<Spectrum*>(user);
+
+	spectrum->Process(static_cast<const float*>(buffer), length / (sizeof(float) * spectrum->GetChannels()));
+}
+
 void LibAudio::ApplyEqualizer()
 {
 	EQ_DEBUG_LOGF("ApplyEqualizer called - isEqEnable=%d", isEqEnable);
@@ -20,6 +20,10 @@
 #include "XmlFile.h"
 #include "UTF.h"
 #include "Threading.h"
+#include "ReadAhead.h"
+#include "Equalizer.h"
+#include "Spectrum.h"
+#include "Crossfade.h"
 #include "bass/bass.h"
 //#include "bass/tags.h"
 #include "bass/bass_fx.h"
@@ -76,7 +80,7 @@ public:
 	void Pause(); // Pause playback
 	void Play(); // Resume playback
 
-	Error PlayFile(const std::wstring& file, long long cue);
+	Error PlayFile(const std::wstring& file, long long cue, float replayGain = 1.0f);
 	void PlayURL(const std::wstring& url, bool isReconnect = false);
 
 	bool StartPlayWASAPI(bool isFile, bool needFade, bool gaplessResume = false);
@@ -85,7 +89,7 @@ public:
 	void ResetCueSync(long long cue = 0, double lenght = 0.0, QWORD position = 0, QWORD offset = 0);
 	void FreePreload();
 	void PrepareOpen(bool needFade);
-	HSTREAM OpenMediaFile(const std::wstring& file, QWORD* outByteLength, double* outTimeSecond, double* position = nullptr, QWORD* outBytePosition = nullptr, int* outError = nullptr);
+	HSTREAM OpenMediaFile(const std::wstring& file, QWORD* outByteLength, double* outTimeSecond, double* position = nullptr, QWORD* outBytePosition = nullptr, int* outError = nullptr, float replayGain = 1.0f);
 	HSTREAM OpenMediaURL(const std::wstring& url, int* outError = nullptr);
 
 	int GetTimePosition();
@@ -94,8 +98,7 @@ public:
 	int GetPosition();
 	int GetVolume();
 	inline bool GetMute() {return isSoundMute;}
-	void GetFFT(float* fft);
-	void GetFFT2(float* fft, int size); // Not used
+	void GetSpectrum(float* bands); // Spectrum::BandCount values
 
 	void SetPosition(int position);
 	void SetVolume(int volume);
@@ -128,11 +131,23 @@ public:
 
 	bool IsRadioStream() {return isRadioStream;}
 
+	// Load playing and preloaded files to memory, budget in megabytes
+	void SetPlayMemory(bool isEnable, int budget) {isPlayMemory = isEnable; playMemoryBudget = (std::size_t)std::max(0, budget) * 1024 * 1024;}
+
+	// Crossfade between tracks for WASAPI/ASIO, fade time in seconds, curve is Crossfade::Curve
+	void SetCrossfade(bool isEnable, int seconds, int curve) {crossfade.SetEnable(isEnable, seconds, curve);}
+
+	// Read-ahead buffer of WASAPI/ASIO (for diagnostics)
+	unsigned GetBufferUnderruns() {return bufferUnderruns;}
+	int GetBufferFill() {return bufferFill;}
+
 private:
 	HSTREAM streamPlay = NULL; // Playing stream
 	HSTREAM streamMixer = NULL; // Mixer stream
 	HSTREAM streamPreload = NULL; // Preloaded stream
+	HSTREAM streamFade = NULL; // Previous stream that fades out after the crossfade
 	std::wstring filePreload; // Preloaded file
+	float replayGainPreload = 1.0f; // ReplayGain of the preloaded file (linear)
 	bool isPreloadRate = false;
 	HSTREAM streamMixerCopyWASAPI = NULL;
 	HSYNC syncEnd = NULL;
@@ -172,6 +187,7 @@ private:
 	std::wstring profilePath;
 
 	std::wstring fileThis; // Playing file
+	float replayGainThis = 1.0f; // ReplayGain of the playing file (linear)
 	std::wstring urlThis; // Playing URL address
 
 	QWORD byteLength = 0; // Playing file size in bytes
@@ -188,22 +204,27 @@ private:
 
 	bool isEqEnable = false; // Equalizer state (on/off)
 
-	HFX fxPreamp = NULL; // Preamp Bass_FX
-	HFX fxEqualizer[10]; // 10-band Equalizer Bass_FX (each band is separate BASS_FX_DX8_PARAMEQ)
+	// Equalizer DSP attached to a channel (see Equalizer), all bands and preamp are processed in one DSP.
+	// The previous channel can still play for some time (fade), so its DSP is kept until the channel is freed.
+	struct EqualizerDSP
+	{
+		HSTREAM channel = NULL;
+		HDSP dsp = NULL;
+		std::unique_ptr<Equalizer> equalizer;
+	};
+	std::vector<EqualizerDSP> eqDSPs; // The last one is for the current channel
 
 	float eqPreamp = 0.0f; // Preamp setting in db
 	float eqValues[10] = {0.0f}; // Equalizer settings in db
 	// Standard 10-band equalizer frequencies (Hz)
 	static const float eqFrequencies[10];
-
-	// Initialize equalizer effect handles to NULL
-	void InitializeEqHandles() {
-		for (int i = 0; i < 10; i++) {
-			fxEqualizer[i] = NULL;
-		}
-	}
 	std::wstring eqPreset; // Name of the equalizer preset
 
+	// Spectrum analyzer for visualizers (see Spectrum), DSP is attached to the output channel
+	Spectrum spectrum;
+	HSTREAM spectrumChannel = NULL;
+	HDSP spectrumDSP = NULL;
+
 	WinylWnd* wndWinyl = nullptr; // Main window (to send messages)
 
 	float soundVolume = 1.0f; // Sound volume
@@ -219,6 +240,12 @@ private:
 	void SaveEqBand(XmlNode& xmlNode, char* name, float f);
 	bool LoadEqualizer();
 	void LoadEqBand(XmlNode& xmlNode, char* name, float* f);
+	void FreeEqualizers();
+	Equalizer* GetEqualizer(HSTREAM channel);
+	static void CALLBACK DSPEqualizer(HDSP handle, DWORD channel, void* buffer, DWORD length, void* user);
+
+	void ApplySpectrum();
+	static void CALLBACK DSPSpectrum(HDSP handle, DWORD channel, void* buffer, DWORD length, void* user);
 
 	static void CALLBACK SyncProcEnd(HSYNC handle, DWORD channel, DWORD data, void* user);
 	static void CALLBACK SyncRadioMeta(HSYNC handle, DWORD channel, DWORD data, void* user);
@@ -244,6 +271,43 @@ private:
 
 	std::atomic<bool> nextCueTrack = false;
 
+	// Crossfade functions (WASAPI/ASIO only). RunThreadBuffer preloads the next track, fade points
+	// are found in RunThreadCrossfade (it decodes seconds of both files) and RunThreadBuffer starts the fade.
+	struct CrossfadeJob
+	{
+		HSTREAM stream = NULL;
+		HSTREAM streamNext = NULL;
+		std::wstring file;
+		std::wstring fileNext;
+		double timeSecond = 0.0;
+		double timeSecondNext = 0.0;
+		QWORD posPlus = 0;
+		DWORD freq = 0;
+		DWORD chans = 0;
+		// Result of RunThreadCrossfade, in frames of the buffer streams
+		bool isReady = false;
+		long long endFrame = 0;
+		long long fadeFrames = 0;
+		long long leadFrames = 0;
+	};
+	Crossfade crossfade;
+	CrossfadeJob crossfadeJob; // Under mutexCrossfade
+	Threading::Thread threadCrossfade;
+	std::unique_ptr<Threading::Event> eventCrossfade;
+	std::unique_ptr<Threading::Mutex> mutexCrossfade;
+	std::atomic<bool> stopThreadCrossfade = false;
+	std::atomic<bool> nextCrossfade = false; // Prepare the crossfade in RunThreadBuffer
+	std::atomic<bool> readyCrossfade = false; // Fade points are found, start the crossfade in RunThreadBuffer
+	std::atomic<bool> isCrossfadeNext = false; // The next track is started by the crossfade
+	void SetCrossfadeSync();
+	void PrepareCrossfade();
+	void RunThreadCrossfade();
+	void StartCrossfade();
+	void FreeFade();
+	static void CALLBACK SyncProcCrossfadePrepare(HSYNC handle, DWORD channel, DWORD data, void* user);
+	static void CALLBACK SyncProcCrossfade(HSYNC handle, DWORD channel, DWORD data, void* user);
+	static void CALLBACK DSPCrossfade(HDSP handle, DWORD channel, void* buffer, DWORD length, void* user);
+
 	QWORD posPlus = 0;
 	std::unique_ptr<Threading::Thread> threadBuffer;
 	std::unique_ptr<Threading::Event> eventBuffer;
@@ -252,12 +316,62 @@ private:
 	std::atomic<bool> stopThreadBuffer = false;
 	void RunThreadBuffer();
 
+	// The file stream is read by RunThreadBuffer into the read-ahead ring, the buffer stream takes data
+	// from the ring in StreamProcBuffer (in the output thread) without locks (see ReadAhead).
 	struct STRUCTBUFFER
 	{
-		HSTREAM streamFile;
-		HSTREAM streamBuffer;
-		char* buffer;
-		int bytes;
+		LibAudio* libAudio = nullptr;
+		HSTREAM streamFile = NULL;
+		HSTREAM streamBuffer = NULL;
+		std::unique_ptr<ReadAhead> readAhead;
+		std::atomic<bool> isFreed = false; // The buffer stream is freed
+		Crossfade::Fader fader; // Gain of the crossfade (DSP on the buffer stream)
+		HDSP faderDSP = NULL;
+		bool isCrossfade = false; // The next file is already preloaded for the crossfade
+	};
+	std::vector<STRUCTBUFFER*> bufferStreams; // Only for RunThreadBuffer
+	std::vector<STRUCTBUFFER*> bufferStreamsNew; // New buffer streams from OpenMediaFile (under mutexBuffer)
+	std::atomic<bool> isBufferStreamsNew = false;
+	std::atomic<unsigned> bufferUnderruns = 0;
+	std::atomic<int> bufferFill = 0; // In percent, of the last read buffer stream
+
+	// Files loaded to memory (see SetPlayMemory). OpenMediaFile is called from syncs and RunThreadBuffer
+	// so the stream is opened at once and the file is loaded by RunThreadMemory, until then
+	// the stream reads the part that is not loaded yet from the file (see FileReadProc).
+	struct MemoryFile
+	{
+		LibAudio* libAudio = nullptr;
+		std::wstring file;
+		std::unique_ptr<char[]> data;
+		std::size_t size = 0;
+		std::atomic<std::size_t> loaded = 0; // Loaded by RunThreadMemory
+		std::atomic<bool> isClosed = false; // The stream is freed
+		std::atomic<int> refCount = 1; // The stream and RunThreadMemory
+		FileHandle fileHandle; // Only for the stream
+		std::size_t position = 0; // Only for the stream
 	};
-	std::vector<STRUCTBUFFER*> bufferStreams;
+	bool isPlayMemory = false;
+	std::size_t playMemoryBudget = 0;
+	std::atomic<std::size_t> playMemoryUsed = 0;
+	Threading::Thread threadMemory;
+	std::unique_ptr<Threading::Event> eventMemory;
+	std::unique_ptr<Threading::Mutex> mutexMemory;
+	std::vector<MemoryFile*> memoryFilesNew; // Files to load (under mutexMemory)
+	std::atomic<bool> stopThreadMemory = false;
+	void RunThreadMemory();
+
+	HSTREAM OpenMemoryFile(const std::wstring& file, DWORD flags);
+	void LoadMemoryFile(MemoryFile* memoryFile);
+	static void ReleaseMemoryFile(MemoryFile* memoryFile);
+	static void CALLBACK FileCloseProc(void* user);
+	static QWORD CALLBACK FileLenProc(void* user);
+	static DWORD CALLBACK FileReadProc(void* buffer, DWORD length, void* user);
+	static BOOL CALLBACK FileSeekProc(QWORD offset, void* user);
+
+	void AddBufferStreamsNew();
+	STRUCTBUFFER* FindBufferStream(HSTREAM stream);
+	bool FillBufferStream(STRUCTBUFFER* buf);
+	void FreeBufferStream(STRUCTBUFFER* buf);
+	static DWORD CALLBACK StreamProcBuffer(HSTREAM handle, void* buffer, DWORD length, void* user);
+	static void CALLBACK SyncFreeBuffer(HSYNC handle, DWORD channel, DWORD data, void* user);
 };
@@ -0,0 +1,212 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "LyricsCache.h"
+#include "FileSystem.h"
+#include "UTF.h"
+
+LyricsCache::LyricsCache()
+{
+
+}
+
+LyricsCache::~LyricsCache()
+{
+	Close();
+}
+
+bool LyricsCache::Open(const std::wstring& file)
+{
+	Close();
+
+	if (!db.OpenCreate(file))
+		return false;
+
+	DBase::SQLRequest::Exec(db, "PRAGMA synchronous=NORMAL;");
+
+	DBase::SQLRequest::Exec(db,
+		"CREATE TABLE IF NOT EXISTS lyrics (key TEXT PRIMARY KEY, provider TEXT, lyrics TEXT, time INTEGER);");
+	DBase::SQLRequest::Exec(db,
+		"CREATE TABLE IF NOT EXISTS providers (provider TEXT PRIMARY KEY, hits INTEGER, misses INTEGER, latency INTEGER);");
+
+	DBase::SQLRequest sqlSelect(db,
+		"SELECT provider,hits,misses,latency FROM providers;");
+
+	mutexStats.Lock();
+	while (sqlSelect.StepRow())
+	{
+		ProviderStats& providerStats = stats[sqlSelect.ColumnText16(0)];
+		providerStats.hits = sqlSelect.ColumnInt(1);
+		providerStats.misses = sqlSelect.ColumnInt(2);
+		providerStats.latency = sqlSelect.ColumnInt(3);
+	}
+	mutexStats.Unlock();
+
+	// Remove expired misses
+	DBase::SQLRequest sqlDelete(db,
+		"DELETE FROM lyrics WHERE lyrics IS NULL AND time<?;");
+
+	sqlDelete.BindInt64(1, FileSystem::GetTimeNow() - missTimeout);
+
+	sqlDelete.Step();
+
+	return true;
+}
+
+void LyricsCache::Close()
+{
+	if (db)
+		db.Close();
+
+	mutexStats.Lock();
+	stats.clear();
+	mutexStats.Unlock();
+}
+
+std::wstring LyricsCache::Normalize(const std::wstring& str)
+{
+	std::wstring result;
+	result.reserve(str.size());
+
+	// Lower case, trim and collapse spaces
+	std::wstring lower = StringEx::ToLowerUS(str);
+	for (std::size_t i = 0, size = lower.size(); i < size; ++i)
+	{
+		wchar_t c = lower[i];
+		if (c == ' ' || c == '\t')
+		{
+			if (!result.empty() && result.back() != ' ')
+				result.push_back(' ');
+		}
+		else
+			result.push_back(c);
+	}
+
+	StringEx::TrimRight(result);
+
+	return result;
+}
+
+std::string LyricsCache::MakeKey(const std::wstring& artist, const std::wstring& title, const std::wstring& provider)
+{
+	return UTF::UTF8S(Normalize(artist) + L'\n' + Normalize(title) + L'\n' + provider);
+}
+
+LyricsCache::Result LyricsCache::Load(const std::wstring& artist, const std::wstring& title, const std::wstring& provider, std::string& outLyrics)
+{
+	outLyrics.clear();
+
+	if (!db)
+		return Result::None;
+
+	DBase::SQLRequest sqlSelect;
+	sqlSelect.PrepareCached(db,
+		"SELECT lyrics,time FROM lyrics WHERE key=?;");
+
+	sqlSelect.BindText8(1, MakeKey(artist, title, provider));
+
+	if (!sqlSelect.StepRow())
+		return Result::None;
+
+	if (sqlSelect.ColumnIsNull(0))
+	{
+		if (FileSystem::GetTimeNow() - sqlSelect.ColumnInt64(1) > missTimeout)
+			return Result::None; // Expired, ask the provider again
+
+		return Result::NotFound;
+	}
+
+	outLyrics = sqlSelect.ColumnText8(0);
+
+	return Result::Found;
+}
+
+void LyricsCache::Save(const std::wstring& artist, const std::wstring& title, const std::wstring& provider, const std::string& lyrics,
+	const std::wstring& source)
+{
+	if (!db)
+		return;
+
+	DBase::SQLRequest sqlInsert;
+	sqlInsert.PrepareCached(db,
+		"INSERT OR REPLACE INTO lyrics (key,provider,lyrics,time) VALUES (?,?,?,?);");
+
+	sqlInsert.BindText8(1, MakeKey(artist, title, provider));
+	sqlInsert.BindText16(2, source.empty() ? provider : source);
+	if (!lyrics.empty())
+		sqlInsert.BindText8(3, lyrics);
+	else
+		sqlInsert.BindNull(3);
+	sqlInsert.BindInt64(4, FileSystem::GetTimeNow());
+
+	sqlInsert.Step();
+}
+
+LyricsCache::ProviderStats LyricsCache::GetProviderStats(const std::wstring& provider)
+{
+	LockGuard lock(mutexStats);
+
+	auto find = stats.find(provider);
+	if (find != stats.end())
+		return find->second;
+
+	return ProviderStats();
+}
+
+void LyricsCache::AddProviderResult(const std::wstring& provider, bool isFound, int latency)
+{
+	mutexStats.Lock();
+
+	ProviderStats& providerStats = stats[provider];
+
+	// Halve old results from time to time so the order follows recent behavior of providers
+	if (providerStats.hits + providerStats.misses >= 1000)
+	{
+		providerStats.hits /= 2;
+		providerStats.misses /= 2;
+	}
+
+	if (isFound)
+		providerStats.hits++;
+	else
+		providerStats.misses++;
+
+	if (providerStats.latency == 0)
+		providerStats.latency = latency;
+	else
+		providerStats.latency = (providerStats.latency * 4 + latency) / 5;
+
+	ProviderStats newStats = providerStats;
+
+	mutexStats.Unlock();
+
+	if (!db)
+		return;
+
+	DBase::SQLRequest sqlInsert;
+	sqlInsert.PrepareCached(db,
+		"INSERT OR REPLACE INTO providers (provider,hits,misses,latency) VALUES (?,?,?,?);");
+
+	sqlInsert.BindText16(1, provider);
+	sqlInsert.BindInt(2, newStats.hits);
+	sqlInsert.BindInt(3, newStats.misses);
+	sqlInsert.BindInt(4, newStats.latency);
+
+	sqlInsert.Step();
+}
@@ -0,0 +1,78 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "DBase.h"
+#include <map>
+
+// Cache of lyrics from the internet (see LyricsLoader::LoadLyricsFromInternet).
+// Lyrics are stored in a database in the profile folder by artist, title and provider,
+// artist and title are compared in lower case without extra spaces.
+// If the provider doesn't have lyrics for the track it is stored too (negative caching),
+// such record expires after missTimeout so the provider is asked again later.
+// Also it keeps latency and hit rate of each provider to order providers when they race (see LyricsLoader::LoadLyricsRace).
+// Used from the lyrics thread and the prefetch thread (see WinylWnd::LyricsPrefetchRun),
+// SQLite connection is serialized so only provider statistics in memory are locked.
+
+class LyricsCache
+{
+
+public:
+	LyricsCache();
+	virtual ~LyricsCache();
+	LyricsCache(const LyricsCache&) = delete;
+	LyricsCache& operator=(const LyricsCache&) = delete;
+
+	bool Open(const std::wstring& file);
+	void Close();
+	inline bool IsOpen() {return db ? true : false;}
+
+	enum class Result
+	{
+		None,    // Not in the cache
+		Found,   // outLyrics contains lyrics
+		NotFound // The provider doesn't have lyrics
+	};
+
+	Result Load(const std::wstring& artist, const std::wstring& title, const std::wstring& provider, std::string& outLyrics);
+	// Empty lyrics to save that the provider doesn't have lyrics,
+	// source is the provider that returned lyrics if it is not the same (when providers race)
+	void Save(const std::wstring& artist, const std::wstring& title, const std::wstring& provider, const std::string& lyrics,
+		const std::wstring& source = std::wstring());
+
+	struct ProviderStats
+	{
+		int hits = 0;
+		int misses = 0;
+		int latency = 0; // Moving average in ms, 0 if unknown
+	};
+	ProviderStats GetProviderStats(const std::wstring& provider);
+	void AddProviderResult(const std::wstring& provider, bool isFound, int latency);
+
+private:
+	static const long long missTimeout = 3 * 24 * 60 * 60; // Seconds
+
+	DBase::SQLFile db;
+
+	Threading::Mutex mutexStats;
+	std::map<std::wstring, ProviderStats> stats;
+
+	static std::string MakeKey(const std::wstring& artist, const std::wstring& title, const std::wstring& provider);
+	static std::wstring Normalize(const std::wstring& str);
+};
@@ -24,6 +24,7 @@
 #include "HttpClient.h"
 #include "Threading.h"
 #include "XmlFile.h"
+#include "LyricsCache.h"
 
 LyricsLoader::LyricsLoader()
 {
@@ -35,7 +36,7 @@ LyricsLoader::~LyricsLoader()
 	
 }
 
-long long LyricsLoader::timePrev = 0;
+std::atomic<long long> LyricsLoader::timePrev(0);
 
 wchar_t* LyricsLoader::providers[] =
 {
@@ -50,6 +51,7 @@ wchar_t* LyricsLoader::providers[] =
 	L"oldielyrics.com",
 };
 int LyricsLoader::providersCount = sizeof(providers) / sizeof(providers[0]);
+const wchar_t* LyricsLoader::providerAuto = L"auto";
 
 int LyricsLoader::GetLyricsProviderByURL(const std::wstring& url)
 {
@@ -174,62 +176,197 @@ bool LyricsLoader::LoadLyricsFromInternet(const std::wstring& artist, const std:
 
 	long long timeNow = FileSystem::GetTimeNowMs();
 
-	if (timeNow - timePrev <= timeoutLyrics)
+	bool isRace = (provider == providerAuto);
+
+	// Do not request the same provider too often, in the race the requests go to different providers
+	if (!isRace && timeNow - timePrev <= timeoutLyrics)
 		Threading::ThreadSleep((unsigned)std::max(0LL, timeoutLyrics - (timeNow - timePrev)));
-	
-	if (FilterInputIsAscii(urlArtist) && FilterInputIsAscii(urlTitle))
-	{
-		FilterInputRemoveBraces(urlTitle);
-
-		std::string lyrics;
-
-		assert(providersCount == 8);
-
-		if (provider.empty())
-			lyrics = ProviderLyricsWikiaCom(urlArtist, urlTitle);
-		else if (provider == providers[1])
-			lyrics = ProviderMusixmatchCom(urlArtist, urlTitle);
-		else if (provider == providers[2])
-			lyrics = ProviderAZLyricsCom(urlArtist, urlTitle);
-		else if (provider == providers[3])
-			lyrics = ProviderLetrasMusBr(urlArtist, urlTitle);
-		else if (provider == providers[4])
-			lyrics = ProviderLyricsManiaCom(urlArtist, urlTitle);
-		else if (provider == providers[5])
-			lyrics = ProviderSongLyricsCom(urlArtist, urlTitle);
-		else if (provider == providers[6])
-			lyrics = ProviderGeniusCom(urlArtist, urlTitle);
-		else if (provider == providers[7])
-			lyrics = ProviderOldieLyricsCom(urlArtist, urlTitle);
 
-		LyricsToLines(lyrics);
+	std::string lyrics;
+	std::wstring source;
+	bool isAnswer = false;
 
-		int i = 0;
-	}
+	bool isAscii = FilterInputIsAscii(urlArtist) && FilterInputIsAscii(urlTitle);
+
+	FilterInputRemoveBraces(urlTitle);
+
+	if (isRace)
+		isAnswer = LoadLyricsRace(urlArtist, urlTitle, isAscii, lyrics, source);
 	else
 	{
-		FilterInputRemoveBraces(urlTitle);
+		int index = provider.empty() ? 0 : GetLyricsProviderByURL(provider);
 
-		std::string lyrics;
+		// Only these providers support not ASCII requests
+		if (isAscii || index == 0 || index == 1)
+			isAnswer = LoadLyricsProvider(index, urlArtist, urlTitle, lyrics);
+		else
+			isAnswer = true; // The provider cannot have lyrics for this request
+	}
 
-		if (provider.empty())
-			lyrics = ProviderLyricsWikiaCom(urlArtist, urlTitle);
-		else if (provider == providers[1])
-			lyrics = ProviderMusixmatchCom(urlArtist, urlTitle);
+	LyricsToLines(lyrics);
 
-		LyricsToLines(lyrics);
+	// Save a miss only if the providers answered that they don't have lyrics, a failed request
+	// (offline, timeout, server error) is not saved or the lyrics would be hidden until the miss expires
+	if (cache && (!lines.empty() || isAnswer))
+		cache->Save(artist, title, provider.empty() ? providers[0] : provider, lines.empty() ? std::string() : lyrics, source);
+
+	long long timeDone = FileSystem::GetTimeNowMs();
+	timePrev = timeDone;
+
+	if (timeDone - timeNow <= timeoutShow)
+		Threading::ThreadSleep((unsigned)std::max(0LL, timeoutShow - (timeDone - timeNow)));
+
+	if (lines.empty())
+		return false;
 
-		int i = 0;
+	return true;
+}
+
+bool LyricsLoader::LoadLyricsProvider(int provider, const std::string& urlArtist, const std::string& urlTitle, std::string& outLyrics)
+{
+	assert(providersCount == 8);
+
+	outLyrics.clear();
+
+	switch (provider)
+	{
+		case 0: return ProviderLyricsWikiaCom(urlArtist, urlTitle, outLyrics);
+		case 1: return ProviderMusixmatchCom(urlArtist, urlTitle, outLyrics);
+		case 2: return ProviderAZLyricsCom(urlArtist, urlTitle, outLyrics);
+		case 3: return ProviderLetrasMusBr(urlArtist, urlTitle, outLyrics);
+		case 4: return ProviderLyricsManiaCom(urlArtist, urlTitle, outLyrics);
+		case 5: return ProviderSongLyricsCom(urlArtist, urlTitle, outLyrics);
+		case 6: return ProviderGeniusCom(urlArtist, urlTitle, outLyrics);
+		case 7: return ProviderOldieLyricsCom(urlArtist, urlTitle, outLyrics);
 	}
 
-	timePrev = FileSystem::GetTimeNowMs();
+	return false;
+}
 
-	if (timePrev - timeNow <= timeoutShow)
-		Threading::ThreadSleep((unsigned)std::max(0LL, timeoutShow - (timePrev - timeNow)));
+bool LyricsLoader::LoadLyricsRace(const std::string& urlArtist, const std::string& urlTitle, bool isAscii, std::string& outLyrics, std::wstring& outSource)
+{
+	// Order providers by expected time to lyrics (latency / hit rate), unknown providers keep the order of the table
+	struct Candidate
+	{
+		int provider;
+		double score;
+	};
+	std::vector<Candidate> candidates;
 
-	if (lines.empty())
+	for (int i = 0; i < providersCount; ++i)
+	{
+		// Only these providers support not ASCII requests
+		if (!isAscii && i != 0 && i != 1)
+			continue;
+
+		Candidate candidate = {i, 0.0};
+		if (cache)
+		{
+			LyricsCache::ProviderStats stats = cache->GetProviderStats(providers[i]);
+			double hitRate = (stats.hits + 1.0) / (stats.hits + stats.misses + 2.0);
+			candidate.score = (stats.latency > 0 ? stats.latency : 1000) / hitRate;
+		}
+		candidates.push_back(candidate);
+	}
+
+	std::stable_sort(candidates.begin(), candidates.end(),
+		[](const Candidate& a, const Candidate& b) {return a.score < b.score;});
+
+	if ((int)candidates.size() > raceCount)
+		candidates.resize(raceCount);
+
+	HttpClient::Cancel cancel;
+	httpCancel = &cancel;
+
+	Threading::Mutex mutexRace;
+	Threading::Event eventRace;
+	int countDone = 0;
+	int countFailed = 0;
+	int winner = -1;
+	std::string winnerLyrics;
+
+	std::vector<std::future<void>> futures;
+
+	for (const Candidate& candidate : candidates)
+	{
+		int provider = candidate.provider;
+
+		futures.push_back(std::async(std::launch::async, [&, provider]()
+		{
+			long long timeStart = FileSystem::GetTimeNowMs();
+
+			std::string lyrics;
+			bool isAnswer = LoadLyricsProvider(provider, urlArtist, urlTitle, lyrics);
+			FilterOutputTrim(lyrics);
+
+			// Requests aborted because another provider won do not count
+			if (cache && (!lyrics.empty() || !cancel.IsAborted()))
+				cache->AddProviderResult(providers[provider], !lyrics.empty(), (int)(FileSystem::GetTimeNowMs() - timeStart));
+
+			mutexRace.Lock();
+			++countDone;
+			if (!isAnswer)
+				++countFailed;
+			if (winner == -1 && !lyrics.empty())
+			{
+				winner = provider;
+				winnerLyrics = std::move(lyrics);
+			}
+			mutexRace.Unlock();
+
+			eventRace.Set();
+		}));
+	}
+
+	while (true)
+	{
+		eventRace.Wait();
+
+		LockGuard lock(mutexRace);
+		if (winner > -1 || countDone == (int)futures.size())
+			break;
+	}
+
+	// Abort the rest and wait for them, aborted requests return at once
+	cancel.Abort();
+	for (auto& future : futures)
+		future.get();
+
+	httpCancel = nullptr;
+
+	if (winner > -1)
+	{
+		outSource = providers[winner];
+		outLyrics = std::move(winnerLyrics);
+		return true;
+	}
+
+	return countFailed == 0;
+}
+
+bool LyricsLoader::GetHttpPage(const std::string& url, std::string& outPage)
+{
+	DWORD statusCode = 0;
+	if (HttpClient::GetHttpPage(url, outPage, httpCancel, &statusCode))
+		return true;
+
+	// Providers answer 404 for unknown songs, other errors can be temporary (403 and 429 when requests are too often)
+	return (statusCode == 404 || statusCode == 410);
+}
+
+bool LyricsLoader::LoadLyricsFromCache(const std::wstring& artist, const std::wstring& title, const std::wstring& provider)
+{
+	if (cache == nullptr || artist.empty() || title.empty())
+		return false;
+
+	std::string lyrics;
+	LyricsCache::Result result = cache->Load(artist, title, provider.empty() ? providers[0] : provider, lyrics);
+
+	if (result == LyricsCache::Result::None)
 		return false;
 
+	LyricsToLines(lyrics);
+
 	return true;
 }
 
@@ -528,10 +665,8 @@ void LyricsLoader::FilterOutputTrim(std::string &str)
 	str.erase(str.find_last_not_of(" \t\r\n") + 1);
 }
 
-std::string LyricsLoader::ProviderLyricsWikiaCom(const std::string& urlArtist, const std::string& urlTitle)
+bool LyricsLoader::ProviderLyricsWikiaCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics)
 {
-	std::string lyrics;
-
 	std::string artist = urlArtist;
 	std::string title = urlTitle;
 	std::replace(artist.begin(), artist.end(), ' ', '_');
@@ -541,7 +676,8 @@ std::string LyricsLoader::ProviderLyricsWikiaCom(const std::string& urlArtist, c
 
 	std::string url = "http://lyrics.wikia.com/wiki/" + artist + ":" + title;
 
-	if (HttpClient::GetHttpPage(url, lyrics))
+	bool result = GetHttpPage(url, lyrics);
+	if (result)
 	{
 		if (!lyrics.empty())
 		{
@@ -557,7 +693,7 @@ std::string LyricsLoader::ProviderLyricsWikiaCom(const std::string& urlArtist, c
 /*
 	std::string url = "http://lyrics.wikia.com/" + artist + ":" + title + "?action=edit";
 
-	if (HttpClient::GetHttpPage(url, lyrics))
+	if (GetHttpPage(url, lyrics))
 	{
 		if (!lyrics.empty())
 		{
@@ -568,16 +704,14 @@ std::string LyricsLoader::ProviderLyricsWikiaCom(const std::string& urlArtist, c
 		}
 	}
 */
-	return lyrics;
+	return result;
 }
 
-std::string LyricsLoader::ProviderAZLyricsCom(const std::string& urlArtist, const std::string& urlTitle)
+bool LyricsLoader::ProviderAZLyricsCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics)
 {
 	// plyrics.com
 	// urbanlyrics.com
 
-	std::string lyrics;
-
 	std::string artist = FilterInputStripSpaces(urlArtist);
 	std::string title = FilterInputStripSpaces(urlTitle);
 	FilterInputLowerAscii(artist);
@@ -585,7 +719,8 @@ std::string LyricsLoader::ProviderAZLyricsCom(const std::string& urlArtist, cons
 
 	std::string url = "https://www.azlyrics.com/lyrics/" + artist + "/" + title + ".html";
 
-	if (HttpClient::GetHttpPage(url, lyrics))
+	bool result = GetHttpPage(url, lyrics);
+	if (result)
 	{
 		if (!lyrics.empty())
 		{
@@ -599,13 +734,11 @@ std::string LyricsLoader::ProviderAZLyricsCom(const std::string& urlArtist, cons
 		}
 	}
 
-	return lyrics;
+	return result;
 }
 
-std::string LyricsLoader::ProviderMetroLyricsCom(const std::string& urlArtist, const std::string& urlTitle)
+bool LyricsLoader::ProviderMetroLyricsCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics)
 {
-	std::string lyrics;
-
 	std::string artist = FilterInputStripSpaces(urlArtist, '-');
 	std::string title = FilterInputStripSpaces(urlTitle, '-');
 	FilterInputLowerAscii(artist);
@@ -613,7 +746,8 @@ std::string LyricsLoader::ProviderMetroLyricsCom(const std::string& urlArtist, c
 
 	std::string url = "http://www.metrolyrics.com/" + title + "-lyrics-" + artist + ".html";
 
-	if (HttpClient::GetHttpPage(url, lyrics))
+	bool result = GetHttpPage(url, lyrics);
+	if (result)
 	{
 		if (!lyrics.empty())
 		{
@@ -627,13 +761,11 @@ std::string LyricsLoader::ProviderMetroLyricsCom(const std::string& urlArtist, c
 		}
 	}
 
-	return lyrics;
+	return result;
 }
 
-std::string LyricsLoader::ProviderSongLyricsCom(const std::string& urlArtist, const std::string& urlTitle)
+bool LyricsLoader::ProviderSongLyricsCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics)
 {
-	std::string lyrics;
-
 	std::string artist = FilterInputStripSpaces(urlArtist, '-');
 	std::string title = FilterInputStripSpaces(urlTitle, '-');
 	FilterInputLowerAscii(artist);
@@ -641,7 +773,8 @@ std::string LyricsLoader::ProviderSongLyricsCom(const std::string& urlArtist, co
 
 	std::string url = "http://www.songlyrics.com/" + artist + "/" + title + "-lyrics" + "/";
 
-	if (HttpClient::GetHttpPage(url, lyrics))
+	bool result = GetHttpPage(url, lyrics);
+	if (result)
 	{
 		if (!lyrics.empty())
 		{
@@ -655,13 +788,11 @@ std::string LyricsLoader::ProviderSongLyricsCom(const std::string& urlArtist, co
 		}
 	}
 
-	return lyrics;
+	return result;
 }
 
-std::string LyricsLoader::ProviderOldieLyricsCom(const std::string& urlArtist, const std::string& urlTitle)
+bool LyricsLoader::ProviderOldieLyricsCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics)
 {
-	std::string lyrics;
-
 	std::string artist = FilterInputStripSpaces(urlArtist, '_');
 	std::string title = FilterInputStripSpaces(urlTitle, '_');
 	FilterInputLowerAscii(artist);
@@ -669,7 +800,8 @@ std::string LyricsLoader::ProviderOldieLyricsCom(const std::string& urlArtist, c
 
 	std::string url = "https://www.oldielyrics.com/lyrics/" + artist + "/" + title + ".html";
 
-	if (HttpClient::GetHttpPage(url, lyrics))
+	bool result = GetHttpPage(url, lyrics);
+	if (result)
 	{
 		if (!lyrics.empty())
 		{
@@ -683,13 +815,11 @@ std::string LyricsLoader::ProviderOldieLyricsCom(const std::string& urlArtist, c
 		}
 	}
 
-	return lyrics;
+	return result;
 }
 
-std::string LyricsLoader::ProviderChartLyricsCom(const std::string& urlArtist, const std::string& urlTitle)
+bool LyricsLoader::ProviderChartLyricsCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics)
 {
-	std::string lyrics;
-
 	std::string artist = FilterInputUriEncode(urlArtist, true);
 	std::string title = FilterInputUriEncode(urlTitle, true);
 
@@ -697,7 +827,8 @@ std::string LyricsLoader::ProviderChartLyricsCom(const std::string& urlArtist, c
 
 	std::string apixml;
 
-	if (HttpClient::GetHttpPage(url, apixml))
+	bool result = GetHttpPage(url, apixml);
+	if (result)
 	{
 		if (!apixml.empty())
 		{
@@ -715,13 +846,11 @@ std::string LyricsLoader::ProviderChartLyricsCom(const std::string& urlArtist, c
 		}
 	}
 
-	return lyrics;
+	return result;
 }
 
-std::string LyricsLoader::ProviderLyricsManiaCom(const std::string& urlArtist, const std::string& urlTitle)
+bool LyricsLoader::ProviderLyricsManiaCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics)
 {
-	std::string lyrics;
-
 	std::string artist = FilterInputStripSpaces(urlArtist, '_');
 	std::string title = FilterInputStripSpaces(urlTitle, '_');
 	FilterInputLowerAscii(artist);
@@ -729,7 +858,8 @@ std::string LyricsLoader::ProviderLyricsManiaCom(const std::string& urlArtist, c
 
 	std::string url = "https://www.lyricsmania.com/" + title + "_lyrics_" + artist + ".html";
 
-	if (HttpClient::GetHttpPage(url, lyrics))
+	bool result = GetHttpPage(url, lyrics);
+	if (result)
 	{
 		if (!lyrics.empty())
 		{
@@ -743,13 +873,11 @@ std::string LyricsLoader::ProviderLyricsManiaCom(const std::string& urlArtist, c
 		}
 	}
 
-	return lyrics;
+	return result;
 }
 
-std::string LyricsLoader::ProviderGeniusCom(const std::string& urlArtist, const std::string& urlTitle)
+bool LyricsLoader::ProviderGeniusCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics)
 {
-	std::string lyrics;
-
 	std::string artist = FilterInputStripSpaces(urlArtist, '-');
 	std::string title = FilterInputStripSpaces(urlTitle, '-');
 	FilterInputLowerAscii(artist);
@@ -757,7 +885,8 @@ std::string LyricsLoader::ProviderGeniusCom(const std::string& urlArtist, const
 
 	std::string url = "https://genius.com/" + artist + "-" + title + "-lyrics";
 
-	if (HttpClient::GetHttpPage(url, lyrics))
+	bool result = GetHttpPage(url, lyrics);
+	if (result)
 	{
 		if (!lyrics.empty())
 		{
@@ -771,13 +900,11 @@ std::string LyricsLoader::ProviderGeniusCom(const std::string& urlArtist, const
 		}
 	}
 
-	return lyrics;
+	return result;
 }
 
-std::string LyricsLoader::ProviderLetrasMusBr(const std::string& urlArtist, const std::string& urlTitle)
+bool LyricsLoader::ProviderLetrasMusBr(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics)
 {
-	std::string lyrics;
-
 	std::string artist = FilterInputStripSpaces(urlArtist, '_');
 	std::string title = FilterInputStripSpaces(urlTitle, '_');
 	FilterInputLowerAscii(artist);
@@ -785,7 +912,8 @@ std::string LyricsLoader::ProviderLetrasMusBr(const std::string& urlArtist, cons
 
 	std::string url = "https://www.letras.mus.br/winamp.php?musica=" + title + "&artista=" + artist;
 
-	if (HttpClient::GetHttpPage(url, lyrics))
+	bool result = GetHttpPage(url, lyrics);
+	if (result)
 	{
 		if (!lyrics.empty())
 		{
@@ -799,13 +927,11 @@ std::string LyricsLoader::ProviderLetrasMusBr(const std::string& urlArtist, cons
 		}
 	}
 
-	return lyrics;
+	return result;
 }
 
-std::string LyricsLoader::ProviderMusixmatchCom(const std::string& urlArtist, const std::string& urlTitle)
+bool LyricsLoader::ProviderMusixmatchCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics)
 {
-	std::string lyrics;
-
 	std::string artist = FilterInputStripSpaces(urlArtist, '-');
 	std::string title = FilterInputStripSpaces(urlTitle, '-');
 	FilterInputLowerAscii(artist);
@@ -813,7 +939,8 @@ std::string LyricsLoader::ProviderMusixmatchCom(const std::string& urlArtist, co
 
 	std::string url = "https://www.musixmatch.com/lyrics/" + artist + "/" + title;
 
-	if (HttpClient::GetHttpPage(url, lyrics))
+	bool result = GetHttpPage(url, lyrics);
+	if (result)
 	{
 		if (!lyrics.empty())
 		{
@@ -843,5 +970,5 @@ std::string LyricsLoader::ProviderMusixmatchCom(const std::string& urlArtist, co
 		}
 	}
 
-	return lyrics;
+	return result;
 }
\ No newline at end of file
@@ -18,6 +18,10 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <atomic>
+#include "HttpClient.h"
+
+class LyricsCache;
 
 class LyricsLoader
 {
@@ -29,6 +33,10 @@ public:
 	bool LoadLyricsFromFile(const std::wstring& file);
 	bool LoadLyricsFromTags(const std::wstring& file);
 	bool LoadLyricsFromInternet(const std::wstring& artist, const std::wstring& title, const std::wstring& provider);
+	// Return true if the result for the provider is in the cache (lines are empty if the provider doesn't have lyrics)
+	bool LoadLyricsFromCache(const std::wstring& artist, const std::wstring& title, const std::wstring& provider);
+	// Results of LoadLyricsFromInternet are saved to this cache
+	inline void SetCache(LyricsCache* lyricsCache) {cache = lyricsCache;}
 	std::vector<std::wstring>& GetLines() {return lines;}
 	std::wstring GetLyrics();
 
@@ -37,9 +45,12 @@ public:
 	static const wchar_t* GetLyricsProvider(int index) {return providers[index];}
 	static int GetLyricsProviderCount() {return providersCount;}
 	static int GetLyricsProviderByURL(const std::wstring& url);
+	// Use this provider to race the best providers (see LoadLyricsRace)
+	static const wchar_t* GetLyricsProviderAuto() {return providerAuto;}
 
 private:
 	std::vector<std::wstring> lines;
+	LyricsCache* cache = nullptr;
 
 	bool LoadLyricsFromFileImpl(const std::wstring& file);
 
@@ -50,8 +61,22 @@ private:
 
 	static wchar_t* providers[];
 	static int providersCount;
+	static const wchar_t* providerAuto;
+
+	static const int raceCount = 3; // Number of providers to request at the same time
+	HttpClient::Cancel* httpCancel = nullptr; // Abort requests of providers that lost the race
+
+	// Return false if the request failed (no connection, timeout, server error), the provider can still have lyrics so it is not cached,
+	// return true if the provider answered, outLyrics is empty if the provider doesn't have lyrics
+	bool LoadLyricsProvider(int provider, const std::string& urlArtist, const std::string& urlTitle, std::string& outLyrics);
+	// Request several providers at the same time and take lyrics from the first that has them,
+	// providers are ordered by latency and hit rate (see LyricsCache::GetProviderStats)
+	// Return false if there are no lyrics and some provider failed (see LoadLyricsProvider)
+	bool LoadLyricsRace(const std::string& urlArtist, const std::string& urlTitle, bool isAscii, std::string& outLyrics, std::wstring& outSource);
+	// Return value is the same as for LoadLyricsProvider, "not found" is an answer (outPage is empty)
+	bool GetHttpPage(const std::string& url, std::string& outPage);
 
-	static long long timePrev;
+	static std::atomic<long long> timePrev; // Used from the lyrics thread and the prefetch thread
 
 	bool FilterInputIsValid(const std::string& str);
 	bool FilterInputIsAscii(const std::string& str);
@@ -66,15 +91,15 @@ private:
 	void FilterOutputHtmlEncode(const std::string &src, std::size_t start, std::size_t end, std::string &dst);
 	void FilterOutputTrim(std::string &str);
 
-	std::string ProviderLyricsWikiaCom(const std::string& urlArtist, const std::string& urlTitle);
-	std::string ProviderAZLyricsCom(const std::string& urlArtist, const std::string& urlTitle);
-	std::string ProviderMetroLyricsCom(const std::string& urlArtist, const std::string& urlTitle);
-	std::string ProviderSongLyricsCom(const std::string& urlArtist, const std::string& urlTitle);
-	std::string ProviderOldieLyricsCom(const std::string& urlArtist, const std::string& urlTitle);
-	std::string ProviderChartLyricsCom(const std::string& urlArtist, const std::string& urlTitle);
-	std::string ProviderLyricsManiaCom(const std::string& urlArtist, const std::string& urlTitle);
-	std::string ProviderGeniusCom(const std::string& urlArtist, const std::string& urlTitle);
-	std::string ProviderLetrasMusBr(const std::string& urlArtist, const std::string& urlTitle);
-	std::string ProviderMusixmatchCom(const std::string& urlArtist, const std::string& urlTitle);
+	bool ProviderLyricsWikiaCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics);
+	bool ProviderAZLyricsCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics);
+	bool ProviderMetroLyricsCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics);
+	bool ProviderSongLyricsCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics);
+	bool ProviderOldieLyricsCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics);
+	bool ProviderChartLyricsCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics);
+	bool ProviderLyricsManiaCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics);
+	bool ProviderGeniusCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics);
+	bool ProviderLetrasMusBr(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics);
+	bool ProviderMusixmatchCom(const std::string& urlArtist, const std::string& urlTitle, std::string& lyrics);
 };
 
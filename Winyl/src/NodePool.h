@@ -0,0 +1,100 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Threading.h"
+#include <vector>
+#include <memory>
+#include <cassert>
+
+// Pool for nodes of the list and the tree (see operator new/delete of SkinListNode and SkinTreeNode).
+// Nodes are allocated in blocks and freed nodes are reused, so filling and clearing a list with
+// many thousands of nodes doesn't go to the heap for each node. The blocks are kept until the pool
+// is destroyed (at exit, when all nodes are already deleted), the peak usage is usually reached again.
+// The pool is used from the main thread and from the search thread (DBase::FillListSearch*).
+
+template<class T, std::size_t BlockSize = 1024>
+class NodePool final
+{
+public:
+	NodePool() {}
+	~NodePool()
+	{
+		assert(countUsed == 0); // Some nodes are not deleted
+	}
+	NodePool(const NodePool&) = delete;
+	NodePool& operator=(const NodePool&) = delete;
+
+	void* Allocate()
+	{
+		LockGuard lock(mutex);
+
+		if (freeSlot == nullptr)
+		{
+			blocks.emplace_back(new Slot[BlockSize]);
+
+			Slot* block = blocks.back().get();
+			for (std::size_t i = 0; i < BlockSize - 1; ++i)
+				block[i].next = &block[i + 1];
+			block[BlockSize - 1].next = nullptr;
+
+			freeSlot = block;
+		}
+
+		Slot* slot = freeSlot;
+		freeSlot = slot->next;
+
+		++countUsed;
+		if (countUsed > countPeak)
+			countPeak = countUsed;
+
+		return slot;
+	}
+
+	void Free(void* ptr)
+	{
+		if (ptr == nullptr)
+			return;
+
+		LockGuard lock(mutex);
+
+		Slot* slot = static_cast<Slot*>(ptr);
+		slot->next = freeSlot;
+		freeSlot = slot;
+
+		--countUsed;
+	}
+
+	std::size_t GetCountUsed() {return countUsed;}
+	std::size_t GetCountPeak() {return countPeak;}
+	std::size_t GetCountBlocks() {return blocks.size();}
+
+private:
+	union Slot
+	{
+		Slot* next;
+		alignas(T) unsigned char data[sizeof(T)];
+	};
+
+	Threading::Mutex mutex;
+	Slot* freeSlot = nullptr;
+	std::vector<std::unique_ptr<Slot[]>> blocks;
+
+	std::size_t countUsed = 0;
+	std::size_t countPeak = 0;
+};
@@ -17,6 +17,7 @@
 
 #include "stdafx.h"
 #include "Progress.h"
+#include "DebugMacros.h"
 
 Progress::Progress()
 {
@@ -153,7 +154,7 @@ bool Progress::IsMusicFile(const std::wstring& file, bool* outCue)
 	return false;
 }
 
-void Progress::CalculateFolder(const std::wstring& folder)
+void Progress::CalculateFolder(const std::wstring& folder, bool isManifest)
 {
 	assert(!folder.empty() && folder.back() == '\\');
 
@@ -162,6 +163,8 @@ void Progress::CalculateFolder(const std::wstring& folder)
 
 	FileSystem::Find find(folder);
 
+	int manifestFolder = -1;
+
 	while (find.Next())
 	{
 		if (isStopThread)
@@ -173,14 +176,25 @@ void Progress::CalculateFolder(const std::wstring& folder)
 			if (find.IsHidden() && !isPlaylist && !isNewPlaylist)
 				continue;
 
-			CalculateFolder(folder + find.GetFileName() + L"\\");
+			CalculateFolder(folder + find.GetFileName() + L"\\", isManifest);
 		}
 		else
 		{
 			bool cue = false;
 			if (IsMusicFile(find.GetFileName(), &cue))
 			{
-				if (cue) cueFiles.emplace_back(FileStruct{folder, find.GetFileName(), find.GetFileSize(), find.GetModified()});
+				if (isManifest)
+				{
+					if (manifestFolder < 0)
+					{
+						manifestFolder = (int)manifestFolders.size();
+						manifestFolders.push_back(folder);
+					}
+					manifestFiles.emplace_back(ManifestFile{find.GetFileName(),
+						find.GetFileSize(), find.GetModified(), (unsigned int)manifestFolder, cue});
+				}
+				else if (cue)
+					cueFiles.emplace_back(FileStruct{folder, find.GetFileName(), find.GetFileSize(), find.GetModified()});
 				numberFiles++;
 			}
 		}
@@ -214,39 +228,6 @@ bool Progress::CalculateFile(const std::wstring& file)
 	return false;
 }
 
-void Progress::AddFolderToLibrary(const std::wstring& folder, bool isLibraryEmpty)
-{
-	assert(!folder.empty() && folder.back() == '\\');
-
-	if (isStopThread)
-		return;
-
-	FileSystem::Find find(folder);
-
-	while (find.Next())
-	{
-		if (isStopThread)
-			return;
-
-		if (find.IsDirectory())
-		{
-			if (find.IsHidden())
-				continue;
-
-			AddFolderToLibrary(folder + find.GetFileName() + L"\\", isLibraryEmpty);
-		}
-		else
-		{
-			if (IsMusicFile(find.GetFileName()))
-			{
-				AddToLibrary(isLibraryEmpty, folder, find.GetFileName(), find.GetFileSize(), find.GetModified());
-
-				funcUpdateProgressPos(++progressPos, numberFiles);
-			}
-		}
-	}
-}
-
 void Progress::AddFolderToPlaylist(const std::wstring& folder, bool isTempPlaylist)
 {
 	assert(!folder.empty() && folder.back() == '\\');
@@ -344,54 +325,336 @@ int Progress::GetFileHash(const std::wstring& file, bool& outNoDrive)
 	return StringEx::HashFNV1a32(fileLowerUS);
 }
 
-void Progress::AddToLibrary(bool isLibraryEmpty, const std::wstring& path, const std::wstring& file, long long fileSize, long long fileTime)
+bool Progress::AddToLibrary(bool isLibraryEmpty, const std::wstring& path, const std::wstring& file, long long fileSize, long long fileTime)
 {
-	bool noDrive = false;
-	int fileHash = GetFileHash(path + file, noDrive);
+	LibraryJob job;
+	job.path = path;
+	job.file = file;
+	job.fileSize = fileSize;
+	job.fileTime = fileTime;
+	job.fileHash = GetFileHash(path + file, job.noDrive);
 
-	long long id = 0;
 	long long size = 0;
 	long long modified = 0;
 	bool cue = false;
 
-	if (dBase->CheckFile(noDrive, path, file, fileHash, 0, id, modified, size, cue, true)) // Already added
+	if (dBase->CheckFile(job.noDrive, path, file, job.fileHash, 0, job.id, modified, size, cue, true)) // Already added
+	{
+		if (cue) // Do not add if the file is part of cue
+			job.action = LibraryJob::Action::Skip;
+		else if (!isRescanAll && fileSize == size && fileTime == modified) // File isn't changed
+			job.action = LibraryJob::Action::Unchanged;
+		else // File is added but tags are changed, need to update
+			job.action = LibraryJob::Action::Update;
+	}
+	else // File isn't added, need to add
+		job.action = LibraryJob::Action::Add;
+
+	if (job.action == LibraryJob::Action::Update || job.action == LibraryJob::Action::Add)
+	{
+		queueLibraryRead->Push(std::move(job));
+		return true;
+	}
+
+	WriteToLibrary(isLibraryEmpty, job);
+	funcUpdateProgressPos(++progressPos, numberFiles);
+	return false;
+}
+
+void Progress::ThreadLibraryReader()
+{
+	LibraryJob job;
+	while (queueLibraryRead->Pop(job))
+	{
+		// Return the job even after stop, the scan thread counts the jobs it waits for
+		if (!isStopThread)
+			FillSongStruct(job.noDrive, job.path, job.file, job.fileHash, job.fileSize, job.fileTime, &job.dataSongInfo);
+
+		queueLibraryWrite->Push(std::move(job));
+	}
+}
+
+std::size_t Progress::WriteReadJobs(bool isLibraryEmpty, bool isWait)
+{
+	// Write the jobs the readers have finished, if isWait then wait for at least one
+	std::size_t count = 0;
+
+	LibraryJob job;
+	while ((isWait && count == 0) ? queueLibraryWrite->Pop(job) : queueLibraryWrite->TryPop(job))
+	{
+		++count;
+
+		if (isStopThread) // Just drain the queue
+			continue;
+
+		WriteToLibrary(isLibraryEmpty, job);
+
+		funcUpdateProgressPos(++progressPos, numberFiles);
+	}
+
+	return count;
+}
+
+void Progress::WriteToLibrary(bool isLibraryEmpty, LibraryJob& job)
+{
+	switch (job.action)
+	{
+	case LibraryJob::Action::Skip:
+		break;
+
+	case LibraryJob::Action::Unchanged:
+		UpdateProgressTextEmpty();
+
+		dBase->SetUpdateOK(job.id);
+		break;
+
+	case LibraryJob::Action::Update:
+		UpdateProgressText(job.file);
+
+		dBase->UpdateTagsModified(job.id, &job.dataSongInfo);
+		dBase->SetUpdateOK(job.id);
+		break;
+
+	case LibraryJob::Action::Add:
 	{
-		if (cue) return; // Do not add if the file is part of cue
+		UpdateProgressText(job.file);
 
-		if (!isRescanAll && fileSize == size && fileTime == modified) // File isn't changed
+		long long idTags = 0;
+
+		if (isFindMoved && !isLibraryEmpty && dBase->CheckTags(idTags, &job.dataSongInfo)) // Check tags, maybe it's moved file
 		{
-			UpdateProgressTextEmpty();
+			dBase->UpdateTagsFileMove(idTags, &job.dataSongInfo);
+			dBase->SetUpdateOK(idTags);
+		}
+		else // Add new file
+			dBase->AddFileToLibrary(&job.dataSongInfo);
+		break;
+	}
+	}
+}
+
+void Progress::AddFoldersToLibrary(bool isLibraryEmpty)
+{
+	// Disk and network I/O dominate when reading tags so use more readers than cores on small machines
+	SYSTEM_INFO systemInfo = {};
+	::GetSystemInfo(&systemInfo);
+	int numberReaders = std::max(2, std::min(libraryReadersMax, (int)systemInfo.dwNumberOfProcessors));
+
+	Threading::BoundedQueue<LibraryJob> queueRead(libraryQueueSize);
+	Threading::BoundedQueue<LibraryJob> queueWrite(libraryQueueSize);
+	queueLibraryRead = &queueRead;
+	queueLibraryWrite = &queueWrite;
+
+	std::vector<std::unique_ptr<Threading::Thread>> threadReaders;
+	for (int i = 0; i < numberReaders; ++i)
+	{
+		threadReaders.emplace_back(new Threading::Thread());
+		threadReaders.back()->Start(std::bind(&Progress::ThreadLibraryReader, this));
+	}
+
+	std::size_t countReading = 0; // Jobs given to the readers and not written yet
+
+	for (const ManifestFile& manifestFile : manifestFiles)
+	{
+		if (isStopThread) break;
+
+		if (manifestFile.isCue) // Cue files are already processed
+			continue;
+
+		// Keep both queues from being full, see Progress.h
+		while (countReading >= libraryQueueSize)
+			countReading -= WriteReadJobs(isLibraryEmpty, true);
+
+		if (AddToLibrary(isLibraryEmpty, manifestFolders[manifestFile.folder], manifestFile.file, manifestFile.fileSize, manifestFile.fileTime))
+			++countReading;
+
+		countReading -= WriteReadJobs(isLibraryEmpty, false);
+	}
+
+	// The readers finish the queue and exit, then write the rest
+	queueRead.Close();
+	for (auto& threadReader : threadReaders)
+		threadReader->Join();
+
+	while (countReading > 0)
+		countReading -= WriteReadJobs(isLibraryEmpty, true);
+
+	queueLibraryRead = nullptr;
+	queueLibraryWrite = nullptr;
+}
+
+void Progress::AnalyzeReplayGain()
+{
+	std::vector<std::vector<DBase::ReplayGainTrack>> albums;
+	dBase->GetReplayGainAlbums(albums);
+
+	// Album gain depends on all tracks of the album, so if a track is new or changed the whole album is analyzed again
+	std::vector<std::unique_ptr<GainAlbum>> gainAlbums;
+	int numberTracks = 0;
 
-			dBase->SetUpdateOK(id);
+	for (auto& tracks : albums)
+	{
+		bool isChanged = false;
+		for (const auto& track : tracks)
+		{
+			ReplayGain::Values values;
+			if (!ReplayGain::FromString(track.replayGain, values) ||
+				values.fileSize != track.size || values.fileTime != track.modified)
+			{
+				isChanged = true;
+				break;
+			}
 		}
-		else // File is added but tags are changed, need to update
+
+		if (!isChanged)
+			continue;
+
+		gainAlbums.emplace_back(new GainAlbum());
+		gainAlbums.back()->meters.resize(tracks.size());
+		gainAlbums.back()->tracks = std::move(tracks);
+		numberTracks += (int)gainAlbums.back()->tracks.size();
+	}
+
+	std::vector<std::vector<DBase::ReplayGainTrack>>().swap(albums);
+
+	if (numberTracks == 0)
+		return;
+
+	progressPos = 0;
+	numberFiles = numberTracks;
+	funcUpdateProgressRange(0, numberFiles);
+	funcUpdateProgressPos(progressPos, numberFiles);
+
+	// Decoding is CPU bound so leave one core for playback and UI
+	SYSTEM_INFO systemInfo = {};
+	::GetSystemInfo(&systemInfo);
+	int numberAnalyzers = std::max(1, std::min(libraryReadersMax, (int)systemInfo.dwNumberOfProcessors - 1));
+
+	Threading::BoundedQueue<GainJob> queueRead(libraryQueueSize);
+	Threading::BoundedQueue<GainJob> queueWrite(libraryQueueSize);
+	queueGainRead = &queueRead;
+	queueGainWrite = &queueWrite;
+
+	std::vector<std::unique_ptr<Threading::Thread>> threadAnalyzers;
+	for (int i = 0; i < numberAnalyzers; ++i)
+	{
+		threadAnalyzers.emplace_back(new Threading::Thread());
+		threadAnalyzers.back()->Start(std::bind(&Progress::ThreadGainAnalyzer, this), Threading::Thread::Priority::BelowNormal);
+	}
+
+	Threading::Thread threadWriter;
+	threadWriter.Start(std::bind(&Progress::ThreadGainWriter, this));
+
+	for (auto& gainAlbum : gainAlbums)
+	{
+		if (isStopThread) break;
+
+		for (std::size_t i = 0, size = gainAlbum->tracks.size(); i < size; ++i)
 		{
-			UpdateProgressText(file);
+			GainJob job;
+			job.album = gainAlbum.get();
+			job.track = i;
+			queueRead.Push(std::move(job));
+		}
+	}
 
-			DBase::DATABASE_SONGINFO dataSongInfo;
-			FillSongStruct(noDrive, path, file, fileHash, fileSize, fileTime, &dataSongInfo);
+	queueRead.Close();
+	for (auto& threadAnalyzer : threadAnalyzers)
+		threadAnalyzer->Join();
 
-			dBase->UpdateTagsModified(id, &dataSongInfo);
-			dBase->SetUpdateOK(id);
+	queueWrite.Close();
+	threadWriter.Join();
+
+	queueGainRead = nullptr;
+	queueGainWrite = nullptr;
+}
+
+void Progress::ThreadGainAnalyzer()
+{
+	GainJob job;
+	while (queueGainRead->Pop(job))
+	{
+		if (isStopThread) // Just drain the queue
+			continue;
+
+		const DBase::ReplayGainTrack& track = job.album->tracks[job.track];
+
+		double start = 0.0;
+		double length = 0.0;
+		if (track.cue)
+		{
+			start = CueFile::GetOffset(track.cue);
+			if (CueFile::IsLenght(track.cue))
+				length = CueFile::GetLenght(track.cue);
 		}
+
+		std::unique_ptr<ReplayGain> meter(new ReplayGain());
+		if (meter->AnalyzeFile(track.file, start, length, isStopThread))
+			job.album->meters[job.track] = std::move(meter);
+
+		queueGainWrite->Push(std::move(job));
 	}
-	else // File isn't added, need to add
+}
+
+void Progress::ThreadGainWriter()
+{
+	GainJob job;
+	while (queueGainWrite->Pop(job))
 	{
-		UpdateProgressText(file);
+		if (isStopThread) // Just drain the queue, albums that are not complete are analyzed next time
+			continue;
 
-		DBase::DATABASE_SONGINFO dataSongInfo;
-		FillSongStruct(noDrive, path, file, fileHash, fileSize, fileTime, &dataSongInfo);
+		GainAlbum* album = job.album;
 
-		long long idTags = 0;
+		UpdateProgressText(PathEx::FileFromPath(album->tracks[job.track].file));
+
+		if (++album->countDone == album->tracks.size())
+			WriteReplayGain(*album);
 
-		if (isFindMoved && !isLibraryEmpty && dBase->CheckTags(idTags, &dataSongInfo)) // Check tags, maybe it's moved file
+		funcUpdateProgressPos(++progressPos, numberFiles);
+	}
+}
+
+void Progress::WriteReplayGain(GainAlbum& album)
+{
+	std::vector<const ReplayGain*> meters;
+	float albumPeak = 0.0f;
+	for (const auto& meter : album.meters)
+	{
+		if (meter)
 		{
-			dBase->UpdateTagsFileMove(idTags, &dataSongInfo);
-			dBase->SetUpdateOK(idTags);
+			meters.push_back(meter.get());
+			albumPeak = std::max(albumPeak, meter->GetPeak());
 		}
-		else // Add new file
-			dBase->AddFileToLibrary(&dataSongInfo);
 	}
+
+	float albumGain = 0.0f;
+	if (!meters.empty())
+		albumGain = ReplayGain::GetGain(ReplayGain::GetLoudness(meters));
+
+	dBase->Begin();
+	for (std::size_t i = 0, size = album.tracks.size(); i < size; ++i)
+	{
+		// Tracks that cannot be decoded are stored too (with zero peak) so they are not analyzed every time
+		ReplayGain::Values values;
+		values.fileSize = album.tracks[i].size;
+		values.fileTime = album.tracks[i].modified;
+
+		if (album.meters[i])
+		{
+			values.trackGain = ReplayGain::GetGain(album.meters[i]->GetLoudness());
+			values.trackPeak = album.meters[i]->GetPeak();
+			values.albumGain = albumGain;
+			values.albumPeak = albumPeak;
+		}
+
+		dBase->SetReplayGain(album.tracks[i].id, ReplayGain::ToString(values));
+	}
+	dBase->Commit();
+
+	// Measured blocks are not needed anymore
+	album.meters.clear();
+	album.meters.shrink_to_fit();
 }
 
 void Progress::AddToPlaylist(bool isTempPlaylist, const std::wstring& path, const std::wstring& file, long long fileSize, long long fileTime, bool fast)
@@ -913,10 +1176,10 @@ void Progress::RunThread()
 
 void Progress::ThreadLibrary()
 {
-	// Calculate the number of files
+	// Calculate the number of files and remember them
 	for (std::size_t i = 0, size = libraryFolders.size(); i < size; ++i)
 	{
-		CalculateFolder(libraryFolders[i]);
+		CalculateFolder(libraryFolders[i], true);
 		if (isStopThread) break;
 	}
 
@@ -939,27 +1202,39 @@ void Progress::ThreadLibrary()
 	funcUpdateProgressMarquee(false);
 	funcUpdateProgressRange(0, numberFiles);
 
-	//LARGE_INTEGER freq; QueryPerformanceFrequency(&freq);
-	//LARGE_INTEGER counter1; QueryPerformanceCounter(&counter1);
+#if defined(_DEBUG) && defined(WINYL_ENABLE_DEBUG_LOGGING)
+	LARGE_INTEGER freq; QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER counter1; QueryPerformanceCounter(&counter1);
+	long long cacheHits = dBase->dbLibrary.GetCacheHits();
+	long long cacheMisses = dBase->dbLibrary.GetCacheMisses();
+#endif
 
-	for (std::size_t i = 0, size = cueFiles.size(); i < size; ++i)
+	for (const ManifestFile& manifestFile : manifestFiles)
 	{
-		AddCueToLibrary(isLibraryEmpty, cueFiles[i].path, cueFiles[i].file, cueFiles[i].fileSize, cueFiles[i].fileTime);
+		if (!manifestFile.isCue)
+			continue;
+
+		AddCueToLibrary(isLibraryEmpty, manifestFolders[manifestFile.folder],
+			manifestFile.file, manifestFile.fileSize, manifestFile.fileTime);
 		if (isStopThread) break;
 
 		funcUpdateProgressPos(++progressPos, numberFiles);
 	}
 
-	for (std::size_t i = 0, size = libraryFolders.size(); i < size; ++i)
-	{
-		AddFolderToLibrary(libraryFolders[i], isLibraryEmpty);
-		if (isStopThread) break;
-	}
+	if (!isStopThread)
+		AddFoldersToLibrary(isLibraryEmpty);
+
+	// Free the manifest, it can be big for large libraries
+	std::vector<ManifestFile>().swap(manifestFiles);
+	std::vector<std::wstring>().swap(manifestFolders);
 
-	//LARGE_INTEGER counter2; QueryPerformanceCounter(&counter2);
-	//double perfDiffMs = (counter2.QuadPart - counter1.QuadPart) *1000.0 / freq.QuadPart;
-	//int i = 0;
-	//::MessageBoxW(NULL, std::to_wstring(perfDiffMs).c_str(), L"", 0);
+#if defined(_DEBUG) && defined(WINYL_ENABLE_DEBUG_LOGGING)
+	LARGE_INTEGER counter2; QueryPerformanceCounter(&counter2);
+	double perfDiffMs = (counter2.QuadPart - counter1.QuadPart) * 1000.0 / freq.QuadPart;
+	DEBUG_LOGF("Library scan: %d files in %.0f ms (%.1f files/s), statement cache hits=%lld misses=%lld",
+		progressPos, perfDiffMs, perfDiffMs > 0 ? progressPos * 1000.0 / perfDiffMs : 0.0,
+		dBase->dbLibrary.GetCacheHits() - cacheHits, dBase->dbLibrary.GetCacheMisses() - cacheMisses);
+#endif
 
 	if (isAddAllToLibrary)
 	{
@@ -987,6 +1262,10 @@ void Progress::ThreadLibrary()
 	dBase->Commit();
 	dBase->CueCommit();
 	dBase->MemFlagDetach();
+
+	if (isReplayGain && !isStopThread)
+		AnalyzeReplayGain();
+
 	// VACUUM causes UI thread to hang when access to db, need to do someting with this
 	//dBase->Vacuum(); // Don't use VACUUM it's very slow and lock the database
 }
@@ -999,9 +1278,9 @@ void Progress::ThreadPlaylist()
 		if (!CalculateFile(libraryFolders[i]))
 		{
 			if (libraryFolders[i].size() > 3) // Path
-				CalculateFolder(libraryFolders[i] + L"\\");
+				CalculateFolder(libraryFolders[i] + L"\\", false);
 			else // Disk
-				CalculateFolder(libraryFolders[i]);
+				CalculateFolder(libraryFolders[i], false);
 		}
 		if (isStopThread) break;
 	}
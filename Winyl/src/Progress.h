@@ -28,6 +28,7 @@
 #include "FileSystem.h"
 #include "TagLibReader.h"
 #include "CueFile.h"
+#include "ReplayGain.h"
 
 class Progress
 {
@@ -62,6 +63,7 @@ public:
 	inline void SetAddAllToLibrary(bool enable) {isAddAllToLibrary = enable;}
 	inline void SetFindMoved(bool enable) {isFindMoved = enable;}
 	inline void SetRescanAll(bool enable) {isRescanAll = enable;}
+	inline void SetReplayGain(bool enable) {isReplayGain = enable;}
 
 	bool FastAddFileToPlaylist(const std::wstring& musicfile, int start, bool& isFolder);
 
@@ -84,6 +86,7 @@ private:
 
 	bool isFindMoved = false;
 	bool isRescanAll = false;
+	bool isReplayGain = false;
 
 	std::vector<std::wstring> libraryFolders;
 
@@ -116,6 +119,20 @@ private:
 
 	std::deque<FileStruct> cueFiles;
 
+	// Files found when counting library files, the library is updated from this list
+	// so folders are walked only once (it matters a lot for network drives)
+	struct ManifestFile
+	{
+		std::wstring file;
+		long long fileSize;
+		long long fileTime;
+		unsigned int folder; // Index in manifestFolders
+		bool isCue;
+	};
+
+	std::vector<std::wstring> manifestFolders;
+	std::vector<ManifestFile> manifestFiles;
+
 	int numberFiles = 0;
 	int numberStart = 0;
 	int numberOffset = 0;
@@ -126,14 +143,49 @@ private:
 	void RunThread();
 
 	bool CalculateFile(const std::wstring& folder);
-	void CalculateFolder(const std::wstring& folder);
+	// isManifest: fill the manifest instead of cueFiles (for the library)
+	void CalculateFolder(const std::wstring& folder, bool isManifest);
 
 	void AddFolderToPlaylist(const std::wstring& folder, bool isTempPlaylist);
-	void AddFolderToLibrary(const std::wstring& folder, bool isLibraryEmpty);
 	bool AddFileToPlaylist(const std::wstring& file, bool isTempPlaylist);
 	void AddURLToPlaylist(const std::wstring& url, const std::wstring& title, bool isTempPlaylist);
 
-	void AddToLibrary(bool isLibraryEmpty, const std::wstring& path, const std::wstring& file, long long fileSize, long long fileTime);
+	// Library scanner pipeline: this thread enumerates files, checks them against the library and updates the database,
+	// the pool of tag readers only fills the song info. So dbLibrary is used by one thread only and the checks
+	// see the tracks added earlier in the same transaction (cue tracks). The number of jobs given to the readers
+	// is limited by the queue size, so the readers never block on the full write queue while this thread waits for them.
+	struct LibraryJob
+	{
+		enum class Action
+		{
+			Skip,      // The file is part of cue, only count it
+			Unchanged, // The file is already in the library and isn't changed
+			Update,    // The file is already in the library but tags are changed
+			Add        // The file isn't in the library
+		};
+
+		Action action = Action::Skip;
+		long long id = 0;
+		bool noDrive = false;
+		int fileHash = 0;
+		std::wstring path;
+		std::wstring file;
+		long long fileSize = 0;
+		long long fileTime = 0;
+		DBase::DATABASE_SONGINFO dataSongInfo;
+	};
+
+	static const std::size_t libraryQueueSize = 256;
+	static const int libraryReadersMax = 8;
+
+	Threading::BoundedQueue<LibraryJob>* queueLibraryRead = nullptr;
+	Threading::BoundedQueue<LibraryJob>* queueLibraryWrite = nullptr;
+
+	void AddFoldersToLibrary(bool isLibraryEmpty);
+	bool AddToLibrary(bool isLibraryEmpty, const std::wstring& path, const std::wstring& file, long long fileSize, long long fileTime);
+	void ThreadLibraryReader();
+	std::size_t WriteReadJobs(bool isLibraryEmpty, bool isWait);
+	void WriteToLibrary(bool isLibraryEmpty, LibraryJob& job);
 	void AddToPlaylist(bool isTempPlaylist, const std::wstring& path, const std::wstring& file, long long fileSize, long long fileTime, bool fast = false);
 
 	void AddCueToLibrary(bool isLibraryEmpty, const std::wstring& path, const std::wstring& file, long long cueSize, long long cueTime);
@@ -146,6 +198,30 @@ private:
 	void FillSongStruct(bool noDrive, const std::wstring& path, const std::wstring& file, int fileHash, long long fileSize, long long fileTime,
 		DBase::DATABASE_SONGINFO* dataSongInfo, std::unique_ptr<TagLibReader> *tag = nullptr, CueFile *cue = nullptr, std::size_t i = 0);
 
+	// ReplayGain analysis after the library is updated: this thread queues tracks of albums with new or changed tracks,
+	// the pool of analyzers decodes and measures the tracks and the single writer thread calculates album gain
+	// when all tracks of an album are measured and updates the database.
+	struct GainAlbum
+	{
+		std::vector<DBase::ReplayGainTrack> tracks;
+		std::vector<std::unique_ptr<ReplayGain>> meters; // nullptr if the track cannot be decoded
+		std::size_t countDone = 0; // Only for the writer
+	};
+
+	struct GainJob
+	{
+		GainAlbum* album = nullptr;
+		std::size_t track = 0;
+	};
+
+	Threading::BoundedQueue<GainJob>* queueGainRead = nullptr;
+	Threading::BoundedQueue<GainJob>* queueGainWrite = nullptr;
+
+	void AnalyzeReplayGain();
+	void ThreadGainAnalyzer();
+	void ThreadGainWriter();
+	void WriteReplayGain(GainAlbum& album);
+
 	void CheckLibraryFiles();
 	void CheckCueLibraryFiles();
 
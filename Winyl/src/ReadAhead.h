@@ -0,0 +1,117 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include "RingBuffer.h"
+
+// ReadAhead
+// Read-ahead of a decoded stream for WASAPI/ASIO (see LibAudio::RunThreadBuffer and StreamProcBuffer).
+// The reading thread fills the ring from the decoder with Fill, the output thread takes the data with Read
+// without locks and wakes up the reading thread only when the ring goes below the low watermark.
+// The decoder is a functor: std::size_t decode(float* data, std::size_t count) returns the number of read items
+// (whole frames, like BASS_ChannelGetData), 0 if it does not have data right now (network file) or DecodeEnd.
+// No Win32 and no BASS here, the same code is tested with a fake decoder (see Tests/TestRingBuffer.cpp).
+class ReadAhead final
+{
+public:
+	static const std::size_t DecodeEnd = (std::size_t)-1;
+
+	enum class Result
+	{
+		Full,   // The ring is full
+		NoData, // The decoder does not have data right now, try again later
+		End     // The decoder is at the end, the caller frees it and calls SetEnd
+	};
+
+	ReadAhead(std::size_t minCapacity, std::size_t frameSize) :
+		ring(minCapacity, frameSize), lowWatermark(ring.Capacity() / 2) {}
+	ReadAhead(const ReadAhead&) = delete;
+	ReadAhead& operator=(const ReadAhead&) = delete;
+
+	inline std::size_t Capacity() const {return ring.Capacity();}
+	inline std::size_t Size() const {return ring.Size();}
+	inline int GetFillPercent() const {return (int)(ring.Size() * 100 / ring.Capacity());}
+	inline bool IsEnd() const {return isEnd;}
+
+	// Reading thread: read from the decoder to the free space of the ring until it is full
+	template<class Decode>
+	Result Fill(Decode decode)
+	{
+		// Before reading so the output thread can wake up the reading thread again while it reads
+		isWakeUp = false;
+
+		for (;;)
+		{
+			// Read directly to the free space of the ring (it's in two parts when the ring wraps,
+			// a frame that crosses the wrap point goes through the bounce buffer of the ring)
+			std::size_t count = 0;
+			float* data = ring.WriteBegin(count);
+			if (count == 0)
+				return Result::Full;
+
+			std::size_t c = decode(data, count);
+			if (c == DecodeEnd)
+				return Result::End;
+			else if (c == 0)
+				return Result::NoData;
+
+			ring.WriteEnd(c);
+		}
+	}
+
+	// The thread that opens the stream: read the first portion before the reading thread knows about the stream,
+	// so the output gets data faster. The end of the stream is left to Fill.
+	template<class Decode>
+	void FillFirst(Decode decode)
+	{
+		std::size_t count = 0;
+		float* data = ring.WriteBegin(count);
+		std::size_t c = decode(data, count);
+		if (c != DecodeEnd && c != 0)
+			ring.WriteEnd(c);
+	}
+
+	// Reading thread: all data of the stream is in the ring, the caller has already prepared the next stream
+	// (the output ends as soon as the ring is empty)
+	void SetEnd() {isEnd = true;}
+
+	// Output thread: copy up to count items, return the number of copied items.
+	// outEnd is true when the stream is read to the end, outWakeUp is true when the caller must wake up
+	// the reading thread (only once until the next Fill).
+	std::size_t Read(float* data, std::size_t count, bool& outEnd, bool& outWakeUp)
+	{
+		// Check the end before reading, all data is already in the ring then
+		bool end = isEnd;
+
+		std::size_t c = ring.Read(data, count);
+		std::size_t size = ring.Size();
+
+		outEnd = (end && size == 0);
+		outWakeUp = (!outEnd && size < lowWatermark && !isWakeUp.exchange(true));
+
+		return c;
+	}
+
+private:
+	Threading::RingBuffer<float> ring;
+	const std::size_t lowWatermark = 0; // Wake up the reading thread when the ring has less data
+	std::atomic<bool> isWakeUp = false; // The reading thread is already woken up
+	std::atomic<bool> isEnd = false; // The stream is read to the end
+};
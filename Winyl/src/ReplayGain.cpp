@@ -0,0 +1,449 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "ReplayGain.h"
+#ifndef TESTS // The tests use only the meter and are not linked with BASS
+#include "bass/bass.h"
+#endif
+#include <cmath>
+#include <algorithm>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define REPLAYGAIN_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const double referenceLoudness = -18.0; // ReplayGain 2.0
+	const double pi = 3.14159265358979323846;
+}
+
+ReplayGain::ReplayGain()
+{
+
+}
+
+ReplayGain::~ReplayGain()
+{
+
+}
+
+std::string ReplayGain::ToString(const Values& values)
+{
+	char text[128];
+	sprintf_s(text, "%.2f %.6f %.2f %.6f %lld %lld", values.trackGain, values.trackPeak,
+		values.albumGain, values.albumPeak, values.fileSize, values.fileTime);
+	return text;
+}
+
+bool ReplayGain::FromString(const std::string& text, Values& outValues)
+{
+	if (sscanf_s(text.c_str(), "%f %f %f %f %lld %lld", &outValues.trackGain, &outValues.trackPeak,
+		&outValues.albumGain, &outValues.albumPeak, &outValues.fileSize, &outValues.fileTime) == 6)
+		return true;
+
+	outValues = Values();
+	return false;
+}
+
+#ifndef TESTS
+bool ReplayGain::AnalyzeFile(const std::wstring& file, double start, double length, const std::atomic<bool>& isStop)
+{
+	HSTREAM stream = BASS_StreamCreateFile(FALSE, file.c_str(), 0, 0, BASS_UNICODE|BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT);
+	if (stream == NULL)
+		return false;
+
+	BASS_CHANNELINFO ci;
+	if (!BASS_ChannelGetInfo(stream, &ci) || ci.chans == 0 || ci.chans > maxChannels)
+	{
+		BASS_StreamFree(stream);
+		return false;
+	}
+
+	if (start > 0.0)
+		BASS_ChannelSetPosition(stream, BASS_ChannelSeconds2Bytes(stream, start), BASS_POS_BYTE);
+
+	QWORD bytesLeft = (QWORD)-1;
+	if (length > 0.0)
+		bytesLeft = BASS_ChannelSeconds2Bytes(stream, length);
+
+	Start((int)ci.freq, (int)ci.chans);
+
+	std::vector<float> buffer((ci.freq / 10) * ci.chans);
+
+	bool result = true;
+	while (bytesLeft > 0)
+	{
+		if (isStop)
+		{
+			result = false;
+			break;
+		}
+
+		DWORD bytes = (DWORD)std::min((QWORD)(buffer.size() * sizeof(float)), bytesLeft);
+		DWORD read = BASS_ChannelGetData(stream, buffer.data(), bytes);
+		if (read == (DWORD)-1 || read == 0) // The end
+			break;
+
+		Process(buffer.data(), read / (sizeof(float) * ci.chans));
+		bytesLeft -= read;
+	}
+
+	BASS_StreamFree(stream);
+
+	return result;
+}
+#endif
+
+void ReplayGain::Start(int rate, int chans)
+{
+	sampleRate = rate;
+	channels = std::min(chans, (int)maxChannels);
+
+	// K-weighting filters for any sample rate (the same as in ITU-R BS.1770 for 48 kHz)
+	double f0 = 1681.974450955533;
+	double G = 3.999843853973347;
+	double Q = 0.7071752369554196;
+	double K = std::tan(pi * f0 / sampleRate);
+	double Vh = std::pow(10.0, G / 20.0);
+	double Vb = std::pow(Vh, 0.4996667741545416);
+	double a0 = 1.0 + K / Q + K * K;
+
+	b1[0] = (Vh + Vb * K / Q + K * K) / a0;
+	b1[1] = 2.0 * (K * K - Vh) / a0;
+	b1[2] = (Vh - Vb * K / Q + K * K) / a0;
+	a1[0] = 1.0;
+	a1[1] = 2.0 * (K * K - 1.0) / a0;
+	a1[2] = (1.0 - K / Q + K * K) / a0;
+
+	f0 = 38.13547087602444;
+	Q = 0.5003270373238773;
+	K = std::tan(pi * f0 / sampleRate);
+	a0 = 1.0 + K / Q + K * K;
+
+	b2[0] = 1.0;
+	b2[1] = -2.0;
+	b2[2] = 1.0;
+	a2[0] = 1.0;
+	a2[1] = 2.0 * (K * K - 1.0) / a0;
+	a2[2] = (1.0 - K / Q + K * K) / a0;
+
+	// Surround channels are louder, LFE is not counted (WAVEFORMATEXTENSIBLE order)
+	for (int i = 0; i < maxChannels; ++i)
+		weights[i] = 1.0;
+	if (channels == 1) // Mono is played by both speakers, count it as dual mono or it reads 3 dB lower than the same stereo
+		weights[0] = 2.0;
+	else if (channels == 5)
+		weights[3] = weights[4] = 1.41;
+	else if (channels == 6)
+	{
+		weights[3] = 0.0;
+		weights[4] = weights[5] = 1.41;
+	}
+
+	for (int i = 0; i < maxChannels; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+			z[i][j] = 0.0;
+		subBlockSum[i] = 0.0;
+	}
+
+	subBlockFrames = std::max(1, sampleRate / 10);
+	subBlockPos = 0;
+	subBlockCount = 0;
+	blocks.clear();
+
+	// Windowed sinc for 4x oversampling, each phase is normalized to unity gain
+	isOversample = sampleRate < 88200;
+	if (isOversample)
+	{
+		const int taps = firTaps * 4;
+		double h[taps];
+		for (int n = 0; n < taps; ++n)
+		{
+			double t = (n - (taps - 1) / 2.0) / 4.0;
+			double sinc = (t == 0.0) ? 1.0 : std::sin(pi * t) / (pi * t);
+			double window = 0.42 - 0.5 * std::cos(2.0 * pi * n / (taps - 1)) + 0.08 * std::cos(4.0 * pi * n / (taps - 1));
+			h[n] = sinc * window;
+		}
+		for (int k = 0; k < 4; ++k)
+		{
+			double sum = 0.0;
+			for (int j = 0; j < firTaps; ++j)
+				sum += h[k + j * 4];
+			for (int j = 0; j < firTaps; ++j)
+				fir[j][k] = (float)(h[k + j * 4] / sum);
+		}
+	}
+
+	for (int i = 0; i < maxChannels; ++i)
+	{
+		for (int j = 0; j < firTaps * 2; ++j)
+			history[i][j] = 0.0f;
+	}
+	historyPos = 0;
+	peak = 0.0f;
+}
+
+void ReplayGain::Process(const float* samples, std::size_t frames)
+{
+	while (frames > 0)
+	{
+		std::size_t count = std::min(frames, subBlockFrames - subBlockPos);
+
+		FilterChannels(samples, count);
+		FindPeak(samples, count);
+
+		subBlockPos += count;
+		if (subBlockPos == subBlockFrames)
+			AddSubBlock();
+
+		samples += count * channels;
+		frames -= count;
+	}
+}
+
+void ReplayGain::AddSubBlock()
+{
+	double energy = 0.0;
+	for (int ch = 0; ch < channels; ++ch)
+	{
+		energy += weights[ch] * subBlockSum[ch];
+		subBlockSum[ch] = 0.0;
+	}
+
+	subBlocks[subBlockCount % 4] = energy / subBlockFrames;
+	++subBlockCount;
+	subBlockPos = 0;
+
+	// 400 ms blocks with 75% overlap
+	if (subBlockCount >= 4)
+		blocks.push_back((subBlocks[0] + subBlocks[1] + subBlocks[2] + subBlocks[3]) / 4.0);
+}
+
+#ifdef REPLAYGAIN_SSE2
+void ReplayGain::FilterChannels(const float* samples, std::size_t frames)
+{
+	// Two channels in one vector, the last vector has one channel if the number of channels is odd
+
+	const __m128d vb10 = _mm_set1_pd(b1[0]), vb11 = _mm_set1_pd(b1[1]), vb12 = _mm_set1_pd(b1[2]);
+	const __m128d va11 = _mm_set1_pd(a1[1]), va12 = _mm_set1_pd(a1[2]);
+	const __m128d vb20 = _mm_set1_pd(b2[0]), vb21 = _mm_set1_pd(b2[1]), vb22 = _mm_set1_pd(b2[2]);
+	const __m128d va21 = _mm_set1_pd(a2[1]), va22 = _mm_set1_pd(a2[2]);
+
+	for (int ch = 0; ch < channels; ch += 2)
+	{
+		bool isPair = ch + 1 < channels;
+
+		__m128d s11 = _mm_set_pd(z[ch + 1][0], z[ch][0]);
+		__m128d s12 = _mm_set_pd(z[ch + 1][1], z[ch][1]);
+		__m128d s21 = _mm_set_pd(z[ch + 1][2], z[ch][2]);
+		__m128d s22 = _mm_set_pd(z[ch + 1][3], z[ch][3]);
+		__m128d sum = _mm_setzero_pd();
+
+		const float* p = samples + ch;
+		for (std::size_t i = 0; i < frames; ++i, p += channels)
+		{
+			__m128d x;
+			if (isPair)
+				x = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)p));
+			else
+				x = _mm_set_sd(*p);
+
+			__m128d y = _mm_add_pd(_mm_mul_pd(vb10, x), s11);
+			s11 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(vb11, x), _mm_mul_pd(va11, y)), s12);
+			s12 = _mm_sub_pd(_mm_mul_pd(vb12, x), _mm_mul_pd(va12, y));
+			x = y;
+
+			y = _mm_add_pd(_mm_mul_pd(vb20, x), s21);
+			s21 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(vb21, x), _mm_mul_pd(va21, y)), s22);
+			s22 = _mm_sub_pd(_mm_mul_pd(vb22, x), _mm_mul_pd(va22, y));
+
+			sum = _mm_add_pd(sum, _mm_mul_pd(y, y));
+		}
+
+		double state[2];
+		_mm_storeu_pd(state, s11); z[ch][0] = state[0]; z[ch + 1][0] = state[1];
+		_mm_storeu_pd(state, s12); z[ch][1] = state[0]; z[ch + 1][1] = state[1];
+		_mm_storeu_pd(state, s21); z[ch][2] = state[0]; z[ch + 1][2] = state[1];
+		_mm_storeu_pd(state, s22); z[ch][3] = state[0]; z[ch + 1][3] = state[1];
+
+		_mm_storeu_pd(state, sum);
+		subBlockSum[ch] += state[0];
+		if (isPair)
+			subBlockSum[ch + 1] += state[1];
+	}
+}
+
+void ReplayGain::FindPeak(const float* samples, std::size_t frames)
+{
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	int pos = historyPos;
+	for (int ch = 0; ch < channels; ++ch)
+	{
+		__m128 vmax = _mm_setzero_ps();
+		const float* p = samples + ch;
+
+		if (!isOversample)
+		{
+			for (std::size_t i = 0; i < frames; ++i, p += channels)
+				vmax = _mm_max_ss(vmax, _mm_andnot_ps(signMask, _mm_set_ss(*p)));
+		}
+		else
+		{
+			__m128 coefs[firTaps];
+			for (int j = 0; j < firTaps; ++j)
+				coefs[j] = _mm_loadu_ps(fir[j]);
+
+			float* h = history[ch];
+			pos = historyPos;
+
+			// All 4 phases of the interpolated sample are calculated at once
+			for (std::size_t i = 0; i < frames; ++i, p += channels)
+			{
+				pos = (pos == 0 ? firTaps : pos) - 1;
+				h[pos] = h[pos + firTaps] = *p;
+
+				__m128 y = _mm_setzero_ps();
+				for (int j = 0; j < firTaps; ++j)
+					y = _mm_add_ps(y, _mm_mul_ps(coefs[j], _mm_set1_ps(h[pos + j])));
+
+				vmax = _mm_max_ps(vmax, _mm_andnot_ps(signMask, y));
+				vmax = _mm_max_ps(vmax, _mm_andnot_ps(signMask, _mm_set1_ps(*p)));
+			}
+		}
+
+		float result[4];
+		_mm_storeu_ps(result, vmax);
+		peak = std::max(peak, std::max(std::max(result[0], result[1]), std::max(result[2], result[3])));
+	}
+	historyPos = pos;
+}
+#else
+void ReplayGain::FilterChannels(const float* samples, std::size_t frames)
+{
+	for (int ch = 0; ch < channels; ++ch)
+	{
+		double* s = z[ch];
+		double sum = 0.0;
+
+		const float* p = samples + ch;
+		for (std::size_t i = 0; i < frames; ++i, p += channels)
+		{
+			double x = *p;
+
+			double y = b1[0] * x + s[0];
+			s[0] = b1[1] * x - a1[1] * y + s[1];
+			s[1] = b1[2] * x - a1[2] * y;
+			x = y;
+
+			y = b2[0] * x + s[2];
+			s[2] = b2[1] * x - a2[1] * y + s[3];
+			s[3] = b2[2] * x - a2[2] * y;
+
+			sum += y * y;
+		}
+
+		subBlockSum[ch] += sum;
+	}
+}
+
+void ReplayGain::FindPeak(const float* samples, std::size_t frames)
+{
+	int pos = historyPos;
+	for (int ch = 0; ch < channels; ++ch)
+	{
+		float* h = history[ch];
+		pos = historyPos;
+
+		const float* p = samples + ch;
+		for (std::size_t i = 0; i < frames; ++i, p += channels)
+		{
+			peak = std::max(peak, std::fabs(*p));
+
+			if (!isOversample)
+				continue;
+
+			pos = (pos == 0 ? firTaps : pos) - 1;
+			h[pos] = h[pos + firTaps] = *p;
+
+			for (int k = 0; k < 4; ++k)
+			{
+				float y = 0.0f;
+				for (int j = 0; j < firTaps; ++j)
+					y += fir[j][k] * h[pos + j];
+				peak = std::max(peak, std::fabs(y));
+			}
+		}
+	}
+	historyPos = pos;
+}
+#endif
+
+double ReplayGain::GetLoudness(const std::vector<const ReplayGain*>& meters)
+{
+	// Gating from ITU-R BS.1770-4: absolute gate at -70 LUFS, relative gate at -10 LU
+
+	const double absoluteGate = std::pow(10.0, (-70.0 + 0.691) / 10.0);
+
+	double sum = 0.0;
+	std::size_t count = 0;
+	for (const ReplayGain* meter : meters)
+	{
+		for (double energy : meter->blocks)
+		{
+			if (energy > absoluteGate)
+			{
+				sum += energy;
+				++count;
+			}
+		}
+	}
+
+	if (count == 0)
+		return -70.0;
+
+	const double relativeGate = (sum / count) * 0.1;
+
+	sum = 0.0;
+	count = 0;
+	for (const ReplayGain* meter : meters)
+	{
+		for (double energy : meter->blocks)
+		{
+			if (energy > absoluteGate && energy > relativeGate)
+			{
+				sum += energy;
+				++count;
+			}
+		}
+	}
+
+	if (count == 0)
+		return -70.0;
+
+	return -0.691 + 10.0 * std::log10(sum / count);
+}
+
+float ReplayGain::GetGain(double loudness)
+{
+	return (float)std::max(-24.0, std::min(24.0, referenceLoudness - loudness));
+}
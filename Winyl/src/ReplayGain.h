@@ -0,0 +1,100 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Loudness meter for ReplayGain 2.0 (EBU R128 / ITU-R BS.1770).
+// K-weighting filters work on pairs of channels in double precision with SSE2,
+// gated 400 ms blocks are kept so the album loudness can be calculated from the tracks of the album.
+// The true peak is found with 4x oversampling (for sample rates below 88.2 kHz).
+// Mono is measured as dual mono, so a mono file gets the same gain as the same stereo file.
+// One meter is used from one thread, Progress runs several meters at once.
+
+class ReplayGain
+{
+
+public:
+	ReplayGain();
+	virtual ~ReplayGain();
+	ReplayGain(const ReplayGain&) = delete;
+	ReplayGain& operator=(const ReplayGain&) = delete;
+
+	// Values stored in the replaygain column of the library
+	struct Values
+	{
+		float trackGain = 0.0f; // dB
+		float trackPeak = 0.0f; // Linear, 0 if the track is not analyzed (decoding error or silence)
+		float albumGain = 0.0f;
+		float albumPeak = 0.0f;
+		long long fileSize = 0; // Size and modified time of the file when it was analyzed
+		long long fileTime = 0;
+	};
+
+	static std::string ToString(const Values& values);
+	static bool FromString(const std::string& text, Values& outValues);
+
+	// Decode and analyze a file, start and length in seconds for a track from cue (length = 0 to the end)
+	bool AnalyzeFile(const std::wstring& file, double start, double length, const std::atomic<bool>& isStop);
+
+	void Start(int sampleRate, int channels);
+	void Process(const float* samples, std::size_t frames);
+
+	double GetLoudness() {return GetLoudness(std::vector<const ReplayGain*>{this});} // LUFS
+	inline float GetPeak() {return peak;}
+
+	static double GetLoudness(const std::vector<const ReplayGain*>& meters); // Album loudness
+	static float GetGain(double loudness); // dB to the reference loudness
+
+private:
+	static const int maxChannels = 8;
+	static const int firTaps = 12; // Taps for each of 4 phases of the oversampling filter
+
+	int sampleRate = 44100;
+	int channels = 2;
+
+	// K-weighting, stage 1 is high shelf, stage 2 is high pass
+	double b1[3] = {};
+	double a1[3] = {};
+	double b2[3] = {};
+	double a2[3] = {};
+	double z[maxChannels][4] = {}; // Filter state for each channel
+
+	double weights[maxChannels] = {};
+
+	std::size_t subBlockFrames = 0; // 100 ms
+	std::size_t subBlockPos = 0;
+	double subBlockSum[maxChannels] = {};
+	double subBlocks[4] = {}; // The last 4 sub-blocks make 400 ms block
+	std::size_t subBlockCount = 0;
+
+	std::vector<double> blocks; // Mean square of each 400 ms block (75% overlap)
+
+	bool isOversample = false;
+	float fir[firTaps][4] = {};
+	float history[maxChannels][firTaps * 2] = {};
+	int historyPos = 0;
+	float peak = 0.0f;
+
+	void FilterChannels(const float* samples, std::size_t frames);
+	void FindPeak(const float* samples, std::size_t frames);
+	void AddSubBlock();
+};
@@ -0,0 +1,139 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cassert>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+// Only the standard library here, so the read-ahead can be tested without Win32 (see ReadAhead.h)
+
+namespace Threading
+{
+
+// RingBuffer
+// Lock-free ring buffer for one producer thread and one consumer thread.
+// Positions only grow (the index is position & mask) so the buffer is empty when positions are equal
+// and full when they differ by the capacity. The producer writes directly into the buffer.
+// The producer always writes whole frames of frameSize items (audio samples of all channels),
+// the capacity is power of 2 so with 3, 5, 6, 7 channels a frame can cross the wrap point,
+// such frames are written through a small bounce buffer.
+template<class T>
+class RingBuffer final
+{
+public:
+	explicit RingBuffer(std::size_t minCapacity, std::size_t frameSize = 1)
+	{
+		assert(frameSize > 0 && frameSize <= minCapacity);
+		capacity = 1;
+		while (capacity < minCapacity)
+			capacity <<= 1;
+		mask = capacity - 1;
+		items.reset(new T[capacity]);
+
+		frame = frameSize;
+		if (capacity % frame != 0)
+		{
+			bounceSize = frame * 16;
+			bounce.reset(new T[bounceSize]);
+		}
+	}
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+
+	inline std::size_t Capacity() const {return capacity;}
+	// Approximate when called not from the producer or the consumer
+	inline std::size_t Size() const {return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);}
+
+	// Producer: get contiguous free space of whole frames (can be less than all free space when it wraps),
+	// outCount is 0 only when there is no free space for one frame
+	T* WriteBegin(std::size_t& outCount)
+	{
+		std::size_t write = writePos.load(std::memory_order_relaxed);
+		std::size_t read = readPos.load(std::memory_order_acquire);
+
+		std::size_t index = write & mask;
+		std::size_t free = capacity - (write - read);
+		outCount = std::min(free, capacity - index);
+		outCount -= outCount % frame;
+
+		isBounce = (outCount == 0 && free >= frame);
+		if (isBounce) // Less than one frame before the wrap point
+		{
+			outCount = std::min(free - free % frame, bounceSize);
+			return bounce.get();
+		}
+
+		return items.get() + index;
+	}
+	// Producer: publish count items written after WriteBegin
+	void WriteEnd(std::size_t count)
+	{
+		assert(count <= capacity - Size());
+		assert(count % frame == 0);
+
+		std::size_t write = writePos.load(std::memory_order_relaxed);
+
+		if (isBounce)
+		{
+			std::size_t index = write & mask;
+			std::size_t first = std::min(count, capacity - index);
+			std::copy(bounce.get(), bounce.get() + first, items.get() + index);
+			std::copy(bounce.get() + first, bounce.get() + count, items.get());
+			isBounce = false;
+		}
+
+		writePos.store(write + count, std::memory_order_release);
+	}
+
+	// Consumer: copy up to count items, return the number of copied items
+	std::size_t Read(T* data, std::size_t count)
+	{
+		std::size_t read = readPos.load(std::memory_order_relaxed);
+		std::size_t write = writePos.load(std::memory_order_acquire);
+
+		count = std::min(count, write - read);
+
+		std::size_t index = read & mask;
+		std::size_t first = std::min(count, capacity - index);
+		std::copy(items.get() + index, items.get() + index + first, data);
+		std::copy(items.get(), items.get() + (count - first), data + first);
+
+		readPos.store(read + count, std::memory_order_release);
+		return count;
+	}
+
+private:
+	std::unique_ptr<T[]> items;
+	std::size_t capacity = 0;
+	std::size_t mask = 0;
+
+	// Only for the producer
+	std::size_t frame = 1;
+	std::unique_ptr<T[]> bounce;
+	std::size_t bounceSize = 0;
+	bool isBounce = false;
+
+	// Separate cache lines so the producer and the consumer do not slow down each other
+	alignas(64) std::atomic<std::size_t> writePos = 0;
+	alignas(64) std::atomic<std::size_t> readPos = 0;
+};
+
+} // namespace Threading
@@ -194,6 +194,39 @@ bool Settings::LoadSettings()
 			if (xmlLibraryAddAll)
 				xmlLibraryAddAll.Attribute("ID", &isAddAllToLibrary);
 
+			XmlNode xmlLibraryWAL = xmlMain.FirstChild("LibraryWAL");
+			if (xmlLibraryWAL)
+			{
+				xmlLibraryWAL.Attribute("ID", &isLibraryWAL);
+				xmlLibraryWAL.Attribute("Checkpoint", &libraryWALCheckpoint);
+			}
+
+			XmlNode xmlCoverMemory = xmlMain.FirstChild("CoverMemory");
+			if (xmlCoverMemory)
+				xmlCoverMemory.Attribute("Size", &coverMemory);
+
+			XmlNode xmlPlayMemory = xmlMain.FirstChild("PlayMemory");
+			if (xmlPlayMemory)
+			{
+				xmlPlayMemory.Attribute("ID", &isPlayMemory);
+				xmlPlayMemory.Attribute("Budget", &playMemoryBudget);
+			}
+
+			XmlNode xmlReplayGain = xmlMain.FirstChild("ReplayGain");
+			if (xmlReplayGain)
+			{
+				xmlReplayGain.Attribute("Mode", &replayGainMode);
+				xmlReplayGain.Attribute("Scan", &isReplayGainScan);
+			}
+
+			XmlNode xmlCrossfade = xmlMain.FirstChild("Crossfade");
+			if (xmlCrossfade)
+			{
+				xmlCrossfade.Attribute("ID", &isCrossfade);
+				xmlCrossfade.Attribute("Time", &crossfadeTime);
+				xmlCrossfade.Attribute("Curve", &crossfadeCurve);
+			}
+
 			XmlNode xmlPlayFocus = xmlMain.FirstChild("PlayFocus");
 			if (xmlPlayFocus)
 				xmlPlayFocus.Attribute("ID", &isPlayFocus);
@@ -465,6 +498,39 @@ bool Settings::SaveSettings()
 		if (xmlLibraryAddAll)
 			xmlLibraryAddAll.AddAttribute("ID", (int)isAddAllToLibrary);
 
+		XmlNode xmlLibraryWAL = xmlMain.AddChild("LibraryWAL");
+		if (xmlLibraryWAL)
+		{
+			xmlLibraryWAL.AddAttribute("ID", (int)isLibraryWAL);
+			xmlLibraryWAL.AddAttribute("Checkpoint", libraryWALCheckpoint);
+		}
+
+		XmlNode xmlCoverMemory = xmlMain.AddChild("CoverMemory");
+		if (xmlCoverMemory)
+			xmlCoverMemory.AddAttribute("Size", coverMemory);
+
+		XmlNode xmlPlayMemory = xmlMain.AddChild("PlayMemory");
+		if (xmlPlayMemory)
+		{
+			xmlPlayMemory.AddAttribute("ID", (int)isPlayMemory);
+			xmlPlayMemory.AddAttribute("Budget", playMemoryBudget);
+		}
+
+		XmlNode xmlReplayGain = xmlMain.AddChild("ReplayGain");
+		if (xmlReplayGain)
+		{
+			xmlReplayGain.AddAttribute("Mode", replayGainMode);
+			xmlReplayGain.AddAttribute("Scan", (int)isReplayGainScan);
+		}
+
+		XmlNode xmlCrossfade = xmlMain.AddChild("Crossfade");
+		if (xmlCrossfade)
+		{
+			xmlCrossfade.AddAttribute("ID", (int)isCrossfade);
+			xmlCrossfade.AddAttribute("Time", crossfadeTime);
+			xmlCrossfade.AddAttribute("Curve", crossfadeCurve);
+		}
+
 		XmlNode xmlPlayFocus = xmlMain.AddChild("PlayFocus");
 		if (xmlPlayFocus)
 			xmlPlayFocus.AddAttribute("ID", (int)isPlayFocus);
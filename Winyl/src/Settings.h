@@ -190,6 +190,31 @@ public:
 	inline void SetAddAllToLibrary(bool isEnable) {isAddAllToLibrary = isEnable;}
 	inline bool IsAddAllToLibrary() {return isAddAllToLibrary;}
 
+	inline void SetLibraryWAL(bool isEnable) {isLibraryWAL = isEnable;}
+	inline bool IsLibraryWAL() {return isLibraryWAL;}
+	inline void SetLibraryWALCheckpoint(int pages) {libraryWALCheckpoint = pages;}
+	inline int GetLibraryWALCheckpoint() {return libraryWALCheckpoint;}
+
+	inline void SetCoverMemory(int megabytes) {coverMemory = megabytes;}
+	inline int GetCoverMemory() {return coverMemory;}
+
+	inline void SetPlayMemory(bool isEnable) {isPlayMemory = isEnable;}
+	inline bool IsPlayMemory() {return isPlayMemory;}
+	inline void SetPlayMemoryBudget(int megabytes) {playMemoryBudget = megabytes;}
+	inline int GetPlayMemoryBudget() {return playMemoryBudget;}
+
+	inline void SetReplayGainMode(int mode) {replayGainMode = mode;}
+	inline int GetReplayGainMode() {return replayGainMode;}
+	inline void SetReplayGainScan(bool isEnable) {isReplayGainScan = isEnable;}
+	inline bool IsReplayGainScan() {return isReplayGainScan;}
+
+	inline void SetCrossfade(bool isEnable) {isCrossfade = isEnable;}
+	inline bool IsCrossfade() {return isCrossfade;}
+	inline void SetCrossfadeTime(int seconds) {crossfadeTime = seconds;}
+	inline int GetCrossfadeTime() {return crossfadeTime;}
+	inline void SetCrossfadeCurve(int curve) {crossfadeCurve = curve;}
+	inline int GetCrossfadeCurve() {return crossfadeCurve;}
+
 	inline void SetLastPlayIndex(long long index) {lastPlayIndex = index;}
 	inline long long GetLastPlayIndex() {return lastPlayIndex;}
 
@@ -375,6 +400,21 @@ private:
 
 	bool isAddAllToLibrary = true;
 
+	bool isLibraryWAL = false; // Library database in WAL mode (browse the library while it is updating)
+	int libraryWALCheckpoint = 1000; // Auto checkpoint of the library in pages
+
+	int coverMemory = 64; // Memory for covers of the list in megabytes (see CoverMemory.h)
+
+	bool isPlayMemory = false; // Load playing and preloaded files to memory (playback doesn't depend on disk load)
+	int playMemoryBudget = 256; // Memory for loaded files in megabytes, bigger files are played from disk
+
+	int replayGainMode = 0; // 0 - Off, 1 - Track gain, 2 - Album gain
+	bool isReplayGainScan = false; // Analyze ReplayGain of new and changed tracks when the library is updated
+
+	bool isCrossfade = false; // Crossfade between tracks (WASAPI/ASIO only)
+	int crossfadeTime = 5; // In seconds
+	int crossfadeCurve = 0; // 0 - Equal power, 1 - Square root (equal power), 2 - Linear
+
 	long long lastPlayIndex = 0;
 
 	bool isRescanRemoveMissing = true;
@@ -0,0 +1,338 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "SkinCache.h"
+#include "ExImage.h"
+#include "FileSystem.h"
+#include "UTF.h"
+#include <algorithm>
+
+SkinCache::~SkinCache()
+{
+	Close();
+}
+
+std::wstring SkinCache::GetCacheFile(const std::wstring& path, const std::wstring& skinName, bool isSkinPack)
+{
+	return path + L"Skin-" + StringEx::Format(L"%016llX",
+		(unsigned long long)StringEx::HashFNV1a64(StringEx::ToLowerUS(skinName) + (isSkinPack ? L".wzp" : L""))) + L".cache";
+}
+
+void SkinCache::RemoveUnused(const std::wstring& path, const std::wstring& skinPath)
+{
+	// Cache files of all skins, the same way as DlgSkin finds skins
+	std::vector<std::wstring> skinFiles;
+
+	FileSystem::Find findSkin(skinPath);
+	while (findSkin.Next())
+	{
+		if (findSkin.IsDirectory())
+			skinFiles.push_back(GetCacheFile(path, findSkin.GetFileName(), false));
+		else if (PathEx::ExtFromFile(findSkin.GetFileName()) == L"wzp")
+			skinFiles.push_back(GetCacheFile(path, PathEx::NameFromFile(findSkin.GetFileName()), true));
+	}
+
+	FileSystem::Find findCache(path, L"Skin-*.cache");
+	while (findCache.Next())
+	{
+		if (findCache.IsDirectory())
+			continue;
+
+		std::wstring file = path + findCache.GetFileName();
+		if (std::find(skinFiles.begin(), skinFiles.end(), file) == skinFiles.end())
+			FileSystem::RemoveFile(file);
+	}
+}
+
+bool SkinCache::Open(const std::wstring& path, const std::wstring& skinName, const std::wstring& skinFile)
+{
+	static_assert(sizeof(Header) == 32, "Wrong size of SkinCache::Header");
+	static_assert(sizeof(Record) == 32, "Wrong size of SkinCache::Record");
+
+	Close();
+
+	isSkinPack = !skinFile.empty();
+
+	Header skinHeader = {};
+	skinHeader.magic = fileMagic;
+	skinHeader.skinHash = StringEx::HashFNV1a64(StringEx::ToLowerUS(skinName) + (isSkinPack ? L".wzp" : L""));
+	if (isSkinPack)
+	{
+		FileSystem::FindFile findFile(skinFile);
+		if (findFile.IsFound())
+		{
+			skinHeader.skinSize = findFile.GetFileSize();
+			skinHeader.skinTime = findFile.GetModified();
+		}
+	}
+
+	// The single cache file of the previous version for all skins
+	::DeleteFileW((path + L"Skin.cache").c_str());
+
+	std::wstring file = GetCacheFile(path, skinName, isSkinPack);
+
+	fileHandle.reset(::CreateFileW(file.c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!fileHandle)
+		return false;
+
+	LARGE_INTEGER size = {};
+	::GetFileSizeEx(fileHandle.get(), &size);
+	fileSize = size.QuadPart;
+
+	Header header = {};
+	if (fileSize >= (long long)sizeof(header))
+	{
+		DWORD bytesRead = 0;
+		::ReadFile(fileHandle.get(), &header, sizeof(header), &bytesRead, NULL);
+	}
+
+	// New file, old format, the skin pack is changed or too many records, start from scratch
+	if (header.magic != skinHeader.magic || header.skinHash != skinHeader.skinHash ||
+		header.skinSize != skinHeader.skinSize || header.skinTime != skinHeader.skinTime || fileSize > maxFileSize)
+	{
+		LARGE_INTEGER zero = {};
+		::SetFilePointerEx(fileHandle.get(), zero, NULL, FILE_BEGIN);
+		::SetEndOfFile(fileHandle.get());
+
+		fileSize = 0;
+		if (!WriteData(0, &skinHeader, sizeof(skinHeader)))
+		{
+			Close();
+			return false;
+		}
+		fileSize = sizeof(skinHeader);
+	}
+
+	if (fileSize > (long long)sizeof(Header))
+	{
+		mapHandle.reset(::CreateFileMappingW(fileHandle.get(), NULL, PAGE_READONLY, 0, 0, NULL));
+		if (mapHandle)
+		{
+			mapView.reset(::MapViewOfFile(mapHandle.get(), FILE_MAP_READ, 0, 0, 0));
+			if (mapView)
+				mapSize = fileSize;
+		}
+	}
+
+	ReadIndex();
+
+	return true;
+}
+
+void SkinCache::Close()
+{
+	mapView.reset();
+	mapHandle.reset();
+	fileHandle.reset();
+
+	mapSize = 0;
+	fileSize = 0;
+
+	index.clear();
+	bits.clear();
+	bits.shrink_to_fit();
+}
+
+void SkinCache::ReadIndex()
+{
+	if (!mapView)
+		return;
+
+	const char* data = static_cast<const char*>(mapView.get());
+
+	long long offset = sizeof(Header);
+	while (offset + (long long)sizeof(Record) <= mapSize)
+	{
+		Record record;
+		memcpy(&record, data + offset, sizeof(Record));
+
+		if (record.type == RecordType::Image)
+		{
+			if (record.width <= 0 || record.width > maxImageSize ||
+				record.height <= 0 || record.height > maxImageSize ||
+				record.size != (unsigned int)(record.width * record.height * 4))
+				break;
+		}
+		else if (record.type == RecordType::Xml)
+		{
+			if (record.size == 0 || record.size > maxXmlSize || record.size % 4 != 0)
+				break;
+		}
+		else
+			break;
+
+		long long size = record.size;
+		if (offset + (long long)sizeof(Record) + size > mapSize)
+			break; // The last record is not complete
+
+		Item& item = index[record.hash];
+		item.offset = offset + sizeof(Record);
+		item.fileTime = record.fileTime;
+		item.type = record.type;
+		item.size = record.size;
+		item.width = record.width;
+		item.height = record.height;
+
+		offset += sizeof(Record) + size;
+	}
+
+	// Write new records after the last valid record
+	fileSize = offset;
+}
+
+long long SkinCache::GetFileTime(const std::wstring& file)
+{
+	// Images of the skin pack are checked by the modified time of the pack in the header
+	if (isSkinPack)
+		return 0;
+
+	return FileSystem::GetModified(file);
+}
+
+bool SkinCache::Load(const std::wstring& file, ExImage& outImage)
+{
+	if (!fileHandle)
+		return false;
+
+	auto find = index.find(StringEx::HashFNV1a64(StringEx::ToLowerUS(file)));
+	if (find == index.end())
+		return false;
+
+	const Item& item = find->second;
+
+	if (item.type != RecordType::Image || item.fileTime != GetFileTime(file))
+		return false;
+
+	std::size_t size = item.size;
+
+	if (item.offset + (long long)size <= mapSize)
+		return outImage.LoadFromBits(static_cast<const char*>(mapView.get()) + item.offset, item.width, item.height);
+	else if (ReadBits(item.offset, size))
+		return outImage.LoadFromBits(bits.data(), item.width, item.height);
+
+	return false;
+}
+
+void SkinCache::Save(const std::wstring& file, ExImage& image)
+{
+	if (!fileHandle || !image.IsValid())
+		return;
+
+	if (image.Width() > maxImageSize || image.Height() > maxImageSize)
+		return;
+
+	if (!image.GetBits(bits))
+		return;
+
+	Record record = {};
+	record.hash = StringEx::HashFNV1a64(StringEx::ToLowerUS(file));
+	record.fileTime = GetFileTime(file);
+	record.type = RecordType::Image;
+	record.size = (unsigned int)bits.size();
+	record.width = image.Width();
+	record.height = image.Height();
+
+	WriteRecord(record, bits.data());
+}
+
+bool SkinCache::LoadXml(const std::wstring& file, const char** outData, std::size_t* outSize)
+{
+	if (!fileHandle)
+		return false;
+
+	auto find = index.find(StringEx::HashFNV1a64(StringEx::ToLowerUS(file)));
+	if (find == index.end())
+		return false;
+
+	const Item& item = find->second;
+
+	if (item.type != RecordType::Xml || item.fileTime != GetFileTime(file))
+		return false;
+
+	// The tree is read in place so only from the mapped part, new records are mapped at the next open
+	if (item.offset + (long long)item.size > mapSize)
+		return false;
+
+	*outData = static_cast<const char*>(mapView.get()) + item.offset;
+	*outSize = item.size;
+
+	return true;
+}
+
+void SkinCache::SaveXml(const std::wstring& file, const std::vector<char>& data)
+{
+	if (!fileHandle || data.empty() || data.size() > maxXmlSize || data.size() % 4 != 0)
+		return;
+
+	Record record = {};
+	record.hash = StringEx::HashFNV1a64(StringEx::ToLowerUS(file));
+	record.fileTime = GetFileTime(file);
+	record.type = RecordType::Xml;
+	record.size = (unsigned int)data.size();
+
+	WriteRecord(record, data.data());
+}
+
+void SkinCache::WriteRecord(const Record& record, const void* data)
+{
+	long long offset = fileSize;
+
+	if (!WriteData(offset, &record, sizeof(Record)))
+		return;
+	if (!WriteData(offset + sizeof(Record), data, record.size))
+		return;
+
+	fileSize = offset + sizeof(Record) + record.size;
+
+	Item& item = index[record.hash];
+	item.offset = offset + sizeof(Record);
+	item.fileTime = record.fileTime;
+	item.type = record.type;
+	item.size = record.size;
+	item.width = record.width;
+	item.height = record.height;
+}
+
+bool SkinCache::ReadBits(long long offset, std::size_t size)
+{
+	bits.resize(size);
+
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	DWORD bytesRead = 0;
+	if (::ReadFile(fileHandle.get(), bits.data(), (DWORD)size, &bytesRead, &overlapped) && bytesRead == size)
+		return true;
+
+	return false;
+}
+
+bool SkinCache::WriteData(long long offset, const void* data, std::size_t size)
+{
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	DWORD bytesWritten = 0;
+	if (::WriteFile(fileHandle.get(), data, (DWORD)size, &bytesWritten, &overlapped) && bytesWritten == size)
+		return true;
+
+	return false;
+}
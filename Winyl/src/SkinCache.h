@@ -0,0 +1,129 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class ExImage;
+
+// Disk cache of decoded skin images and parsed skin xml files (see ExImage::LoadEx and XmlFile::LoadEx).
+// Decoding PNG files of the skin through WIC is the slowest part of the skin loading,
+// so all images of a skin are stored in a pack file in the profile folder (Skin-<hash of the skin name>.cache,
+// one file for each skin so switching between skins doesn't rebuild anything) as ready to use
+// premultiplied BGRA pixels and at the next start the skin images are created directly from the mapped file.
+// Xml files are stored as flattened trees (see XmlFlat) that are read from the mapped file without parsing.
+// The header of the file holds the size and the modified time of the skin pack,
+// if the skin pack is changed the file is rebuilt. For skins in a folder the modified time
+// of each image file is stored in the record instead.
+// The pack file is only appended, the last record for the same image wins.
+// Files of skins that are removed from the skin folder are deleted by RemoveUnused.
+// Not thread safe, skins are loaded only from the main thread.
+
+class SkinCache
+{
+private:
+	SkinCache() {}
+public:
+	virtual ~SkinCache();
+	SkinCache(const SkinCache&) = delete;
+	SkinCache& operator=(const SkinCache&) = delete;
+
+	static SkinCache& Instance()
+	{
+		static SkinCache cache;
+		return cache;
+	}
+
+	// path is the folder for the cache files, skinFile is the skin pack (.wzp) or empty if the skin is in a folder
+	bool Open(const std::wstring& path, const std::wstring& skinName, const std::wstring& skinFile);
+	void Close();
+	inline bool IsOpen() {return fileHandle ? true : false;}
+
+	bool Load(const std::wstring& file, ExImage& outImage);
+	void Save(const std::wstring& file, ExImage& image);
+
+	// outData points to the mapped file and is valid until the cache is closed
+	bool LoadXml(const std::wstring& file, const char** outData, std::size_t* outSize);
+	void SaveXml(const std::wstring& file, const std::vector<char>& data);
+
+	static std::wstring GetCacheFile(const std::wstring& path, const std::wstring& skinName, bool isSkinPack);
+	// Delete cache files in path of skins that are not in skinPath anymore
+	static void RemoveUnused(const std::wstring& path, const std::wstring& skinPath);
+
+private:
+	static const unsigned int fileMagic = 0x33435357; // "WSC3"
+	static const long long maxFileSize = 64LL * 1024 * 1024;
+	static const int maxImageSize = 4096;
+	static const unsigned int maxXmlSize = 16 * 1024 * 1024;
+
+	enum class RecordType : unsigned int
+	{
+		Image = 1,
+		Xml = 2
+	};
+
+	struct Header
+	{
+		unsigned int magic;
+		unsigned int reserved;
+		long long skinHash;
+		long long skinSize;
+		long long skinTime;
+	};
+
+	struct Record
+	{
+		long long hash;
+		long long fileTime;
+		RecordType type;
+		unsigned int size; // Size of the data after the record
+		int width; // Only for images
+		int height;
+	};
+
+	struct Item
+	{
+		long long offset; // Offset of the data in the file
+		long long fileTime;
+		RecordType type;
+		unsigned int size;
+		int width;
+		int height;
+	};
+
+	std::unordered_map<long long, Item> index;
+
+	FileHandle fileHandle;
+	MappingHandle mapHandle;
+	MapViewHandle mapView;
+	long long mapSize = 0;
+	long long fileSize = 0;
+
+	bool isSkinPack = false;
+
+	std::vector<char> bits;
+
+	long long GetFileTime(const std::wstring& file);
+	void ReadIndex();
+	bool ReadBits(long long offset, std::size_t size);
+	void WriteRecord(const Record& record, const void* data);
+	bool WriteData(long long offset, const void* data, std::size_t size);
+};
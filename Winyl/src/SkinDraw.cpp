@@ -889,6 +889,51 @@ void SkinDraw::DrawPosition(int percent)
 		drawMini->DrawPosition(percent);
 }
 
+void SkinDraw::DrawWaveform(const Waveform* waveform)
+{
+	for (std::size_t i = 0, isize = layouts.size(); i < isize; ++i)
+	{
+		for (std::size_t j = 0, jsize = layouts[i]->elements.size(); j < jsize; ++j)
+		{
+			SkinElement* element = layouts[i]->elements[j]->element.get();
+
+			if (element->type == SkinElement::Type::Track && static_cast<SkinSlider*>(element)->IsWaveform())
+			{
+				static_cast<SkinSlider*>(element)->SetWaveform(waveform);
+
+				if (!element->IsHidden())
+					RedrawElement(element);
+			}
+		}
+	}
+
+	if (drawAlpha)
+		drawAlpha->DrawWaveform(waveform);
+	if (drawMini)
+		drawMini->DrawWaveform(waveform);
+}
+
+bool SkinDraw::IsWaveform()
+{
+	for (std::size_t i = 0, isize = layouts.size(); i < isize; ++i)
+	{
+		for (std::size_t j = 0, jsize = layouts[i]->elements.size(); j < jsize; ++j)
+		{
+			SkinElement* element = layouts[i]->elements[j]->element.get();
+
+			if (element->type == SkinElement::Type::Track && static_cast<SkinSlider*>(element)->IsWaveform())
+				return true;
+		}
+	}
+
+	if (drawAlpha && drawAlpha->IsWaveform())
+		return true;
+	if (drawMini && drawMini->IsWaveform())
+		return true;
+
+	return false;
+}
+
 void SkinDraw::DrawVolume(int percent)
 {
 	for (std::size_t i = 0, isize = layouts.size(); i < isize; ++i)
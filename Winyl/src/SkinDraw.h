@@ -85,6 +85,8 @@ public:
 	///////
 
 	void DrawPosition(int percent);
+	void DrawWaveform(const Waveform* waveform);
+	bool IsWaveform();
 	void DrawVolume(int percent);
 	void DrawPlay(bool isPlay);
 	void DrawMute(bool isMute);
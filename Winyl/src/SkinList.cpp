@@ -17,6 +17,7 @@
 
 #include "stdafx.h"
 #include "SkinList.h"
+#include <algorithm>
 
 SkinList::SkinList()
 {
@@ -134,7 +135,7 @@ void SkinList::ResetIndex(bool isNowPlaying)
 				swprintf_s(number, format.c_str(), i);
 			else
 				swprintf_s(number, format.c_str(), i % 1000);
-			node->labels[(std::size_t)SkinListElement::Type::Index] = number;
+			node->SetLabel(SkinListElement::Type::Index, number);
 		}
 	}
 }
@@ -146,12 +147,10 @@ ListNodeUnsafe SkinList::InsertHead(ListNodeUnsafe parent, const std::wstring& f
 
 	ListNodeUnsafe newNode = new SkinListNode();
 
-	newNode->labels.resize((std::size_t)SkinListElement::Type::EnumCount);
-
 	newNode->nodeType = SkinListNode::NodeType::Head;
 
 	// File name of the first track (use it to get a cover from the track folder)
-	newNode->file = file;
+	newNode->SetFile(file);
 
 	parent->AddChild(newNode);
 
@@ -161,9 +160,7 @@ ListNodeUnsafe SkinList::InsertHead(ListNodeUnsafe parent, const std::wstring& f
 
 		newNode->Left()->nodeType = SkinListNode::NodeType::Left;
 
-		newNode->Left()->file = file;
-
-		newNode->Left()->labels.resize((std::size_t)SkinListElement::Type::EnumCount);
+		newNode->Left()->SetFile(file);
 	}
 
 	if (isRightShow)
@@ -172,9 +169,7 @@ ListNodeUnsafe SkinList::InsertHead(ListNodeUnsafe parent, const std::wstring& f
 
 		newNode->Right()->nodeType = SkinListNode::NodeType::Right;
 
-		newNode->Right()->file = file;
-
-		newNode->Right()->labels.resize((std::size_t)SkinListElement::Type::EnumCount);
+		newNode->Right()->SetFile(file);
 	}
 
 	SetControlRedraw(isControlRedraw);
@@ -190,11 +185,9 @@ ListNodeUnsafe SkinList::InsertTrack(ListNodeUnsafe parent, const std::wstring&
 
 	ListNodeUnsafe newNode = new SkinListNode();
 
-	newNode->labels.resize((std::size_t)SkinListElement::Type::EnumCount);
-
 	newNode->nodeType = SkinListNode::NodeType::Song;
 	
-	newNode->file = file;
+	newNode->SetFile(file);
 
 	newNode->idLibrary = idLibrary;
 	newNode->idPlaylist = idPlaylist;
@@ -245,11 +238,9 @@ ListNodeUnsafe SkinList::InsertTrackToNowPlaying(ListNodeUnsafe parent, const st
 
 	ListNodeUnsafe newNode = new SkinListNode();
 
-	newNode->labels.resize((std::size_t)SkinListElement::Type::EnumCount);
-
 	newNode->nodeType = SkinListNode::NodeType::Song;
 	
-	newNode->file = file;
+	newNode->SetFile(file);
 
 	newNode->idLibrary = idLibrary;
 	newNode->idPlaylist = idPlaylist;
@@ -271,7 +262,12 @@ ListNodeUnsafe SkinList::InsertTrackToNowPlaying(ListNodeUnsafe parent, const st
 
 void SkinList::SetNodeString(ListNodeUnsafe node, SkinListElement::Type type, const std::wstring& label)
 {
-	node->labels[(std::size_t)type] = label;
+	node->SetLabel(type, label);
+}
+
+void SkinList::SetNodeString(ListNodeUnsafe node, SkinListElement::Type type, const char* label)
+{
+	node->SetLabel(type, label);
 }
 
 void SkinList::SetNodeString2(ListNodeUnsafe node, SkinListElement::Type type, const std::wstring& label)
@@ -279,20 +275,20 @@ void SkinList::SetNodeString2(ListNodeUnsafe node, SkinListElement::Type type, c
 	if (isHeadUpperCase)
 	{
 		std::wstring labelUpper = StringEx::ToUpper(label);
-		node->labels[(std::size_t)type] = labelUpper;
+		node->SetLabel(type, labelUpper);
 	}
 	else
-		node->labels[(std::size_t)type] = label;
+		node->SetLabel(type, label);
 }
 
 void SkinList::SetLeftString(ListNodeUnsafe node, SkinListElement::Type type, const std::wstring& label)
 {
-	node->Left()->labels[(std::size_t)type] = label;
+	node->Left()->SetLabel(type, label);
 }
 
 void SkinList::SetRightString(ListNodeUnsafe node, SkinListElement::Type type, const std::wstring& label)
 {
-	node->Right()->labels[(std::size_t)type] = label;
+	node->Right()->SetLabel(type, label);
 }
 
 void SkinList::SetPlayRating(int rating)
@@ -346,6 +342,8 @@ void SkinList::DeleteAllNode()
 
 	// Clear visible nodes because they can contain pointers to "dead" nodes
 	visibleNodes.clear();
+	listRows.clear();
+	listGroups.clear();
 
 	// Clear everything that can contain pointers to "dead" nodes
 	shuffleIndex = 0;
@@ -373,6 +371,8 @@ void SkinList::DeleteAllNodePlay(bool isReturnToDefault)
 
 	// Clear visible nodes because they can contain pointers to "dead" nodes
 	visibleNodes.clear();
+	listRows.clear();
+	listGroups.clear();
 
 	if (isReturnToDefault) // Switch to "Now Playing" view
 	{
@@ -525,6 +525,8 @@ void SkinList::DeleteSelected()
 
 	// Clear visible nodes because they can contain pointers to "dead" nodes
 	visibleNodes.clear();
+	listRows.clear();
+	listGroups.clear();
 
 	// Must clear shuffle too because shuffle array can contain pointers to "dead" nodes
 	if (!rootNodePlay || rootNodePlay == rootNode)
@@ -612,15 +614,20 @@ void SkinList::OnPaint(HDC dc, PAINTSTRUCT& ps)
 	CRect rc2;
 	::GetClientRect(thisWnd, rc2);
 	
-	// Recursively draw all nodes
+	// Draw only visible nodes
 	if (isControlRedraw)
 	{
 		if (rootNode->HasChild())
 		{
-			DrawNodesRecursive(dcMemory, rootNode.get(), -rc.left, -HScrollGetPos() - rc.top,
+			listThread.SetViewport(HScrollGetPos(), HScrollGetPos() + rc2.Height());
+
+			CoverMemory::Instance().NewPaintPass();
+			DrawNodes(dcMemory, -rc.left, -HScrollGetPos() - rc.top,
 				rc2.right - scrollWidth - rc.left, rc.Height());
 
-			VisibleNodesRecursive(rootNode.get(), -HScrollGetPos(), rc2.Height());
+			VisibleNodes(-HScrollGetPos(), rc2.Height());
+
+			PrefetchCovers(HScrollGetPos(), rc2.Height());
 		}
 		else
 		{
@@ -674,231 +681,276 @@ void SkinList::OnPaint(HDC dc, PAINTSTRUCT& ps)
 	listThread.DrawCover();
 }
 
-int SkinList::VisibleNodesRecursive(SkinListNode* recursiveNode, int y, int height)
+std::size_t SkinList::FindFirstRow(int pos)
 {
-	// If there are no nodes to draw just return
-	//if (!recursiveNode->HasChild())
-	//	return y;
-
-	int y2 = y;
+	// Find the first row that ends below the position, rows are sorted so use binary search
+	std::size_t first = 0;
+	std::size_t count = listRows.size();
 
-	for (ListNodeUnsafe node = recursiveNode->Child(); node != nullptr; node = node->Next())
+	while (count > 0)
 	{
-		if (y > height) // Do not draw nodes that beyond window bottom
-			return y;
-
-		if (node->nodeType == SkinListNode::NodeType::Song) // Draw track
+		std::size_t step = count / 2;
+		if (listRows[first + step].node->rcNode.bottom <= pos)
 		{
-			if (y > -trackHeight) // Draw only visible nodes
-			{
-				visibleNodes.push_back(node); // Fill visible nodes array
-			}
+			first += step + 1;
+			count -= step + 1;
 		}
-		else if (node->nodeType == SkinListNode::NodeType::Head) // Draw header
+		else
+			count = step;
+	}
+
+	return first;
+}
+
+std::size_t SkinList::FindFirstGroup(int pos)
+{
+	// Find the first group that ends below the position, groups are sorted the same way as rows
+	// but when the bottoms are not sorted (nested groups) use linear search
+	if (!isGroupsSorted)
+	{
+		for (std::size_t i = 0, size = listGroups.size(); i < size; ++i)
 		{
-			if (y > -headHeight) // Draw only visible nodes
-			{
-				visibleNodes.push_back(node); // Fill visible nodes array
-			}
+			if (listGroups[i].bottom > pos)
+				return i;
 		}
+		return listGroups.size();
+	}
 
-		y += node->rcNode.Height();
+	std::size_t first = 0;
+	std::size_t count = listGroups.size();
 
-///////////////////////////////////////////////////////////////////////////
-		// Recursively draw all open subnodes //
-		if (node->isOpen && node->HasChild())
-			y = VisibleNodesRecursive(node, y, height);
-///////////////////////////////////////////////////////////////////////////
+	while (count > 0)
+	{
+		std::size_t step = count / 2;
+		if (listGroups[first + step].bottom <= pos)
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+		else
+			count = step;
 	}
 
-	// Recalculate height to show album art
-	if (recursiveNode->left && isLeftAlways && (y - y2) < leftHeight)
-		y = y2 + leftHeight;
-	if (recursiveNode->right && isRightAlways && (y - y2) < rightHeight)
-		y = y2 + rightHeight;
-
-	return y;
+	return first;
 }
 
-int SkinList::DrawNodesRecursive(HDC dc, SkinListNode* recursiveNode, int x, int y, int right, int height)
+void SkinList::VisibleNodes(int y, int height)
 {
-	// Latest value is height not bottom like expected because it is only a limiter for drawing,
-	// also this function was a bit different before, and for the sake of minimal changes it became slightly illogical.
+	for (std::size_t i = FindFirstRow(-y), size = listRows.size(); i < size; ++i)
+	{
+		ListNodeUnsafe node = listRows[i].node;
 
-	// If there are no nodes to draw just return
-	//if (!recursiveNode->HasChild())
-	//	return y;
+		if (node->rcNode.top + y > height) // Do not take nodes that beyond window bottom
+			break;
 
-	int y2 = y; // Save y to use it at the end to draw panes
-	bool isShowL = false; // Show left pane?
-	bool isShowR = false; // Show right pane?
+		visibleNodes.push_back(node); // Fill visible nodes array
+	}
+}
 
-	for (ListNodeUnsafe node = recursiveNode->Child(); node != nullptr; node = node->Next())
-	{
-		if (y > height) // Do not draw nodes that beyond window bottom
-			break; //return y;
+void SkinList::PrefetchCovers(int scrollPos, int height)
+{
+	// Add covers a screen ahead in the scroll direction, so they are loaded before they are shown.
+	// The size of a cover is known only after it is drawn, so take the size of drawn covers.
 
+	int top = scrollPos + height;
+	int bottom = scrollPos + height * 2;
+	if (listThread.GetDirection() < 0)
+	{
+		top = scrollPos - height;
+		bottom = scrollPos;
+	}
 
-		if (node->nodeType == SkinListNode::NodeType::Song) // Draw track
+	if (szCoverHead.cx > 0)
+	{
+		for (std::size_t row = FindFirstRow(top), rowCount = listRows.size(); row < rowCount; ++row)
 		{
-			if (y > -trackHeight) // Draw only visible nodes
-			{
-				// If there is a place for a pane then move nodes
-				int showL = 0; int showR = 0;
-				if (recursiveNode->left)
-				{
-					if (isLeftAlways || (recursiveNode->ccount * trackHeight) >= leftHeight)
-					{
-						isShowL = true;
-						if (!isLeftOver) // Left pane overlap tracks?
-							showL = leftWidth;
-					}
-				}
-				if (recursiveNode->right)
-				{
-					if (isRightAlways || (recursiveNode->ccount * trackHeight) >= rightHeight)
-					{
-						isShowR = true;
-						if (!isRightOver) // Right pane overlap tracks?
-							showR = rightWidth;
-					}
-				}
-
-				// Node area
-				CRect rc(x + showL, y, right - showR, y + trackHeight);
-
-				// Draw background
-				for (std::size_t i = 0, size = skinTrackB.size(); i < size; ++i)
-				{
-					skinTrackB[i]->Draw(dc, rc, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
-				}
+			ListNodeUnsafe node = listRows[row].node;
 
-				// Draw elements
-				for (std::size_t i = 0, size = skinTrack.size(); i < size; ++i)
-				{
-					if ((int)skinTrack[i]->type >= 0)
-						skinTrack[i]->DrawText(dc, rc, node->labels[(std::size_t)skinTrack[i]->type], node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
-					else if (skinTrack[i]->type == SkinListElement::Type::Rating)
-						skinTrack[i]->DrawRating(dc, rc, node->rating, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary/*, rcRate*/);
-					else if (skinTrack[i]->type == SkinListElement::Type::ArtistTitle)
-						skinTrack[i]->DrawText2(dc, rc, node->labels[0], node->labels[2], node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
-				}
+			if (node->rcNode.top >= bottom)
+				break;
 
-				// Fill visible nodes array
-				//visibleNodes.push_back(node);
+			if (node->nodeType == SkinListNode::NodeType::Head && !node->isCover)
+			{
+				node->szCover = szCoverHead;
+				listThread.AddCover(node, node->rcNode.top);
 			}
 		}
-		else if (node->nodeType == SkinListNode::NodeType::Head) // Draw header
+	}
+
+	if (szCoverLeft.cx > 0 || szCoverRight.cx > 0)
+	{
+		for (std::size_t g = FindFirstGroup(top), groupCount = listGroups.size(); g < groupCount; ++g)
 		{
-			if (y > -headHeight) // Draw only visible nodes
-			{
-				// Node area
-				CRect rc(x, y, right, y + headHeight);
+			ListNodeUnsafe node = listGroups[g].node;
 
-				// Draw background
-				for (std::size_t i = 0, size = skinHeadB.size(); i < size; ++i)
-				{
-					skinHeadB[i]->Draw(dc, rc, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
-				}
+			if (listGroups[g].top >= bottom)
+				break;
 
-				// Draw elements
-				for (std::size_t i = 0, size = skinHead.size(); i < size; ++i)
-				{
-					if ((int)skinHead[i]->type >= 0)
-						skinHead[i]->DrawText(dc, rc, node->labels[(std::size_t)skinHead[i]->type], node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
-					else if (skinHead[i]->type == SkinListElement::Type::Cover)
-					{
-						skinHead[i]->DrawCover(dc, rc, nullptr, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary, node->szCover);
-						listThread.AddCover(node);
-					}
-					else if (skinHead[i]->type == SkinListElement::Type::ArtistAlbum)
-						skinHead[i]->DrawText2(dc, rc, node->labels[0], node->labels[1], node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
-				}
+			if (node->left && !node->left->isCover && szCoverLeft.cx > 0 &&
+				(isLeftAlways || (node->ccount * trackHeight) >= leftHeight))
+			{
+				node->left->szCover = szCoverLeft;
+				listThread.AddCover(node->left, listGroups[g].top);
+			}
 
-				// Fill visible nodes array
-				//visibleNodes.push_back(node);
+			if (node->right && !node->right->isCover && szCoverRight.cx > 0 &&
+				(isRightAlways || (node->ccount * trackHeight) >= rightHeight))
+			{
+				node->right->szCover = szCoverRight;
+				listThread.AddCover(node->right, listGroups[g].top);
 			}
 		}
-
-		y += node->rcNode.Height();
-
-///////////////////////////////////////////////////////////////////////////
-		// Recursively draw all open subnodes //
-		if (node->isOpen && node->HasChild())
-			y = DrawNodesRecursive(dc, node, x + nodeIndent, y, right, height);
-///////////////////////////////////////////////////////////////////////////
 	}
+}
 
+void SkinList::DrawNodes(HDC dc, int x, int y, int right, int height)
+{
+	// Latest value is height not bottom like expected because it is only a limiter for drawing.
+	// y is the offset of nodes, nodes are drawn at rcNode.top + y.
 
-	// Draw left pane if present and visible
-	if (recursiveNode->left && y2 > -leftHeight)
+	for (std::size_t row = FindFirstRow(-y), rowCount = listRows.size(); row < rowCount; ++row)
 	{
-		if (isLeftAlways || isShowL) // Show left pane?
+		ListNodeUnsafe node = listRows[row].node;
+		int nodeX = x + listRows[row].indent;
+		int nodeY = node->rcNode.top + y;
+
+		if (nodeY > height) // Do not draw nodes that beyond window bottom
+			break;
+
+		if (node->nodeType == SkinListNode::NodeType::Song) // Draw track
 		{
-			// Left pane use Header node states for drawing
-			ListNodeUnsafe node = recursiveNode;
+			ListNodeUnsafe parentNode = node->Parent();
+
+			// If there is a place for a pane then move nodes
+			int showL = 0; int showR = 0;
+			if (parentNode->left && !isLeftOver) // Left pane overlap tracks?
+			{
+				if (isLeftAlways || (parentNode->ccount * trackHeight) >= leftHeight)
+					showL = leftWidth;
+			}
+			if (parentNode->right && !isRightOver) // Right pane overlap tracks?
+			{
+				if (isRightAlways || (parentNode->ccount * trackHeight) >= rightHeight)
+					showR = rightWidth;
+			}
+
+			// Node area
+			CRect rc(nodeX + showL, nodeY, right - showR, nodeY + trackHeight);
+
+			// Draw background
+			for (std::size_t i = 0, size = skinTrackB.size(); i < size; ++i)
+			{
+				skinTrackB[i]->Draw(dc, rc, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
+			}
 
+			// Draw elements
+			for (std::size_t i = 0, size = skinTrack.size(); i < size; ++i)
+			{
+				if ((int)skinTrack[i]->type >= 0)
+					skinTrack[i]->DrawText(dc, rc, node->GetLabel(skinTrack[i]->type), node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
+				else if (skinTrack[i]->type == SkinListElement::Type::Rating)
+					skinTrack[i]->DrawRating(dc, rc, node->rating, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary/*, rcRate*/);
+				else if (skinTrack[i]->type == SkinListElement::Type::ArtistTitle)
+					skinTrack[i]->DrawText2(dc, rc, node->GetLabel(SkinListElement::Type::Artist), node->GetLabel(SkinListElement::Type::Title), node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
+			}
+		}
+		else if (node->nodeType == SkinListNode::NodeType::Head) // Draw header
+		{
 			// Node area
-			CRect rc(x, y2, x + leftWidth, y2 + leftHeight);
+			CRect rc(nodeX, nodeY, right, nodeY + headHeight);
 
 			// Draw background
-			for (std::size_t i = 0, size = skinLeftB.size(); i < size; ++i)
-				skinLeftB[i]->Draw(dc, rc, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
+			for (std::size_t i = 0, size = skinHeadB.size(); i < size; ++i)
+			{
+				skinHeadB[i]->Draw(dc, rc, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
+			}
 
 			// Draw elements
-			for (std::size_t i = 0, size = skinLeft.size(); i < size; ++i)
+			for (std::size_t i = 0, size = skinHead.size(); i < size; ++i)
 			{
-				if ((int)skinLeft[i]->type >= 0)
-					skinLeft[i]->DrawText(dc, rc, node->left->labels[(std::size_t)skinLeft[i]->type], node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
-				else if (skinLeft[i]->type == SkinListElement::Type::Cover)
+				if ((int)skinHead[i]->type >= 0)
+					skinHead[i]->DrawText(dc, rc, node->GetLabel(skinHead[i]->type), node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
+				else if (skinHead[i]->type == SkinListElement::Type::Cover)
 				{
-					skinLeft[i]->DrawCover(dc, rc, node->left->cover, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary, node->left->szCover);
-					listThread.AddCover(node->left);
+					skinHead[i]->DrawCover(dc, rc, nullptr, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary, node->szCover);
+					listThread.AddCover(node, node->rcNode.top);
+					szCoverHead = node->szCover;
 				}
+				else if (skinHead[i]->type == SkinListElement::Type::ArtistAlbum)
+					skinHead[i]->DrawText2(dc, rc, node->GetLabel(SkinListElement::Type::Artist), node->GetLabel(SkinListElement::Type::Album), node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
 			}
-
-			// Do not fill visible nodes array because a pane is transparent for mouse click
 		}
 	}
 
-	// Draw right pane if present and visible
-	if (recursiveNode->right && y2 > -rightHeight)
+	// Draw panes over the tracks
+	for (std::size_t g = FindFirstGroup(-y), groupCount = listGroups.size(); g < groupCount; ++g)
 	{
-		if (isRightAlways || isShowR) // Show right pane?
+		// Left and right panes use Header node states for drawing
+		ListNodeUnsafe node = listGroups[g].node;
+		int paneX = x + listGroups[g].indent;
+		int paneY = listGroups[g].top + y;
+
+		if (paneY > height)
+			break;
+
+		// Draw left pane if present and visible
+		if (node->left && paneY > -leftHeight)
 		{
-			// Right pane use Header node states for drawing
-			ListNodeUnsafe node = recursiveNode;
+			if (isLeftAlways || (node->ccount * trackHeight) >= leftHeight) // Show left pane?
+			{
+				// Node area
+				CRect rc(paneX, paneY, paneX + leftWidth, paneY + leftHeight);
 
-			// Node area
-			CRect rc(right - rightWidth, y2, right, y2 + rightHeight);
+				// Draw background
+				for (std::size_t i = 0, size = skinLeftB.size(); i < size; ++i)
+					skinLeftB[i]->Draw(dc, rc, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
 
-			// Draw background
-			for (std::size_t i = 0, size = skinRightB.size(); i < size; ++i)
-				skinRightB[i]->Draw(dc, rc, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
+				// Draw elements
+				for (std::size_t i = 0, size = skinLeft.size(); i < size; ++i)
+				{
+					if ((int)skinLeft[i]->type >= 0)
+						skinLeft[i]->DrawText(dc, rc, node->left->GetLabel(skinLeft[i]->type), node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
+					else if (skinLeft[i]->type == SkinListElement::Type::Cover)
+					{
+						skinLeft[i]->DrawCover(dc, rc, GetNodeCover(node->left).get(), node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary, node->left->szCover);
+						listThread.AddCover(node->left, listGroups[g].top);
+						szCoverLeft = node->left->szCover;
+					}
+				}
 
-			// Draw elements
-			for (std::size_t i = 0, size = skinRight.size(); i < size; ++i)
+				// Do not fill visible nodes array because a pane is transparent for mouse click
+			}
+		}
+
+		// Draw right pane if present and visible
+		if (node->right && paneY > -rightHeight)
+		{
+			if (isRightAlways || (node->ccount * trackHeight) >= rightHeight) // Show right pane?
 			{
-				if ((int)skinRight[i]->type >= 0)
-					skinRight[i]->DrawText(dc, rc, node->right->labels[(std::size_t)skinRight[i]->type], node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
-				else if (skinRight[i]->type == SkinListElement::Type::Cover)
+				// Node area
+				CRect rc(right - rightWidth, paneY, right, paneY + rightHeight);
+
+				// Draw background
+				for (std::size_t i = 0, size = skinRightB.size(); i < size; ++i)
+					skinRightB[i]->Draw(dc, rc, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
+
+				// Draw elements
+				for (std::size_t i = 0, size = skinRight.size(); i < size; ++i)
 				{
-					skinRight[i]->DrawCover(dc, rc, node->right->cover, node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary, node->right->szCover);
-					listThread.AddCover(node->right);
+					if ((int)skinRight[i]->type >= 0)
+						skinRight[i]->DrawText(dc, rc, node->right->GetLabel(skinRight[i]->type), node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary);
+					else if (skinRight[i]->type == SkinListElement::Type::Cover)
+					{
+						skinRight[i]->DrawCover(dc, rc, GetNodeCover(node->right).get(), node->stateSelect, node->statePlay, node->stateLine, node->stateLibrary, node->right->szCover);
+						listThread.AddCover(node->right, listGroups[g].top);
+						szCoverRight = node->right->szCover;
+					}
 				}
-			}
 
-			// Do not fill visible nodes array because a pane is transparent for mouse click
+				// Do not fill visible nodes array because a pane is transparent for mouse click
+			}
 		}
 	}
-
-	// Recalculate height to show album art
-	if (recursiveNode->left && isLeftAlways && (y - y2) < leftHeight)
-		y = y2 + leftHeight;
-	if (recursiveNode->right && isRightAlways && (y - y2) < rightHeight)
-		y = y2 + rightHeight;
-
-	return y;
 }
 
 void SkinList::OnLButtonDown(UINT nFlags, CPoint point)
@@ -1421,6 +1473,23 @@ ListNodeUnsafe SkinList::FindNodeByIndexR(ListNodeUnsafe recursiveNode, long lon
 	return nullptr;
 }
 
+std::shared_ptr<ExImage> SkinList::GetNodeCover(ListNodeUnsafe node)
+{
+	std::shared_ptr<ExImage> cover;
+
+	if (node->cover)
+	{
+		cover = CoverMemory::Instance().Get(node->cover);
+		if (!cover) // The cover is deleted from the memory, load it again
+		{
+			node->cover = 0;
+			node->isCover = false;
+		}
+	}
+
+	return cover;
+}
+
 void SkinList::UpdateCovers()
 {
 	ClearCoversR(rootNode.get());
@@ -1439,20 +1508,20 @@ void SkinList::ClearCoversR(ListNodeUnsafe recursiveNode)
 		{
 			if (node->cover)
 			{
-				delete node->cover;
-				node->cover = nullptr;
+				CoverMemory::Instance().Remove(node->cover);
+				node->cover = 0;
 				node->isCover = false;
 			}
 			if (node->left && node->left->cover)
 			{
-				delete node->left->cover;
-				node->left->cover = nullptr;
+				CoverMemory::Instance().Remove(node->left->cover);
+				node->left->cover = 0;
 				node->left->isCover = false;
 			}
 			if (node->right && node->right->cover)
 			{
-				delete node->right->cover;
-				node->right->cover = nullptr;
+				CoverMemory::Instance().Remove(node->right->cover);
+				node->right->cover = 0;
 				node->right->isCover = false;
 			}
 		}
@@ -1551,13 +1620,24 @@ void SkinList::OnContextMenu(HWND hWnd, CPoint point)
 
 int SkinList::FindNodeByPoint(const CPoint& point, int scrollPos)
 {
-	for (std::size_t i = 0, size = visibleNodes.size(); i < size; ++i)
+	// Visible nodes are sorted by position so use binary search
+	std::size_t first = 0;
+	std::size_t count = visibleNodes.size();
+	while (count > 0)
 	{
-		if (point.y + scrollPos >= visibleNodes[i]->rcNode.top &&
-			point.y + scrollPos <= visibleNodes[i]->rcNode.bottom)
-			return (int)i;
+		std::size_t step = count / 2;
+		if (visibleNodes[first + step]->rcNode.bottom < point.y + scrollPos)
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+		else
+			count = step;
 	}
 
+	if (first < visibleNodes.size() && point.y + scrollPos >= visibleNodes[first]->rcNode.top)
+		return (int)first;
+
 	return -1;
 }
 
@@ -1566,8 +1646,14 @@ void SkinList::ResetScrollBar()
     CRect rcClient;
 	::GetClientRect(thisWnd, rcClient);
 
+	listRows.clear();
+	listGroups.clear();
+
 	heightNodes = CalculateHeight(rootNode.get(), 0, 0);
 
+	isGroupsSorted = std::is_sorted(listGroups.begin(), listGroups.end(),
+		[](const ListGroup& a, const ListGroup& b) {return a.bottom < b.bottom;});
+
 	if (rcClient.Height() < heightNodes/* + 8*/)
     {
 		HScrollSetInfo(0, heightNodes, trackHeight, rcClient.Height());
@@ -1629,9 +1715,16 @@ int SkinList::CalculateHeight(SkinListNode* recursiveNode, int y, int nesting)
 
 	int y2 = y;
 
+	// Add the group before children to keep groups sorted, the bottom is set below
+	std::size_t group = listGroups.size();
+	if (recursiveNode->left || recursiveNode->right)
+		listGroups.push_back({recursiveNode, nesting * nodeIndent, y, y});
+
 	int count = 0;
 	for (ListNodeUnsafe node = recursiveNode->Child(); node != nullptr; node = node->Next())
 	{
+		listRows.push_back({node, nesting * nodeIndent});
+
 		if (node->nodeType == SkinListNode::NodeType::Song)
 		{
 			node->rcNode.top = y;
@@ -1661,6 +1754,9 @@ int SkinList::CalculateHeight(SkinListNode* recursiveNode, int y, int nesting)
 	if (recursiveNode->right && isRightAlways && (y - y2) < rightHeight)
 		y = y2 + rightHeight;
 
+	if (recursiveNode->left || recursiveNode->right)
+		listGroups[group].bottom = y;
+
 	return y;
 }
 
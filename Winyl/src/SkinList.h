@@ -44,6 +44,7 @@ public:
 	ListNodeUnsafe InsertTrackToNowPlaying(ListNodeUnsafe parent, const std::wstring& file, long long idLibrary, long long idPlaylist,
 		int rating, int time, unsigned size, long long cue);
 	void SetNodeString(ListNodeUnsafe node, SkinListElement::Type type, const std::wstring& label);
+	void SetNodeString(ListNodeUnsafe node, SkinListElement::Type type, const char* label); // UTF-8 from the database
 	void SetNodeString2(ListNodeUnsafe node, SkinListElement::Type type, const std::wstring& label);
 	void SetLeftString(ListNodeUnsafe node, SkinListElement::Type type, const std::wstring& label);
 	void SetRightString(ListNodeUnsafe node, SkinListElement::Type type, const std::wstring& label);
@@ -146,6 +147,7 @@ public:
 
 	inline void EnableSmoothScroll(bool isEnable) {isSmoothScrollEnabled = isEnable;}
 	inline void SetEventSmoothScroll(Threading::Event* event) {eventSmoothScroll = event;}
+	inline void SetProfilePath(const std::wstring& path) {listThread.SetCoverCacheFile(path + L"Covers.cache");}
 	inline bool IsSmoothScrollRun() {return isSmoothScrollRun;}
 	void SmoothScrollRun();
 
@@ -279,6 +281,32 @@ private:
 
 	std::vector<ListNodeUnsafe> visibleNodes;
 
+	// Flat index of all shown nodes (headers and tracks) in order of rcNode.top, it is rebuilt by CalculateHeight
+	// when nodes are added, removed or moved, and used to find visible nodes by binary search on each paint.
+	struct ListRow
+	{
+		ListNodeUnsafe node;
+		int indent; // Indent of the node (nesting * nodeIndent)
+	};
+	// Nodes with panes (left and right), top and bottom is the area of children of the node
+	struct ListGroup
+	{
+		ListNodeUnsafe node;
+		int indent;
+		int top;
+		int bottom;
+	};
+	std::vector<ListRow> listRows;
+	std::vector<ListGroup> listGroups;
+	// Groups are added before their children so a group with panes nested in another one
+	// ends before its parent, then bottoms are not sorted and FindFirstGroup can't use binary search
+	bool isGroupsSorted = true;
+
+	// Sizes of drawn covers, used to prefetch covers that are not drawn yet
+	CSize szCoverHead;
+	CSize szCoverLeft;
+	CSize szCoverRight;
+
 	std::vector<ListNodeSafe> selectedNodes;
 
 	std::vector<ListNodeSafe> shuffleNodes;
@@ -287,8 +315,11 @@ private:
 	int CalculateHeight(SkinListNode* recursiveNode, int y, int nesting);
 	int FindNodeByPoint(const CPoint& point, int scrollPos);
 	void ResetScrollBar();
-	int DrawNodesRecursive(HDC dc, SkinListNode* recursiveNode, int x, int y, int right, int height);
-	int VisibleNodesRecursive(SkinListNode* recursiveNode, int y, int height);
+	void DrawNodes(HDC dc, int x, int y, int right, int height);
+	void VisibleNodes(int y, int height);
+	std::size_t FindFirstRow(int pos);
+	std::size_t FindFirstGroup(int pos);
+	void PrefetchCovers(int scrollPos, int height);
 
 	ListNodeUnsafe FindNextNode(ListNodeUnsafe findNode, bool isPage = false, ListNodeUnsafe recursiveNode = nullptr);
 	ListNodeUnsafe FindPrevNode(ListNodeUnsafe findNode, bool isPage = false, ListNodeUnsafe recursiveNode = nullptr);
@@ -301,6 +332,7 @@ private:
 	void SelectAllR(SkinListNode* recursiveNode);
 
 	void ClearCoversR(ListNodeUnsafe recursiveNode);
+	std::shared_ptr<ExImage> GetNodeCover(ListNodeUnsafe node);
 
 
 private: // Messages
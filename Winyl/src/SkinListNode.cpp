@@ -17,6 +17,21 @@
 
 #include "stdafx.h"
 #include "SkinListNode.h"
+#include "NodePool.h"
+
+static NodePool<SkinListNode> nodePool;
+static StringPool labelPool;
+
+void* SkinListNode::operator new(std::size_t size)
+{
+	assert(size == sizeof(SkinListNode));
+	return nodePool.Allocate();
+}
+
+void SkinListNode::operator delete(void* ptr)
+{
+	nodePool.Free(ptr);
+}
 
 SkinListNode::SkinListNode()
 {
@@ -25,11 +40,52 @@ SkinListNode::SkinListNode()
 
 SkinListNode::~SkinListNode()
 {
+	for (StringPool::Handle label : labels)
+		labelPool.Release(label);
+	labelPool.Release(filePath);
+
 	if (left) delete left;
 	if (right) delete right;
 
-	if (cover) delete cover;
+	CoverMemory::Instance().Remove(cover);
 
 	if (child)
 		EmptyChild();
 }
+
+std::wstring SkinListNode::GetFile()
+{
+	return labelPool.Get(filePath) + fileName;
+}
+
+void SkinListNode::SetFile(const std::wstring& file)
+{
+	// Split after the last separator, a URL is split the same way
+	std::size_t find = file.find_last_of(L"\\/");
+	std::size_t start = (find == std::wstring::npos) ? 0 : find + 1;
+
+	StringPool::Handle old = filePath;
+	filePath = labelPool.Add(file.substr(0, start));
+	labelPool.Release(old);
+
+	fileName = file.substr(start);
+}
+
+std::wstring SkinListNode::GetLabel(SkinListElement::Type type)
+{
+	return labelPool.Get(labels[(std::size_t)type]);
+}
+
+void SkinListNode::SetLabel(SkinListElement::Type type, const std::wstring& label)
+{
+	StringPool::Handle old = labels[(std::size_t)type];
+	labels[(std::size_t)type] = labelPool.Add(label);
+	labelPool.Release(old);
+}
+
+void SkinListNode::SetLabel(SkinListElement::Type type, const char* label)
+{
+	StringPool::Handle old = labels[(std::size_t)type];
+	labels[(std::size_t)type] = labelPool.Add(label);
+	labelPool.Release(old);
+}
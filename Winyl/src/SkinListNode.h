@@ -19,12 +19,16 @@
 
 #include "ExImage.h"
 #include "SkinListElement.h"
+#include "StringPool.h"
+#include "CoverMemory.h"
 
 class SkinListNode final
 {
 public:
 	SkinListNode();
 	~SkinListNode();
+	static void* operator new(std::size_t size); // Nodes are allocated from the pool (see NodePool.h)
+	static void operator delete(void* ptr);
 	friend class SkinList;
 	friend class SkinListElement;
 	friend class SkinListBack;
@@ -209,11 +213,12 @@ public:
 	}
 
 public:
-	std::wstring file;
-	const std::wstring& GetFile() {return file;}
+	std::wstring GetFile(); // Full path
+	void SetFile(const std::wstring& file);
 	long long GetCueValue() {return trackCue;}
-	const std::wstring& GetLabel(SkinListElement::Type type) {return labels[(std::size_t)type];}
-	void SetLabel(SkinListElement::Type type, const std::wstring& label) {labels[(std::size_t)type] = label;}
+	std::wstring GetLabel(SkinListElement::Type type);
+	void SetLabel(SkinListElement::Type type, const std::wstring& label);
+	void SetLabel(SkinListElement::Type type, const char* label); // UTF-8
 
 	int rating = 0;
 	long long trackCue = 0;
@@ -225,7 +230,7 @@ public:
 	long long idPlaylist = 0; // Track index in the playlist
 
 private:
-	ExImage* cover = nullptr; // Cover art
+	CoverMemory::Handle cover = 0; // Cover art (see CoverMemory.h)
 	bool isCover = false; // Cover art is loaded?
 	CSize szCover;
 
@@ -243,7 +248,9 @@ private:
 	bool isOpen = true;
 	bool isSelect = false;
 	bool isShuffle = false;
-	std::vector<std::wstring> labels;
+	StringPool::Handle labels[(std::size_t)SkinListElement::Type::EnumCount] = {}; // Interned labels (see StringPool.h)
+	StringPool::Handle filePath = 0; // Interned folder of the file, the tracks of an album share it
+	std::wstring fileName; // File name without the folder
 
 //	int flag = 0;
 
@@ -17,6 +17,7 @@
 
 #include "stdafx.h"
 #include "SkinListThread.h"
+#include "DebugMacros.h"
 
 SkinListThread::SkinListThread()
 {
@@ -30,19 +31,30 @@ SkinListThread::~SkinListThread()
 
 void SkinListThread::NewThread()
 {
-	assert(!threadWorker.IsJoinable());
+	assert(threadWorkers.empty());
+
+	// Decoding of covers is CPU bound but leave cores for the main and audio threads
+	SYSTEM_INFO systemInfo = {};
+	::GetSystemInfo(&systemInfo);
+	int numberWorkers = std::max(1, std::min(workersMax, (int)systemInfo.dwNumberOfProcessors / 2));
 
 	stopThread = false;
-	threadWorker.Start(std::bind(&SkinListThread::RunThread, this));
+	for (int i = 0; i < numberWorkers; ++i)
+	{
+		threadWorkers.emplace_back(new Threading::Thread());
+		threadWorkers.back()->Start(std::bind(&SkinListThread::RunThread, this));
+	}
 }
 
 void SkinListThread::DeleteThread()
 {
-	if (threadWorker.IsJoinable())
+	if (!threadWorkers.empty())
 	{
 		stopThread = true;
 		eventThread.Set();
-		threadWorker.Join();
+		for (auto& threadWorker : threadWorkers)
+			threadWorker->Join();
+		threadWorkers.clear();
 	}
 }
 
@@ -50,22 +62,83 @@ void SkinListThread::ReInit()
 {
 	DeleteThread();
 
-	coverNodes.clear();
+	DEBUG_LOGF("Cover memory: %zu covers, %zu of %zu KB, evicted %zu",
+		CoverMemory::Instance().GetCount(), CoverMemory::Instance().GetBytesUsed() / 1024,
+		CoverMemory::Instance().GetBytesBudget() / 1024, CoverMemory::Instance().GetCountEvicted());
+
+	coverQueue.clear();
+	coverJobs.clear();
 
 	NewThread();
 }
 
-void SkinListThread::AddCover(ListNodeUnsafe node)
+void SkinListThread::AddCover(ListNodeUnsafe node, int pos)
 {
 	if (!node->isCover)
 	{
 		node->isCover = true;
 		mutexThread.Lock();
-		coverNodes.push_back(node);
+		auto find = coverJobs.find(node);
+		if (find == coverJobs.end())
+			coverJobs.emplace(node, coverQueue.emplace(pos, node));
+		else if (find->second->first != pos) // Still pending (the list reset the flag), only move it to the new position
+		{
+			coverQueue.erase(find->second);
+			find->second = coverQueue.emplace(pos, node);
+		}
 		mutexThread.Unlock();
 	}
 }
 
+void SkinListThread::SetViewport(int top, int bottom)
+{
+	mutexThread.Lock();
+
+	if (top > viewTop)
+		viewDirection = 1;
+	else if (top < viewTop)
+		viewDirection = -1;
+
+	viewTop = top;
+	viewBottom = bottom;
+
+	// Drop covers that are more than a screen away, the list adds them again when they are drawn.
+	// The distance only grows to the both ends of the queue so only far covers are touched.
+	int maxDistance = std::max(1, bottom - top);
+	while (!coverQueue.empty() && JobDistance(coverQueue.begin()->first) > maxDistance)
+		DropJob(coverQueue.begin());
+	while (!coverQueue.empty() && JobDistance(std::prev(coverQueue.end())->first) > maxDistance)
+		DropJob(std::prev(coverQueue.end()));
+
+	mutexThread.Unlock();
+}
+
+int SkinListThread::JobDistance(int pos)
+{
+	// Distance from the visible area, covers behind the scroll direction are less important
+	if (pos < viewTop)
+		return (viewTop - pos) * (viewDirection > 0 ? 2 : 1);
+	else if (pos > viewBottom)
+		return (pos - viewBottom) * (viewDirection < 0 ? 2 : 1);
+
+	return 0;
+}
+
+void SkinListThread::DropJob(CoverQueue::iterator job)
+{
+	job->second->isCover = false;
+	coverJobs.erase(job->second);
+	coverQueue.erase(job);
+}
+
+void SkinListThread::SetCoverCacheFile(const std::wstring& file)
+{
+	mutexCache.Lock();
+	coverCacheFile = file;
+	isCoverCacheTried = false;
+	mutexCache.Unlock();
+}
+
 void SkinListThread::DrawCover()
 {
 	eventThread.Set();
@@ -73,41 +146,99 @@ void SkinListThread::DrawCover()
 
 void SkinListThread::RunThread()
 {
+	// WIC decoders are COM objects, each worker needs its own COM initialization
+	::CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
 	while (!stopThread)
 	{
 		eventThread.Wait();
 
 		mutexThread.Lock();
-		while (!stopThread && !coverNodes.empty())
+		while (!stopThread && !coverQueue.empty())
 		{
-			SkinListNode* node = coverNodes.front();
-			coverNodes.pop_front();
+			// Take the nearest cover to the visible area: the first cover from the top of the visible area
+			// or the last cover above it, the distance only grows farther from them
+			CoverQueue::iterator nearest = coverQueue.lower_bound(viewTop);
+			if (nearest == coverQueue.end() || (nearest != coverQueue.begin() &&
+				JobDistance(std::prev(nearest)->first) < JobDistance(nearest->first)))
+				--nearest;
+
+			ListNodeUnsafe node = nearest->second;
+			coverJobs.erase(node);
+			coverQueue.erase(nearest);
+
+			// Wake up the next worker if there are more covers (the event is auto reset)
+			if (!coverQueue.empty())
+				eventThread.Set();
 			mutexThread.Unlock();
 
-			CoverLoader coverLoader;
+			LoadCover(node);
 
-			coverLoader.LoadCoverImage(node->GetFile());
-			if (coverLoader.GetImage().IsValid())
-			{
-				ExImage* cover = new ExImage();
+			mutexThread.Lock();
+		}
 
-				CSize sz = node->szCover;
+		mutexThread.Unlock();
+	}
 
-				if (cover->ThumbnailFromSource(coverLoader.GetImage(), sz.cx, sz.cy))
-				{
-					//Sleep(1000);
+	// Wake up the next worker to stop it
+	eventThread.Set();
 
-					node->cover = cover;
+	::CoUninitialize();
+}
 
-					::InvalidateRect(wndParent, NULL, FALSE);
-				}
-				else
-					delete cover;
-			}
+void SkinListThread::LoadCover(ListNodeUnsafe node)
+{
+	mutexCache.Lock();
+	if (!isCoverCacheTried && !coverCacheFile.empty())
+	{
+		isCoverCacheTried = true;
+		coverCache.Open(coverCacheFile);
+	}
+	mutexCache.Unlock();
+
+	// Covers are cached by the cover file (the track itself for the embedded cover),
+	// so look for the cover file in the same order as CoverLoader::LoadCoverImage
+	CoverLoader coverLoader;
+	std::wstring fileCover;
+
+	if (coverLoader.FindFrontCover(node->GetFile(), fileCover))
+		LoadCoverFile(node, coverLoader, fileCover, false);
+	else if (!LoadCoverFile(node, coverLoader, node->GetFile(), true) &&
+		coverLoader.FindFolderCover(node->GetFile(), fileCover))
+		LoadCoverFile(node, coverLoader, fileCover, false);
+}
 
-			mutexThread.Lock();
+bool SkinListThread::LoadCoverFile(ListNodeUnsafe node, CoverLoader& coverLoader, const std::wstring& fileCover, bool isEmbedded)
+{
+	CSize sz = node->szCover;
+
+	ExImage* cover = new ExImage();
+
+	mutexCache.Lock();
+	bool isCached = coverCache.Load(fileCover, sz.cx, sz.cy, *cover);
+	mutexCache.Unlock();
+
+	if (!isCached)
+	{
+		bool isCover = isEmbedded ? coverLoader.LoadCoverEmbedded(fileCover) : coverLoader.LoadCoverFile(fileCover);
+
+		if (!isCover || cover->ThumbnailFromSource(coverLoader.GetImage(), sz.cx, sz.cy))
+		{
+			mutexCache.Lock();
+			coverCache.Save(fileCover, sz.cx, sz.cy, isCover ? cover : nullptr);
+			mutexCache.Unlock();
 		}
+	}
 
-		mutexThread.Unlock();
+	if (!cover->IsValid())
+	{
+		delete cover;
+		return false;
 	}
+
+	node->cover = CoverMemory::Instance().Add(cover);
+
+	::InvalidateRect(wndParent, NULL, FALSE);
+
+	return true;
 }
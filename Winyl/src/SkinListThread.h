@@ -20,7 +20,15 @@
 #include "Threading.h"
 #include "SkinListNode.h"
 #include "CoverLoader.h"
-#include <deque>
+#include "CoverCache.h"
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+// Loads covers for the list in a few worker threads.
+// The list adds covers of nodes when it draws them (and a screen ahead in the scroll direction),
+// and sets the visible area on each paint. Workers take the cover nearest to the visible area first,
+// and covers that are far away from the visible area are dropped (they are added again when drawn).
 
 class SkinListThread
 {
@@ -29,26 +37,55 @@ public:
 	SkinListThread();
 	virtual ~SkinListThread();
 
-	std::deque<ListNodeUnsafe> coverNodes;
-
 	HWND wndParent = NULL;
 
 	std::atomic<bool> stopThread = false;
 
-	Threading::Thread threadWorker;
+	std::vector<std::unique_ptr<Threading::Thread>> threadWorkers;
 	Threading::Event eventThread;
 	Threading::Mutex mutexThread;
+
+	Threading::Mutex mutexCache;
+	CoverCache coverCache;
+	std::wstring coverCacheFile;
+	bool isCoverCacheTried = false; // Do not try to open the cache for each cover if it fails
 	
-	void AddCover(ListNodeUnsafe node);
+	// pos is the position of the node in the list (not in the window)
+	void AddCover(ListNodeUnsafe node, int pos);
 	void DrawCover();
 	void ReInit();
 
+	// Call before drawing covers, top and bottom is the visible area in the list
+	void SetViewport(int top, int bottom);
+	// 1 scroll down, -1 scroll up, 0 not scrolled yet
+	inline int GetDirection() {return viewDirection;}
+
 	void NewThread();
 	void DeleteThread();
 
 	inline void SetParentWnd(HWND parent) {wndParent = parent;}
+	void SetCoverCacheFile(const std::wstring& file);
 
 	void RunThread();
+
+private:
+	static const int workersMax = 4;
+
+	// Pending covers ordered by the position in the list (the nearest to the visible area is found
+	// without going through all of them) and by the node (a node has only one pending cover)
+	typedef std::multimap<int, ListNodeUnsafe> CoverQueue;
+	CoverQueue coverQueue;
+	std::unordered_map<ListNodeUnsafe, CoverQueue::iterator> coverJobs;
+
+	int viewTop = 0;
+	int viewBottom = 0;
+	int viewDirection = 0;
+
+	int JobDistance(int pos);
+	void DropJob(CoverQueue::iterator job);
+	void LoadCover(ListNodeUnsafe node);
+	// Return false if the file doesn't have a cover
+	bool LoadCoverFile(ListNodeUnsafe node, CoverLoader& coverLoader, const std::wstring& fileCover, bool isEmbedded);
 };
 
 
@@ -93,6 +93,20 @@ bool SkinSlider::LoadSkin(const std::wstring& file, ZipFile* zipFile)
 				}
 			}
 
+			XmlNode xmlWaveform = xmlMain.FirstChild("Waveform");
+			if (xmlWaveform)
+			{
+				isWaveform = true;
+
+				const char* strColor = xmlWaveform.AttributeRaw("Color");
+				if (strColor)
+					waveColor[0] = 0xFF000000 | strtoul(strColor, 0, 16); // RGB
+
+				const char* strColor2 = xmlWaveform.AttributeRaw("Color2");
+				if (strColor2)
+					waveColor[1] = 0xFF000000 | strtoul(strColor2, 0, 16);
+			}
+
 			XmlNode xmlButton = xmlMain.FirstChild("Button");
 			
 			if (xmlButton)
@@ -133,12 +147,17 @@ bool SkinSlider::LoadSkin(const std::wstring& file, ZipFile* zipFile)
 
 void SkinSlider::SetRect(CRect& rcDraw)
 {
+	bool isResize = (rcDraw.Width() != rcRect.Width() || rcDraw.Height() != rcRect.Height());
+
 	rcRect = rcDraw;
 
 	if (!isButton)
 		position = (percent * rcRect.Width() + 100000 / 2) / 100000;
 	else
 		position = (percent * (rcRect.Width() - imButton[0].Width()) + 100000 / 2) / 100000;
+
+	if (isResize && !waveBuckets.empty())
+		RenderWaveform();
 }
 
 void SkinSlider::Draw(HDC dc, bool isAlpha)
@@ -147,7 +166,12 @@ void SkinSlider::Draw(HDC dc, bool isAlpha)
 	int posButton = pos;
 	pos += imButton[0].Width() / 2;
 
-	if (isBackground)
+	if (imWave[0].IsValid())
+	{
+		imWave[1].Crop(dc, rcRect.left, rcRect.top, pos, rcRect.Height());
+		imWave[0].Crop2(dc, rcRect.left + pos, rcRect.top, CRect(pos, 0, rcRect.Width(), rcRect.Height()));
+	}
+	else if (isBackground)
 	{
 		//imFill[0].Draw(dc, rcRect);
 		imFill[1].Crop(dc, rcRect.left, rcRect.top, pos, rcRect.Height());
@@ -345,4 +369,75 @@ int SkinSlider::CalcPercent(const CPoint& point)
 	CalcPositionByPoint(point, outPosition, outPercent);
 
 	return outPercent;
+}
+
+void SkinSlider::SetWaveform(const Waveform* waveform)
+{
+	if (!isWaveform)
+		return;
+
+	if (waveform)
+		waveBuckets = waveform->GetBuckets();
+	else
+		waveBuckets.clear();
+
+	RenderWaveform();
+}
+
+void SkinSlider::RenderWaveform()
+{
+	imWave[0].Clear();
+	imWave[1].Clear();
+
+	int width = rcRect.Width();
+	int height = rcRect.Height();
+
+	if (waveBuckets.empty() || width <= 0 || height <= 0)
+		return;
+
+	// The same range as the thumb position
+	int offset = isButton ? imButton[0].Width() / 2 : 0;
+	int range = isButton ? width - imButton[0].Width() : width;
+	if (range <= 0)
+		return;
+
+	std::size_t count = waveBuckets.size();
+	float half = (height - 1) / 2.0f;
+
+	std::vector<unsigned int> pixels[2];
+	pixels[0].resize((std::size_t)width * height, 0);
+	pixels[1].resize((std::size_t)width * height, 0);
+
+	for (int x = 0; x < range; ++x)
+	{
+		// Several buckets in one column or one bucket in several columns
+		std::size_t first = (std::size_t)x * count / range;
+		std::size_t last = std::max(first + 1, (std::size_t)(x + 1) * count / range);
+
+		int min = 0, max = 0, rms = 0;
+		for (std::size_t i = first; i < last; ++i)
+		{
+			min = std::min(min, (int)waveBuckets[i].min);
+			max = std::max(max, (int)waveBuckets[i].max);
+			rms = std::max(rms, (int)waveBuckets[i].rms);
+		}
+
+		int peakTop = (int)(half - max * half / 127 + 0.5f);
+		int peakBottom = (int)(half - min * half / 127 + 0.5f);
+		int rmsTop = std::max(peakTop, (int)(half - rms * half / 255 + 0.5f));
+		int rmsBottom = std::min(peakBottom, (int)(half + rms * half / 255 + 0.5f));
+
+		for (int k = 0; k < 2; ++k)
+		{
+			unsigned int color = waveColor[k];
+			unsigned int colorPeak = (color >> 1) & 0x7F7F7F7F; // Half transparent, premultiplied
+
+			unsigned int* column = pixels[k].data() + offset + x;
+			for (int y = peakTop; y <= peakBottom; ++y)
+				column[y * width] = (y >= rmsTop && y <= rmsBottom) ? color : colorPeak;
+		}
+	}
+
+	imWave[0].LoadFromBits((const char*)pixels[0].data(), width, height);
+	imWave[1].LoadFromBits((const char*)pixels[1].data(), width, height);
 }
\ No newline at end of file
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "SkinElement.h"
+#include "Waveform.h"
 
 class SkinSlider : public SkinElement
 {
@@ -62,8 +63,19 @@ public:
 	int GetThumbPosition();
 	int CalcPercent(const CPoint& point);
 
+	// Waveform is drawn instead of the fill if the skin has Waveform node, nullptr to remove
+	void SetWaveform(const Waveform* waveform);
+	inline bool IsWaveform() {return isWaveform;}
+
 private:
 	void CalcPositionByPoint(CPoint point, int& outPosition, int& outPercent);
+
+	bool isWaveform = false;
+	unsigned int waveColor[2] = {0xFF808080, 0xFFFFFFFF}; // Opaque BGRA, the same as File and File2 of the fill
+	std::vector<Waveform::Bucket> waveBuckets;
+	ExImage imWave[2];
+
+	void RenderWaveform();
 };
 
 
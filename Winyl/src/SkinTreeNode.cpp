@@ -17,6 +17,20 @@
 
 #include "stdafx.h"
 #include "SkinTreeNode.h"
+#include "NodePool.h"
+
+static NodePool<SkinTreeNode> nodePool;
+
+void* SkinTreeNode::operator new(std::size_t size)
+{
+	assert(size == sizeof(SkinTreeNode));
+	return nodePool.Allocate();
+}
+
+void SkinTreeNode::operator delete(void* ptr)
+{
+	nodePool.Free(ptr);
+}
 
 SkinTreeNode::SkinTreeNode()
 {
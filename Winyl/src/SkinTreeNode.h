@@ -25,6 +25,8 @@ class SkinTreeNode final
 public:
 	SkinTreeNode();
 	~SkinTreeNode();
+	static void* operator new(std::size_t size); // Nodes are allocated from the pool (see NodePool.h)
+	static void operator delete(void* ptr);
 	friend class SkinTree;
 	friend class SkinTreeElement;
 	friend class SkinTreeBack;
@@ -123,18 +123,18 @@ void SkinVis::OnSize(UINT nType, int cx, int cy)
 
 
 // Return true if the animation is completed.
-// If fft == nullptr then complete the animation,
+// If spectrum == nullptr then complete the animation,
 // If previous and isPause == true then complete the animation of peaks only.
-bool SkinVis::SetFFT(float* fft, bool isPause)
+bool SkinVis::SetSpectrum(const float* spectrum, bool isPause)
 {
 	if (!::IsWindowVisible(thisWnd))
-		return (fft == nullptr);
+		return (spectrum == nullptr);
 
 	int sizeBands = (int)bands.size();
 	int sizeRects = (int)rects.size();
 	
 	if (!(sizeBands > 0 && sizeRects > 0))
-		return (fft == nullptr);
+		return (spectrum == nullptr);
 
 	bool isStop = true;
 
@@ -166,38 +166,24 @@ bool SkinVis::SetFFT(float* fft, bool isPause)
 		}
 	}
 
-	if (fft == nullptr)
+	if (spectrum == nullptr)
 	{
 		::InvalidateRect(thisWnd, NULL, TRUE);
 		return isStop;
 	}
 
-	int curFFT = 50; // Start position is 50 the first values isn't good
-	int stepFFT = 1024 / sizeBands / 5; // Step, reduced by 5 times to collect only first values in general
-	int maxFFT = 1000; // End position is not 1024 because the last values are almost invisible
-
-	// Step cannot be less than 1
-	stepFFT = std::max(1, stepFFT);
-
 	for (int i = 0; i < sizeBands; ++i)
 	{
-		if (curFFT + stepFFT > maxFFT)
-			break;
-
-		int num = 0;
-		int sum = 0;
+		// Spectrum bands are already log-frequency and scaled, just reduce them to the bands of the skin
+		int first = i * Spectrum::BandCount / sizeBands;
+		int last = std::max(first + 1, (i + 1) * Spectrum::BandCount / sizeBands);
 
 		// Calculate the arithmetic mean, so Bands will be more smooth to each other
-		for (int j = curFFT; j < curFFT + stepFFT; j += 1)
-		{
-			++num;
-			sum += (int)(sqrt(fft[j]) * 5 * sizeRects); // (sqrt to make low values more visible)
-		}
-
-		num = sum / num;
+		float sum = 0.0f;
+		for (int j = first; j < last; ++j)
+			sum += spectrum[j];
 
-		// Move FFT
-		curFFT += stepFFT;
+		int num = (int)(sum / (last - first) * sizeRects);
 
 		// Adjust
 		if (num > sizeRects - 1)
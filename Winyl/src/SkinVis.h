@@ -22,6 +22,7 @@
 #include "XmlFile.h"
 #include "ExImage.h"
 #include "UTF.h"
+#include "Spectrum.h"
 
 class SkinVis : public WindowEx
 {
@@ -34,7 +35,7 @@ public:
 
 	bool NewWindow(HWND parent);
 	bool LoadSkin(const std::wstring& file, ZipFile* zipFile);
-	bool SetFFT(float* fft, bool isPause);
+	bool SetSpectrum(const float* spectrum, bool isPause); // Spectrum::BandCount values
 	
 private:
 	void PrepareSkin();
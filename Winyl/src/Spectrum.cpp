@@ -0,0 +1,441 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "Spectrum.h"
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define SPECTRUM_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	const double minFrequency = 40.0;
+	const double maxFrequency = 16000.0;
+	const float floorDb = -70.0f; // Full scale sine is 0 dB
+	const float ceilDb = -10.0f;
+	const long long activeTime = 5000000; // Do not analyze if the spectrum is not read for 5 sec
+	const long long staleTime = 200000; // Show nothing if the latest frame is older (stopped)
+	const double pi = 3.14159265358979323846;
+}
+
+Spectrum::Spectrum()
+{
+	for (int i = 0; i < frameCount; ++i)
+	{
+		frames[i].sequence.store(0);
+		frames[i].due.store(0);
+		std::fill(frames[i].bands, frames[i].bands + BandCount, 0.0f);
+	}
+	frameWrite.store(0);
+
+	readTime.store(0);
+	pauseTime.store(0);
+	pauseTotal.store(0);
+
+	// Periodic Hann window, sum of the window is fftSize / 2
+	for (int i = 0; i < fftSize; ++i)
+		window[i] = (float)(0.5 - 0.5 * std::cos(2.0 * pi * i / fftSize));
+
+	int bits = 0;
+	while ((1 << bits) < fftHalf)
+		++bits;
+
+	for (int i = 0; i < fftHalf; ++i)
+	{
+		int reverse = 0;
+		for (int j = 0; j < bits; ++j)
+		{
+			if (i & (1 << j))
+				reverse |= 1 << (bits - 1 - j);
+		}
+		bitReverse[i] = (unsigned short)reverse;
+	}
+
+	for (int half = 1; half < fftHalf; half <<= 1)
+	{
+		for (int j = 0; j < half; ++j)
+		{
+			twiddleRe[half - 1 + j] = (float)std::cos(pi * j / half);
+			twiddleIm[half - 1 + j] = (float)-std::sin(pi * j / half);
+		}
+	}
+	twiddleRe[fftHalf - 1] = twiddleIm[fftHalf - 1] = 0.0f; // Not used
+
+	for (int k = 0; k < fftHalf; ++k)
+	{
+		splitRe[k] = (float)std::cos(2.0 * pi * k / fftSize);
+		splitIm[k] = (float)-std::sin(2.0 * pi * k / fftSize);
+	}
+
+	SetFormat(44100, 2, 0.0);
+}
+
+Spectrum::~Spectrum()
+{
+
+}
+
+long long Spectrum::Clock()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+long long Spectrum::Now()
+{
+	long long pause = pauseTime.load(std::memory_order_acquire);
+	return (pause ? pause : Clock()) - pauseTotal.load(std::memory_order_acquire);
+}
+
+void Spectrum::SetPause(bool isPause)
+{
+	long long pause = pauseTime.load();
+
+	if (isPause && !pause)
+		pauseTime.store(Clock());
+	else if (!isPause && pause)
+	{
+		pauseTotal.fetch_add(Clock() - pause);
+		pauseTime.store(0);
+	}
+}
+
+void Spectrum::SetFormat(int rate, int chans, double outputLatency)
+{
+	sampleRate = std::max(rate, 1);
+	channels = std::max(chans, 1);
+	latency = (long long)(outputLatency * 1000000.0);
+
+	hop = std::max(256, sampleRate / 100);
+	hopFill = 0;
+	playEnd = 0;
+
+	double binWidth = (double)sampleRate / fftSize;
+	double bandMin = minFrequency;
+	double bandMax = std::min(maxFrequency, sampleRate * 0.45);
+	double ratio = bandMax / bandMin;
+
+	for (int i = 0; i < BandCount; ++i)
+	{
+		double from = bandMin * std::pow(ratio, (double)i / BandCount) / binWidth;
+		double to = bandMin * std::pow(ratio, (double)(i + 1) / BandCount) / binWidth;
+
+		Bins& bins = bandBins[i];
+
+		// Low bands are narrower than a bin
+		if (to - from < 1.0)
+		{
+			double center = (from + to) / 2;
+			bins.first = std::max(1, std::min((int)center, fftHalf - 2));
+			bins.last = bins.first - 1;
+			bins.frac = (float)std::max(0.0, std::min(center - bins.first, 1.0));
+		}
+		else
+		{
+			bins.first = std::max(1, std::min((int)std::ceil(from), fftHalf - 1));
+			bins.last = std::max(bins.first, std::min((int)std::floor(to), fftHalf - 1));
+			bins.frac = 0.0f;
+		}
+	}
+}
+
+void Spectrum::Process(const float* samples, std::size_t frames)
+{
+	long long now = Now();
+	if (playEnd < now)
+		playEnd = now;
+
+	bool isActive = (Clock() - readTime.load(std::memory_order_relaxed) < activeTime);
+
+	float scale = 1.0f / channels;
+
+	for (std::size_t i = 0; i < frames; ++i)
+	{
+		float mono = 0.0f;
+		for (int c = 0; c < channels; ++c)
+			mono += samples[c];
+		samples += channels;
+
+		history[historyPos++ & (fftSize - 1)] = mono * scale;
+
+		if (++hopFill >= hop)
+		{
+			hopFill = 0;
+
+			if (isActive)
+			{
+				long long due = playEnd + (long long)(i + 1) * 1000000 / sampleRate;
+				Analyze(std::min(due, now + latency));
+			}
+		}
+	}
+
+	// The output thread takes data as it is played, so it is enough to not let the time drift
+	playEnd += (long long)frames * 1000000 / sampleRate;
+	if (playEnd > now + latency)
+		playEnd = now + latency;
+}
+
+void Spectrum::Analyze(long long due)
+{
+	// Pack even samples to real and odd samples to imaginary parts in bit-reversed order
+	for (int i = 0; i < fftHalf; ++i)
+	{
+		unsigned pos = historyPos + i * 2;
+		re[bitReverse[i]] = history[pos & (fftSize - 1)] * window[i * 2];
+		im[bitReverse[i]] = history[(pos + 1) & (fftSize - 1)] * window[i * 2 + 1];
+	}
+
+#ifdef SPECTRUM_SSE
+	TransformSSE();
+	CalcPowerSSE();
+#else
+	Transform();
+	CalcPower();
+#endif
+
+	unsigned index = frameWrite.load(std::memory_order_relaxed);
+	Frame& frame = frames[index % frameCount];
+
+	unsigned sequence = frame.sequence.load(std::memory_order_relaxed);
+	frame.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	frame.due.store(due, std::memory_order_relaxed);
+
+	for (int i = 0; i < BandCount; ++i)
+	{
+		const Bins& bins = bandBins[i];
+
+		float value = 0.0f;
+		if (bins.last < bins.first)
+			value = power[bins.first] + (power[bins.first + 1] - power[bins.first]) * bins.frac;
+		else
+		{
+			for (int j = bins.first; j <= bins.last; ++j)
+				value = std::max(value, power[j]);
+		}
+
+		float db = 10.0f * std::log10(value + 1e-12f);
+		frame.bands[i] = std::max(0.0f, std::min((db - floorDb) / (ceilDb - floorDb), 1.0f));
+	}
+
+	frame.sequence.store(sequence + 2, std::memory_order_release);
+	frameWrite.store(index + 1, std::memory_order_release);
+}
+
+void Spectrum::Read(float* outBands)
+{
+	readTime.store(Clock(), std::memory_order_relaxed);
+
+	long long now = Now();
+	unsigned last = frameWrite.load(std::memory_order_acquire);
+
+	// From the newest frame to the oldest, the first frame that is due is shown
+	for (unsigned i = 0; i < (unsigned)frameCount && i < last; ++i)
+	{
+		const Frame& frame = frames[(last - 1 - i) % frameCount];
+
+		unsigned sequence = frame.sequence.load(std::memory_order_acquire);
+		if (sequence & 1)
+			continue;
+
+		long long due = frame.due.load(std::memory_order_relaxed);
+		if (due > now)
+			continue;
+
+		std::memcpy(outBands, frame.bands, sizeof(frame.bands));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (frame.sequence.load(std::memory_order_relaxed) != sequence)
+			continue; // Overwritten while copying
+
+		if (now - due < staleTime)
+			return;
+		break;
+	}
+
+	std::fill(outBands, outBands + BandCount, 0.0f);
+}
+
+void Spectrum::Transform()
+{
+	// Radix-2 decimation in time, the input is already in bit-reversed order
+	for (int half = 1; half < fftHalf; half <<= 1)
+	{
+		const float* wr = twiddleRe + half - 1;
+		const float* wi = twiddleIm + half - 1;
+
+		for (int i = 0; i < fftHalf; i += half * 2)
+		{
+			float* ar = re + i;
+			float* ai = im + i;
+			float* br = ar + half;
+			float* bi = ai + half;
+
+			for (int j = 0; j < half; ++j)
+			{
+				float tr = wr[j] * br[j] - wi[j] * bi[j];
+				float ti = wr[j] * bi[j] + wi[j] * br[j];
+
+				br[j] = ar[j] - tr;
+				bi[j] = ai[j] - ti;
+				ar[j] += tr;
+				ai[j] += ti;
+			}
+		}
+	}
+}
+
+void Spectrum::TransformSSE()
+{
+#ifdef SPECTRUM_SSE
+	// The first two stages are done in scalar, then 4 butterflies at once
+	for (int half = 1; half < fftHalf; half <<= 1)
+	{
+		const float* wr = twiddleRe + half - 1;
+		const float* wi = twiddleIm + half - 1;
+
+		for (int i = 0; i < fftHalf; i += half * 2)
+		{
+			float* ar = re + i;
+			float* ai = im + i;
+			float* br = ar + half;
+			float* bi = ai + half;
+
+			if (half < 4)
+			{
+				for (int j = 0; j < half; ++j)
+				{
+					float tr = wr[j] * br[j] - wi[j] * bi[j];
+					float ti = wr[j] * bi[j] + wi[j] * br[j];
+
+					br[j] = ar[j] - tr;
+					bi[j] = ai[j] - ti;
+					ar[j] += tr;
+					ai[j] += ti;
+				}
+				continue;
+			}
+
+			for (int j = 0; j < half; j += 4)
+			{
+				__m128 xwr = _mm_loadu_ps(wr + j);
+				__m128 xwi = _mm_loadu_ps(wi + j);
+				__m128 xbr = _mm_loadu_ps(br + j);
+				__m128 xbi = _mm_loadu_ps(bi + j);
+				__m128 xar = _mm_loadu_ps(ar + j);
+				__m128 xai = _mm_loadu_ps(ai + j);
+
+				__m128 tr = _mm_sub_ps(_mm_mul_ps(xwr, xbr), _mm_mul_ps(xwi, xbi));
+				__m128 ti = _mm_add_ps(_mm_mul_ps(xwr, xbi), _mm_mul_ps(xwi, xbr));
+
+				_mm_storeu_ps(br + j, _mm_sub_ps(xar, tr));
+				_mm_storeu_ps(bi + j, _mm_sub_ps(xai, ti));
+				_mm_storeu_ps(ar + j, _mm_add_ps(xar, tr));
+				_mm_storeu_ps(ai + j, _mm_add_ps(xai, ti));
+			}
+		}
+	}
+#else
+	Transform();
+#endif
+}
+
+// Split the complex FFT of even/odd samples to the spectrum of real signal:
+// X[k] = (Z[k] + conj(Z[N-k])) / 2 + W^k * (Z[k] - conj(Z[N-k])) / 2i
+// The values are doubled here and the scale is applied to the power,
+// so full scale sine is 1.0 with Hann window.
+void Spectrum::CalcPower()
+{
+	const float scale = 4.0f / ((float)fftSize * fftSize);
+
+	for (int k = 0; k < fftHalf; ++k)
+	{
+		int n = (fftHalf - k) & (fftHalf - 1);
+
+		float er = re[k] + re[n];
+		float ei = im[k] - im[n];
+		float orr = im[k] + im[n];
+		float oi = re[n] - re[k];
+
+		float xr = er + splitRe[k] * orr - splitIm[k] * oi;
+		float xi = ei + splitRe[k] * oi + splitIm[k] * orr;
+
+		power[k] = (xr * xr + xi * xi) * scale;
+	}
+}
+
+void Spectrum::CalcPowerSSE()
+{
+#ifdef SPECTRUM_SSE
+	const float scale = 4.0f / ((float)fftSize * fftSize);
+	const __m128 xscale = _mm_set1_ps(scale);
+
+	// DC
+	power[0] = (re[0] + im[0]) * (re[0] + im[0]) * 4.0f * scale;
+
+	int k = 1;
+	for (; k + 4 <= fftHalf; k += 4)
+	{
+		// Mirrored bins N-k...N-k-3 are loaded from N-k-3 and reversed
+		__m128 ar = _mm_loadu_ps(re + k);
+		__m128 ai = _mm_loadu_ps(im + k);
+		__m128 cr = _mm_loadu_ps(re + fftHalf - k - 3);
+		__m128 ci = _mm_loadu_ps(im + fftHalf - k - 3);
+		cr = _mm_shuffle_ps(cr, cr, _MM_SHUFFLE(0, 1, 2, 3));
+		ci = _mm_shuffle_ps(ci, ci, _MM_SHUFFLE(0, 1, 2, 3));
+
+		__m128 er = _mm_add_ps(ar, cr);
+		__m128 ei = _mm_sub_ps(ai, ci);
+		__m128 orr = _mm_add_ps(ai, ci);
+		__m128 oi = _mm_sub_ps(cr, ar);
+
+		__m128 wr = _mm_loadu_ps(splitRe + k);
+		__m128 wi = _mm_loadu_ps(splitIm + k);
+
+		__m128 xr = _mm_add_ps(er, _mm_sub_ps(_mm_mul_ps(wr, orr), _mm_mul_ps(wi, oi)));
+		__m128 xi = _mm_add_ps(ei, _mm_add_ps(_mm_mul_ps(wr, oi), _mm_mul_ps(wi, orr)));
+
+		_mm_storeu_ps(power + k, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(xr, xr), _mm_mul_ps(xi, xi)), xscale));
+	}
+
+	for (; k < fftHalf; ++k)
+	{
+		int n = fftHalf - k;
+
+		float er = re[k] + re[n];
+		float ei = im[k] - im[n];
+		float orr = im[k] + im[n];
+		float oi = re[n] - re[k];
+
+		float xr = er + splitRe[k] * orr - splitIm[k] * oi;
+		float xi = ei + splitRe[k] * oi + splitIm[k] * orr;
+
+		power[k] = (xr * xr + xi * xi) * scale;
+	}
+#else
+	CalcPower();
+#endif
+}
@@ -0,0 +1,114 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Spectrum analyzer for visualizers (see SkinVis).
+// Process is called in the audio thread from DSP of the output channel, samples are mixed to mono
+// and every hop (10 ms) a real FFT with Hann window is done (SSE butterflies) and the bins are
+// reduced to log-frequency bands. Bands are published with the time when they will be heard,
+// the visualizer takes the latest frame that is due in Read, without locks and without calls to BASS.
+// A small ring of frames is used instead of a double buffer because the output buffer of DirectSound
+// is long (1 sec) and the spectrum must be delayed by the same time.
+
+class Spectrum
+{
+
+public:
+	static const int BandCount = 256;
+
+	Spectrum();
+	virtual ~Spectrum();
+	Spectrum(const Spectrum&) = delete;
+	Spectrum& operator=(const Spectrum&) = delete;
+
+	// Call before Process (when the DSP is not attached), latency is the output buffer size in seconds
+	void SetFormat(int sampleRate, int channels, double latency);
+	inline int GetChannels() {return channels;}
+
+	// The clock of the spectrum stops on pause so buffered data is shown on time after resume
+	void SetPause(bool isPause);
+
+	// Audio thread
+	void Process(const float* samples, std::size_t frames);
+
+	// Any thread (one reader), values from 0.0 to 1.0, all zeros if nothing is playing
+	void Read(float* outBands);
+
+private:
+	static const int fftSize = 2048;
+	static const int fftHalf = fftSize / 2; // The real FFT is done as a complex FFT of half size
+	static const int frameCount = 128; // Must be power of 2 and cover the DirectSound buffer
+
+	struct Frame
+	{
+		std::atomic<unsigned> sequence; // Odd while the frame is written
+		std::atomic<long long> due;
+		float bands[BandCount];
+	};
+
+	struct Bins
+	{
+		int first = 1;
+		int last = 1; // last < first then interpolate between first and first + 1
+		float frac = 0.0f;
+	};
+
+	Frame frames[frameCount];
+	std::atomic<unsigned> frameWrite;
+
+	std::atomic<long long> readTime;
+	std::atomic<long long> pauseTime;
+	std::atomic<long long> pauseTotal;
+
+	// Tables
+	float window[fftSize];
+	unsigned short bitReverse[fftHalf];
+	float twiddleRe[fftHalf]; // Twiddles of all stages, the stage with half size N starts at N - 1
+	float twiddleIm[fftHalf];
+	float splitRe[fftHalf]; // Twiddles to split the complex FFT to the real one
+	float splitIm[fftHalf];
+	Bins bandBins[BandCount];
+
+	// Audio thread
+	float history[fftSize] = {};
+	unsigned historyPos = 0;
+	int hopFill = 0;
+	long long playEnd = 0; // When the buffered data ends
+
+	float re[fftHalf];
+	float im[fftHalf];
+	float power[fftHalf];
+
+	int sampleRate = 44100;
+	int channels = 2;
+	int hop = 441;
+	long long latency = 0;
+
+	static long long Clock();
+	long long Now();
+
+	void Analyze(long long due);
+	void Transform();
+	void TransformSSE();
+	void CalcPower();
+	void CalcPowerSSE();
+};
@@ -0,0 +1,159 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Threading.h"
+#include "UTF.h"
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <cassert>
+
+// Interned UTF-8 strings for labels and folders of the list (see SkinListNode::GetLabel/SetLabel/GetFile).
+// Album, artist, genre, year, folder etc. repeat for many tracks, so each value is stored only once
+// and nodes hold 32-bit handles. Strings are stored in UTF-8 as they come from the database
+// and converted to UTF-16 only when they are read (drawn), so filling a list doesn't convert all labels.
+// Strings are reference counted and the handle is reused when no node uses the string anymore
+// (labels of the radio change all the time for example).
+// Handle 0 is always an empty string and it is not counted.
+// The pool is used from the main thread and from the search thread (DBase::FillListSearch*),
+// so Get returns a copy: the entry can be reused by another thread right after the lock.
+
+class StringPool final
+{
+public:
+	using Handle = unsigned int;
+
+	StringPool()
+	{
+		entries.emplace_back();
+	}
+	StringPool(const StringPool&) = delete;
+	StringPool& operator=(const StringPool&) = delete;
+
+	// UTF-8, the string is looked up without a copy so adding an existing string doesn't allocate
+	Handle Add(const char* str, std::size_t size)
+	{
+		if (str == nullptr || size == 0)
+			return 0;
+
+		LockGuard lock(mutex);
+
+		Handle handle = 0;
+
+		auto find = index.find(Key{str, size});
+		if (find != index.end())
+		{
+			handle = find->second;
+			++entries[handle].refCount;
+		}
+		else
+		{
+			if (!freeHandles.empty())
+			{
+				handle = freeHandles.back();
+				freeHandles.pop_back();
+				entries[handle].str.assign(str, size);
+			}
+			else
+			{
+				handle = (Handle)entries.size();
+				entries.emplace_back();
+				entries.back().str.assign(str, size);
+			}
+
+			// The key points to the string in the deque, entries are never moved
+			const std::string& entry = entries[handle].str;
+			entries[handle].refCount = 1;
+			index.emplace(Key{entry.data(), entry.size()}, handle);
+		}
+
+		return handle;
+	}
+	Handle Add(const char* str) {return str ? Add(str, std::strlen(str)) : 0;}
+	Handle Add(const std::string& str) {return Add(str.data(), str.size());}
+	Handle Add(const std::wstring& str) {return str.empty() ? 0 : Add(UTF::UTF8S(str));}
+
+	void Release(Handle handle)
+	{
+		if (handle == 0)
+			return;
+
+		LockGuard lock(mutex);
+
+		assert(handle < entries.size() && entries[handle].refCount > 0);
+
+		if (--entries[handle].refCount == 0)
+		{
+			const std::string& entry = entries[handle].str;
+			index.erase(Key{entry.data(), entry.size()});
+			entries[handle].str.clear();
+			entries[handle].str.shrink_to_fit();
+			freeHandles.push_back(handle);
+		}
+	}
+
+	// UTF-16 copy of the string
+	std::wstring Get(Handle handle)
+	{
+		if (handle == 0)
+			return std::wstring();
+
+		LockGuard lock(mutex);
+		assert(handle < entries.size());
+		return UTF::UTF16S(entries[handle].str);
+	}
+
+private:
+	struct Entry
+	{
+		std::string str;
+		unsigned refCount = 0;
+	};
+
+	struct Key
+	{
+		const char* data;
+		std::size_t size;
+	};
+	struct HashKey
+	{
+		std::size_t operator()(const Key& key) const
+		{
+			// FNV-1a
+			std::size_t hash = sizeof(std::size_t) == 8 ? (std::size_t)14695981039346656037ULL : 2166136261U;
+			const std::size_t prime = sizeof(std::size_t) == 8 ? (std::size_t)1099511628211ULL : 16777619U;
+			for (std::size_t i = 0; i < key.size; ++i)
+				hash = (hash ^ (unsigned char)key.data[i]) * prime;
+			return hash;
+		}
+	};
+	struct EqualKey
+	{
+		bool operator()(const Key& key1, const Key& key2) const
+		{
+			return key1.size == key2.size && std::memcmp(key1.data, key2.data, key1.size) == 0;
+		}
+	};
+
+	Threading::Mutex mutex;
+	std::deque<Entry> entries;
+	std::vector<Handle> freeHandles;
+	std::unordered_map<Key, Handle, HashKey, EqualKey> index;
+};
@@ -425,7 +425,7 @@ void TagLibCover::ReadCoverFromMP4Tags(TagLib::MP4::Tag* tag)
 
 void TagLibCover::CreateCoverImage(const char* data, int size)
 {
-	outImage->LoadBuffer(data, size);
+	outImage->LoadBufferCopy(data, size);
 }
 
 bool TagLibCover::IsCoverJPG(const std::vector<char>& data)
@@ -0,0 +1,322 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../../DBase.h"
+#include <vector>
+#include <algorithm>
+
+// Library database benchmarks on a temporary database in the temp folder. They use SQLRequest and
+// the collations of the player (DBase::CreateFunctions) with the same SQL as DBase on a library
+// of generated tracks, only the columns that the SQL needs are in the table.
+// BenchSortKeys compares the requests of the trees and lists sorted by MYCASE collation and by sort keys.
+
+namespace
+{
+
+typedef DBase::SQLFile SQLFile;
+typedef DBase::SQLRequest SQLRequest;
+
+const int benchTracks = 100000;
+
+class Timer
+{
+public:
+	Timer() {::QueryPerformanceFrequency(&freq); ::QueryPerformanceCounter(&start);}
+	double Seconds()
+	{
+		LARGE_INTEGER end;
+		::QueryPerformanceCounter(&end);
+		return (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+	}
+
+private:
+	LARGE_INTEGER freq, start;
+};
+
+struct Track
+{
+	std::wstring path;
+	std::wstring file;
+	int fileHash = 0;
+};
+
+int FileHash(const std::wstring& file)
+{
+	// Any hash is fine here, it is only the index for the lookup (see Progress::GetFileHash)
+	unsigned hash = 2166136261u;
+	for (wchar_t c : file)
+		hash = (hash ^ (unsigned)::towlower(c)) * 16777619u;
+	return (int)hash;
+}
+
+std::wstring TempFile(const wchar_t* name)
+{
+	wchar_t tempPath[MAX_PATH] = {};
+	::GetTempPathW(MAX_PATH, tempPath);
+	return std::wstring(tempPath) + name;
+}
+
+bool CreateLibrary(SQLFile& db, const std::wstring& file, std::vector<Track>& tracks)
+{
+	::DeleteFileW(file.c_str());
+	if (!db.OpenCreate(file))
+		return false;
+
+	DBase::CreateFunctions(db);
+
+	SQLRequest::Exec(db, "PRAGMA cache_size = 10000;");
+	SQLRequest::Exec(db,
+		"CREATE TABLE library (id INTEGER PRIMARY KEY,cue INTEGER,filehash INTEGER,path TEXT,file TEXT,"
+		"filesize INTEGER,modified INTEGER,track TEXT,disc TEXT,title TEXT,album TEXT,artist TEXT,albumartist TEXT,"
+		"year TEXT,deleted INTEGER,titlekey BLOB,albumkey BLOB,artistkey BLOB,albumartistkey BLOB);");
+	SQLRequest::Exec(db, "CREATE INDEX filehash_index ON library(filehash);");
+
+	SQLRequest::Exec(db, "BEGIN;");
+
+	SQLRequest sqlInsert(db,
+		"INSERT INTO library (filehash,path,file,filesize,modified,track,disc,title,album,artist,year)"
+		" VALUES (?,?,?,?,?,?,?,?,?,?,?);");
+
+	// Artists with 5 albums of 10 tracks, names with different case and letters outside of ASCII
+	const wchar_t* syllables[] = {L"ka", L"Mo", L"r\u00E4", L"Ti", L"lu", L"S\u00E9", L"no", L"Vi", L"de", L"\u00D8R", L"ba", L"zi"};
+	const int countSyllables = sizeof(syllables) / sizeof(syllables[0]);
+	unsigned random = 1;
+
+	tracks.resize(benchTracks);
+	for (int i = 0; i < benchTracks; ++i)
+	{
+		int artist = i / 50;
+		int album = i / 10;
+		int track = i % 10 + 1;
+
+		std::wstring artistName, albumName, title;
+		for (int j = 0, a = artist; j < 3; ++j, a /= countSyllables)
+			artistName += syllables[a % countSyllables];
+		random = random * 1103515245 + 12345;
+		albumName = syllables[(random >> 16) % countSyllables] + std::wstring(L" ") + std::to_wstring(album);
+		title = syllables[(random >> 8) % countSyllables] + std::wstring(L" title ") + std::to_wstring(i);
+
+		Track& t = tracks[i];
+		t.path = L"D:\\Music\\" + artistName + L"\\" + albumName + L"\\";
+		t.file = std::to_wstring(track) + L" " + title + L".mp3";
+		t.fileHash = FileHash(t.path + t.file);
+
+		sqlInsert.BindInt(1, t.fileHash);
+		sqlInsert.BindText16(2, t.path);
+		sqlInsert.BindText16(3, t.file);
+		sqlInsert.BindInt64(4, 5000000 + i);
+		sqlInsert.BindInt64(5, 130000000000000000LL + i);
+		sqlInsert.BindText16(6, std::to_wstring(track));
+		sqlInsert.BindText16(7, L"1");
+		sqlInsert.BindText16(8, title);
+		sqlInsert.BindText16(9, albumName);
+		sqlInsert.BindText16(10, artistName);
+		sqlInsert.BindText16(11, std::to_wstring(1970 + album % 50));
+		sqlInsert.StepReset();
+	}
+
+	sqlInsert.Finalize();
+	SQLRequest::Exec(db, "COMMIT;");
+
+	return true;
+}
+
+// One rescan of unchanged files, what Progress::AddToLibrary and WriteToLibrary do for each file
+// (DBase::CheckFile and DBase::SetUpdateOK), with statements prepared each time or taken from the cache
+double Rescan(SQLFile& db, const std::vector<Track>& tracks, bool isCached)
+{
+	SQLRequest::Exec(db, "ATTACH DATABASE ':memory:' AS memory_db;");
+	SQLRequest::Exec(db, "BEGIN;");
+	SQLRequest::Exec(db, "CREATE TABLE memory_db.memflag (fpk INTEGER PRIMARY KEY,fid INTEGER,fflag INTEGER);");
+	SQLRequest::Exec(db, "INSERT INTO memflag (fid,fflag) SELECT id,1 FROM library;");
+	SQLRequest::Exec(db, "CREATE INDEX memory_db.memflag_index ON memflag(fid);");
+
+	Timer timer;
+
+	int found = 0;
+	for (const Track& track : tracks)
+	{
+		SQLRequest sqlSelect;
+		const char* select = "SELECT id,cue,filesize,modified FROM library WHERE filehash=?1 AND file=?2 COLLATE FILECASE AND path=?3 COLLATE FILECASE LIMIT 1;";
+		if (isCached)
+			sqlSelect.PrepareCached(db, select);
+		else
+			sqlSelect.Prepare(db, select);
+
+		sqlSelect.BindInt(1, track.fileHash);
+		sqlSelect.BindText16(2, track.file);
+		sqlSelect.BindText16(3, track.path);
+
+		if (!sqlSelect.StepRow())
+			continue;
+		++found;
+
+		SQLRequest sqlUpdate;
+		const char* update = "UPDATE memflag SET fflag=NULL WHERE fid=? AND fflag=1;";
+		if (isCached)
+			sqlUpdate.PrepareCached(db, update);
+		else
+			sqlUpdate.Prepare(db, update);
+
+		sqlUpdate.BindInt64(1, sqlSelect.ColumnInt64(0));
+		sqlUpdate.Step();
+	}
+
+	double time = timer.Seconds();
+
+	if (found != (int)tracks.size())
+		wprintf(L"  Found %d files of %d\n", found, (int)tracks.size());
+
+	SQLRequest::Exec(db, "DROP TABLE memflag;");
+	SQLRequest::Exec(db, "COMMIT;");
+
+	db.ClearCache(); // The same as DBase::MemFlagDetach
+	SQLRequest::Exec(db, "DETACH DATABASE memory_db;");
+
+	return time;
+}
+
+// The best time of a few runs of a tree or list request, it reads the first column of all rows
+double Query(SQLFile& db, const char* sql, int& outRows)
+{
+	const int runs = 5;
+	double best = 0.0;
+
+	for (int i = 0; i < runs; ++i)
+	{
+		Timer timer;
+
+		SQLRequest sqlSelect(db, sql);
+		int rows = 0;
+		while (sqlSelect.StepRow())
+		{
+			sqlSelect.ColumnText16(0);
+			++rows;
+		}
+		sqlSelect.Finalize();
+
+		double time = timer.Seconds();
+		if (i == 0 || time < best)
+			best = time;
+		outRows = rows;
+	}
+
+	return best;
+}
+
+void CompareQuery(SQLFile& db, const wchar_t* name, const char* sqlCollate, const char* sqlKey)
+{
+	int rowsCollate = 0, rowsKey = 0;
+	double timeCollate = Query(db, sqlCollate, rowsCollate);
+	double timeKey = Query(db, sqlKey, rowsKey);
+
+	wprintf(L"  %s (%d rows): MYCASE %.1f ms, sort keys %.1f ms (x%.1f)\n",
+		name, rowsKey, timeCollate * 1000.0, timeKey * 1000.0, timeCollate / std::max(timeKey, 1e-9));
+	if (rowsCollate != rowsKey)
+		wprintf(L"  Rows are different: MYCASE %d, sort keys %d\n", rowsCollate, rowsKey);
+}
+
+} // namespace
+
+bool BenchStatementCache()
+{
+	std::wstring file = TempFile(L"WinylBench.db");
+
+	SQLFile db;
+	std::vector<Track> tracks;
+	if (!CreateLibrary(db, file, tracks))
+	{
+		wprintf(L"  Cannot create %s\n", file.c_str());
+		return true;
+	}
+
+	// The first pass warms up the page cache
+	Rescan(db, tracks, false);
+
+	double timePrepare = Rescan(db, tracks, false);
+
+	long long hits = db.GetCacheHits();
+	long long misses = db.GetCacheMisses();
+	double timeCached = Rescan(db, tracks, true);
+	hits = db.GetCacheHits() - hits;
+	misses = db.GetCacheMisses() - misses;
+
+	db.Close();
+	::DeleteFileW(file.c_str());
+
+	wprintf(L"  Rescan of %d files: prepare each time %.0f ms (%.0f files/s), cached %.0f ms (%.0f files/s)\n",
+		(int)tracks.size(), timePrepare * 1000.0, tracks.size() / std::max(timePrepare, 1e-9),
+		timeCached * 1000.0, tracks.size() / std::max(timeCached, 1e-9));
+	wprintf(L"  Statement cache: %lld hits, %lld misses\n", hits, misses);
+
+	return true;
+}
+
+bool BenchSortKeys()
+{
+	std::wstring file = TempFile(L"WinylBench.db");
+
+	SQLFile db;
+	std::vector<Track> tracks;
+	if (!CreateLibrary(db, file, tracks))
+	{
+		wprintf(L"  Cannot create %s\n", file.c_str());
+		return true;
+	}
+
+	// The one-time cost of the keys, the same as DBase::UpdateSortKeys and DBase::CreateSortKeys
+	Timer timerKeys;
+	SQLRequest::Exec(db, "BEGIN;");
+	SQLRequest::Exec(db, "UPDATE library SET titlekey=SORTKEY(title),albumkey=SORTKEY(album),"
+		"artistkey=SORTKEY(artist),albumartistkey=SORTKEY(albumartist);");
+	SQLRequest::Exec(db, "COMMIT;");
+	double timeFill = timerKeys.Seconds();
+
+	Timer timerIndex;
+	SQLRequest::Exec(db, "CREATE INDEX titlekey_index ON library(titlekey);");
+	SQLRequest::Exec(db, "CREATE INDEX albumkey_index ON library(albumkey);");
+	SQLRequest::Exec(db, "CREATE INDEX artistkey_index ON library(IFNULL(albumartistkey,artistkey));");
+	SQLRequest::Exec(db, "CREATE INDEX albumartistkey_index ON library(albumartistkey);");
+	double timeIndex = timerIndex.Seconds();
+
+	wprintf(L"  Sort keys of %d tracks: fill %.0f ms, indexes %.0f ms\n",
+		(int)tracks.size(), timeFill * 1000.0, timeIndex * 1000.0);
+
+	// The requests of DBase::FillTreeAlbum, FillTreeArtist and FillListArtist before and after the sort keys
+	CompareQuery(db, L"Album tree",
+		"SELECT album FROM library WHERE deleted IS NULL GROUP BY album COLLATE MYCASE ORDER BY album COLLATE MYCASE;",
+		"SELECT album FROM library WHERE deleted IS NULL GROUP BY albumkey ORDER BY albumkey;");
+
+	CompareQuery(db, L"Artist tree",
+		"SELECT IFNULL(albumartist,artist) AS art FROM library WHERE deleted IS NULL"
+		" GROUP BY art COLLATE MYCASE ORDER BY art COLLATE MYCASE;",
+		"SELECT IFNULL(albumartist,artist) AS art FROM library WHERE deleted IS NULL"
+		" GROUP BY IFNULL(albumartistkey,artistkey) ORDER BY IFNULL(albumartistkey,artistkey);");
+
+	CompareQuery(db, L"Track list",
+		"SELECT title FROM library WHERE deleted IS NULL"
+		" ORDER BY IFNULL(albumartist,artist) COLLATE MYCASE,CAST(year AS INTEGER) DESC,album COLLATE MYCASE,CAST(disc AS INTEGER),CAST(track AS INTEGER);",
+		"SELECT title FROM library WHERE deleted IS NULL"
+		" ORDER BY IFNULL(albumartistkey,artistkey),CAST(year AS INTEGER) DESC,albumkey,CAST(disc AS INTEGER),CAST(track AS INTEGER);");
+
+	db.Close();
+	::DeleteFileW(file.c_str());
+
+	return true;
+}
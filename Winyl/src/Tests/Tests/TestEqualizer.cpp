@@ -0,0 +1,374 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../../Equalizer.h"
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+// Tests of Equalizer against the response of the peaking filter of Audio EQ Cookbook by Robert Bristow-Johnson,
+// not against another implementation of the same math: the gain at the centre frequency of a band is the gain
+// of the band, the gain at the band edges (1.5 octaves between them) is half of it and far from the band it is 0 dB.
+// The gains are measured with sines through Equalizer itself. Besides: 0 dB is bypass, the preamp is a plain gain,
+// the SSE path and the scalar path give the same samples, a band that goes out and comes back starts clean.
+
+namespace
+{
+
+const float frequencies[Equalizer::BandCount] = {31.5f, 63.0f, 125.0f, 250.0f, 500.0f, 1000.0f, 2000.0f, 4000.0f, 8000.0f, 16000.0f};
+const double pi = 3.14159265358979323846;
+
+bool IsBandActive(int band, int sampleRate)
+{
+	// Equalizer skips bands above Nyquist with a margin
+	return frequencies[band] < sampleRate * 0.45f;
+}
+
+// Gain in dB of a sine at the frequency through the equalizer, measured on all channels after the filters settle
+bool MeasureGain(Equalizer& eq, int sampleRate, int channels, double frequency, double& outGain)
+{
+	const std::size_t frames = sampleRate * 2;
+	const double amplitude = 0.25;
+
+	std::vector<float> samples(frames * channels);
+	for (std::size_t i = 0; i < frames; ++i)
+	{
+		float x = (float)(amplitude * std::sin(2.0 * pi * frequency * i / sampleRate));
+		for (int ch = 0; ch < channels; ++ch)
+			samples[i * channels + ch] = x;
+	}
+
+	// Buffers of 10 ms like in the player
+	for (std::size_t i = 0; i < frames; i += sampleRate / 100)
+		eq.Process(samples.data() + i * channels, std::min(frames - i, (std::size_t)sampleRate / 100));
+
+	// The last second, about a whole number of periods, the power of the input sine is amplitude^2 / 2
+	std::size_t window = (std::size_t)(std::floor(frequency) * sampleRate / frequency);
+	std::size_t start = frames - window;
+
+	outGain = 0.0;
+	for (int ch = 0; ch < channels; ++ch)
+	{
+		double power = 0.0;
+		for (std::size_t i = start; i < frames; ++i)
+			power += (double)samples[i * channels + ch] * samples[i * channels + ch];
+		power /= window;
+
+		double gain = 10.0 * std::log10(power / (amplitude * amplitude / 2.0));
+		if (ch > 0 && gain != outGain)
+		{
+			wprintf(L"  %d Hz %d channels: %g Hz channel %d has %g dB, channel 0 %g dB\n",
+				sampleRate, channels, frequency, ch, gain, outGain);
+			return false;
+		}
+		outGain = gain;
+	}
+
+	return true;
+}
+
+bool CheckGain(int sampleRate, int channels, int band, float gain, double frequency, double expected, double tolerance)
+{
+	Equalizer eq(frequencies);
+	eq.SetBand(band, gain);
+	eq.SetFormat(sampleRate, channels);
+
+	double measured = 0.0;
+	if (!MeasureGain(eq, sampleRate, channels, frequency, measured))
+		return false;
+
+	if (std::abs(measured - expected) > tolerance)
+	{
+		wprintf(L"  %d Hz %d channels: band %g Hz at %g dB, %g Hz is %g dB, expected %g dB\n",
+			sampleRate, channels, frequencies[band], gain, frequency, measured, expected);
+		return false;
+	}
+
+	return true;
+}
+
+bool CheckResponse(int sampleRate, int channels)
+{
+	bool result = true;
+
+	const double edge = std::pow(2.0, 1.5 / 2.0); // Half of the bandwidth in octaves
+
+	for (int band = 0; band < Equalizer::BandCount; ++band)
+	{
+		double f0 = frequencies[band];
+
+		if (!IsBandActive(band, sampleRate))
+		{
+			// Skipped band, bypass (only the rounding of the measurement)
+			if (!CheckGain(sampleRate, channels, band, 12.0f, f0 / 2.0, 0.0, 1e-6))
+				result = false;
+			continue;
+		}
+
+		for (float gain : {12.0f, -12.0f, 6.0f, -3.0f})
+		{
+			// The centre frequency
+			if (!CheckGain(sampleRate, channels, band, gain, f0, gain, 0.02))
+				result = false;
+
+			// The edges, where the bilinear transform does not warp the response much
+			// (the low bands at high rates are less precise with float coefficients)
+			if (f0 * edge < sampleRate / 16.0)
+			{
+				if (!CheckGain(sampleRate, channels, band, gain, f0 * edge, gain / 2.0, 0.1) ||
+					!CheckGain(sampleRate, channels, band, gain, f0 / edge, gain / 2.0, 0.1))
+					result = false;
+			}
+
+			// 5 octaves away
+			double far = (f0 * 32.0 < sampleRate * 0.45) ? f0 * 32.0 : f0 / 32.0;
+			if (!CheckGain(sampleRate, channels, band, gain, far, 0.0, 0.1))
+				result = false;
+		}
+	}
+
+	return result;
+}
+
+void FillNoise(std::vector<float>& samples, unsigned seed)
+{
+	for (std::size_t i = 0; i < samples.size(); ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		samples[i] = ((float)((seed >> 8) & 0xFFFF) / 0x8000 - 1.0f) * 0.25f;
+	}
+}
+
+bool CheckPreamp(int sampleRate, int channels)
+{
+	// All bands at 0 dB: without the preamp the samples are not touched, with it they are only scaled
+	// (the preamp is smoothed over the first block only)
+	for (float preamp : {0.0f, -6.0f, 3.0f})
+	{
+		Equalizer eq(frequencies);
+		eq.SetPreamp(preamp);
+		eq.SetFormat(sampleRate, channels);
+
+		std::vector<float> samples(sampleRate / 10 * channels);
+		FillNoise(samples, 5);
+		std::vector<float> input = samples;
+
+		eq.Process(samples.data(), sampleRate / 10);
+
+		double scale = std::pow(10.0, preamp / 20.0);
+		for (std::size_t i = 0; i < samples.size(); ++i)
+		{
+			double expected = input[i] * scale;
+			if (preamp == 0.0f ? (samples[i] != input[i]) : (std::abs(samples[i] - expected) > 1e-6))
+			{
+				wprintf(L"  %d Hz %d channels: preamp %g dB, sample %u is %.9g, expected %.9g\n",
+					sampleRate, channels, preamp, (unsigned)i, samples[i], expected);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool ComparePaths(int sampleRate)
+{
+	// The same mono noise in 2 channels (SSE path) and in 6 channels (scalar path),
+	// gains and the preamp are changed while playing so the smoothing is compared too
+	const int channelsSSE = 2;
+	const int channelsScalar = 6;
+
+	Equalizer eqSSE(frequencies);
+	Equalizer eqScalar(frequencies);
+
+	const float gains[Equalizer::BandCount] = {6.0f, -3.0f, 0.0f, 4.5f, -12.0f, 2.0f, 0.0f, -6.0f, 9.0f, 3.0f};
+	for (int i = 0; i < Equalizer::BandCount; ++i)
+	{
+		eqSSE.SetBand(i, gains[i]);
+		eqScalar.SetBand(i, gains[i]);
+	}
+	eqSSE.SetFormat(sampleRate, channelsSSE);
+	eqScalar.SetFormat(sampleRate, channelsScalar);
+
+	std::vector<float> mono;
+	std::vector<float> samplesSSE;
+	std::vector<float> samplesScalar;
+
+	// Odd sizes of buffers so blocks do not always start at the same place
+	const std::size_t sizes[] = {1, 63, 64, 65, 441, 1024, 4096, 7};
+
+	for (int step = 0; step < 300; ++step)
+	{
+		if (step == 50)
+		{
+			eqSSE.SetBand(4, 0.0f); eqScalar.SetBand(4, 0.0f);
+			eqSSE.SetPreamp(-4.0f); eqScalar.SetPreamp(-4.0f);
+		}
+		else if (step == 150)
+		{
+			eqSSE.SetBand(4, -8.0f); eqScalar.SetBand(4, -8.0f);
+			eqSSE.SetBand(2, 5.0f); eqScalar.SetBand(2, 5.0f);
+		}
+
+		std::size_t frames = sizes[step % (sizeof(sizes) / sizeof(sizes[0]))];
+		mono.resize(frames);
+		FillNoise(mono, step + 1);
+
+		samplesSSE.resize(frames * channelsSSE);
+		samplesScalar.resize(frames * channelsScalar);
+		for (std::size_t i = 0; i < frames; ++i)
+		{
+			for (int ch = 0; ch < channelsSSE; ++ch)
+				samplesSSE[i * channelsSSE + ch] = mono[i];
+			for (int ch = 0; ch < channelsScalar; ++ch)
+				samplesScalar[i * channelsScalar + ch] = mono[i];
+		}
+
+		eqSSE.Process(samplesSSE.data(), frames);
+		eqScalar.Process(samplesScalar.data(), frames);
+
+		for (std::size_t i = 0; i < frames; ++i)
+		{
+			float x = samplesSSE[i * channelsSSE];
+			for (int ch = 0; ch < channelsSSE; ++ch)
+			{
+				if (memcmp(&samplesSSE[i * channelsSSE + ch], &x, sizeof(float)) != 0)
+				{
+					wprintf(L"  %d Hz: step %d frame %u channel %d differs on the SSE path\n", sampleRate, step, (unsigned)i, ch);
+					return false;
+				}
+			}
+			for (int ch = 0; ch < channelsScalar; ++ch)
+			{
+				if (memcmp(&samplesScalar[i * channelsScalar + ch], &x, sizeof(float)) != 0)
+				{
+					wprintf(L"  %d Hz: step %d frame %u channel %d is %.9g on the scalar path, %.9g on the SSE path\n",
+						sampleRate, step, (unsigned)i, ch, samplesScalar[i * channelsScalar + ch], x);
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool CheckBandReturn(int sampleRate, int channels)
+{
+	// The band plays loud noise, goes out to 0 dB, then comes back on silence:
+	// it must start from the clean state so the silence stays silence
+	Equalizer eq(frequencies);
+	eq.SetBand(0, 12.0f);
+	eq.SetFormat(sampleRate, channels);
+
+	std::vector<float> samples(sampleRate / 10 * channels);
+	FillNoise(samples, 9);
+	eq.Process(samples.data(), sampleRate / 10);
+
+	// Smoothed to 0 dB in 12 blocks while the noise still plays
+	eq.SetBand(0, 0.0f);
+	FillNoise(samples, 10);
+	eq.Process(samples.data(), 64 * 12);
+
+	eq.SetBand(0, 12.0f);
+	std::fill(samples.begin(), samples.end(), 0.0f);
+	eq.Process(samples.data(), sampleRate / 10);
+
+	for (std::size_t i = 0; i < samples.size(); ++i)
+	{
+		if (samples[i] != 0.0f)
+		{
+			wprintf(L"  %d Hz %d channels: sample %u after the band is back is %g\n",
+				sampleRate, channels, (unsigned)i, samples[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+} // namespace
+
+bool TestEqualizer()
+{
+	bool result = true;
+
+	const int rates[] = {44100, 48000, 96000, 22050};
+	for (int rate : rates)
+	{
+		// 1, 2, 4 channels go through the SSE path, 6 and 8 through the scalar one
+		for (int chans : {1, 2, 4, 6, 8})
+		{
+			if (!CheckPreamp(rate, chans))
+				result = false;
+			if (!CheckBandReturn(rate, chans))
+				result = false;
+		}
+
+		for (int chans : {2, 6})
+		{
+			if (!CheckResponse(rate, chans))
+				result = false;
+		}
+
+		if (!ComparePaths(rate))
+			result = false;
+	}
+
+	return result;
+}
+
+bool BenchEqualizer()
+{
+	const int sampleRate = 44100;
+	const int seconds = 600;
+	const std::size_t bufferFrames = 441; // 10 ms, about the size of a WASAPI period
+
+	for (int chans : {2, 6})
+	{
+		for (int bands : {0, 3, 10})
+		{
+			Equalizer eq(frequencies);
+			for (int i = 0; i < bands; ++i)
+				eq.SetBand(i, (i % 2) ? -4.0f : 4.0f);
+			eq.SetFormat(sampleRate, chans);
+
+			std::vector<float> samples(bufferFrames * chans);
+			FillNoise(samples, 3);
+
+			std::size_t count = (std::size_t)sampleRate * seconds / bufferFrames;
+
+			LARGE_INTEGER freq, start, end;
+			::QueryPerformanceFrequency(&freq);
+			::QueryPerformanceCounter(&start);
+
+			for (std::size_t i = 0; i < count; ++i)
+				eq.Process(samples.data(), bufferFrames);
+
+			::QueryPerformanceCounter(&end);
+
+			double time = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+			wprintf(L"  %d channels, %2d bands: %7.1f ms for %d s, %6.0fx realtime\n",
+				chans, bands, time * 1000.0, seconds, seconds / std::max(time, 1e-9));
+		}
+	}
+
+	return true;
+}
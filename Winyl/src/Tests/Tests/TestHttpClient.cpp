@@ -0,0 +1,259 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../../HttpClient.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// HttpClient test against a small HTTP/1.1 server on 127.0.0.1 (a random port).
+// The server counts accepted connections, so the test sees if WinHTTP reuses the socket (keep-alive)
+// after a page and after an error page, and it has a page that never answers for Cancel and the timeout.
+
+namespace
+{
+
+const char pageBody[] = "Winyl loopback test";
+
+class LoopbackServer final
+{
+public:
+	LoopbackServer() {}
+	~LoopbackServer() {Stop();}
+	LoopbackServer(const LoopbackServer&) = delete;
+	LoopbackServer& operator=(const LoopbackServer&) = delete;
+
+	bool Start()
+	{
+		listenSocket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listenSocket == INVALID_SOCKET)
+			return false;
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = 0;
+
+		int addrSize = sizeof(addr);
+		if (::bind(listenSocket, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+			::listen(listenSocket, SOMAXCONN) == SOCKET_ERROR ||
+			::getsockname(listenSocket, (sockaddr*)&addr, &addrSize) == SOCKET_ERROR)
+		{
+			::closesocket(listenSocket);
+			listenSocket = INVALID_SOCKET;
+			return false;
+		}
+
+		port = ntohs(addr.sin_port);
+		threadAccept = std::thread(&LoopbackServer::RunAccept, this);
+
+		return true;
+	}
+
+	void Stop()
+	{
+		if (listenSocket == INVALID_SOCKET)
+			return;
+
+		// Closing the sockets wakes up accept and recv
+		::closesocket(listenSocket);
+		listenSocket = INVALID_SOCKET;
+		threadAccept.join();
+
+		for (SOCKET s : sockets)
+			::shutdown(s, SD_BOTH);
+		for (std::thread& t : threads)
+			t.join();
+		for (SOCKET s : sockets)
+			::closesocket(s);
+
+		sockets.clear();
+		threads.clear();
+	}
+
+	int GetPort() {return port;}
+	int GetCountConnections() {return countConnections;}
+
+private:
+	void RunAccept()
+	{
+		while (true)
+		{
+			SOCKET s = ::accept(listenSocket, NULL, NULL);
+			if (s == INVALID_SOCKET)
+				break;
+
+			++countConnections;
+
+			// Only this thread adds, Stop reads after this thread is finished
+			sockets.push_back(s);
+			threads.emplace_back(&LoopbackServer::RunConnection, this, s);
+		}
+	}
+
+	void RunConnection(SOCKET s)
+	{
+		std::string buffer;
+		char data[4096];
+
+		while (true)
+		{
+			int read = ::recv(s, data, sizeof(data), 0);
+			if (read <= 0)
+				break;
+			buffer.append(data, read);
+
+			std::size_t end;
+			while ((end = buffer.find("\r\n\r\n")) != std::string::npos)
+			{
+				// Request line: GET /path HTTP/1.1
+				std::size_t start = buffer.find(' ');
+				std::string path = buffer.substr(start + 1, buffer.find(' ', start + 1) - start - 1);
+				buffer.erase(0, end + 4);
+
+				std::string response;
+				if (path == "/ok")
+					response = Response("200 OK", pageBody);
+				else if (path == "/404")
+					response = Response("404 Not Found", std::string(4096, 'x'));
+				else if (path == "/hang")
+					continue; // Never answer
+				else
+					response = Response("400 Bad Request", "");
+
+				::send(s, response.data(), (int)response.size(), 0);
+			}
+		}
+	}
+
+	static std::string Response(const char* status, const std::string& body)
+	{
+		return std::string("HTTP/1.1 ") + status + "\r\n"
+			"Content-Type: text/plain\r\n"
+			"Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+	}
+
+	SOCKET listenSocket = INVALID_SOCKET;
+	int port = 0;
+	std::atomic<int> countConnections{0};
+	std::thread threadAccept;
+	std::vector<SOCKET> sockets;
+	std::vector<std::thread> threads;
+};
+
+bool CheckPage(const std::wstring& url, bool isResult, const std::string& page, DWORD status)
+{
+	std::string outPage;
+	DWORD outStatus = 0;
+	bool result = HttpClient::GetHttpPage(url, outPage, nullptr, &outStatus);
+
+	if (result != isResult || outPage != page || outStatus != status)
+	{
+		wprintf(L"  %s: result %d, status %u, %d bytes\n", url.c_str(), (int)result, (unsigned)outStatus, (int)outPage.size());
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace
+
+bool TestHttpClient()
+{
+	WSADATA wsaData = {};
+	if (::WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return false;
+
+	bool result = true;
+
+	LoopbackServer server;
+	if (server.Start())
+	{
+		// A new session, so only connections of this test are counted
+		HttpClient::CloseSession();
+
+		std::wstring url = L"http://127.0.0.1:" + std::to_wstring(server.GetPort());
+
+		// Keep-alive: the second page goes through the same socket
+		result &= CheckPage(url + L"/ok", true, pageBody, 200);
+		result &= CheckPage(url + L"/ok", true, pageBody, 200);
+		if (server.GetCountConnections() != 1)
+		{
+			wprintf(L"  Keep-alive: %d connections for 2 pages\n", server.GetCountConnections());
+			result = false;
+		}
+
+		// The body of an error page is read too, so the socket is still reused
+		result &= CheckPage(url + L"/404", false, "", 404);
+		result &= CheckPage(url + L"/ok", true, pageBody, 200);
+		if (server.GetCountConnections() != 1)
+		{
+			wprintf(L"  Keep-alive after an error page: %d connections for 4 pages\n", server.GetCountConnections());
+			result = false;
+		}
+
+		// Cancel wakes up a request that waits for the answer
+		HttpClient::Cancel cancel;
+		std::thread threadAbort([&cancel]() {::Sleep(300); cancel.Abort();});
+
+		std::string page;
+		DWORD status = 0;
+		DWORD time = ::GetTickCount();
+		bool resultCancel = HttpClient::GetHttpPage(url + L"/hang", page, &cancel, &status);
+		time = ::GetTickCount() - time;
+		threadAbort.join();
+
+		if (resultCancel || status != 0 || time > 3000)
+		{
+			wprintf(L"  Cancel: result %d, status %u, %u ms\n", (int)resultCancel, (unsigned)status, (unsigned)time);
+			result = false;
+		}
+
+		// New requests with the aborted Cancel fail at once
+		if (HttpClient::GetHttpPage(url + L"/ok", page, &cancel))
+		{
+			wprintf(L"  Cancel: a request after Abort is not failed\n");
+			result = false;
+		}
+
+		// Without Cancel the request ends by the timeout of the session (5 seconds)
+		time = ::GetTickCount();
+		bool resultTimeout = HttpClient::GetHttpPage(url + L"/hang", page, nullptr, &status);
+		time = ::GetTickCount() - time;
+
+		if (resultTimeout || status != 0 || time < 4000 || time > 20000)
+		{
+			wprintf(L"  Timeout: result %d, status %u, %u ms\n", (int)resultTimeout, (unsigned)status, (unsigned)time);
+			result = false;
+		}
+
+		HttpClient::CloseSession();
+		server.Stop();
+	}
+	else
+	{
+		wprintf(L"  Cannot start the server\n");
+		result = false;
+	}
+
+	::WSACleanup();
+
+	return result;
+}
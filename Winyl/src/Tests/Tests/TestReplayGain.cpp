@@ -0,0 +1,154 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../../ReplayGain.h"
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+// Tests of the ReplayGain meter with the loudness and true peak signals of EBU Tech 3341,
+// the expected values are from the document, not from the meter:
+// a 1 kHz sine at -23 dBFS in both channels is -23 LUFS (also at other levels and sample rates),
+// the relative gate removes quiet parts, a mono file is measured as dual mono (the same as stereo),
+// the true peak of a sine sampled between its peaks is found within +0.2/-0.4 dB.
+
+namespace
+{
+
+const double pi = 3.14159265358979323846;
+
+// Sine in all channels, amplitude in dBFS (of the peak), phase in degrees.
+// It starts with a 10 ms fade in: a sine that starts at once is a step and its true peak really overshoots.
+void AddSine(std::vector<float>& samples, int sampleRate, int channels, double frequency,
+	double amplitudeDB, double seconds, double phase = 0.0)
+{
+	double amplitude = std::pow(10.0, amplitudeDB / 20.0);
+	std::size_t frames = (std::size_t)(seconds * sampleRate);
+	std::size_t fadeFrames = sampleRate / 100;
+
+	std::size_t start = samples.size();
+	samples.resize(start + frames * channels);
+
+	for (std::size_t i = 0; i < frames; ++i)
+	{
+		double x = amplitude * std::sin(2.0 * pi * frequency * i / sampleRate + phase * pi / 180.0);
+		if (i < fadeFrames)
+			x *= 0.5 - 0.5 * std::cos(pi * i / fadeFrames);
+		for (int ch = 0; ch < channels; ++ch)
+			samples[start + i * channels + ch] = (float)x;
+	}
+}
+
+void Analyze(ReplayGain& meter, const std::vector<float>& samples, int sampleRate, int channels)
+{
+	meter.Start(sampleRate, channels);
+
+	// Buffers of 100 ms like in ReplayGain::AnalyzeFile, but not aligned to the blocks of the meter
+	const std::size_t bufferFrames = sampleRate / 10 + 7;
+	std::size_t frames = samples.size() / channels;
+	for (std::size_t i = 0; i < frames; i += bufferFrames)
+		meter.Process(samples.data() + i * channels, std::min(bufferFrames, frames - i));
+}
+
+bool CheckLoudness(const wchar_t* name, const std::vector<float>& samples, int sampleRate, int channels, double expected)
+{
+	ReplayGain meter;
+	Analyze(meter, samples, sampleRate, channels);
+
+	double loudness = meter.GetLoudness();
+	if (std::fabs(loudness - expected) > 0.1)
+	{
+		wprintf(L"  %s, %d Hz, %d channels: %.2f LUFS, expected %.1f\n", name, sampleRate, channels, loudness, expected);
+		return false;
+	}
+
+	return true;
+}
+
+bool CheckTruePeak(int sampleRate, double frequency, double amplitudeDB, double phase, double expected)
+{
+	std::vector<float> samples;
+	AddSine(samples, sampleRate, 2, frequency, amplitudeDB, 1.0, phase);
+
+	ReplayGain meter;
+	Analyze(meter, samples, sampleRate, 2);
+
+	double peak = 20.0 * std::log10(meter.GetPeak());
+	if (peak < expected - 0.4 || peak > expected + 0.2)
+	{
+		wprintf(L"  True peak, %d Hz, %g Hz sine, phase %g: %.2f dBTP, expected %.1f\n",
+			sampleRate, frequency, phase, peak, expected);
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace
+
+bool TestReplayGain()
+{
+	bool result = true;
+
+	for (int rate : {44100, 48000, 96000})
+	{
+		// EBU Tech 3341 case 1 and 2: stereo sine 1 kHz, 20 s
+		for (double level : {-23.0, -33.0})
+		{
+			std::vector<float> samples;
+			AddSine(samples, rate, 2, 1000.0, level, 20.0);
+			result &= CheckLoudness(L"Sine", samples, rate, 2, level);
+		}
+
+		// Case 3: -36 dBFS 10 s, -23 dBFS 60 s, -36 dBFS 10 s, the relative gate leaves only -23
+		std::vector<float> gated;
+		AddSine(gated, rate, 2, 1000.0, -36.0, 10.0);
+		AddSine(gated, rate, 2, 1000.0, -23.0, 60.0);
+		AddSine(gated, rate, 2, 1000.0, -36.0, 10.0);
+		result &= CheckLoudness(L"Relative gate", gated, rate, 2, -23.0);
+
+		// Case 5: -26 dBFS 20 s, -20 dBFS 20.1 s, -26 dBFS 20 s
+		std::vector<float> steps;
+		AddSine(steps, rate, 2, 1000.0, -26.0, 20.0);
+		AddSine(steps, rate, 2, 1000.0, -20.0, 20.1);
+		AddSine(steps, rate, 2, 1000.0, -26.0, 20.0);
+		result &= CheckLoudness(L"Steps", steps, rate, 2, -23.0);
+
+		// Mono is dual mono: the same sine in one channel is the same loudness as in two
+		std::vector<float> mono;
+		AddSine(mono, rate, 1, 1000.0, -23.0, 20.0);
+		result &= CheckLoudness(L"Mono", mono, rate, 1, -23.0);
+
+		// Silence is below the absolute gate
+		std::vector<float> silence(rate * 2 * 5);
+		result &= CheckLoudness(L"Silence", silence, rate, 2, -70.0);
+	}
+
+	// EBU Tech 3341 cases 15-19: true peak of sines at 48 kHz, the samples miss the peaks of cases 16-19
+	result &= CheckTruePeak(48000, 48000 / 4.0, -6.02, 0.0, -6.0);
+	result &= CheckTruePeak(48000, 48000 / 4.0, -6.02, 45.0, -6.0);
+	result &= CheckTruePeak(48000, 48000 / 6.0, -6.02, 60.0, -6.0);
+	result &= CheckTruePeak(48000, 48000 / 8.0, -6.02, 67.5, -6.0);
+	result &= CheckTruePeak(48000, 48000 / 4.0, 3.01, 45.0, 3.0);
+
+	// The same at 44.1 kHz
+	result &= CheckTruePeak(44100, 44100 / 4.0, -6.02, 45.0, -6.0);
+
+	return result;
+}
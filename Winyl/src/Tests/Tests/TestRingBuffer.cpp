@@ -0,0 +1,213 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Stress test of the read-ahead of LibAudio for WASAPI/ASIO. ReadAhead is the same code that LibAudio uses,
+// only the threads around it are emulated: the reading thread like LibAudio::RunThreadBuffer and the output
+// thread like LibAudio::StreamProcBuffer. The decoder is fake: like BASS_ChannelGetData it returns only
+// whole frames, sometimes it has no data (network file) and at the end it returns DecodeEnd.
+// Each sample is its position in the file so any lost, repeated or reordered sample is found.
+// Only the standard library is used (no stdafx.h), so it also builds and runs without Win32:
+// g++ -std=c++17 -O2 -pthread -DTEST_RINGBUFFER_MAIN TestRingBuffer.cpp && ./a.out
+
+#include "Tests.h"
+#include "../../ReadAhead.h"
+#include <cwchar>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace
+{
+
+class FakeDecoder
+{
+public:
+	FakeDecoder(int chans, std::size_t frames) : chans(chans), total(frames * chans) {}
+
+	std::size_t Decode(float* data, std::size_t count)
+	{
+		if (position == total)
+			return ReadAhead::DecodeEnd;
+
+		random = random * 1103515245 + 12345;
+		if ((random >> 16) % 8 == 0) // No data right now
+			return 0;
+
+		count = std::min(count, total - position);
+		count = std::min(count, (std::size_t)((random >> 16) % 4096 + 1) * chans); // Random portion
+		count -= count % chans; // Only whole frames
+
+		for (std::size_t i = 0; i < count; ++i)
+			data[i] = (float)((position + i) % 1000000);
+		position += count;
+
+		return count;
+	}
+
+private:
+	const std::size_t chans;
+	const std::size_t total;
+	std::size_t position = 0;
+	unsigned random = 1;
+};
+
+// Auto reset event like Threading::Event
+class Event
+{
+public:
+	void Set()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isSet = true;
+		cond.notify_one();
+	}
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [this]() {return isSet;});
+		isSet = false;
+	}
+	void TryWait(int milliseconds)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait_for(lock, std::chrono::milliseconds(milliseconds), [this]() {return isSet;});
+		isSet = false;
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool isSet = false;
+};
+
+// The reading thread, like LibAudio::RunThreadBuffer and FillBufferStream
+void RunReadAhead(ReadAhead& readAhead, FakeDecoder& decoder, Event& event, std::atomic<bool>& isStop)
+{
+	while (!isStop && !readAhead.IsEnd())
+	{
+		ReadAhead::Result result = readAhead.Fill([&decoder](float* data, std::size_t count)
+		{
+			return decoder.Decode(data, count);
+		});
+
+		if (result == ReadAhead::Result::End)
+			readAhead.SetEnd();
+		else if (result == ReadAhead::Result::NoData)
+			event.TryWait(1);
+		else
+			event.Wait();
+	}
+}
+
+bool RingBufferStress(int chans)
+{
+	const std::size_t frames = 2000000;
+	const int freq = 44100;
+
+	FakeDecoder decoder(chans, frames);
+	ReadAhead readAhead(freq / 10 * chans, chans); // ~100 ms
+	Event event;
+	std::atomic<bool> isStop(false);
+
+	// The first portion is read by the thread that opens the stream, like LibAudio::OpenMediaFile
+	readAhead.FillFirst([&decoder](float* data, std::size_t count) {return decoder.Decode(data, count);});
+
+	std::thread thread([&]() {RunReadAhead(readAhead, decoder, event, isStop);});
+
+	// The output thread, like LibAudio::StreamProcBuffer
+	std::vector<float> data(4096 * chans);
+	std::size_t position = 0;
+	std::size_t total = frames * chans;
+	unsigned random = 7;
+	auto timeData = std::chrono::steady_clock::now();
+	bool result = true;
+
+	while (result)
+	{
+		random = random * 1103515245 + 12345;
+		std::size_t length = ((random >> 16) % 4096 + 1) * chans; // The device asks only whole frames
+
+		bool isEnd = false;
+		bool isWakeUp = false;
+		std::size_t c = readAhead.Read(data.data(), length, isEnd, isWakeUp);
+
+		for (std::size_t i = 0; i < c; ++i)
+		{
+			if (data[i] != (float)((position + i) % 1000000))
+			{
+				wprintf(L"  %d channels: wrong sample at %u\n", chans, (unsigned)(position + i));
+				result = false;
+				break;
+			}
+		}
+		position += c;
+
+		if (isEnd)
+			break;
+
+		if (isWakeUp)
+			event.Set();
+
+		if (c > 0)
+			timeData = std::chrono::steady_clock::now();
+		else if (std::chrono::steady_clock::now() - timeData > std::chrono::seconds(2)) // The ring is not filled anymore
+		{
+			wprintf(L"  %d channels: stalled at %u, free %u\n", chans, (unsigned)position,
+				(unsigned)(readAhead.Capacity() - readAhead.Size()));
+			result = false;
+		}
+	}
+
+	if (result && position != total)
+	{
+		wprintf(L"  %d channels: read %u samples of %u\n", chans, (unsigned)position, (unsigned)total);
+		result = false;
+	}
+
+	isStop = true;
+	event.Set();
+	thread.join();
+
+	return result;
+}
+
+} // namespace
+
+bool TestRingBuffer()
+{
+	bool result = true;
+
+	// With 3, 5, 6, 7 channels frames cross the wrap point of the ring
+	for (int chans = 1; chans <= 8; ++chans)
+	{
+		if (!RingBufferStress(chans))
+			result = false;
+	}
+
+	return result;
+}
+
+#ifdef TEST_RINGBUFFER_MAIN
+int main()
+{
+	bool result = TestRingBuffer();
+	wprintf(L"RingBuffer: %ls\n", result ? L"OK" : L"FAILED");
+	return result ? 0 : 1;
+}
+#endif
@@ -0,0 +1,166 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../../SkinListNode.h"
+#include <psapi.h>
+#include <vector>
+
+#pragma comment(lib, "psapi.lib")
+
+// List node benchmark: a list of 50k tracks in groups of 10 is filled and cleared a few times
+// the same way as DBase fills SkinList (a head node for each album and song nodes with labels).
+// The nodes are real SkinListNode, so they are allocated from the node pool and the labels are interned
+// (see NodePool.h and StringPool.h). The heap line is the same number of allocations of the same size
+// from the heap for comparison, without the labels.
+
+namespace
+{
+
+const int benchNodes = 50000;
+const int benchGroup = 10;
+const int benchCycles = 5;
+
+class Timer
+{
+public:
+	Timer() {::QueryPerformanceFrequency(&freq); ::QueryPerformanceCounter(&start);}
+	double Seconds()
+	{
+		LARGE_INTEGER end;
+		::QueryPerformanceCounter(&end);
+		return (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+	}
+
+private:
+	LARGE_INTEGER freq, start;
+};
+
+struct Memory
+{
+	std::size_t current = 0;
+	std::size_t peak = 0;
+};
+
+Memory GetMemory()
+{
+	Memory memory;
+
+	PROCESS_MEMORY_COUNTERS counters = {};
+	counters.cb = sizeof(counters);
+	if (::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		memory.current = counters.PagefileUsage; // Private bytes
+		memory.peak = counters.PeakPagefileUsage;
+	}
+
+	return memory;
+}
+
+void FillList(SkinListNode* root)
+{
+	SkinListNode* head = nullptr;
+
+	for (int i = 0; i < benchNodes; ++i)
+	{
+		int album = i / benchGroup;
+
+		if (i % benchGroup == 0)
+		{
+			head = new SkinListNode();
+			head->SetLabel(SkinListElement::Type::Artist, L"Artist " + std::to_wstring(album / 5));
+			head->SetLabel(SkinListElement::Type::Album, L"Album " + std::to_wstring(album));
+			head->SetLabel(SkinListElement::Type::Year, std::to_wstring(1970 + album % 50));
+			root->AddChild(head);
+		}
+
+		SkinListNode* node = new SkinListNode();
+		node->SetFile(L"D:\\Music\\Artist " + std::to_wstring(album / 5) + L"\\Album " + std::to_wstring(album) +
+			L"\\" + std::to_wstring(i % benchGroup + 1) + L" Title " + std::to_wstring(i) + L".mp3");
+		node->idLibrary = i + 1;
+		node->SetLabel(SkinListElement::Type::Title, L"Title " + std::to_wstring(i));
+		node->SetLabel(SkinListElement::Type::Artist, L"Artist " + std::to_wstring(album / 5));
+		node->SetLabel(SkinListElement::Type::Album, L"Album " + std::to_wstring(album));
+		node->SetLabel(SkinListElement::Type::Track, std::to_wstring(i % benchGroup + 1));
+		head->AddChild(node);
+	}
+}
+
+double HeapAllocations()
+{
+	const int count = benchNodes + benchNodes / benchGroup;
+	std::vector<void*> ptrs(count);
+
+	Timer timer;
+
+	for (int j = 0; j < benchCycles; ++j)
+	{
+		for (int i = 0; i < count; ++i)
+			ptrs[i] = ::operator new(sizeof(SkinListNode));
+		for (int i = 0; i < count; ++i)
+			::operator delete(ptrs[i]);
+	}
+
+	return timer.Seconds() / benchCycles;
+}
+
+} // namespace
+
+bool BenchNodePool()
+{
+	Memory memoryStart = GetMemory();
+
+	double timeFill = 0.0;
+	double timeClear = 0.0;
+	std::size_t memoryFilled = 0;
+
+	for (int j = 0; j < benchCycles; ++j)
+	{
+		SkinListNode root;
+
+		Timer timerFill;
+		FillList(&root);
+		double time = timerFill.Seconds();
+		if (j > 0) // The first cycle creates the pool blocks
+			timeFill += time;
+
+		memoryFilled = GetMemory().current;
+
+		Timer timerClear;
+		root.EmptyChild(); // The same as SkinList::DeleteAllNode
+		if (j > 0)
+			timeClear += timerClear.Seconds();
+	}
+
+	timeFill /= benchCycles - 1;
+	timeClear /= benchCycles - 1;
+
+	Memory memoryEnd = GetMemory();
+
+	double timeHeap = HeapAllocations();
+
+	const int count = benchNodes + benchNodes / benchGroup;
+	wprintf(L"  %d nodes: fill %.1f ms, clear %.1f ms (%.0f ns per node)\n",
+		count, timeFill * 1000.0, timeClear * 1000.0, (timeFill + timeClear) * 1e9 / count);
+	wprintf(L"  Heap new/delete of the same nodes without labels: %.1f ms\n", timeHeap * 1000.0);
+	wprintf(L"  Private bytes: start %.1f MB, filled %.1f MB, cleared %.1f MB, peak %.1f MB\n",
+		memoryStart.current / 1048576.0, memoryFilled / 1048576.0,
+		memoryEnd.current / 1048576.0, memoryEnd.peak / 1048576.0);
+
+	return true;
+}
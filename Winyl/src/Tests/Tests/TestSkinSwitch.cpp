@@ -0,0 +1,264 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../../ExImage.h"
+#include "../../SkinCache.h"
+#include "../../XmlFile.h"
+#include "../../ZipFile.h"
+#include "../../FileSystem.h"
+#include <vector>
+
+// Skin switch benchmark: all images and xml files of a skin are loaded from the skin pack the same way
+// as at the skin switch (ExImage::LoadEx and XmlFile::LoadEx with SkinCache opened for the skin,
+// see WinylWnd::OpenSkinCache). Cold = the cache is empty, each image is decoded by WIC and each xml file
+// is parsed from the mapped pack, warm = the cache is reopened, the images are created from the cached pixels
+// and the xml files are read from the flattened trees.
+// The pack is made from the skin folder in the temp folder with stored (not compressed) files
+// the same as PackSkin makes it.
+
+std::wstring benchSkinFolder = L"..\\..\\..\\data\\Skin\\Light\\";
+
+namespace
+{
+
+struct PackFile
+{
+	std::string name; // UTF-8 with '/' as the separator
+	std::vector<char> data;
+	unsigned int offset = 0; // Offset of the local file header
+};
+
+void FindSkinFiles(const std::wstring& path, const std::wstring& folder, std::vector<std::wstring>& files)
+{
+	FileSystem::Find find(path + folder);
+	while (find.Next())
+	{
+		if (find.IsDirectory())
+			FindSkinFiles(path, folder + find.GetFileName() + L"\\", files);
+		else
+			files.push_back(folder + find.GetFileName());
+	}
+}
+
+bool ReadWholeFile(const std::wstring& file, std::vector<char>& data)
+{
+	FileHandle fileHandle(::CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!fileHandle)
+		return false;
+
+	LARGE_INTEGER size = {};
+	::GetFileSizeEx(fileHandle.get(), &size);
+	data.resize((std::size_t)size.QuadPart);
+	if (data.empty())
+		return true;
+
+	DWORD bytesRead = 0;
+	return ::ReadFile(fileHandle.get(), data.data(), (DWORD)data.size(), &bytesRead, NULL) && bytesRead == data.size();
+}
+
+void PutShort(std::vector<char>& out, unsigned int value)
+{
+	out.push_back((char)(value & 0xFF));
+	out.push_back((char)((value >> 8) & 0xFF));
+}
+
+void PutInt(std::vector<char>& out, unsigned int value)
+{
+	PutShort(out, value & 0xFFFF);
+	PutShort(out, value >> 16);
+}
+
+// Only what ZipFile::OpenFile reads, the CRC is not checked there so it is not calculated
+bool WriteSkinPack(const std::wstring& file, std::vector<PackFile>& files)
+{
+	std::vector<char> out;
+
+	for (PackFile& f : files)
+	{
+		f.offset = (unsigned int)out.size();
+
+		PutInt(out, 0x04034b50); // Local file header signature
+		PutShort(out, 20); // Version needed to extract
+		PutShort(out, 0x0800); // Flags: UTF-8 names
+		PutShort(out, 0); // Compression method: stored
+		PutInt(out, 0); // Time and date
+		PutInt(out, 0); // CRC-32
+		PutInt(out, (unsigned int)f.data.size()); // Compressed size
+		PutInt(out, (unsigned int)f.data.size()); // Uncompressed size
+		PutShort(out, (unsigned int)f.name.size());
+		PutShort(out, 0); // Extra field length
+		out.insert(out.end(), f.name.begin(), f.name.end());
+		out.insert(out.end(), f.data.begin(), f.data.end());
+	}
+
+	unsigned int dirOffset = (unsigned int)out.size();
+
+	for (const PackFile& f : files)
+	{
+		PutInt(out, 0x02014b50); // Central directory file header signature
+		PutShort(out, 20); // Version made by
+		PutShort(out, 20); // Version needed to extract
+		PutShort(out, 0x0800);
+		PutShort(out, 0);
+		PutInt(out, 0);
+		PutInt(out, 0);
+		PutInt(out, (unsigned int)f.data.size());
+		PutInt(out, (unsigned int)f.data.size());
+		PutShort(out, (unsigned int)f.name.size());
+		PutShort(out, 0); // Extra field length
+		PutShort(out, 0); // File comment length
+		PutShort(out, 0); // Disk number
+		PutShort(out, 0); // Internal attributes
+		PutInt(out, 0); // External attributes
+		PutInt(out, f.offset);
+		out.insert(out.end(), f.name.begin(), f.name.end());
+	}
+
+	unsigned int dirSize = (unsigned int)out.size() - dirOffset;
+
+	PutInt(out, 0x06054b50); // End of central directory signature
+	PutShort(out, 0);
+	PutShort(out, 0);
+	PutShort(out, (unsigned int)files.size());
+	PutShort(out, (unsigned int)files.size());
+	PutInt(out, dirSize);
+	PutInt(out, dirOffset);
+	PutShort(out, 0); // Comment length
+
+	FileHandle fileHandle(::CreateFileW(file.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!fileHandle)
+		return false;
+
+	DWORD bytesWritten = 0;
+	return ::WriteFile(fileHandle.get(), out.data(), (DWORD)out.size(), &bytesWritten, NULL) && bytesWritten == out.size();
+}
+
+bool LoadSkinFiles(const std::wstring& skinPack, const std::wstring& cachePath,
+	const std::vector<std::wstring>& images, const std::vector<std::wstring>& xmls, double& time)
+{
+	LARGE_INTEGER freq, start, end;
+	::QueryPerformanceFrequency(&freq);
+	::QueryPerformanceCounter(&start);
+
+	ZipFile zipFile;
+	if (!zipFile.OpenFile(skinPack))
+		return false;
+
+	SkinCache::Instance().Open(cachePath, L"WinylBench", skinPack);
+
+	bool result = true;
+	for (const std::wstring& image : images)
+	{
+		ExImage exImage;
+		if (!exImage.LoadEx(image, &zipFile))
+			result = false;
+	}
+
+	for (const std::wstring& xml : xmls)
+	{
+		XmlFile xmlFile;
+		if (!xmlFile.LoadEx(xml, &zipFile) || !xmlFile.RootNode().FirstChild())
+			result = false;
+	}
+
+	SkinCache::Instance().Close();
+
+	::QueryPerformanceCounter(&end);
+	time = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+
+	return result;
+}
+
+} // namespace
+
+bool BenchSkinSwitch()
+{
+	std::vector<std::wstring> names;
+	if (FileSystem::Exists(benchSkinFolder))
+		FindSkinFiles(benchSkinFolder, L"", names);
+	if (names.empty())
+	{
+		wprintf(L"  No skin in %s, skipped\n", benchSkinFolder.c_str());
+		return true;
+	}
+
+	std::vector<PackFile> files;
+	std::vector<std::wstring> images;
+	std::vector<std::wstring> xmls;
+
+	for (const std::wstring& name : names)
+	{
+		PackFile f;
+		if (!ReadWholeFile(benchSkinFolder + name, f.data) || f.data.empty())
+			continue;
+
+		std::wstring zipName = name;
+		std::replace(zipName.begin(), zipName.end(), '\\', '/');
+		f.name = UTF::UTF8S(zipName);
+		files.push_back(std::move(f));
+
+		std::wstring ext = PathEx::ExtFromFile(zipName);
+		if (ext == L"png")
+			images.push_back(name);
+		else if (ext == L"xml")
+			xmls.push_back(name);
+	}
+
+	wchar_t tempPath[MAX_PATH] = {};
+	::GetTempPathW(MAX_PATH, tempPath);
+	std::wstring skinPack = std::wstring(tempPath) + L"WinylBench.wzp";
+	std::wstring cacheFile = SkinCache::GetCacheFile(tempPath, L"WinylBench", true);
+
+	if (!WriteSkinPack(skinPack, files))
+	{
+		wprintf(L"  Cannot write %s\n", skinPack.c_str());
+		return true;
+	}
+
+	::CoInitializeEx(NULL, COINIT_APARTMENTTHREADED|COINIT_DISABLE_OLE1DDE);
+	ExImage::Source::ImagingFactory::Instance().Init();
+
+	const int passes = 5;
+	double timeCold = 0.0, timeWarm = 0.0;
+
+	for (int i = 0; i < passes; ++i)
+	{
+		double time = 0.0;
+
+		::DeleteFileW(cacheFile.c_str());
+		if (!LoadSkinFiles(skinPack, tempPath, images, xmls, time))
+			wprintf(L"  Some files are not loaded\n");
+		timeCold += time;
+
+		LoadSkinFiles(skinPack, tempPath, images, xmls, time);
+		timeWarm += time;
+	}
+
+	ExImage::Source::ImagingFactory::Instance().Free();
+	::CoUninitialize();
+
+	::DeleteFileW(cacheFile.c_str());
+	::DeleteFileW(skinPack.c_str());
+
+	wprintf(L"  %d images, %d xml files: cold %.1f ms, warm %.1f ms\n", (int)images.size(), (int)xmls.size(),
+		timeCold * 1000.0 / passes, timeWarm * 1000.0 / passes);
+
+	return true;
+}
@@ -0,0 +1,168 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../../XmlFile.h"
+#include "../../SkinCache.h"
+#include "../../FileSystem.h"
+#include <string>
+
+// Skin xml through SkinCache: the first load parses the file and saves the flattened tree,
+// after the cache is reopened the tree is read from the mapped file (XmlFlat) and must give
+// the same result for everything XmlNode returns. When the file is changed it is parsed again.
+
+namespace
+{
+
+const char skinXml[] =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<Skin Version=\"1\" Name=\"Test &amp; skin\">\n"
+	"  <Element Type=\"Button\" X=\"10\" Y=\"-5\" Color=\"0x1F\" Show=\"1\"/>\n"
+	"  <element Type=\"Text\">Text value</element>\n"
+	"  <Element Type=\"Slider\"><Layout Left=\"4\" Big=\"5000000000\"/></Element>\n"
+	"  <Empty/>\n"
+	"</Skin>\n";
+
+const char* attrNames[] = {"Version", "Name", "Type", "X", "Y", "Color", "Show", "Left", "Big", "type", "None"};
+
+void DumpNode(XmlNode xmlNode, std::string& out)
+{
+	out += "<";
+	out += xmlNode.Name();
+	out += ">";
+	out += xmlNode.Value8();
+
+	for (const char* attr : attrNames)
+	{
+		const char* value = xmlNode.AttributeRaw(attr);
+		const char* valueNoCase = xmlNode.AttributeNoCase(attr);
+		int valueInt = 0;
+		bool valueBool = false;
+		long long valueLong = 0;
+		bool isInt = xmlNode.Attribute(attr, &valueInt);
+		bool isBool = xmlNode.Attribute(attr, &valueBool);
+		bool isLong = xmlNode.AttributeLong(attr, &valueLong);
+
+		char buffer[256];
+		sprintf_s(buffer, " %s=%s|%s|%d%d%d|%d|%d|%lld", attr, value ? value : "-", valueNoCase ? valueNoCase : "-",
+			(int)isInt, (int)isBool, (int)isLong, valueInt, (int)valueBool, valueLong);
+		out += buffer;
+	}
+
+	XmlNode xmlElement = xmlNode.FirstChild("Element");
+	out += xmlElement ? " first:" + xmlElement.Attribute8("Type") : " first:-";
+	if (xmlElement)
+	{
+		XmlNode xmlNext = xmlElement.NextChild("Element");
+		out += xmlNext ? " next:" + xmlNext.Attribute8("Type") : " next:-";
+	}
+	XmlNode xmlNoCase = xmlNode.FirstChildNoCase("ELEMENT");
+	out += xmlNoCase ? " nocase:" + xmlNoCase.Attribute8("Type") : " nocase:-";
+	if (xmlNoCase)
+	{
+		XmlNode xmlNext = xmlNoCase.NextChildNoCase("ELEMENT");
+		out += xmlNext ? " nextnocase:" + xmlNext.Attribute8("Type") : " nextnocase:-";
+	}
+	out += "\n";
+
+	for (XmlNode xmlChild = xmlNode.FirstChild(); xmlChild; xmlChild = xmlChild.NextChild())
+		DumpNode(xmlChild, out);
+}
+
+bool WriteXml(const std::wstring& file, const std::string& xml, long long time)
+{
+	FileHandle fileHandle(::CreateFileW(file.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!fileHandle)
+		return false;
+
+	DWORD bytesWritten = 0;
+	if (!::WriteFile(fileHandle.get(), xml.data(), (DWORD)xml.size(), &bytesWritten, NULL) || bytesWritten != xml.size())
+		return false;
+
+	// The cache compares the time in seconds, so set it instead of waiting
+	ULARGE_INTEGER ull;
+	ull.QuadPart = (unsigned long long)(time + 11644473600LL) * 10000000ULL;
+	FILETIME ft = {ull.LowPart, ull.HighPart};
+	return ::SetFileTime(fileHandle.get(), NULL, NULL, &ft) ? true : false;
+}
+
+bool LoadXml(const std::wstring& cachePath, const std::wstring& file, std::string& out)
+{
+	out.clear();
+
+	SkinCache::Instance().Open(cachePath, L"WinylTest", L"");
+
+	XmlFile xmlFile;
+	bool result = xmlFile.LoadEx(file, nullptr);
+	if (result)
+		DumpNode(xmlFile.RootNode(), out);
+
+	SkinCache::Instance().Close();
+
+	return result;
+}
+
+} // namespace
+
+bool TestSkinXml()
+{
+	wchar_t tempPath[MAX_PATH] = {};
+	::GetTempPathW(MAX_PATH, tempPath);
+	std::wstring cachePath = tempPath;
+	std::wstring cacheFile = SkinCache::GetCacheFile(cachePath, L"WinylTest", false);
+	std::wstring file = cachePath + L"WinylTestSkin.xml";
+
+	::DeleteFileW(cacheFile.c_str());
+
+	bool result = true;
+
+	std::string parsed, cached;
+	if (!WriteXml(file, skinXml, 1500000000) || !LoadXml(cachePath, file, parsed) || !LoadXml(cachePath, file, cached))
+	{
+		wprintf(L"  Cannot load %s\n", file.c_str());
+		result = false;
+	}
+	else
+	{
+		if (parsed.find("Test & skin") == std::string::npos || parsed.find("<element>Text value") == std::string::npos)
+		{
+			wprintf(L"  The parsed tree is wrong\n");
+			result = false;
+		}
+		if (cached != parsed)
+		{
+			wprintf(L"  The tree from the cache is different:\n%S", cached.c_str());
+			result = false;
+		}
+	}
+
+	// The cache must not return the old tree for the changed file
+	std::string changed = "<Skin Version=\"2\"/>";
+	if (result && (!WriteXml(file, changed, 1500000010) || !LoadXml(cachePath, file, cached) ||
+		cached.find(" Version=2|") == std::string::npos))
+	{
+		wprintf(L"  The changed file is loaded from the cache\n");
+		result = false;
+	}
+
+	::DeleteFileW(file.c_str());
+	::DeleteFileW(cacheFile.c_str());
+
+	return result;
+}
@@ -0,0 +1,74 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Tests.cpp : Defines the entry point for the console application.
+// Run without parameters to run all tests, the exit code is the number of failed tests.
+// Run with the parameter bench to run the benchmarks after the tests,
+// the second parameter is the skin folder for the skin switch benchmark.
+//
+
+#include "stdafx.h"
+#include "Tests.h"
+
+FutureWin* futureWin = nullptr;
+
+static int RunTest(const wchar_t* name, bool (*test)())
+{
+	wprintf(L"%s...\n", name);
+
+	DWORD time = ::GetTickCount();
+	bool result = test();
+	time = ::GetTickCount() - time;
+
+	wprintf(L"%s: %s (%u ms)\n", name, result ? L"OK" : L"FAILED", (unsigned)time);
+
+	return result ? 0 : 1;
+}
+
+int _tmain(int argc, _TCHAR* argv[])
+{
+	futureWin = new FutureWin();
+
+	int failed = 0;
+
+	failed += RunTest(L"RingBuffer", TestRingBuffer);
+	failed += RunTest(L"Equalizer", TestEqualizer);
+	failed += RunTest(L"HttpClient", TestHttpClient);
+	failed += RunTest(L"ReplayGain", TestReplayGain);
+	failed += RunTest(L"SkinXml", TestSkinXml);
+
+	if (argc > 1 && _tcscmp(argv[1], _T("bench")) == 0)
+	{
+		if (argc > 2)
+		{
+			benchSkinFolder = argv[2];
+			if (!benchSkinFolder.empty() && benchSkinFolder.back() != '\\')
+				benchSkinFolder.push_back('\\');
+		}
+
+		RunTest(L"Equalizer benchmark", BenchEqualizer);
+		RunTest(L"Skin switch benchmark", BenchSkinSwitch);
+		RunTest(L"Statement cache benchmark", BenchStatementCache);
+		RunTest(L"Sort keys benchmark", BenchSortKeys);
+		RunTest(L"Node pool benchmark", BenchNodePool);
+	}
+
+	delete futureWin;
+
+	return failed;
+}
@@ -0,0 +1,39 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <string>
+
+// Tests and benchmarks of the parts that do not need the audio device or the main window.
+// Each test returns false if it is failed and prints the reason with wprintf.
+
+bool TestRingBuffer();
+bool TestEqualizer();
+bool TestHttpClient();
+bool TestReplayGain();
+bool TestSkinXml();
+
+// Benchmarks, they only print the results
+bool BenchEqualizer();
+bool BenchSkinSwitch();
+bool BenchStatementCache();
+bool BenchSortKeys();
+bool BenchNodePool();
+
+extern std::wstring benchSkinFolder; // The skin for BenchSkinSwitch
@@ -0,0 +1,43 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// stdafx.cpp : source file that includes just the standard includes
+// Tests.pch will be the pre-compiled header
+// stdafx.obj will contain the pre-compiled type information
+
+#include "stdafx.h"
+
+// The same libs as in Winyl stdafx.cpp, sqlite3 is built by its own project
+#pragma comment(lib, "Ws2_32.lib")
+#pragma comment(lib, "Winhttp.lib")
+
+#ifndef _WIN64
+#	ifndef NDEBUG
+#		pragma comment(lib, "../../sqlite3/sqlite3/Debug/sqlite3.lib")
+#	else
+#		pragma comment(lib, "../../sqlite3/sqlite3/Release/sqlite3.lib")
+#	endif
+#else // _WIN64
+#	ifndef NDEBUG
+#		pragma comment(lib, "../../sqlite3/sqlite3/x64/Debug/sqlite3.lib")
+#	else
+#		pragma comment(lib, "../../sqlite3/sqlite3/x64/Release/sqlite3.lib")
+#	endif
+#endif
+
+// TODO: reference any additional headers you need in STDAFX.H
+// and not in this file
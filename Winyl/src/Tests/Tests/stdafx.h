@@ -0,0 +1,49 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// stdafx.h : include file for standard system include files,
+// or project specific include files that are used frequently, but
+// are changed infrequently
+//
+
+#pragma once
+
+#include "targetver.h"
+
+// The same as in Winyl stdafx.h
+#define WINVER 0x0501
+#define _WIN32_WINNT 0x0601
+
+#define STRICT
+#define NOMINMAX
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+
+#include "uxtheme.h"
+#include "ShObjIdl.h"
+#include "Shlobj.h"
+
+#include "../../mtypes.h"
+
+#include "../../AutoHandle.h"
+
+#include "../../FutureWin.h"
+extern FutureWin* futureWin;
+
+#define TESTS
@@ -23,7 +23,12 @@
 #include <stdexcept>
 #include <functional>
 #include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <algorithm>
 #include "FutureWin.h"
+#include "RingBuffer.h"
 
 namespace Threading
 {
@@ -196,14 +201,21 @@ private:
 
 // Mutex
 
+// Mutex can be a static object (NodePool, StringPool etc.), static objects are created before
+// futureWin is initialized and destroyed after it is deleted, so the lock type is chosen once
+// in the constructor and a critical section is used if futureWin is not initialized yet.
+
 class Mutex final
 {
 public:
 	Mutex()
 	{
-		if (futureWin->IsSevenOrLater()) // TryAcquireSRWLockExclusive available only since Win7
+		if (futureWin && futureWin->IsSevenOrLater()) // TryAcquireSRWLockExclusive available only since Win7
+		{
+			isSRWLock = true;
 			futureWin->InitializeSRWLock(&srwLock);
-		else if (futureWin->IsVistaOrLater())
+		}
+		else if (futureWin && futureWin->IsVistaOrLater())
 			futureWin->InitializeCriticalSectionEx(&critSection, 4000, CRITICAL_SECTION_NO_DEBUG_INFO);
 		else
 			::InitializeCriticalSectionAndSpinCount(&critSection, 4000);
@@ -212,7 +224,7 @@ public:
 	{
 		assert(idThread == 0); // Mutex is locked
 
-		if (!futureWin->IsSevenOrLater())
+		if (!isSRWLock)
 			::DeleteCriticalSection(&critSection);
 	}
 	Mutex(const Mutex&) = delete;
@@ -222,7 +234,7 @@ public:
 	{
 		assert(idThread != ::GetCurrentThreadId()); // Lock on the same thread = deadlock
 
-		if (futureWin->IsSevenOrLater())
+		if (isSRWLock)
 			futureWin->AcquireSRWLockExclusive(&srwLock);
 		else
 			::EnterCriticalSection(&critSection);
@@ -237,7 +249,7 @@ public:
 #ifndef NDEBUG
 		idThread = 0;
 #endif
-		if (futureWin->IsSevenOrLater())
+		if (isSRWLock)
 			futureWin->ReleaseSRWLockExclusive(&srwLock);
 		else
 			::LeaveCriticalSection(&critSection);
@@ -246,7 +258,7 @@ public:
 	{
 		assert(idThread != ::GetCurrentThreadId()); // TryLock on the same thread = undefined behavior
 
-		if (futureWin->IsSevenOrLater())
+		if (isSRWLock)
 		{
 			if (futureWin->TryAcquireSRWLockExclusive(&srwLock))
 			{
@@ -275,6 +287,7 @@ public:
 	// https://msdn.microsoft.com/en-gb/magazine/jj721588.aspx
 
 private:
+	bool isSRWLock = false;
 	SRWLOCK srwLock;
 	CRITICAL_SECTION critSection;
 #ifndef NDEBUG
@@ -568,6 +581,130 @@ private:
 	Event::EventXP eventXP;
 };
 
+// BoundedQueue
+// Blocking FIFO queue with limited capacity to pass work between threads (producer waits when the queue is full).
+// After Close producers are released and Push fails, consumers get the rest of items and then Pop fails.
+template<class T>
+class BoundedQueue final
+{
+public:
+	explicit BoundedQueue(std::size_t capacity)
+	{
+		assert(capacity > 0);
+		semaphoreItems = ::CreateSemaphoreW(NULL, 0, (LONG)capacity, NULL);
+		semaphoreSlots = ::CreateSemaphoreW(NULL, (LONG)capacity, (LONG)capacity, NULL);
+		eventClose = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+		if (semaphoreItems == NULL || semaphoreSlots == NULL || eventClose == NULL)
+		{
+			DeInit();
+			throw std::runtime_error("BoundedQueue Init Error");
+		}
+	}
+	~BoundedQueue()
+	{
+		DeInit();
+	}
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	bool Push(T&& item)
+	{
+		// Close goes first so a full queue does not block the producer after Close
+		HANDLE handles[2] = {eventClose, semaphoreSlots};
+		switch (::WaitForMultipleObjectsEx(2, handles, FALSE, INFINITE, FALSE))
+		{
+		case WAIT_OBJECT_0:
+			return false;
+		case WAIT_OBJECT_0 + 1:
+			break;
+		default:
+			throw std::runtime_error("BoundedQueue Push Error");
+		}
+
+		mutex.Lock();
+		items.push_back(std::move(item));
+		mutex.Unlock();
+
+		::ReleaseSemaphore(semaphoreItems, 1, NULL);
+		return true;
+	}
+	bool Pop(T& item)
+	{
+		// Items go first so the queue is drained before Close is noticed
+		HANDLE handles[2] = {semaphoreItems, eventClose};
+		switch (::WaitForMultipleObjectsEx(2, handles, FALSE, INFINITE, FALSE))
+		{
+		case WAIT_OBJECT_0:
+			return PopTaken(item);
+		case WAIT_OBJECT_0 + 1:
+			// Closed, but still take the items that are left, each with its own count
+			// so other consumers do not get the same item and the counts stay balanced
+			if (::WaitForSingleObjectEx(semaphoreItems, 0, FALSE) == WAIT_OBJECT_0)
+				return PopTaken(item);
+			return false;
+		default:
+			throw std::runtime_error("BoundedQueue Pop Error");
+		}
+	}
+	// Take an item only if it is available now
+	bool TryPop(T& item)
+	{
+		if (::WaitForSingleObjectEx(semaphoreItems, 0, FALSE) == WAIT_OBJECT_0)
+			return PopTaken(item);
+		return false;
+	}
+	// Wait for at least one item then take all available items up to maxCount
+	bool PopBatch(std::vector<T>& batch, std::size_t maxCount)
+	{
+		batch.clear();
+
+		T item;
+		if (!Pop(item))
+			return false;
+		batch.push_back(std::move(item));
+
+		while (batch.size() < maxCount && TryPop(item))
+			batch.push_back(std::move(item));
+		return true;
+	}
+	void Close()
+	{
+		// Manual reset event, wakes all producers blocked on a full queue and all idle consumers
+		::SetEvent(eventClose);
+	}
+
+private:
+	// Take the item after its count is taken from semaphoreItems and free its slot
+	bool PopTaken(T& item)
+	{
+		if (!PopFront(item))
+			return false;
+		::ReleaseSemaphore(semaphoreSlots, 1, NULL);
+		return true;
+	}
+	bool PopFront(T& item)
+	{
+		LockGuard lock(mutex);
+		if (items.empty())
+			return false;
+		item = std::move(items.front());
+		items.pop_front();
+		return true;
+	}
+	void DeInit()
+	{
+		if (semaphoreItems) {::CloseHandle(semaphoreItems); semaphoreItems = NULL;}
+		if (semaphoreSlots) {::CloseHandle(semaphoreSlots); semaphoreSlots = NULL;}
+		if (eventClose) {::CloseHandle(eventClose); eventClose = NULL;}
+	}
+
+	std::deque<T> items;
+	Mutex mutex;
+	HANDLE semaphoreItems = NULL;
+	HANDLE semaphoreSlots = NULL;
+	HANDLE eventClose = NULL;
+};
+
 } // namespace Threading
 
 // Global usings
@@ -0,0 +1,282 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "Waveform.h"
+#include "FileSystem.h"
+#include "bass/bass.h"
+#include <cmath>
+#include <algorithm>
+
+Waveform::Waveform()
+{
+	static_assert(sizeof(Bucket) == 3, "Wrong size of Waveform::Bucket");
+	static_assert(sizeof(Header) == 32, "Wrong size of Waveform::Header");
+}
+
+Waveform::~Waveform()
+{
+
+}
+
+bool Waveform::LoadFile(const std::wstring& cachePath, const std::wstring& file, const std::atomic<bool>& isStop)
+{
+	buckets.clear();
+
+	FileSystem::FindFile findFile(file);
+	if (!findFile.IsFound())
+		return false;
+
+	long long fileSize = findFile.GetFileSize();
+	long long fileTime = findFile.GetModified();
+
+	std::wstring cacheFile = cachePath + L"\\" +
+		StringEx::Format(L"%016llX", (unsigned long long)StringEx::HashFNV1a64(StringEx::ToLowerUS(file))) + L".peaks";
+
+	if (ReadCache(cacheFile, fileSize, fileTime))
+		return true;
+
+	if (!Extract(file, isStop))
+		return false;
+
+	FileSystem::CreateDir(cachePath);
+	if (WriteCache(cacheFile, fileSize, fileTime))
+		PruneCache(cachePath, cacheFile);
+
+	return true;
+}
+
+void Waveform::Slice(double start, double length)
+{
+	std::size_t first = (std::size_t)std::max(0.0, start * BucketsPerSecond + 0.5);
+	first = std::min(first, buckets.size());
+
+	std::size_t last = buckets.size();
+	if (length > 0.0)
+		last = std::min(last, first + (std::size_t)(length * BucketsPerSecond + 0.5));
+
+	buckets = std::vector<Bucket>(buckets.begin() + first, buckets.begin() + last);
+}
+
+bool Waveform::Extract(const std::wstring& file, const std::atomic<bool>& isStop)
+{
+	HSTREAM stream = BASS_StreamCreateFile(FALSE, file.c_str(), 0, 0, BASS_UNICODE|BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT);
+	if (stream == NULL)
+		return false;
+
+	BASS_CHANNELINFO ci;
+	if (!BASS_ChannelGetInfo(stream, &ci) || ci.chans == 0 || ci.freq == 0)
+	{
+		BASS_StreamFree(stream);
+		return false;
+	}
+
+	int chans = (int)ci.chans;
+	long long rate = (long long)ci.freq;
+
+	QWORD length = BASS_ChannelGetLength(stream, BASS_POS_BYTE);
+	if (length != (QWORD)-1)
+		buckets.reserve((std::size_t)(BASS_ChannelBytes2Seconds(stream, length) * BucketsPerSecond) + 1);
+
+	std::vector<float> buffer((ci.freq / 10) * ci.chans);
+
+	// Bucket boundaries are calculated from the position so the time doesn't drift for any sample rate
+	long long position = 0;
+	long long bucketEnd = rate / BucketsPerSecond;
+	float bucketMin = 0.0f;
+	float bucketMax = 0.0f;
+	double bucketSum = 0.0;
+	long long bucketFrames = 0;
+
+	bool result = true;
+	for (;;)
+	{
+		if (isStop)
+		{
+			result = false;
+			break;
+		}
+
+		DWORD read = BASS_ChannelGetData(stream, buffer.data(), (DWORD)(buffer.size() * sizeof(float)));
+		if (read == (DWORD)-1 || read == 0) // The end
+			break;
+
+		const float* samples = buffer.data();
+		std::size_t frames = read / (sizeof(float) * chans);
+
+		for (std::size_t i = 0; i < frames; ++i)
+		{
+			float mono = 0.0f;
+			for (int c = 0; c < chans; ++c)
+			{
+				float sample = samples[c];
+				mono += sample;
+				bucketMin = std::min(bucketMin, sample);
+				bucketMax = std::max(bucketMax, sample);
+			}
+			samples += chans;
+
+			mono /= chans;
+			bucketSum += mono * mono;
+			++bucketFrames;
+
+			if (++position >= bucketEnd)
+			{
+				AddBucket(bucketMin, bucketMax, bucketSum / bucketFrames);
+
+				if (buckets.size() >= maxBuckets)
+					break;
+
+				bucketEnd = (long long)(buckets.size() + 1) * rate / BucketsPerSecond;
+				bucketMin = bucketMax = 0.0f;
+				bucketSum = 0.0;
+				bucketFrames = 0;
+			}
+		}
+
+		if (buckets.size() >= maxBuckets)
+			break;
+	}
+
+	BASS_StreamFree(stream);
+
+	// The last bucket is shorter
+	if (result && bucketFrames > 0 && buckets.size() < maxBuckets)
+		AddBucket(bucketMin, bucketMax, bucketSum / bucketFrames);
+
+	if (!result || buckets.empty())
+	{
+		buckets.clear();
+		return false;
+	}
+
+	return true;
+}
+
+void Waveform::AddBucket(float min, float max, double meanSquare)
+{
+	Bucket bucket;
+	bucket.min = (signed char)std::max(-127.0f, min * 127.0f);
+	bucket.max = (signed char)std::min(127.0f, max * 127.0f);
+	bucket.rms = (unsigned char)std::min(255.0, std::sqrt(meanSquare) * 255.0);
+	buckets.push_back(bucket);
+}
+
+bool Waveform::ReadCache(const std::wstring& cacheFile, long long fileSize, long long fileTime)
+{
+	FileHandle fileHandle(::CreateFileW(cacheFile.c_str(), GENERIC_READ|FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!fileHandle)
+		return false;
+
+	Header header = {};
+	DWORD bytesRead = 0;
+	if (!::ReadFile(fileHandle.get(), &header, sizeof(Header), &bytesRead, NULL) || bytesRead != sizeof(Header))
+		return false;
+
+	if (header.magic != fileMagic || header.bucketsPerSecond != BucketsPerSecond ||
+		header.fileSize != fileSize || header.fileTime != fileTime ||
+		header.count == 0 || header.count > maxBuckets)
+		return false;
+
+	buckets.resize(header.count);
+
+	DWORD size = (DWORD)(header.count * sizeof(Bucket));
+	if (!::ReadFile(fileHandle.get(), buckets.data(), size, &bytesRead, NULL) || bytesRead != size)
+	{
+		buckets.clear(); // The file is not complete
+		return false;
+	}
+
+	// Mark the file as recently used for PruneCache
+	FILETIME ft;
+	::GetSystemTimeAsFileTime(&ft);
+	::SetFileTime(fileHandle.get(), NULL, NULL, &ft);
+
+	return true;
+}
+
+bool Waveform::WriteCache(const std::wstring& cacheFile, long long fileSize, long long fileTime)
+{
+	FileHandle fileHandle(::CreateFileW(cacheFile.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!fileHandle)
+		return false;
+
+	Header header = {};
+	header.magic = fileMagic;
+	header.bucketsPerSecond = BucketsPerSecond;
+	header.fileSize = fileSize;
+	header.fileTime = fileTime;
+	header.count = (unsigned int)buckets.size();
+
+	DWORD bytesWritten = 0;
+	if (!::WriteFile(fileHandle.get(), &header, sizeof(Header), &bytesWritten, NULL) || bytesWritten != sizeof(Header))
+		return false;
+
+	DWORD size = (DWORD)(header.count * sizeof(Bucket));
+	if (!::WriteFile(fileHandle.get(), buckets.data(), size, &bytesWritten, NULL) || bytesWritten != size)
+		return false;
+
+	return true;
+}
+
+void Waveform::PruneCache(const std::wstring& cachePath, const std::wstring& keepFile)
+{
+	struct CacheFile
+	{
+		std::wstring file;
+		long long size;
+		long long time;
+	};
+
+	std::vector<CacheFile> files;
+	long long totalSize = 0;
+
+	FileSystem::Find find(cachePath + L"\\", L"*.peaks");
+	while (find.Next())
+	{
+		if (find.IsDirectory())
+			continue;
+
+		CacheFile cacheFile;
+		cacheFile.file = cachePath + L"\\" + find.GetFileName();
+		cacheFile.size = find.GetFileSize();
+		cacheFile.time = find.GetModified();
+		totalSize += cacheFile.size;
+		files.push_back(std::move(cacheFile));
+	}
+
+	if (totalSize <= maxCacheSize)
+		return;
+
+	// Remove the least recently used files until a quarter of the limit is free,
+	// so the folder is not enumerated again after each new track
+	std::sort(files.begin(), files.end(),
+		[](const CacheFile& a, const CacheFile& b) {return a.time < b.time;});
+
+	for (const auto& cacheFile : files)
+	{
+		if (totalSize <= maxCacheSize / 4 * 3)
+			break;
+
+		if (cacheFile.file == keepFile)
+			continue;
+
+		if (FileSystem::RemoveFile(cacheFile.file))
+			totalSize -= cacheFile.size;
+	}
+}
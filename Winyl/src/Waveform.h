@@ -0,0 +1,84 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+// Waveform overview of a track for the position slider (see SkinSlider::SetWaveform).
+// Peaks are extracted once by decoding the whole file (in the waveform thread of WinylWnd)
+// and saved in the Waveforms folder of the profile, one small file for each audio file.
+// The name of the file is the hash of the path, the size and modified time of the audio file
+// are stored in the header so the peaks are extracted again when the file is changed.
+// The folder is limited to maxCacheSize, the modified time of a peaks file is updated when it is read
+// so when the limit is exceeded the least recently used files are removed (see PruneCache).
+// Tracks of a cue sheet take a slice of the peaks of the image file.
+
+class Waveform
+{
+
+public:
+	Waveform();
+	virtual ~Waveform();
+	Waveform(const Waveform&) = delete;
+	Waveform& operator=(const Waveform&) = delete;
+
+	static const int BucketsPerSecond = 20;
+
+	struct Bucket
+	{
+		signed char min = 0; // -127..127
+		signed char max = 0;
+		unsigned char rms = 0; // 0..255
+	};
+
+	// Load the peaks from the cache folder or extract them and save to the cache,
+	// isStop is checked while extracting
+	bool LoadFile(const std::wstring& cachePath, const std::wstring& file, const std::atomic<bool>& isStop);
+
+	// Keep only a part of the track (in seconds), length == 0 to the end (for cue tracks)
+	void Slice(double start, double length);
+
+	inline const std::vector<Bucket>& GetBuckets() const {return buckets;}
+	inline bool IsEmpty() const {return buckets.empty();}
+
+private:
+	static const unsigned int fileMagic = 0x31505757; // "WWP1"
+	static const unsigned int maxBuckets = BucketsPerSecond * 60 * 60 * 24;
+	static const long long maxCacheSize = 64LL*1024*1024; // ~4500 tracks of 4 minutes
+
+	struct Header
+	{
+		unsigned int magic;
+		unsigned int bucketsPerSecond;
+		long long fileSize;
+		long long fileTime;
+		unsigned int count;
+		unsigned int reserved;
+	};
+
+	std::vector<Bucket> buckets;
+
+	bool Extract(const std::wstring& file, const std::atomic<bool>& isStop);
+	void AddBucket(float min, float max, double meanSquare);
+	bool ReadCache(const std::wstring& cacheFile, long long fileSize, long long fileTime);
+	bool WriteCache(const std::wstring& cacheFile, long long fileSize, long long fileTime);
+	static void PruneCache(const std::wstring& cachePath, const std::wstring& keepFile);
+};
@@ -19,6 +19,7 @@
 #include "resource.h"
 #include "WinylWnd.h"
 #include "FileSystem.h"
+#include <cmath>
 
 // This class is a mess, need to refactor it, it's doing too many things already.
 
@@ -44,11 +45,29 @@ WinylWnd::~WinylWnd()
 		threadCover.Join();
 	}
 
+	if (threadWaveform.IsJoinable())
+	{
+		// Stop extracting, the thread exits because there is no file
+		mutexWaveform.Lock();
+		waveformFile.clear();
+		isThreadWaveform = true;
+		mutexWaveform.Unlock();
+		threadWaveform.Join();
+	}
+
 	if (threadLyrics.IsJoinable())
 	{
 		threadLyrics.Join();
 	}
 
+	mutexLyricsPrefetch.Lock();
+	isLyricsPrefetchStop = true;
+	mutexLyricsPrefetch.Unlock();
+	if (threadLyricsPrefetch.IsJoinable())
+	{
+		threadLyricsPrefetch.Join();
+	}
+
 	if (threadSearch.IsJoinable())
 	{
 		dBase.SetStopSearch(true);
@@ -204,6 +223,9 @@ bool WinylWnd::NewWindow()
 	if (!zipFile)
 		settings.SetSkinPack(false);
 
+	// Use decoded images of the skin from the cache
+	OpenSkinCache(zipFile.get());
+
 	// Load skin fonts if needed
 	fontsLoader.LoadSkinFonts(programPath, settings.GetSkin(), zipFile.get(), true);
 
@@ -217,6 +239,7 @@ bool WinylWnd::NewWindow()
 
 		if (settings.IsSkinPack())
 			zipFile = skinDraw.NewZipFile(programPath, settings.GetSkin());
+		OpenSkinCache(zipFile.get());
 		skinDraw.LoadSkin(programPath, settings.GetSkin(), zipFile.get());
 	}
 
@@ -371,6 +394,8 @@ bool WinylWnd::NewWindow()
 	HttpClient::SetProxy(settings.GetProxy(), settings.GetProxyHost(),  settings.GetProxyPort(),
 		settings.GetProxyLogin(),  settings.GetProxyPass());
 
+	lyricsCache.Open(profilePath + L"Lyrics.db");
+
 	// Set audio library parameters
 	libAudio.SetProgramPath(programPath);
 	libAudio.SetProfilePath(profilePath);
@@ -384,6 +409,8 @@ bool WinylWnd::NewWindow()
 	}
 	libAudio.SetNoVolumeEffect(settings.IsBassNoVolume(), settings.IsBassNoEffect());
 	libAudio.SetPropertiesWA(settings.IsBassWasapiEvent(), settings.GetBassAsioChannel());
+	libAudio.SetPlayMemory(settings.IsPlayMemory(), settings.GetPlayMemoryBudget());
+	libAudio.SetCrossfade(settings.IsCrossfade(), settings.GetCrossfadeTime(), settings.GetCrossfadeCurve());
 	libAudio.SetProxy(settings.GetProxy(), settings.GetProxyHost(),  settings.GetProxyPort(), 
 		 settings.GetProxyLogin(),  settings.GetProxyPass());
 
@@ -394,6 +421,7 @@ bool WinylWnd::NewWindow()
 	dBase.SetProgramPath(programPath);
 	dBase.SetProfilePath(profilePath);
 	dBase.SetPortableVersion(isPortableVersion);
+	dBase.SetLibraryWAL(settings.IsLibraryWAL(), settings.GetLibraryWALCheckpoint());
 	dBase.OpenLibrary();
 	dBase.SetLanguage(&lang);
 
@@ -437,6 +465,8 @@ bool WinylWnd::NewWindow()
 	{
 		if (settings.GetLyricsProvider().empty())
 			contextMenu.CheckLyricsProvider(0);
+		else if (settings.GetLyricsProvider() == LyricsLoader::GetLyricsProviderAuto())
+			contextMenu.CheckLyricsProvider(-2);
 		else
 		{
 			int prov = LyricsLoader::GetLyricsProviderByURL(settings.GetLyricsProvider());
@@ -665,6 +695,9 @@ bool WinylWnd::ReloadSkin(const std::wstring& skinName, bool isSkinPack)
 	if (!zipFile)
 		settings.SetSkinPack(false);
 
+	// Use decoded images of the skin from the cache
+	OpenSkinCache(zipFile.get());
+
 	// Load new skin fonts if needed
 	fontsLoader.LoadSkinFonts(programPath, settings.GetSkin(), zipFile.get(), true);
 
@@ -678,6 +711,7 @@ bool WinylWnd::ReloadSkin(const std::wstring& skinName, bool isSkinPack)
 
 		if (settings.IsSkinPack())
 			zipFile = skinDraw.NewZipFile(programPath, settings.GetSkin());
+		OpenSkinCache(zipFile.get());
 		skinDraw.LoadSkin(programPath, settings.GetSkin(), zipFile.get());
 
 		result = false;
@@ -768,6 +802,8 @@ bool WinylWnd::ReloadSkin(const std::wstring& skinName, bool isSkinPack)
 
 	skinDraw.DrawMaximize(settings.IsMaximized());
 
+	skinDraw.DrawWaveform(waveform.get());
+
 
 	// Load popup window
 	skinPopup.reset();
@@ -849,6 +885,16 @@ bool WinylWnd::ReloadSkin(const std::wstring& skinName, bool isSkinPack)
 	return result;
 }
 
+void WinylWnd::OpenSkinCache(ZipFile* zipFile)
+{
+	std::wstring skinFile;
+	if (zipFile)
+		skinFile = programPath + L"Skin\\" + settings.GetSkin() + L".wzp";
+
+	SkinCache::RemoveUnused(profilePath, programPath + L"Skin\\");
+	SkinCache::Instance().Open(profilePath, settings.GetSkin(), skinFile);
+}
+
 bool WinylWnd::LoadWindows(bool isReload)
 {
 	for (std::size_t i = 0, isize = skinDraw.Layouts().size(); i < isize; ++i)
@@ -942,6 +988,8 @@ bool WinylWnd::LoadWindows(bool isReload)
 
 	skinEdit->SetFocusWnd(skinList->Wnd());
 
+	skinList->SetProfilePath(profilePath);
+	CoverMemory::Instance().SetBudget((std::size_t)settings.GetCoverMemory() * 1024 * 1024);
 	skinList->SetNoItemsString(lang.GetLineS(Lang::Playlist, 4));
 	skinList->EnablePlayFocus(settings.IsPlayFocus());
 	skinList->EnableSmoothScroll(settings.IsSmoothScroll());
@@ -1265,6 +1313,11 @@ void WinylWnd::OnDestroy()
 
 	SaveSettings();
 
+	dBase.FlushStats(); // Write pending play counts and ratings
+
+	HttpClient::CloseSession();
+	SkinCache::Instance().Close();
+
 	PostQuitMessage(0);
 }
 
@@ -1490,6 +1543,7 @@ void WinylWnd::ActionStop()
 	skinDraw.DrawTextNone();
 	SetLyricsNone();
 	SetCoverNone();
+	SetWaveformNone();
 
 	if (!settings.IsLibraryNowPlaying())
 		dBase.CloseNowPlaying();
@@ -1917,7 +1971,7 @@ bool WinylWnd::PlayNode(ListNodeUnsafe node, bool isRepeat, bool isNewNowPlaying
 		libAudio.PlayURL(node->GetFile(), isReconnect);
 	}
 	else
-		error = libAudio.PlayFile(node->GetFile(), node->GetCueValue());
+		error = libAudio.PlayFile(node->GetFile(), node->GetCueValue(), GetReplayGain(node));
 
 	if (error != LibAudio::Error::None)
 	{
@@ -1992,6 +2046,8 @@ bool WinylWnd::PlayNode(ListNodeUnsafe node, bool isRepeat, bool isNewNowPlaying
 		//skinDraw.DrawCover(pNode->csFile, csAlbum);
 		bool coverThread = CoverThread(node->GetFile());
 
+		WaveformThread(node->GetFile(), node->GetCueValue());
+
 		SetWindowCaption(artist, title.empty() ? filename : title);
 
 		win7TaskBar.UpdateButtons(thisWnd, true);
@@ -2026,6 +2082,7 @@ bool WinylWnd::PlayNode(ListNodeUnsafe node, bool isRepeat, bool isNewNowPlaying
 		skinDraw.DrawPlay(false);
 		SetLyricsNone(true);
 		SetCoverNone();
+		SetWaveformNone();
 
 		SetWindowCaption(L"", radioString, true);
 
@@ -2040,6 +2097,35 @@ bool WinylWnd::PlayNode(ListNodeUnsafe node, bool isRepeat, bool isNewNowPlaying
 	return true;
 }
 
+float WinylWnd::GetReplayGain(ListNodeUnsafe node)
+{
+	// Called from the main thread and from the thread of LibAudio when the next track is preloaded (see ChangeFile),
+	// values are taken from memory of DBase so the thread of LibAudio doesn't wait for the database
+
+	int mode = settings.GetReplayGainMode();
+	if (mode == 0 || node == nullptr || node->idLibrary == 0)
+		return 1.0f;
+
+	ReplayGain::Values values;
+	if (!dBase.GetReplayGain(node->idLibrary, values) || values.trackPeak <= 0.0f)
+		return 1.0f; // Not analyzed
+
+	// The id of a removed track can be taken by a new track
+	if ((unsigned)values.fileSize != node->trackSize)
+		return 1.0f;
+
+	float gain = values.trackGain;
+	float peak = values.trackPeak;
+	if (mode == 2 && values.albumPeak > 0.0f)
+	{
+		gain = values.albumGain;
+		peak = values.albumPeak;
+	}
+
+	// Do not let the peak go over full scale
+	return std::min((float)std::pow(10.0, gain / 20.0), 1.0f / peak);
+}
+
 void WinylWnd::StartRadio(LibAudio::Error error, bool isReconnect)
 {
 	EnableWaitRadioCursor(false);
@@ -2091,13 +2177,14 @@ void WinylWnd::StartRadio(LibAudio::Error error, bool isReconnect)
 	}
 }
 
-std::wstring WinylWnd::ChangeFile(long long& outCue)
+std::wstring WinylWnd::ChangeFile(long long& outCue, float& outReplayGain)
 {
 	ListNodeUnsafe tempNode = nullptr;
 	//tempFocusNode = nullptr;
 
 	std::wstring file;
 	outCue = 0;
+	outReplayGain = 1.0f;
 
 	if (isRepeatTrack) // Return the same track
 	{
@@ -2105,7 +2192,10 @@ std::wstring WinylWnd::ChangeFile(long long& outCue)
 		tempNode = playNode;
 
 		if (tempNode)
+		{
 			file = tempNode->GetFile();
+			outReplayGain = GetReplayGain(tempNode);
+		}
 
 		skinList->SetTempNode(tempNode);
 		return file;
@@ -2176,6 +2266,9 @@ std::wstring WinylWnd::ChangeFile(long long& outCue)
 	{
 		file = tempNode->GetFile();
 		outCue = tempNode->GetCueValue();
+		outReplayGain = GetReplayGain(tempNode);
+
+		LyricsPrefetch(tempNode);
 	}
 
 	skinList->SetTempNode(tempNode);
@@ -2234,6 +2327,8 @@ void WinylWnd::ChangeNode(bool isError, bool isRadio)
 
 			bool coverThread = CoverThread(skinList->GetTempNode()->GetFile());
 
+			WaveformThread(skinList->GetTempNode()->GetFile(), skinList->GetTempNode()->GetCueValue());
+
 			SetWindowCaption(artist, title.empty() ? filename : title);
 
 			// Increase skip count of the previous track
@@ -2268,6 +2363,7 @@ void WinylWnd::ChangeNode(bool isError, bool isRadio)
 			skinDraw.DrawPlay(false);
 			SetLyricsNone(true);
 			SetCoverNone();
+			SetWaveformNone();
 
 			SetWindowCaption(L"", radioString, true);
 
@@ -3258,6 +3354,12 @@ LRESULT WinylWnd::WindowProcMy(HWND hWnd, UINT message, WPARAM wParam, LPARAM lP
 	}
 	return 0;
 
+	case UWM_WAVEFORMDONE:
+	{
+		WaveformThreadDone();
+	}
+	return 0;
+
 	case UWM_LYRICSDONE:
 	{
 		LyricsThreadDone();
@@ -3647,10 +3749,10 @@ void WinylWnd::OnTimer(UINT_PTR nIDEvent)
 		}
 		else
 		{
-			// Get FFT data and draw it in visualizers
+			// Get spectrum and draw it in visualizers
 
-			float fft[1024];
-			libAudio.GetFFT(fft);
+			float spectrum[Spectrum::BandCount];
+			libAudio.GetSpectrum(spectrum);
 			
 			bool needStop = true;
 
@@ -3658,7 +3760,7 @@ void WinylWnd::OnTimer(UINT_PTR nIDEvent)
 			{
 				for (std::size_t i = 0, size = visuals.size(); i < size; ++i)
 				{
-					if (!visuals[i]->SetFFT((isMediaPlay && !isMediaPause) ? fft : nullptr, isMediaPause))
+					if (!visuals[i]->SetSpectrum((isMediaPlay && !isMediaPause) ? spectrum : nullptr, isMediaPause))
 						needStop = false;
 				}
 			}
@@ -3668,7 +3770,7 @@ void WinylWnd::OnTimer(UINT_PTR nIDEvent)
 			{
 				for (std::size_t i = 0, size = skinMini->visuals.size(); i < size; ++i)
 				{
-					if (!skinMini->visuals[i]->SetFFT((isMediaPlay && !isMediaPause) ? fft : nullptr, isMediaPause))
+					if (!skinMini->visuals[i]->SetSpectrum((isMediaPlay && !isMediaPause) ? spectrum : nullptr, isMediaPause))
 						needStop = false;
 				}
 			}
@@ -4124,6 +4226,16 @@ void WinylWnd::OnCommand(WPARAM wParam, LPARAM lParam)
 		settings.SetLyricsProvider(L"");
 		contextMenu.CheckLyricsProvider(-1);
 		break;
+	case ID_MENU_LYRICS_PROV_AUTO:
+		settings.SetLyricsProviderOff(false);
+		settings.SetLyricsProvider(LyricsLoader::GetLyricsProviderAuto());
+		contextMenu.CheckLyricsProvider(-2);
+		if (isMediaPlay && !isMediaRadio)
+		{
+			isThreadLyrics = true;
+			LyricsThreadStart();
+		}
+		break;
 	case ID_MENU_LYRICS_PROV_1:
 		settings.SetLyricsProviderOff(false);
 		settings.SetLyricsProvider(L"");
@@ -5072,6 +5184,95 @@ void WinylWnd::SetCoverNone()
 	win7TaskBar.EmptyCover(thisWnd);
 }
 
+void WinylWnd::WaveformThread(const std::wstring& file, long long cue)
+{
+	SetWaveformNone();
+
+	// Do not decode anything if the skin doesn't show the waveform
+	if (!skinDraw.IsWaveform())
+		return;
+
+	mutexWaveform.Lock();
+	isThreadWaveform = true;
+	waveformFile = file;
+	waveformCue = cue;
+	waveformDone.reset();
+	mutexWaveform.Unlock();
+
+	WaveformThreadStart();
+}
+
+void WinylWnd::WaveformThreadStart()
+{
+	if (!threadWaveform.IsRunning())
+	{
+		if (threadWaveform.IsJoinable())
+			threadWaveform.Join();
+
+		// Decoding the whole file should not slow down the playback and the interface
+		threadWaveform.StartBackground(std::bind(&WinylWnd::WaveformThreadRun, this));
+	}
+}
+
+void WinylWnd::WaveformThreadRun()
+{
+	while (isThreadWaveform)
+	{
+		mutexWaveform.Lock();
+		isThreadWaveform = false;
+		std::wstring file = waveformFile;
+		long long cue = waveformCue;
+		mutexWaveform.Unlock();
+
+		if (!file.empty())
+		{
+			// Tracks of the same cue sheet use the same peaks file, it is only sliced
+			std::unique_ptr<Waveform> newWaveform(new Waveform());
+
+			if (newWaveform->LoadFile(profilePath + L"Waveforms", file, isThreadWaveform))
+			{
+				if (cue)
+					newWaveform->Slice(CueFile::GetOffset(cue), CueFile::IsLenght(cue) ? CueFile::GetLenght(cue) : 0.0);
+
+				mutexWaveform.Lock();
+				if (!isThreadWaveform) // If another track is not started while extracting
+					waveformDone = std::move(newWaveform);
+				mutexWaveform.Unlock();
+			}
+		}
+	}
+
+	if (IsWnd()) ::PostMessageW(Wnd(), UWM_WAVEFORMDONE, 0, 0);
+}
+
+void WinylWnd::WaveformThreadDone()
+{
+	if (isThreadWaveform)
+	{
+		WaveformThreadStart();
+		return;
+	}
+
+	mutexWaveform.Lock();
+	std::unique_ptr<Waveform> newWaveform = std::move(waveformDone);
+	mutexWaveform.Unlock();
+
+	if (newWaveform && isMediaPlay && !isMediaRadio)
+	{
+		waveform = std::move(newWaveform);
+		skinDraw.DrawWaveform(waveform.get());
+	}
+}
+
+void WinylWnd::SetWaveformNone()
+{
+	if (!waveform)
+		return;
+
+	waveform.reset();
+	skinDraw.DrawWaveform(nullptr);
+}
+
 void WinylWnd::LyricsThread(const std::wstring& file, const std::wstring& title, const std::wstring& artist)
 {
 	if (!isLyricsWindow)
@@ -5120,9 +5321,18 @@ void WinylWnd::LyricsThreadRun()
 			{
 				if (!settings.IsLyricsProviderOff())
 				{
-					if (IsWnd()) ::PostMessageW(Wnd(), UWM_LYRICSRECV, 0, 0);
-					if (lyricsLoader.LoadLyricsFromInternet(artist, title, settings.GetLyricsProvider()))
-						lyricsSource = 3;
+					lyricsLoader.SetCache(&lyricsCache);
+					if (lyricsLoader.LoadLyricsFromCache(artist, title, settings.GetLyricsProvider()))
+					{
+						if (!lyricsLoader.GetLines().empty())
+							lyricsSource = 3;
+					}
+					else
+					{
+						if (IsWnd()) ::PostMessageW(Wnd(), UWM_LYRICSRECV, 0, 0);
+						if (lyricsLoader.LoadLyricsFromInternet(artist, title, settings.GetLyricsProvider()))
+							lyricsSource = 3;
+					}
 				}
 			}
 			else
@@ -5215,6 +5425,63 @@ void WinylWnd::LyricsThreadReload()
 	}
 }
 
+void WinylWnd::LyricsPrefetch(ListNodeUnsafe node)
+{
+	// Called from the thread of LibAudio when the next track is preloaded (see ChangeFile),
+	// only pass the track to the prefetch thread, tags are read from the database there
+
+	if (!isLyricsWindow || settings.IsLyricsProviderOff() || !lyricsCache.IsOpen())
+		return;
+
+	mutexLyricsPrefetch.Lock();
+
+	if (!isLyricsPrefetchStop)
+	{
+		isThreadLyricsPrefetch = true;
+		lyricsPrefetchFile = node->GetFile();
+		lyricsPrefetchIdLibrary = node->idLibrary;
+		lyricsPrefetchIdPlaylist = node->idPlaylist;
+
+		if (!threadLyricsPrefetch.IsRunning())
+		{
+			if (threadLyricsPrefetch.IsJoinable())
+				threadLyricsPrefetch.Join();
+
+			threadLyricsPrefetch.StartBackground(std::bind(&WinylWnd::LyricsPrefetchRun, this));
+		}
+	}
+
+	mutexLyricsPrefetch.Unlock();
+}
+
+void WinylWnd::LyricsPrefetchRun()
+{
+	while (isThreadLyricsPrefetch)
+	{
+		mutexLyricsPrefetch.Lock();
+		isThreadLyricsPrefetch = false;
+		std::wstring file = lyricsPrefetchFile;
+		long long idLibrary = lyricsPrefetchIdLibrary;
+		long long idPlaylist = lyricsPrefetchIdPlaylist;
+		mutexLyricsPrefetch.Unlock();
+
+		std::wstring filename, title, album, artist, genre, year;
+		dBase.GetSongTags(idLibrary, idPlaylist, filename, title, album, artist, genre, year);
+
+		if (title.empty() || artist.empty())
+			continue;
+
+		// Lyrics from the file or tags are loaded fast, no need to go to the internet
+		LyricsLoader lyricsLoader;
+		if (lyricsLoader.LoadLyricsFromFile(file) || lyricsLoader.LoadLyricsFromTags(file))
+			continue;
+
+		lyricsLoader.SetCache(&lyricsCache);
+		if (!lyricsLoader.LoadLyricsFromCache(artist, title, settings.GetLyricsProvider()))
+			lyricsLoader.LoadLyricsFromInternet(artist, title, settings.GetLyricsProvider());
+	}
+}
+
 void WinylWnd::DialogConfig(int page)
 {
 	//SetActiveWindow();
@@ -5287,6 +5554,8 @@ void WinylWnd::DialogLanguage()
 		{
 			if (settings.GetLyricsProvider().empty())
 				contextMenu.CheckLyricsProvider(0);
+			else if (settings.GetLyricsProvider() == LyricsLoader::GetLyricsProviderAuto())
+				contextMenu.CheckLyricsProvider(-2);
 			else
 			{
 				int prov = LyricsLoader::GetLyricsProviderByURL(settings.GetLyricsProvider());
@@ -5558,6 +5827,7 @@ void WinylWnd::ScanLibraryStart(bool isRemoveMissing, bool isIgnoreDeleted, bool
 	dlgProgressPtr->progress.SetFindMoved(isFindMoved);
 	dlgProgressPtr->progress.SetRescanAll(isRescanAll);
 	dlgProgressPtr->progress.SetAddAllToLibrary(settings.IsAddAllToLibrary());
+	dlgProgressPtr->progress.SetReplayGain(settings.IsReplayGainScan());
 
 	dlgProgressPtr->SetTaskbarMessage(wmTaskbarButtonCreated);
 	dlgProgressPtr->CreateModelessDialog(NULL, IDD_DLGPROGRESS);
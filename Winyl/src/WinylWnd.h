@@ -68,8 +68,12 @@
 #include "DlgNewVersion.h"
 #include "SkinLyrics.h"
 #include "LyricsLoader.h"
+#include "LyricsCache.h"
+#include "SkinCache.h"
 #include "HttpClient.h"
 #include "SkinShadow.h"
+#include "Waveform.h"
+#include "CueFile.h"
 
 class WinylWnd : public WindowEx
 {
@@ -97,7 +101,7 @@ public:
 	bool isDragDropOLE = false;
 	void StopDragDrop();
 
-	std::wstring ChangeFile(long long& outCue);
+	std::wstring ChangeFile(long long& outCue, float& outReplayGain);
 	void ChangeNode(bool isError, bool isRadio);
 
 private:
@@ -175,12 +179,28 @@ private:
 	void CoverThreadDone();
 	void SetCoverNone();
 
+	// Waveform thread
+	Threading::Thread threadWaveform;
+	Threading::Mutex mutexWaveform;
+	std::atomic<bool> isThreadWaveform = false; // Also stops extracting when a new track is started
+
+	std::wstring waveformFile;
+	long long waveformCue = 0;
+	std::unique_ptr<Waveform> waveformDone; // Passed from the thread
+	std::unique_ptr<Waveform> waveform; // For the playing track
+
+	void WaveformThread(const std::wstring& file, long long cue);
+	void WaveformThreadStart();
+	void WaveformThreadRun();
+	void WaveformThreadDone();
+	void SetWaveformNone();
+
 	// Lyrics thread
 	Threading::Thread threadLyrics;
 	Threading::Mutex mutexLyrics;
 	std::atomic<bool> isThreadLyrics = false;
 
-	bool isLyricsWindow = false;
+	std::atomic<bool> isLyricsWindow = false; // Also read by LyricsPrefetch from the thread of LibAudio
 	std::wstring lyricsFile, lyricsFileCur;
 	std::wstring lyricsTitle, lyricsTitleCur;
 	std::wstring lyricsArtist, lyricsArtistCur;
@@ -195,6 +215,19 @@ private:
 	void LyricsThreadReceiving();
 	void LyricsThreadReload();
 
+	// Lyrics prefetch thread, loads lyrics of the next track to the cache when it is preloaded (see ChangeFile)
+	LyricsCache lyricsCache;
+	Threading::Thread threadLyricsPrefetch;
+	Threading::Mutex mutexLyricsPrefetch;
+	std::atomic<bool> isThreadLyricsPrefetch = false;
+	bool isLyricsPrefetchStop = false;
+	std::wstring lyricsPrefetchFile;
+	long long lyricsPrefetchIdLibrary = 0;
+	long long lyricsPrefetchIdPlaylist = 0;
+
+	void LyricsPrefetch(ListNodeUnsafe node);
+	void LyricsPrefetchRun();
+
 	// Search thread
 	Threading::Thread threadSearch;
 	std::atomic<bool> isThreadSearch = false;
@@ -235,6 +268,7 @@ private:
 
 	bool ReloadSkin(const std::wstring& skinName, bool isSkinPack);
 	bool LoadWindows(bool isReload);
+	void OpenSkinCache(ZipFile* zipFile);
 	bool LoadLibraryView(bool isReload = false);
 	void EnableAll(bool isEnable);
 
@@ -256,6 +290,7 @@ private:
 	void ActionRepeat(bool isRepeat);
 	void ActionPosition(int position);
 	bool PlayNode(ListNodeUnsafe node, bool isRepeat = false, bool isNewNowPlaying = false, bool isReconnect = false);
+	float GetReplayGain(ListNodeUnsafe node);
 	void ActionPlayEx();
 	void ActionPauseEx();
 
@@ -0,0 +1,163 @@
+/*  This file is part of Winyl Player source code.
+    Copyright (C) 2008-2018, Alex Kras. <winylplayer@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "XmlFile.h"
+#include "SkinCache.h"
+
+bool XmlFile::LoadEx(const std::wstring& file, ZipFile* zipFile)
+{
+	flat = XmlFlat();
+
+	// Only skin files are loaded with this function, try the flattened tree from the cache first
+	const char* data = nullptr;
+	std::size_t size = 0;
+	if (SkinCache::Instance().LoadXml(file, &data, &size) && ReadFlat(data, size))
+		return true;
+
+	if (!LoadExNoCache(file, zipFile))
+		return false;
+
+	if (SkinCache::Instance().IsOpen())
+	{
+		std::vector<char> flatData;
+		Flatten(flatData);
+		SkinCache::Instance().SaveXml(file, flatData);
+	}
+
+	return true;
+}
+
+void XmlFile::Flatten(std::vector<char>& outData)
+{
+	std::vector<XmlFlat::Node> nodes;
+	std::vector<XmlFlat::Attr> attrs;
+	std::string text(1, '\0'); // Offset 0 is an empty string
+
+	FlattenNode(doc, nodes, attrs, text);
+
+	// Keep the size a multiple of 4 so the next record of the cache is aligned
+	text.resize((text.size() + 3) & ~(std::size_t)3, '\0');
+
+	XmlFlat::Header header = {};
+	header.nodeCount = (unsigned int)nodes.size();
+	header.attrCount = (unsigned int)attrs.size();
+	header.textSize = (unsigned int)text.size();
+
+	std::size_t nodesSize = nodes.size() * sizeof(XmlFlat::Node);
+	std::size_t attrsSize = attrs.size() * sizeof(XmlFlat::Attr);
+
+	outData.resize(sizeof(XmlFlat::Header) + nodesSize + attrsSize + text.size());
+
+	char* out = outData.data();
+	memcpy(out, &header, sizeof(XmlFlat::Header));
+	out += sizeof(XmlFlat::Header);
+	if (nodesSize)
+		memcpy(out, nodes.data(), nodesSize);
+	out += nodesSize;
+	if (attrsSize)
+		memcpy(out, attrs.data(), attrsSize);
+	out += attrsSize;
+	memcpy(out, text.data(), text.size());
+}
+
+void XmlFile::FlattenNode(const pugi::xml_node& node, std::vector<XmlFlat::Node>& nodes,
+	std::vector<XmlFlat::Attr>& attrs, std::string& text)
+{
+	auto addText = [&text](const char* str) -> unsigned int
+	{
+		if (str[0] == '\0')
+			return 0;
+
+		unsigned int offset = (unsigned int)text.size();
+		text.append(str, strlen(str) + 1);
+		return offset;
+	};
+
+	std::size_t index = nodes.size();
+
+	XmlFlat::Node flatNode = {};
+	flatNode.name = addText(node.name());
+	flatNode.value = addText(node.child_value());
+	flatNode.firstAttr = (unsigned int)attrs.size();
+
+	for (pugi::xml_attribute a = node.first_attribute(); a; a = a.next_attribute())
+		attrs.push_back({addText(a.name()), addText(a.value())});
+
+	flatNode.attrCount = (unsigned int)attrs.size() - flatNode.firstAttr;
+	nodes.push_back(flatNode);
+
+	// Children go right after the node so links always point forward
+	std::size_t prev = 0;
+	for (pugi::xml_node child = node.first_child(); child; child = child.next_sibling())
+	{
+		std::size_t childIndex = nodes.size();
+
+		if (prev)
+			nodes[prev].nextSibling = (unsigned int)childIndex;
+		else
+			nodes[index].firstChild = (unsigned int)childIndex;
+
+		FlattenNode(child, nodes, attrs, text);
+		prev = childIndex;
+	}
+}
+
+bool XmlFile::ReadFlat(const char* data, std::size_t size)
+{
+	XmlFlat::Header header = {};
+	if (size < sizeof(XmlFlat::Header))
+		return false;
+	memcpy(&header, data, sizeof(XmlFlat::Header));
+
+	if (header.nodeCount == 0 || header.textSize == 0 ||
+		sizeof(XmlFlat::Header) + (unsigned long long)header.nodeCount * sizeof(XmlFlat::Node) +
+		(unsigned long long)header.attrCount * sizeof(XmlFlat::Attr) + header.textSize != size)
+		return false;
+
+	const XmlFlat::Node* nodes = reinterpret_cast<const XmlFlat::Node*>(data + sizeof(XmlFlat::Header));
+	const XmlFlat::Attr* attrs = reinterpret_cast<const XmlFlat::Attr*>(nodes + header.nodeCount);
+	const char* text = reinterpret_cast<const char*>(attrs + header.attrCount);
+
+	// Check everything once so XmlNode doesn't need to, a broken file is parsed again.
+	// Links only point forward so there are no loops.
+	if (text[header.textSize - 1] != '\0')
+		return false;
+
+	for (unsigned int i = 0; i < header.nodeCount; ++i)
+	{
+		const XmlFlat::Node& node = nodes[i];
+		if (node.name >= header.textSize || node.value >= header.textSize ||
+			node.firstAttr > header.attrCount || node.attrCount > header.attrCount - node.firstAttr ||
+			(node.firstChild && (node.firstChild <= i || node.firstChild >= header.nodeCount)) ||
+			(node.nextSibling && (node.nextSibling <= i || node.nextSibling >= header.nodeCount)))
+			return false;
+	}
+
+	for (unsigned int i = 0; i < header.attrCount; ++i)
+	{
+		if (attrs[i].name >= header.textSize || attrs[i].value >= header.textSize)
+			return false;
+	}
+
+	flat.nodes = nodes;
+	flat.attrs = attrs;
+	flat.text = text;
+
+	return true;
+}
@@ -20,6 +20,7 @@
 #include "pugixml/pugixml.hpp"
 #include "XmlNode.h"
 #include "ZipFile.h"
+#include <vector>
 
 class XmlFile
 {
@@ -29,6 +30,8 @@ public:
 
 	inline bool LoadFile(const std::wstring& file)
 	{
+		flat = XmlFlat();
+
 		if (doc.load_file(file.c_str(), pugi::parse_minimal|pugi::parse_escapes, pugi::encoding_utf8).status == pugi::status_ok)
 			return true;
 
@@ -37,14 +40,22 @@ public:
 
 	inline bool LoadBuffer(const void* buffer, size_t size)
 	{
+		flat = XmlFlat();
+
 		if (doc.load_buffer(buffer, size, pugi::parse_minimal|pugi::parse_escapes, pugi::encoding_utf8).status == pugi::status_ok)
 			return true;
 
 		return false;
 	}
 	
-	inline bool LoadEx(const std::wstring& file, ZipFile* zipFile)
+	// Load a file of the current skin, the flattened tree from SkinCache is used if present
+	bool LoadEx(const std::wstring& file, ZipFile* zipFile);
+
+	// The same without the cache (for files of other skins)
+	inline bool LoadExNoCache(const std::wstring& file, ZipFile* zipFile)
 	{
+		flat = XmlFlat();
+
 		if (zipFile == nullptr)
 		{
 			if (doc.load_file(file.c_str(), pugi::parse_minimal|pugi::parse_escapes, pugi::encoding_utf8).status == pugi::status_ok)
@@ -83,11 +94,20 @@ public:
 	inline XmlNode RootNode()
 	{
 		XmlNode xmlNode;
-		xmlNode.node = doc;
+		if (flat.nodes)
+			xmlNode.flat = &flat;
+		else
+			xmlNode.node = doc;
 
 		return xmlNode;
 	}
 
 private:
 	pugi::xml_document doc;
+	XmlFlat flat; // Points to the mapped file of SkinCache when loaded from the cache
+
+	void Flatten(std::vector<char>& outData);
+	void FlattenNode(const pugi::xml_node& node, std::vector<XmlFlat::Node>& nodes,
+		std::vector<XmlFlat::Attr>& attrs, std::string& text);
+	bool ReadFlat(const char* data, std::size_t size);
 };
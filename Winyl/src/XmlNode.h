@@ -19,8 +19,46 @@
 
 #include "pugixml/pugixml.hpp"
 #include <string>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
 #include "UTF.h"
 
+// Flattened xml tree (see XmlFile::LoadEx), nodes and attributes are arrays in one block of memory
+// and names and values are offsets of null terminated strings, so the tree is read directly
+// from the mapped file of SkinCache without parsing. Nodes are in document order,
+// node 0 is the document, 0 as a child or a sibling means no node.
+struct XmlFlat
+{
+	struct Header
+	{
+		unsigned int nodeCount;
+		unsigned int attrCount;
+		unsigned int textSize;
+		unsigned int reserved;
+	};
+
+	struct Node
+	{
+		unsigned int name;
+		unsigned int value; // The same as pugi::xml_node::child_value
+		unsigned int firstAttr;
+		unsigned int attrCount;
+		unsigned int firstChild;
+		unsigned int nextSibling;
+	};
+
+	struct Attr
+	{
+		unsigned int name;
+		unsigned int value;
+	};
+
+	const Node* nodes = nullptr;
+	const Attr* attrs = nullptr;
+	const char* text = nullptr;
+};
+
 class XmlNode
 {
 public:
@@ -29,7 +67,7 @@ public:
 	friend class XmlFile;
 
 public:
-	inline explicit operator bool() {return (node ? true : false);}
+	inline explicit operator bool() {return (flat || node ? true : false);}
 //	inline bool IsEmpty()
 //	{
 //		return node.empty();
@@ -37,6 +75,9 @@ public:
 
 	inline XmlNode FirstChild()
 	{
+		if (flat)
+			return FlatNode(flat->nodes[index].firstChild);
+
 		XmlNode xmlNode;
 		xmlNode.node = node.first_child();
 
@@ -45,6 +86,9 @@ public:
 
 	inline XmlNode NextChild()
 	{
+		if (flat)
+			return FlatNode(flat->nodes[index].nextSibling);
+
 		XmlNode xmlNode;
 		xmlNode.node = node.next_sibling();
 
@@ -53,6 +97,9 @@ public:
 
 	inline XmlNode FirstChild(const char* child)
 	{
+		if (flat)
+			return FlatFind(flat->nodes[index].firstChild, child, false);
+
 		XmlNode xmlNode;
 		xmlNode.node = node.child(child);
 
@@ -61,6 +108,9 @@ public:
 
 	inline XmlNode NextChild(const char* child)
 	{
+		if (flat)
+			return FlatFind(flat->nodes[index].nextSibling, child, false);
+
 		XmlNode xmlNode;
 		xmlNode.node = node.next_sibling(child);
 
@@ -92,6 +142,9 @@ public:
 
 	inline const char* AttributeRaw(const char* attr)
 	{
+		if (flat)
+			return FlatAttribute(attr, false);
+
 		pugi::xml_attribute xmlAttr = node.attribute(attr);
 		if (xmlAttr)
 			return (char*)xmlAttr.value();
@@ -100,6 +153,17 @@ public:
 
 	inline bool Attribute(const char* attr, int* value)
 	{
+		if (flat)
+		{
+			const char* valueraw = FlatAttribute(attr, false);
+			if (valueraw)
+			{
+				*value = FlatToInt(valueraw);
+				return true;
+			}
+			return false;
+		}
+
 		pugi::xml_attribute xmlAttr = node.attribute(attr);
 		if (xmlAttr)
 		{
@@ -111,6 +175,17 @@ public:
 
 	inline bool Attribute(const char* attr, bool* value)
 	{
+		if (flat)
+		{
+			const char* valueraw = FlatAttribute(attr, false);
+			if (valueraw)
+			{
+				*value = (FlatToInt(valueraw) != 0);
+				return true;
+			}
+			return false;
+		}
+
 		pugi::xml_attribute xmlAttr = node.attribute(attr);
 		if (xmlAttr)
 		{
@@ -125,6 +200,17 @@ public:
 
 	inline bool AttributeLong(const char* attr, long long* value)
 	{
+		if (flat)
+		{
+			const char* valueraw = FlatAttribute(attr, false);
+			if (valueraw)
+			{
+				*value = FlatToLong(valueraw);
+				return true;
+			}
+			return false;
+		}
+
 		pugi::xml_attribute xmlAttr = node.attribute(attr);
 		if (xmlAttr)
 		{
@@ -136,11 +222,17 @@ public:
 
 	inline const char* Name()
 	{
+		if (flat)
+			return flat->text + flat->nodes[index].name;
+
 		return node.name();
 	}
 
 	inline const char* Value()
 	{
+		if (flat)
+			return flat->text + flat->nodes[index].value;
+
 		return node.child_value();
 	}
 
@@ -220,7 +312,7 @@ public:
 
 	inline std::string Value8()
 	{
-		const char* value = node.child_value();
+		const char* value = Value();
 
 		return value ? value : std::string();
 	}
@@ -239,6 +331,9 @@ public:
 
 	inline XmlNode FirstChildNoCase(const char* child)
 	{
+		if (flat)
+			return FlatFind(flat->nodes[index].firstChild, child, true);
+
 		XmlNode xmlNode;
 		for (pugi::xml_node n = node.first_child(); n; n = n.next_sibling())
 		{
@@ -254,6 +349,9 @@ public:
 
 	inline XmlNode NextChildNoCase(const char* child)
 	{
+		if (flat)
+			return FlatFind(flat->nodes[index].nextSibling, child, true);
+
 		XmlNode xmlNode;
 		for (pugi::xml_node n = node.next_sibling(); n; n = n.next_sibling())
 		{
@@ -269,6 +367,9 @@ public:
 
 	inline const char* AttributeNoCase(const char* attr)
 	{
+		if (flat)
+			return FlatAttribute(attr, true);
+
 		for (pugi::xml_attribute a = node.first_attribute(); a; a = a.next_attribute())
 		{
 			if (StringEx::IsEqualAsciiRaw(a.name(), attr))
@@ -280,4 +381,68 @@ public:
 
 private:
 	pugi::xml_node node;
+
+	// The node of the flattened tree (when the file is loaded from SkinCache), read only
+	const XmlFlat* flat = nullptr;
+	unsigned int index = 0;
+
+	inline XmlNode FlatNode(unsigned int i)
+	{
+		XmlNode xmlNode;
+		if (i)
+		{
+			xmlNode.flat = flat;
+			xmlNode.index = i;
+		}
+
+		return xmlNode;
+	}
+
+	inline XmlNode FlatFind(unsigned int i, const char* name, bool isNoCase)
+	{
+		for (; i; i = flat->nodes[i].nextSibling)
+		{
+			const char* nodeName = flat->text + flat->nodes[i].name;
+			if (isNoCase ? StringEx::IsEqualAsciiRaw(nodeName, name) : strcmp(nodeName, name) == 0)
+				return FlatNode(i);
+		}
+
+		return XmlNode();
+	}
+
+	inline const char* FlatAttribute(const char* attr, bool isNoCase)
+	{
+		const XmlFlat::Node& flatNode = flat->nodes[index];
+		for (unsigned int i = flatNode.firstAttr, end = i + flatNode.attrCount; i < end; ++i)
+		{
+			const char* attrName = flat->text + flat->attrs[i].name;
+			if (isNoCase ? StringEx::IsEqualAsciiRaw(attrName, attr) : strcmp(attrName, attr) == 0)
+				return flat->text + flat->attrs[i].value;
+		}
+
+		return nullptr;
+	}
+
+	// The same as pugixml as_int and as_llong: decimal or hex with 0x
+	inline static long long FlatToLong(const char* value)
+	{
+		const char* s = value;
+		while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')
+			++s;
+		if (*s == '-' || *s == '+')
+			++s;
+
+		return std::strtoll(value, nullptr, (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) ? 16 : 10);
+	}
+
+	inline static int FlatToInt(const char* value)
+	{
+		// pugixml clamps the value on overflow
+		long long result = FlatToLong(value);
+		if (result > INT_MAX)
+			return INT_MAX;
+		if (result < INT_MIN)
+			return INT_MIN;
+		return (int)result;
+	}
 };
@@ -25,7 +25,7 @@ ZipFile::ZipFile()
 
 ZipFile::~ZipFile()
 {
-
+	CloseFile();
 }
 
 bool ZipFile::OpenFile(const std::wstring& file)
@@ -33,26 +33,38 @@ bool ZipFile::OpenFile(const std::wstring& file)
 	// http://en.wikipedia.org/wiki/Zip_(file_format)#Structure
 	// http://www.pkware.com/documents/casestudies/APPNOTE.TXT
 
-	zipStream.open(file.c_str(), std::ios::in|std::ios::binary);
-	if (!zipStream.is_open())
+	CloseFile();
+
+	fileHandle.reset(::CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!fileHandle)
+		return false;
+
+	LARGE_INTEGER size = {};
+	::GetFileSizeEx(fileHandle.get(), &size);
+	if (size.QuadPart < 32 || size.QuadPart > 0xFFFFFFFF)
+	{
+		CloseFile();
 		return false;
+	}
 
-	zipStream.seekg(0, std::ios::end);
-	unsigned int filesize = (unsigned int)zipStream.tellg();
-	if (filesize < 32)
+	mapHandle.reset(::CreateFileMappingW(fileHandle.get(), NULL, PAGE_READONLY, 0, 0, NULL));
+	if (mapHandle)
+		mapView.reset(::MapViewOfFile(mapHandle.get(), FILE_MAP_READ, 0, 0, 0));
+	if (!mapView)
 	{
-		zipStream.close();
+		CloseFile();
 		return false;
 	}
-	zipStream.seekg(-22, std::ios::end);
+
+	mapSize = (unsigned int)size.QuadPart;
+	const char* data = static_cast<const char*>(mapView.get());
 
 	// End of central directory record
-	char headbuf[22];
-	zipStream.read(headbuf, 22);
+	const char* headbuf = data + mapSize - 22;
 
 	if (!(headbuf[0] == 0x50 && headbuf[1] == 0x4b && headbuf[2] == 0x05 && headbuf[3] == 0x06))
 	{
-		zipStream.close();
+		CloseFile();
 		return false;
 	}
 
@@ -62,21 +74,22 @@ bool ZipFile::OpenFile(const std::wstring& file)
 	memcpy(&dirsize, headbuf + 12, 4);
 	memcpy(&diroffset, headbuf + 16, 4);
 
-	// Central directory
-	zipStream.seekg(diroffset, std::ios::beg);
-
-	char* buffer = new char[dirsize];
-
-	zipStream.read(buffer, dirsize);
-
-	if (zipStream.eof())
+	if (diroffset > mapSize - 22 || dirsize > mapSize - 22 - diroffset)
 	{
-		zipStream.close();
-		delete[] buffer;
+		CloseFile();
 		return false;
 	}
 
-	unsigned int testoffset = 0; // To test the integrity of the archive
+	// Central directory
+	const char* buffer = data + diroffset;
+
+	// Load factor is not more than 0.5 (the size of a record is at least 46 bytes)
+	std::size_t tableSize = 16;
+	while (tableSize < (std::size_t)(dirsize / 46) * 2)
+		tableSize *= 2;
+	zipFiles.resize(tableSize, MAP_FILES());
+
+	unsigned long long testoffset = 0; // To test the integrity of the archive
 
 	for (unsigned int cursor = 0; cursor < dirsize;)
 	{
@@ -87,6 +100,9 @@ bool ZipFile::OpenFile(const std::wstring& file)
 		unsigned int lengthextrafield = 0; // Extra field length
 		unsigned int lengthcomment = 0; // File comment length
 
+		if (dirsize - cursor < 46)
+			break;
+
 		cursor += 10;
 		memcpy(&compmethod, buffer + cursor, 2);
 		cursor += 14;
@@ -101,98 +117,168 @@ bool ZipFile::OpenFile(const std::wstring& file)
 		memcpy(&zipfileoffset, buffer + cursor, 4);
 		cursor += 4;
 
-		std::string zipfile;
-		zipfile.resize(lengthfilename);
-		memcpy(&zipfile[0], buffer + cursor, lengthfilename);
+		if (dirsize - cursor < lengthfilename)
+			break;
 
-		cursor += lengthfilename + lengthextrafield + lengthcomment;
-		
-		if (compmethod == 0 && zipfilesize > 0) // Only no compression && no directories
+		if (compmethod == 0 && zipfilesize > 0 && lengthfilename > 0) // Only no compression && no directories
 		{
-			MAP_FILES frame;
-			frame.offset = zipfileoffset + (lengthfilename + 30);
-			frame.size = zipfilesize;
+			// In 64 bit so a wrong offset near 4 GB cannot wrap around and pass the check
+			unsigned long long offset = (unsigned long long)zipfileoffset + (lengthfilename + 30);
+			if (offset > mapSize || zipfilesize > mapSize - offset)
+				break;
+
+			// Convert the name only once here, lookups compare wide strings
+			std::size_t nameStart = zipNames.size();
+			int len = MultiByteToWideChar(CP_UTF8, 0, buffer + cursor, (int)lengthfilename, NULL, 0);
+			if (len > 0)
+			{
+				zipNames.resize(nameStart + len);
+				MultiByteToWideChar(CP_UTF8, 0, buffer + cursor, (int)lengthfilename, &zipNames[nameStart], len);
+				std::replace(zipNames.begin() + nameStart, zipNames.end(), '\\', '/');
 
-			zipFiles[zipfile] = frame;
+				AddFile(nameStart, (std::size_t)len, (unsigned int)offset, zipfilesize);
+			}
 		}
 
-		testoffset += zipfilesize + lengthfilename + 30;
-	}
+		cursor += lengthfilename + lengthextrafield + lengthcomment;
 
-	delete[] buffer;
+		testoffset += (unsigned long long)zipfilesize + lengthfilename + 30;
+	}
 
 	if (testoffset != diroffset)
 	{
-		zipStream.close();
-		zipFiles.clear();
+		CloseFile();
 		return false;
 	}
 
 	return true;
 }
 
+void ZipFile::CloseFile()
+{
+	FreeBuffer();
+
+	zipFiles.clear();
+	zipFiles.shrink_to_fit();
+	zipNames.clear();
+	zipNames.shrink_to_fit();
+
+	mapView.reset();
+	mapHandle.reset();
+	fileHandle.reset();
+	mapSize = 0;
+}
+
 void ZipFile::FreeBuffer()
 {
-	if (zipBuffer)
+	// The buffer points into the mapped view, nothing to free
+	zipBuffer = nullptr;
+	zipBufferSize = 0;
+}
+
+std::size_t ZipFile::NameStart(const std::wstring& file)
+{
+	// Skip the relative path prefix ("./", ".\\") if any
+	for (std::size_t i = 0, size = file.size(); i + 1 < size; ++i)
 	{
-		delete[] zipBuffer;
-		zipBuffer = nullptr;
-		zipBufferSize = 0;
+		if (file[i] == '.' && (file[i + 1] == '/' || file[i + 1] == '\\'))
+			return i + 2;
 	}
+
+	return 0;
 }
 
-bool ZipFile::UnzipToBuffer(const std::wstring& file)
+unsigned long long ZipFile::NameHash(const wchar_t* name, std::size_t length)
 {
-	// http://stackoverflow.com/questions/2256160/how-bad-is-code-using-stdbasic-stringt-as-a-contiguous-buffer
-	std::string fileUTF8;
-	int len = WideCharToMultiByte(CP_UTF8, 0, file.c_str(), (int)file.size(), NULL, 0, NULL, NULL);
-	if (len > 0)
+	// FNV-1a, the same as StringEx::HashFNV1a64 but treats '\\' as '/'
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for (std::size_t i = 0; i < length; ++i)
+	{
+		hash ^= (name[i] == '\\' ? '/' : name[i]);
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+void ZipFile::AddFile(std::size_t nameStart, std::size_t nameLength, unsigned int offset, unsigned int size)
+{
+	const wchar_t* name = zipNames.c_str() + nameStart;
+	unsigned long long hash = NameHash(name, nameLength);
+
+	std::size_t mask = zipFiles.size() - 1;
+	for (std::size_t i = (std::size_t)hash & mask;; i = (i + 1) & mask)
 	{
-		fileUTF8.resize(len);
-		WideCharToMultiByte(CP_UTF8, 0, file.c_str(), (int)file.size(), &fileUTF8[0], len, NULL, NULL);
+		MAP_FILES& frame = zipFiles[i];
+
+		if (frame.nameLength == 0 || (frame.hash == hash && frame.nameLength == nameLength &&
+			zipNames.compare(frame.nameStart, frame.nameLength, name, nameLength) == 0))
+		{
+			frame.hash = hash;
+			frame.nameStart = (unsigned int)nameStart;
+			frame.nameLength = (unsigned int)nameLength;
+			frame.offset = offset;
+			frame.size = size;
+			return;
+		}
 	}
+}
 
-	std::replace(fileUTF8.begin(), fileUTF8.end(), '\\', '/');
+const ZipFile::MAP_FILES* ZipFile::FindFile(const std::wstring& file)
+{
+	if (zipFiles.empty())
+		return nullptr;
 
-	std::size_t posFind = fileUTF8.find("./");
-	if (posFind != std::string::npos)
-		fileUTF8.erase(0, posFind + 2);
+	std::size_t start = NameStart(file);
+	const wchar_t* name = file.c_str() + start;
+	std::size_t nameLength = file.size() - start;
 
+	unsigned long long hash = NameHash(name, nameLength);
 
-	std::map<std::string, MAP_FILES>::iterator it = zipFiles.find(fileUTF8);
-	if (it != zipFiles.end())
+	std::size_t mask = zipFiles.size() - 1;
+	for (std::size_t i = (std::size_t)hash & mask;; i = (i + 1) & mask)
 	{
-		zipBufferSize = it->second.size;
-		zipBuffer = new char[zipBufferSize];
+		const MAP_FILES& frame = zipFiles[i];
 
-		zipStream.seekg(it->second.offset);
-		zipStream.read(zipBuffer, zipBufferSize);
+		if (frame.nameLength == 0)
+			return nullptr;
 
-		return true;
+		if (frame.hash == hash && frame.nameLength == nameLength)
+		{
+			const wchar_t* zipName = zipNames.c_str() + frame.nameStart;
+
+			std::size_t j = 0;
+			for (; j < nameLength; ++j)
+			{
+				if (zipName[j] != (name[j] == '\\' ? '/' : name[j]))
+					break;
+			}
+			if (j == nameLength)
+				return &frame;
+		}
 	}
-	
-	return false;
 }
 
-bool ZipFile::CheckFileInZip(const std::wstring& file)
+bool ZipFile::UnzipToBuffer(const std::wstring& file)
 {
-	std::string fileUTF8;
-	int len = WideCharToMultiByte(CP_UTF8, 0, file.c_str(), (int)file.size(), NULL, 0, NULL, NULL);
-	if (len > 0)
+	const MAP_FILES* frame = FindFile(file);
+	if (frame)
 	{
-		fileUTF8.resize(len);
-		WideCharToMultiByte(CP_UTF8, 0, file.c_str(), (int)file.size(), &fileUTF8[0], len, NULL, NULL);
+		zipBuffer = static_cast<const char*>(mapView.get()) + frame->offset;
+		zipBufferSize = frame->size;
+		return true;
 	}
 
-	std::replace(fileUTF8.begin(), fileUTF8.end(), '\\', '/');
-
-	std::map<std::string, MAP_FILES>::iterator it = zipFiles.find(fileUTF8);
-	if (it != zipFiles.end())
-		return true;
-	
+	FreeBuffer();
 	return false;
 }
 
+bool ZipFile::CheckFileInZip(const std::wstring& file)
+{
+	return FindFile(file) != nullptr;
+}
+
 #ifdef PACKSKIN
 
 bool ZipFile::ZipPathToFile(const std::wstring& file, const std::wstring& path, int level)
@@ -31,35 +31,58 @@
 #include <fstream>
 #include <algorithm>
 #include <cassert>
+#include "AutoHandle.h"
+
+// Reader of skin packs (.wzp). Only stored (not compressed) files are supported.
+// The pack is mapped into memory and the central directory is indexed once in a flat
+// open addressing hash table, so UnzipToBuffer doesn't allocate or copy anything:
+// GetBuffer points directly into the mapped view and stays valid until the pack is closed.
+// FreeBuffer is kept for callers, it only resets the pointer.
 
 class ZipFile
 {
 public:
 	ZipFile();
 	virtual ~ZipFile();
+	ZipFile(const ZipFile&) = delete;
+	ZipFile& operator=(const ZipFile&) = delete;
 
 	bool OpenFile(const std::wstring& file);
+	void CloseFile();
 	bool UnzipToBuffer(const std::wstring& file);
 	bool CheckFileInZip(const std::wstring& file);
 	void FreeBuffer();
-	char* GetBuffer() {return zipBuffer;}
+	const char* GetBuffer() {return zipBuffer;}
 	unsigned GetBufferSize() {return zipBufferSize;}
 
 	static bool ZipPathToFile(const std::wstring& file, const std::wstring& path, int level = 0);
 	static bool UnzipFileToPath(const std::wstring& file, const std::wstring& path);
 
 private:
-	char* zipBuffer = nullptr;
+	const char* zipBuffer = nullptr;
 	unsigned zipBufferSize = 0;
 
 	struct MAP_FILES
 	{
+		unsigned long long hash;
+		unsigned int nameStart; // Position of the name in zipNames
+		unsigned int nameLength; // 0 = empty slot
 		unsigned int offset;
 		unsigned int size;
 	};
 
-	std::map<std::string, MAP_FILES> zipFiles;
-	std::ifstream zipStream;
+	std::vector<MAP_FILES> zipFiles; // Size is always power of 2
+	std::wstring zipNames; // All names one after another, with '/' as the separator
+
+	FileHandle fileHandle;
+	MappingHandle mapHandle;
+	MapViewHandle mapView;
+	unsigned int mapSize = 0;
+
+	static std::size_t NameStart(const std::wstring& file);
+	static unsigned long long NameHash(const wchar_t* name, std::size_t length);
+	void AddFile(std::size_t nameStart, std::size_t nameLength, unsigned int offset, unsigned int size);
+	const MAP_FILES* FindFile(const std::wstring& file);
 
 #ifdef PACKSKIN
 	static void ZipPathRecur(zipFile zfile, const std::wstring& folderPath, const std::wstring& folderZip, int level);
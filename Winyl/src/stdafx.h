@@ -157,6 +157,7 @@ extern FutureWin* futureWin;
 #define UWM_COVERDONE    WM_USER + 137
 #define UWM_SEARCHDONE   WM_USER + 138
 #define UWM_TIMERTHREAD  WM_USER + 139
+#define UWM_WAVEFORMDONE WM_USER + 140
 
 
 